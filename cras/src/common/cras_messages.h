@@ -56,6 +56,7 @@ enum CRAS_SERVER_MESSAGE_ID {
 	CRAS_SERVER_REGISTER_NOTIFICATION,
 	CRAS_SERVER_SET_AEC_DUMP,
 	CRAS_SERVER_RELOAD_AEC_CONFIG,
+	CRAS_SERVER_DUMP_DSP_PROFILE,
 };
 
 enum CRAS_CLIENT_MESSAGE_ID {
@@ -343,6 +344,19 @@ static inline void cras_fill_dump_dsp_info(
 	m->header.length = sizeof(*m);
 }
 
+/* Dump the CPU time profile of the dsp pipelines to shared memory with the
+ * client. */
+struct __attribute__ ((__packed__)) cras_dump_dsp_profile {
+	struct cras_server_message header;
+};
+
+static inline void cras_fill_dump_dsp_profile(
+		struct cras_dump_dsp_profile *m)
+{
+	m->header.id = CRAS_SERVER_DUMP_DSP_PROFILE;
+	m->header.length = sizeof(*m);
+}
+
 /* Dump current audio thread information to syslog. */
 struct __attribute__ ((__packed__)) cras_dump_audio_thread {
 	struct cras_server_message header;
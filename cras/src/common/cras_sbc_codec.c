@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <sbc/sbc.h>
 #include <stdlib.h>
+#include <sys/param.h>
 
 #include "cras_sbc_codec.h"
 
@@ -57,12 +58,16 @@ int cras_sbc_encode(struct cras_audio_codec *codec, const void *input,
 	struct cras_sbc_data *data = (struct cras_sbc_data *)codec->priv_data;
 	ssize_t written, encoded;
 	int processed = 0, result = 0;
+	size_t frames;
 
-	/* Proceed encode when input buffer has at least one input block and
-	 * there is still room in output buffer.
+	/* Encode as many blocks as both buffers hold in one batch, instead
+	 * of probing for room in the output with an extra encode call.
 	 */
-	while (input_len - processed >= data->codesize &&
-			output_len >= result) {
+	frames = input_len / data->codesize;
+	if (data->frame_length)
+		frames = MIN(frames, output_len / data->frame_length);
+
+	while (frames--) {
 		encoded = sbc_encode(&data->sbc,
 				     input + processed,
 				     data->codesize,
@@ -93,11 +98,19 @@ int cras_sbc_get_frame_length(struct cras_audio_codec *codec)
 	return data->frame_length;
 }
 
-struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq,
-		   uint8_t mode, uint8_t subbands, uint8_t alloc,
-		   uint8_t blocks, uint8_t bitpool) {
+void cras_sbc_set_bitpool(struct cras_audio_codec *codec, uint8_t bitpool)
+{
+	struct cras_sbc_data *data = (struct cras_sbc_data *)codec->priv_data;
+
+	/* libsbc picks up a new bitpool between frames. */
+	data->sbc.bitpool = bitpool;
+	data->frame_length = sbc_get_frame_length(&data->sbc);
+}
+
+/* Allocates a codec with its sbc data zeroed, for the caller to init. */
+static struct cras_audio_codec *sbc_codec_alloc()
+{
 	struct cras_audio_codec *codec;
-	struct cras_sbc_data *data;
 
 	codec = (struct cras_audio_codec *)calloc(1, sizeof(*codec));
 	if (!codec)
@@ -105,8 +118,25 @@ struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq,
 
 	codec->priv_data = (struct cras_sbc_data *)calloc(1,
 			sizeof(struct cras_sbc_data));
-	if (!codec->priv_data)
-		goto create_error;
+	if (!codec->priv_data) {
+		free(codec);
+		return NULL;
+	}
+
+	codec->decode = cras_sbc_decode;
+	codec->encode = cras_sbc_encode;
+	return codec;
+}
+
+struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq,
+		   uint8_t mode, uint8_t subbands, uint8_t alloc,
+		   uint8_t blocks, uint8_t bitpool) {
+	struct cras_audio_codec *codec;
+	struct cras_sbc_data *data;
+
+	codec = sbc_codec_alloc();
+	if (!codec)
+		return NULL;
 
 	data = (struct cras_sbc_data *)codec->priv_data;
 	sbc_init(&data->sbc, 0L);
@@ -119,14 +149,27 @@ struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq,
 	data->sbc.bitpool = bitpool;
 	data->codesize = sbc_get_codesize(&data->sbc);
 	data->frame_length = sbc_get_frame_length(&data->sbc);
-
-	codec->decode = cras_sbc_decode;
-	codec->encode = cras_sbc_encode;
 	return codec;
+}
 
-create_error:
-	free(codec);
-	return NULL;
+struct cras_audio_codec *cras_msbc_codec_create()
+{
+	struct cras_audio_codec *codec;
+	struct cras_sbc_data *data;
+
+	codec = sbc_codec_alloc();
+	if (!codec)
+		return NULL;
+
+	data = (struct cras_sbc_data *)codec->priv_data;
+	if (sbc_init_msbc(&data->sbc, 0L)) {
+		cras_sbc_codec_destroy(codec);
+		return NULL;
+	}
+	data->sbc.endian = SBC_LE;
+	data->codesize = sbc_get_codesize(&data->sbc);
+	data->frame_length = sbc_get_frame_length(&data->sbc);
+	return codec;
 }
 
 void cras_sbc_codec_destroy(struct cras_audio_codec *codec)
@@ -23,6 +23,11 @@ struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq,
 		   uint8_t mode, uint8_t subbands, uint8_t alloc,
 		   uint8_t blocks, uint8_t bitpool);
 
+/* Creates an mSBC codec, the SBC configuration fixed by HFP for wideband
+ * speech: 16kHz mono, 8 subbands, 15 blocks and bitpool 26.
+ */
+struct cras_audio_codec *cras_msbc_codec_create();
+
 /* Destroys an sbc codec.
  * Args:
  *    codec: the codec to destroy.
@@ -37,4 +42,9 @@ int cras_sbc_get_codesize(struct cras_audio_codec *codec);
  */
 int cras_sbc_get_frame_length(struct cras_audio_codec *codec);
 
+/* Sets the bitpool of the sbc encoder, effective from the next encoded
+ * block. Changes the frame_length.
+ */
+void cras_sbc_set_bitpool(struct cras_audio_codec *codec, uint8_t bitpool);
+
 #endif /* COMMON_CRAS_SBC_CODEC_H_ */
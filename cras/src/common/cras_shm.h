@@ -61,6 +61,18 @@ struct __attribute__ ((__packed__)) cras_audio_shm_area {
 	uint8_t samples[];
 };
 
+/* Structure placed after the samples of the shm area. Adding fields here
+ * instead of to cras_audio_shm_area keeps the offset of the samples that
+ * existing clients use. A client can only read the trailer if the shm it
+ * mapped is at least cras_shm_total_size() long.
+ *
+ *  ts_bound - Bound on the error of ts, from the accuracy of the device delay
+ *    and of its estimated rate. Only valid in audio callbacks.
+ */
+struct __attribute__ ((__packed__)) cras_audio_shm_trailer {
+	struct cras_timespec ts_bound;
+};
+
 /* Structure that holds the config for and a pointer to the audio shm area.
  *
  *  config - Size config data, kept separate so it can be checked.
@@ -80,6 +92,15 @@ static inline uint8_t *cras_shm_buff_for_idx(const struct cras_audio_shm *shm,
 	return shm->area->samples + shm->config.used_size * idx;
 }
 
+/* Get a pointer to the trailer after the last buffer. */
+static inline struct cras_audio_shm_trailer *cras_shm_get_trailer(
+		const struct cras_audio_shm *shm)
+{
+	return (struct cras_audio_shm_trailer *)(
+		shm->area->samples +
+		shm->config.used_size * CRAS_NUM_SHM_BUFFERS);
+}
+
 /* Limit a read offset to within the buffer size. */
 static inline
 unsigned cras_shm_check_read_offset(const struct cras_audio_shm *shm,
@@ -468,7 +489,8 @@ static inline unsigned cras_shm_used_frames(const struct cras_audio_shm *shm)
 static inline unsigned cras_shm_total_size(const struct cras_audio_shm *shm)
 {
 	return cras_shm_used_size(shm) * CRAS_NUM_SHM_BUFFERS +
-			sizeof(*shm->area);
+			sizeof(*shm->area) +
+			sizeof(struct cras_audio_shm_trailer);
 }
 
 /* Gets the counter of over-runs. */
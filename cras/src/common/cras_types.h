@@ -35,12 +35,16 @@ enum CRAS_SPECIAL_DEVICE {
  */
 enum TEST_IODEV_TYPE {
 	TEST_IODEV_HOTWORD,
+	TEST_IODEV_SIM_OUTPUT,
+	TEST_IODEV_SIM_INPUT,
 };
 
 
 /* Commands for test iodevs. */
 enum CRAS_TEST_IODEV_CMD {
 	TEST_IODEV_CMD_HOTWORD_TRIGGER,
+	/* Sets the timing of a simulated device from key=value pairs. */
+	TEST_IODEV_CMD_SIM_CONFIG,
 };
 
 /* Directions of audio streams.
@@ -137,6 +141,15 @@ static inline const char *cras_stream_type_str(
 	}
 }
 
+/* Media streams tolerate hundreds of ms of latency, the server may ask them
+ * for up to a whole shm buffer per callback in deep buffer mode. */
+static inline int cras_stream_type_allows_deep_buffer(
+		enum CRAS_STREAM_TYPE stream_type)
+{
+	return stream_type == CRAS_STREAM_TYPE_DEFAULT ||
+	       stream_type == CRAS_STREAM_TYPE_MULTIMEDIA;
+}
+
 /* Effects that can be enabled for a CRAS stream. */
 enum CRAS_STREAM_EFFECT {
 	APM_ECHO_CANCELLATION = (1 << 0),
@@ -181,6 +194,10 @@ static inline uint32_t node_index_of(cras_node_id_t id)
 #define CRAS_HOTWORD_STRING_SIZE 256
 #define MAX_DEBUG_DEVS 4
 #define MAX_DEBUG_STREAMS 8
+#define MAX_DEBUG_DSP_PIPELINES 8
+#define MAX_DEBUG_DSP_MODULES 16
+#define DSP_PROFILE_NUM_BUCKETS 16
+#define DSP_PROFILE_NAME_SIZE 32
 #define AUDIO_THREAD_EVENT_LOG_SIZE (1024*6)
 
 /* There are 8 bits of space for events. */
@@ -254,6 +271,11 @@ struct __attribute__ ((__packed__)) audio_dev_debug_info {
 	uint32_t num_underruns;
 	uint32_t num_severe_underruns;
 	uint32_t highest_hw_level;
+	uint8_t adaptive_watermark;
+	uint32_t num_near_misses;
+	uint32_t num_hw_calls;
+	uint32_t num_wakes;
+	uint32_t num_overruns;
 };
 
 struct __attribute__ ((__packed__)) audio_stream_debug_info {
@@ -270,13 +292,22 @@ struct __attribute__ ((__packed__)) audio_stream_debug_info {
 	uint32_t longest_fetch_sec;
 	uint32_t longest_fetch_nsec;
 	uint32_t num_overruns;
+	uint32_t apm_users;
 	int8_t channel_layout[CRAS_CH_MAX];
 };
 
-/* Debug info shared from server to client. */
+/* Debug info shared from server to client.
+ *    fmt_conv_pool_hits - Stream format converters reused from the pool.
+ *    fmt_conv_pool_misses - Stream format converters built from scratch.
+ *    num_apms - APM instances running, each shared by the number of
+ *        streams in its streams' apm_users.
+ */
 struct __attribute__ ((__packed__)) audio_debug_info {
 	uint32_t num_streams;
 	uint32_t num_devs;
+	uint32_t fmt_conv_pool_hits;
+	uint32_t fmt_conv_pool_misses;
+	uint32_t num_apms;
 	struct audio_dev_debug_info devs[MAX_DEBUG_DEVS];
 	struct audio_stream_debug_info streams[MAX_DEBUG_STREAMS];
 	struct audio_thread_event_log log;
@@ -312,6 +343,51 @@ struct __attribute__ ((__packed__)) cras_audio_thread_snapshot_buffer{
 	int pos;
 };
 
+/* CPU time profile of one instance in a DSP pipeline.
+ *    name - The title of the plugin section in the ini file.
+ *    runs - Number of times the module has been run.
+ *    total_ns - Thread CPU time spent in the module, in nanoseconds.
+ *    max_ns - The longest single run.
+ *    histogram - Run times in power of two buckets. Bucket 0 counts runs
+ *        shorter than 1us, bucket i counts [2^(i-1), 2^i) us and the last
+ *        bucket also counts everything longer.
+ */
+struct __attribute__ ((__packed__)) dsp_module_profile_info {
+	char name[DSP_PROFILE_NAME_SIZE];
+	uint64_t runs;
+	uint64_t total_ns;
+	uint32_t max_ns;
+	uint32_t histogram[DSP_PROFILE_NUM_BUCKETS];
+};
+
+/* CPU time profile of a DSP pipeline and the instances in it.
+ *    purpose - "playback" or "capture".
+ *    sample_rate - The rate the pipeline was instantiated at.
+ *    fixed_point - 1 if the pipeline runs in Q31 instead of float.
+ *    total_samples - Frames processed by the pipeline.
+ *    total_ns - Thread CPU time spent in cras_dsp_pipeline_apply().
+ *    max_ns - The longest single call to cras_dsp_pipeline_apply().
+ *    num_modules - Number of valid entries in modules.
+ *    modules - Profile of the first MAX_DEBUG_DSP_MODULES instances, in the
+ *        order they run.
+ */
+struct __attribute__ ((__packed__)) dsp_pipeline_profile_info {
+	char purpose[DSP_PROFILE_NAME_SIZE];
+	uint32_t sample_rate;
+	uint32_t fixed_point;
+	uint64_t total_samples;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint32_t num_modules;
+	struct dsp_module_profile_info modules[MAX_DEBUG_DSP_MODULES];
+};
+
+/* DSP profile shared from server to client. */
+struct __attribute__ ((__packed__)) dsp_profile_info {
+	uint32_t num_pipelines;
+	struct dsp_pipeline_profile_info pipelines[MAX_DEBUG_DSP_PIPELINES];
+};
+
 /* The server state that is shared with clients.
  *    state_version - Version of this structure.
  *    volume - index from 0-100.
@@ -357,8 +433,10 @@ struct __attribute__ ((__packed__)) cras_audio_thread_snapshot_buffer{
  *        played/captured.
  *    aec_supported - Flag to indicate if system aec is supported.
  *    snapshot_buffer - ring buffer for storing audio thread snapshots.
+ *    dsp_profile_info - Per module CPU time of the DSP pipelines, filled in
+ *        when a client requests it. Same caveat as audio_debug_info.
  */
-#define CRAS_SERVER_STATE_VERSION 2
+#define CRAS_SERVER_STATE_VERSION 8
 struct __attribute__ ((packed, aligned(4))) cras_server_state {
 	uint32_t state_version;
 	uint32_t volume;
@@ -393,6 +471,7 @@ struct __attribute__ ((packed, aligned(4))) cras_server_state {
 	int32_t non_empty_status;
 	int32_t aec_supported;
 	struct cras_audio_thread_snapshot_buffer snapshot_buffer;
+	struct dsp_profile_info dsp_profile_info;
 };
 
 /* Actions for card add/remove/change. */
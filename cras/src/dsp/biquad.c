@@ -366,3 +366,68 @@ void biquad_set(struct biquad *bq, enum biquad_type type, double freq, double Q,
 		break;
 	}
 }
+
+/* Largest sum of coefficient magnitudes, as a power of two, biquad_q31 can
+ * hold in fixed point. Above it too few fractional bits would be left. */
+#define BIQUAD_Q31_MAX_HEADROOM 8
+
+static int32_t to_fixed(float coef, int frac_bits)
+{
+	return (int32_t)round(ldexp(coef, frac_bits));
+}
+
+void biquad_q31_init(struct biquad_q31 *q, const struct biquad *bq)
+{
+	double sum;
+	int headroom = 0;
+
+	/* With sum < 2^headroom and 31 - headroom fractional bits the
+	 * coefficients add up to less than 2^31, so the products of Q31
+	 * samples add up to less than 2^62. The small margin covers the
+	 * rounding of the coefficients. */
+	sum = fabs(bq->b0) + fabs(bq->b1) + fabs(bq->b2) +
+	      fabs(bq->a1) + fabs(bq->a2);
+	while (sum + 1.0 / (1 << 20) >= (1 << headroom) &&
+	       headroom <= BIQUAD_Q31_MAX_HEADROOM)
+		headroom++;
+
+	q->use_float = headroom > BIQUAD_Q31_MAX_HEADROOM;
+	q->fallback = *bq;
+	q->fallback.x1 = 0;
+	q->fallback.x2 = 0;
+	q->fallback.y1 = 0;
+	q->fallback.y2 = 0;
+
+	q->frac_bits = 31 - min(headroom, BIQUAD_Q31_MAX_HEADROOM);
+	q->b0 = to_fixed(bq->b0, q->frac_bits);
+	q->b1 = to_fixed(bq->b1, q->frac_bits);
+	q->b2 = to_fixed(bq->b2, q->frac_bits);
+	q->a1 = to_fixed(bq->a1, q->frac_bits);
+	q->a2 = to_fixed(bq->a2, q->frac_bits);
+	q->x1 = 0;
+	q->x2 = 0;
+	q->y1 = 0;
+	q->y2 = 0;
+	q->err = 0;
+}
+
+int32_t biquad_q31_step_float(struct biquad_q31 *q, int32_t x)
+{
+	struct biquad *bq = &q->fallback;
+	float in = x / 2147483648.0f;
+	float out;
+
+	out = bq->b0 * in + bq->b1 * bq->x1 + bq->b2 * bq->x2 -
+	      bq->a1 * bq->y1 - bq->a2 * bq->y2;
+	bq->x2 = bq->x1;
+	bq->x1 = in;
+	bq->y2 = bq->y1;
+	bq->y1 = out;
+
+	out *= 2147483648.0f;
+	if (out >= 2147483647.0f)
+		return INT32_MAX;
+	if (out <= -2147483648.0f)
+		return INT32_MIN;
+	return (int32_t)lrintf(out);
+}
@@ -10,6 +10,8 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 /* The biquad filter parameters. The transfer function H(z) is (b0 + b1 * z^(-1)
  * + b2 * z^(-2)) / (1 + a1 * z^(-1) + a2 * z^(-2)).  The previous two inputs
  * are stored in x1 and x2, and the previous two outputs are stored in y1 and
@@ -50,6 +52,71 @@ enum biquad_type {
 void biquad_set(struct biquad *bq, enum biquad_type type, double freq, double Q,
 		double gain);
 
+/* The fixed-point version of a biquad filter, for boards without a fast FPU.
+ * The samples are Q31 (int32_t with range [-1.0, 1.0)). The coefficients are
+ * stored with frac_bits fractional bits, chosen from the sum of their
+ * magnitudes so the five products, each up to 2^31 times a coefficient, add
+ * up to less than 2^62 and leave room for the error term in an int64_t. The
+ * part of the accumulator shifted out of the previous output is kept in err
+ * and fed back into the next one (first order error feedback), which keeps
+ * the rounding noise of low frequency filters out of the audio band.
+ * Filters with too much gain for that run the float coefficients in fallback
+ * instead, converting each sample.
+ */
+struct biquad_q31 {
+	int32_t b0, b1, b2;
+	int32_t a1, a2;
+	int frac_bits;
+	int32_t x1, x2;
+	int32_t y1, y2;
+	int64_t err;
+	int use_float;
+	struct biquad fallback;
+};
+
+/* Initializes a fixed-point biquad from the coefficients of a float one. The
+ * history is cleared.
+ */
+void biquad_q31_init(struct biquad_q31 *q, const struct biquad *bq);
+
+/* Filters one Q31 sample through the float fallback of a fixed-point
+ * biquad. Used by biquad_q31_step().
+ */
+int32_t biquad_q31_step_float(struct biquad_q31 *q, int32_t x);
+
+/* Filters one Q31 sample through a fixed-point biquad. The output saturates
+ * instead of wrapping around.
+ */
+static inline int32_t biquad_q31_step(struct biquad_q31 *q, int32_t x)
+{
+	int64_t acc = q->err;
+	int64_t y;
+
+	if (q->use_float)
+		return biquad_q31_step_float(q, x);
+
+	acc += (int64_t)q->b0 * x + (int64_t)q->b1 * q->x1 +
+	       (int64_t)q->b2 * q->x2 - (int64_t)q->a1 * q->y1 -
+	       (int64_t)q->a2 * q->y2;
+	y = acc >> q->frac_bits;
+	if (y > INT32_MAX) {
+		y = INT32_MAX;
+		q->err = 0;
+	} else if (y < INT32_MIN) {
+		y = INT32_MIN;
+		q->err = 0;
+	} else {
+		/* What the shift dropped, acc - y * 2^frac_bits. */
+		q->err = acc & (((int64_t)1 << q->frac_bits) - 1);
+	}
+
+	q->x2 = q->x1;
+	q->x1 = x;
+	q->y2 = q->y1;
+	q->y1 = (int32_t)y;
+	return (int32_t)y;
+}
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -7,10 +7,16 @@
 #include "crossover2.h"
 #include "biquad.h"
 
-static void lr42_set(struct lr42 *lr42, enum biquad_type type, float freq)
+static void lr42_set(struct lr42 *lr42, struct lr42_q31 *lr42_q31,
+		     enum biquad_type type, float freq)
 {
 	struct biquad q;
+	int i, j;
+
 	biquad_set(&q, type, freq, 0, 0);
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < 2; j++)
+			biquad_q31_init(&lr42_q31->bq[i][j], &q);
 	memset(lr42, 0, sizeof(*lr42));
 	lr42->b0 = q.b0;
 	lr42->b1 = q.b1;
@@ -572,13 +578,61 @@ static void lr42_merge(struct lr42 *lp, struct lr42 *hp, int count,
 }
 #endif
 
+/* Runs one Q31 sample of channel ch through both biquads of an LR4 filter. */
+static inline int32_t lr42_q31_step(struct lr42_q31 *f, int ch, int32_t x)
+{
+	int32_t y = biquad_q31_step(&f->bq[0][ch], x);
+	return biquad_q31_step(&f->bq[1][ch], y);
+}
+
+static inline int32_t sat_add_q31(int32_t a, int32_t b)
+{
+	int64_t sum = (int64_t)a + b;
+	if (sum > INT32_MAX)
+		return INT32_MAX;
+	if (sum < INT32_MIN)
+		return INT32_MIN;
+	return (int32_t)sum;
+}
+
+/* Fixed-point version of lr42_split(). */
+static void lr42_split_q31(struct lr42_q31 *lp, struct lr42_q31 *hp, int count,
+			   int32_t *data0L, int32_t *data0R,
+			   int32_t *data1L, int32_t *data1R)
+{
+	int i;
+	for (i = 0; i < count; i++) {
+		int32_t xL = data0L[i];
+		int32_t xR = data0R[i];
+		data0L[i] = lr42_q31_step(lp, 0, xL);
+		data0R[i] = lr42_q31_step(lp, 1, xR);
+		data1L[i] = lr42_q31_step(hp, 0, xL);
+		data1R[i] = lr42_q31_step(hp, 1, xR);
+	}
+}
+
+/* Fixed-point version of lr42_merge(). */
+static void lr42_merge_q31(struct lr42_q31 *lp, struct lr42_q31 *hp, int count,
+			   int32_t *dataL, int32_t *dataR)
+{
+	int i;
+	for (i = 0; i < count; i++) {
+		int32_t xL = dataL[i];
+		int32_t xR = dataR[i];
+		dataL[i] = sat_add_q31(lr42_q31_step(lp, 0, xL),
+				       lr42_q31_step(hp, 0, xL));
+		dataR[i] = sat_add_q31(lr42_q31_step(lp, 1, xR),
+				       lr42_q31_step(hp, 1, xR));
+	}
+}
+
 void crossover2_init(struct crossover2 *xo2, float freq1, float freq2)
 {
 	int i;
 	for (i = 0; i < 3; i++) {
 		float f = (i == 0) ? freq1 : freq2;
-		lr42_set(&xo2->lp[i], BQ_LOWPASS, f);
-		lr42_set(&xo2->hp[i], BQ_HIGHPASS, f);
+		lr42_set(&xo2->lp[i], &xo2->lp_q31[i], BQ_LOWPASS, f);
+		lr42_set(&xo2->hp[i], &xo2->hp_q31[i], BQ_HIGHPASS, f);
 	}
 }
 
@@ -596,3 +650,18 @@ void crossover2_process(struct crossover2 *xo2, int count,
 	lr42_split(&xo2->lp[2], &xo2->hp[2], count, data1L, data1R,
 		   data2L, data2R);
 }
+
+void crossover2_process_q31(struct crossover2 *xo2, int count,
+			    int32_t *data0L, int32_t *data0R,
+			    int32_t *data1L, int32_t *data1R,
+			    int32_t *data2L, int32_t *data2R)
+{
+	if (!count)
+		return;
+
+	lr42_split_q31(&xo2->lp_q31[0], &xo2->hp_q31[0], count, data0L, data0R,
+		       data1L, data1R);
+	lr42_merge_q31(&xo2->lp_q31[1], &xo2->hp_q31[1], count, data0L, data0R);
+	lr42_split_q31(&xo2->lp_q31[2], &xo2->hp_q31[2], count, data1L, data1R,
+		       data2L, data2R);
+}
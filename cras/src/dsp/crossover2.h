@@ -10,6 +10,8 @@
 extern "C" {
 #endif
 
+#include "biquad.h"
+
 /* "crossover2" is a two channel version of the "crossover" filter. It processes
  * two channels of data at once to increase performance. */
 
@@ -28,6 +30,13 @@ struct lr42 {
 	float z1L, z1R, z2L, z2R;
 };
 
+/* The fixed-point version of an lr42, used by crossover2_process_q31(). The
+ * two biquads in series are bq[0][ch] and bq[1][ch] for channel ch.
+ */
+struct lr42_q31 {
+	struct biquad_q31 bq[2][2];
+};
+
 /* Three bands crossover filter:
  *
  * INPUT --+-- lp0 --+-- lp1 --+---> LOW (0)
@@ -45,6 +54,7 @@ struct lr42 {
  */
 struct crossover2 {
 	struct lr42 lp[3], hp[3];
+	struct lr42_q31 lp_q31[3], hp_q31[3];
 };
 
 /* Initializes a crossover2 filter
@@ -69,6 +79,16 @@ void crossover2_process(struct crossover2 *xo2, int count,
 			float *data1L, float *data1R,
 			float *data2L, float *data2R);
 
+/* Splits Q31 input samples to three bands using fixed-point arithmetic only.
+ * The arguments are the same as crossover2_process(). The fixed-point filters
+ * keep their own history, so a crossover2 should be used with only one of the
+ * two functions.
+ */
+void crossover2_process_q31(struct crossover2 *xo2, int count,
+			    int32_t *data0L, int32_t *data0R,
+			    int32_t *data1L, int32_t *data1R,
+			    int32_t *data2L, int32_t *data2R);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -56,6 +56,8 @@ static void init_data_buffer(struct drc *drc)
 	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
 		drc->data1[i] = (float *)calloc(1, size);
 		drc->data2[i] = (float *)calloc(1, size);
+		drc->data1_q31[i] = (int32_t *)calloc(1, size);
+		drc->data2_q31[i] = (int32_t *)calloc(1, size);
 	}
 }
 
@@ -67,6 +69,8 @@ static void free_data_buffer(struct drc *drc)
 	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
 		free(drc->data1[i]);
 		free(drc->data2[i]);
+		free(drc->data1_q31[i]);
+		free(drc->data2_q31[i]);
 	}
 }
 
@@ -401,3 +405,48 @@ void drc_process(struct drc *drc, float **data, int frames)
 	if (!drc->emphasis_disabled)
 		eq2_process(drc->deemphasis_eq, data[0], data[1], frames);
 }
+
+static void sum3_q31(int32_t *data, const int32_t *data1, const int32_t *data2,
+		     int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		int64_t sum = (int64_t)data[i] + data1[i] + data2[i];
+		data[i] = max((int64_t)INT32_MIN, min((int64_t)INT32_MAX, sum));
+	}
+}
+
+void drc_process_q31(struct drc *drc, int32_t **data, int frames)
+{
+	const int shift = DK_Q31_HEADROOM_BITS;
+	const int32_t limit = INT32_MAX >> shift;
+	int i, j;
+	int32_t **data1 = drc->data1_q31;
+	int32_t **data2 = drc->data2_q31;
+
+	/* Make room for the gain of the emphasis filter. */
+	for (i = 0; i < DRC_NUM_CHANNELS; i++)
+		for (j = 0; j < frames; j++)
+			data[i][j] >>= shift;
+
+	if (!drc->emphasis_disabled)
+		eq2_process_q31(drc->emphasis_eq, data[0], data[1], frames);
+
+	crossover2_process_q31(&drc->xo2, frames, data[0], data[1],
+			       data1[0], data1[1], data2[0], data2[1]);
+
+	dk_process_q31(&drc->kernel[0], data, frames);
+	dk_process_q31(&drc->kernel[1], data1, frames);
+	dk_process_q31(&drc->kernel[2], data2, frames);
+
+	for (i = 0; i < DRC_NUM_CHANNELS; i++)
+		sum3_q31(data[i], data1[i], data2[i], frames);
+
+	if (!drc->emphasis_disabled)
+		eq2_process_q31(drc->deemphasis_eq, data[0], data[1], frames);
+
+	for (i = 0; i < DRC_NUM_CHANNELS; i++)
+		for (j = 0; j < frames; j++)
+			data[i][j] = max(-limit - 1, min(limit, data[i][j])) *
+				     (1 << shift);
+}
@@ -131,6 +131,10 @@ struct drc {
 	 * original input buffer). */
 	float *data1[DRC_NUM_CHANNELS];
 	float *data2[DRC_NUM_CHANNELS];
+
+	/* The same for drc_process_q31(). */
+	int32_t *data1_q31[DRC_NUM_CHANNELS];
+	int32_t *data2_q31[DRC_NUM_CHANNELS];
 };
 
 /* DRC needs the parameters to be set before initialization. So drc_new() should
@@ -169,6 +173,16 @@ void drc_free(struct drc *drc);
  */
 void drc_process(struct drc *drc, float **data, int frames);
 
+/* Processes Q31 input data using a DRC. The filters and the delay line run in
+ * fixed-point, see dk_process_q31() for what is left in float. A DRC should be
+ * used with either drc_process() or drc_process_q31(), not both.
+ * Args:
+ *    drc - The DRC we want to use.
+ *    data - Pointers to input/output data, as in drc_process().
+ *    frames - The number of frames to process.
+ */
+void drc_process_q31(struct drc *drc, int32_t **data, int frames);
+
 /* Sets a parameter for the DRC.
  * Args:
  *    drc - The DRC we want to use.
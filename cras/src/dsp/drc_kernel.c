@@ -62,14 +62,17 @@ void dk_init(struct drc_kernel *dk, float sample_rate)
 	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
 		size_t size = sizeof(float) * MAX_PRE_DELAY_FRAMES;
 		dk->pre_delay_buffers[i] = (float *)calloc(1, size);
+		dk->pre_delay_buffers_q31[i] = (int32_t *)calloc(1, size);
 	}
 }
 
 void dk_free(struct drc_kernel *dk)
 {
 	int i;
-	for (i = 0; i < DRC_NUM_CHANNELS; ++i)
+	for (i = 0; i < DRC_NUM_CHANNELS; ++i) {
 		free(dk->pre_delay_buffers[i]);
+		free(dk->pre_delay_buffers_q31[i]);
+	}
 }
 
 /* Sets the pre-delay (lookahead) buffer size */
@@ -96,6 +99,7 @@ static void set_pre_delay_time(struct drc_kernel *dk, float pre_delay_time)
 		for (i = 0; i < DRC_NUM_CHANNELS; ++i) {
 			size_t size = sizeof(float) * MAX_PRE_DELAY_FRAMES;
 			memset(dk->pre_delay_buffers[i], 0, size);
+			memset(dk->pre_delay_buffers_q31[i], 0, size);
 		}
 
 		dk->pre_delay_read_index = 0;
@@ -182,6 +186,8 @@ static void update_static_curve_parameters(struct drc_kernel *dk,
 		/* Threshold and knee. */
 		dk->db_threshold = db_threshold;
 		dk->linear_threshold = decibels_to_linear(db_threshold);
+		dk->linear_threshold_q31 = dk->linear_threshold *
+			(1u << (31 - DK_Q31_HEADROOM_BITS));
 		dk->db_knee = db_knee;
 
 		/* Compute knee parameters. */
@@ -502,22 +508,50 @@ static inline void max_abs_division(float *output,
 }
 #endif
 
+/* Returns the start index of the last input division. */
+static int dk_last_division_start(struct drc_kernel *dk)
+{
+	if (dk->pre_delay_write_index == 0)
+		return MAX_PRE_DELAY_FRAMES - DIVISION_FRAMES;
+	return dk->pre_delay_write_index - DIVISION_FRAMES;
+}
+
+/* Moves detector_average one frame towards the shaped power |gain| of the
+ * un-delayed input. */
+static inline float detector_step(const struct drc_kernel *dk,
+				  float detector_average, float gain)
+{
+	int is_release = (gain > detector_average);
+	if (is_release) {
+		if (gain > NEG_TWO_DB) {
+			detector_average += (gain - detector_average) *
+				dk->sat_release_rate_at_neg_two_db;
+		} else {
+			float gain_db = linear_to_decibels(gain);
+			float db_per_frame = gain_db *
+				dk->sat_release_frames_inv_neg;
+			float sat_release_rate =
+				decibels_to_linear(db_per_frame) - 1;
+			detector_average += (gain - detector_average) *
+				sat_release_rate;
+		}
+	} else {
+		detector_average = gain;
+	}
+
+	/* Fix gremlins. */
+	if (isbadf(detector_average))
+		return 1.0f;
+	return min(detector_average, 1.0f);
+}
+
 /* Update detector_average from the last input division. */
 static void dk_update_detector_average(struct drc_kernel *dk)
 {
 	float abs_input_array[DIVISION_FRAMES];
-	const float sat_release_frames_inv_neg = dk->sat_release_frames_inv_neg;
-	const float sat_release_rate_at_neg_two_db =
-		dk->sat_release_rate_at_neg_two_db;
 	float detector_average = dk->detector_average;
-	int div_start, i;
-
-	/* Calculate the start index of the last input division */
-	if (dk->pre_delay_write_index == 0) {
-		div_start = MAX_PRE_DELAY_FRAMES - DIVISION_FRAMES;
-	} else {
-		div_start = dk->pre_delay_write_index - DIVISION_FRAMES;
-	}
+	int div_start = dk_last_division_start(dk);
+	int i;
 
 	/* The max abs value across all channels for this frame */
 	max_abs_division(abs_input_array,
@@ -525,9 +559,6 @@ static void dk_update_detector_average(struct drc_kernel *dk)
 			 &dk->pre_delay_buffers[1][div_start]);
 
 	for (i = 0; i < DIVISION_FRAMES; i++) {
-		/* Compute compression amount from un-delayed signal */
-		float abs_input = abs_input_array[i];
-
 		/* Calculate shaped power on undelayed input.  Put through
 		 * shaping curve. This is linear up to the threshold, then
 		 * enters a "knee" portion followed by the "ratio" portion. The
@@ -535,30 +566,35 @@ static void dk_update_detector_average(struct drc_kernel *dk)
 		 * derivative matched). The transition from the knee to the
 		 * ratio portion is smooth (1st derivative matched).
 		 */
-		float gain = volume_gain(dk, abs_input);
-		int is_release = (gain > detector_average);
-		if (is_release) {
-			if (gain > NEG_TWO_DB) {
-				detector_average += (gain - detector_average) *
-					sat_release_rate_at_neg_two_db;
-			} else {
-				float gain_db = linear_to_decibels(gain);
-				float db_per_frame = gain_db *
-					sat_release_frames_inv_neg;
-				float sat_release_rate =
-					decibels_to_linear(db_per_frame) - 1;
-				detector_average += (gain - detector_average) *
-					sat_release_rate;
-			}
-		} else {
-			detector_average = gain;
-		}
+		float gain = volume_gain(dk, abs_input_array[i]);
+		detector_average = detector_step(dk, detector_average, gain);
+	}
 
-		/* Fix gremlins. */
-		if (isbadf(detector_average))
-			detector_average = 1.0f;
-		else
-			detector_average = min(detector_average, 1.0f);
+	dk->detector_average = detector_average;
+}
+
+/* Fixed-point version of dk_update_detector_average(). The shaping curve is
+ * flat below the linear threshold, so frames that quiet are told apart with
+ * an integer compare and skip the conversion to float and the curve. */
+static void dk_update_detector_average_q31(struct drc_kernel *dk)
+{
+	int div_start = dk_last_division_start(dk);
+	const int32_t *data0 = &dk->pre_delay_buffers_q31[0][div_start];
+	const int32_t *data1 = &dk->pre_delay_buffers_q31[1][div_start];
+	float detector_average = dk->detector_average;
+	int i;
+
+	for (i = 0; i < DIVISION_FRAMES; i++) {
+		/* Widen before taking the absolute value of INT32_MIN. */
+		int64_t a = llabs((int64_t)data0[i]);
+		int64_t b = llabs((int64_t)data1[i]);
+		int64_t abs_input = max(a, b);
+		float gain = 1;
+
+		if (abs_input >= dk->linear_threshold_q31)
+			gain = volume_gain(dk, abs_input *
+				(1.0f / (1u << (31 - DK_Q31_HEADROOM_BITS))));
+		detector_average = detector_step(dk, detector_average, gain);
 	}
 
 	dk->detector_average = detector_average;
@@ -952,6 +988,93 @@ static void dk_compress_output(struct drc_kernel *dk)
 }
 #endif
 
+/* The fixed-point gain applied by dk_compress_output_q31() has this many
+ * fractional bits, leaving room for up to 24dB of post gain. */
+#define GAIN_Q31_FRAC_BITS 27
+
+/* dk_compress_output_q31() computes the gain in float every this many
+ * frames, and interpolates it linearly in between. */
+#define GAIN_Q31_STEP_FRAMES 4
+
+static inline int64_t gain_to_fixed(float gain)
+{
+	return gain * (1 << GAIN_Q31_FRAC_BITS);
+}
+
+static inline int32_t apply_gain_q31(int32_t sample, int64_t g)
+{
+	int64_t y = ((int64_t)sample * g) >> GAIN_Q31_FRAC_BITS;
+
+	if (y > INT32_MAX)
+		return INT32_MAX;
+	if (y < INT32_MIN)
+		return INT32_MIN;
+	return (int32_t)y;
+}
+
+/* Fixed-point version of dk_compress_output(). The envelope and the warped
+ * gain are computed in float once every GAIN_Q31_STEP_FRAMES frames, at the
+ * same points as the float version. The gain in between is interpolated
+ * and applied with integer adds and multiplies. */
+static void dk_compress_output_q31(struct drc_kernel *dk)
+{
+	const float master_linear_gain = dk->master_linear_gain;
+	const float envelope_rate = dk->envelope_rate;
+	const float scaled_desired_gain = dk->scaled_desired_gain;
+	const float compressor_gain = dk->compressor_gain;
+	const int div_start = dk->pre_delay_read_index;
+	int32_t *ptr_left = &dk->pre_delay_buffers_q31[0][div_start];
+	int32_t *ptr_right = &dk->pre_delay_buffers_q31[1][div_start];
+	int releasing = envelope_rate >= 1;
+	int64_t gain, next_gain, gain_step;
+	float x;
+	float r, r_step;
+	float base;
+	int i, j;
+
+	if (!releasing) {
+		/* Attack - reduce gain to desired. */
+		base = scaled_desired_gain;
+		r = 1 - envelope_rate;
+		x = compressor_gain - scaled_desired_gain;
+	} else {
+		/* Release - exponentially increase gain to 1.0 */
+		base = 0;
+		r = envelope_rate;
+		x = compressor_gain;
+	}
+
+	/* Start from the gain of the last frame of the previous division. */
+	gain = gain_to_fixed(master_linear_gain * warp_sinf(compressor_gain));
+	r_step = r * r * r * r;
+
+	for (i = 0; i < DIVISION_FRAMES; i += GAIN_Q31_STEP_FRAMES) {
+		/* Like dk_compress_output(), the release only clamps the
+		 * gain after the first four frames. */
+		x *= r_step;
+		if (releasing && i > 0)
+			x = min(1.0f, x);
+		next_gain = gain_to_fixed(master_linear_gain *
+					warp_sinf(x + base));
+		gain_step = (next_gain - gain) / GAIN_Q31_STEP_FRAMES;
+
+		for (j = 0; j < GAIN_Q31_STEP_FRAMES - 1; j++) {
+			gain += gain_step;
+			*ptr_left = apply_gain_q31(*ptr_left, gain);
+			*ptr_right = apply_gain_q31(*ptr_right, gain);
+			ptr_left++;
+			ptr_right++;
+		}
+		gain = next_gain;
+		*ptr_left = apply_gain_q31(*ptr_left, gain);
+		*ptr_right = apply_gain_q31(*ptr_right, gain);
+		ptr_left++;
+		ptr_right++;
+	}
+
+	dk->compressor_gain = x + base;
+}
+
 /* After one complete divison of samples have been received (and one divison of
  * samples have been output), we calculate shaped power average
  * (detector_average) from the input division, update envelope parameters from
@@ -965,22 +1088,36 @@ static void dk_process_one_division(struct drc_kernel *dk)
 	dk_compress_output(dk);
 }
 
+/* Fixed-point version of dk_process_one_division(). */
+static void dk_process_one_division_q31(struct drc_kernel *dk)
+{
+	dk_update_detector_average_q31(dk);
+	dk_update_envelope(dk);
+	dk_compress_output_q31(dk);
+}
+
+/* The float and the Q31 paths share the code moving samples in and out of the
+ * pre-delay buffers, both sample types are four bytes. */
+#define SAMPLE_SIZE sizeof(float)
+#define SAMPLE_AT(buf, index) ((char *)(buf) + (index) * SAMPLE_SIZE)
+
 /* Copy the input data to the pre-delay buffer, and copy the output data back to
  * the input buffer */
-static void dk_copy_fragment(struct drc_kernel *dk, float *data_channels[],
-			     unsigned frame_index, int frames_to_process)
+static void dk_copy_fragment(struct drc_kernel *dk, void *const *delay_buffers,
+			     void *const *data_channels, unsigned frame_index,
+			     int frames_to_process)
 {
 	int write_index = dk->pre_delay_write_index;
 	int read_index = dk->pre_delay_read_index;
 	int j;
 
 	for (j = 0; j < DRC_NUM_CHANNELS; ++j) {
-		memcpy(&dk->pre_delay_buffers[j][write_index],
-		       &data_channels[j][frame_index],
-		       frames_to_process * sizeof(float));
-		memcpy(&data_channels[j][frame_index],
-		       &dk->pre_delay_buffers[j][read_index],
-		       frames_to_process * sizeof(float));
+		memcpy(SAMPLE_AT(delay_buffers[j], write_index),
+		       SAMPLE_AT(data_channels[j], frame_index),
+		       frames_to_process * SAMPLE_SIZE);
+		memcpy(SAMPLE_AT(data_channels[j], frame_index),
+		       SAMPLE_AT(delay_buffers[j], read_index),
+		       frames_to_process * SAMPLE_SIZE);
 	}
 
 	dk->pre_delay_write_index = (write_index + frames_to_process) &
@@ -993,8 +1130,9 @@ static void dk_copy_fragment(struct drc_kernel *dk, float *data_channels[],
  * the kernel is disabled. We want to do this to match the processing delay in
  * kernels of other bands.
  */
-static void dk_process_delay_only(struct drc_kernel *dk, float *data_channels[],
-				  unsigned count)
+static void dk_process_delay_only(struct drc_kernel *dk,
+				  void *const *delay_buffers,
+				  void *const *data_channels, unsigned count)
 {
 	int read_index = dk->pre_delay_read_index;
 	int write_index = dk->pre_delay_write_index;
@@ -1010,12 +1148,12 @@ static void dk_process_delay_only(struct drc_kernel *dk, float *data_channels[],
 		int chunk = min(large - small, MAX_PRE_DELAY_FRAMES - large);
 		chunk = min(chunk, count - i);
 		for (j = 0; j < DRC_NUM_CHANNELS; ++j) {
-			memcpy(&dk->pre_delay_buffers[j][write_index],
-			       &data_channels[j][i],
-			       chunk * sizeof(float));
-			memcpy(&data_channels[j][i],
-			       &dk->pre_delay_buffers[j][read_index],
-			       chunk * sizeof(float));
+			memcpy(SAMPLE_AT(delay_buffers[j], write_index),
+			       SAMPLE_AT(data_channels[j], i),
+			       chunk * SAMPLE_SIZE);
+			memcpy(SAMPLE_AT(data_channels[j], i),
+			       SAMPLE_AT(delay_buffers[j], read_index),
+			       chunk * SAMPLE_SIZE);
 		}
 		read_index = (read_index + chunk) & MAX_PRE_DELAY_FRAMES_MASK;
 		write_index = (write_index + chunk) & MAX_PRE_DELAY_FRAMES_MASK;
@@ -1028,11 +1166,13 @@ static void dk_process_delay_only(struct drc_kernel *dk, float *data_channels[],
 
 void dk_process(struct drc_kernel *dk, float *data_channels[], unsigned count)
 {
+	void *const *delay_buffers = (void *const *)dk->pre_delay_buffers;
+	void *const *data = (void *const *)data_channels;
 	int i = 0;
 	int fragment;
 
 	if (!dk->enabled) {
-		dk_process_delay_only(dk, data_channels, count);
+		dk_process_delay_only(dk, delay_buffers, data, count);
 		return;
 	}
 
@@ -1045,7 +1185,7 @@ void dk_process(struct drc_kernel *dk, float *data_channels[], unsigned count)
 	int offset = dk->pre_delay_write_index & DIVISION_FRAMES_MASK;
 	while (i < count) {
 		fragment = min(DIVISION_FRAMES - offset, count - i);
-		dk_copy_fragment(dk, data_channels, i, fragment);
+		dk_copy_fragment(dk, delay_buffers, data, i, fragment);
 		i += fragment;
 		offset = (offset + fragment) & DIVISION_FRAMES_MASK;
 
@@ -1054,3 +1194,34 @@ void dk_process(struct drc_kernel *dk, float *data_channels[], unsigned count)
 			dk_process_one_division(dk);
 	}
 }
+
+void dk_process_q31(struct drc_kernel *dk, int32_t *data_channels[],
+		    unsigned count)
+{
+	void *const *delay_buffers = (void *const *)dk->pre_delay_buffers_q31;
+	void *const *data = (void *const *)data_channels;
+	int i = 0;
+	int fragment;
+
+	if (!dk->enabled) {
+		dk_process_delay_only(dk, delay_buffers, data, count);
+		return;
+	}
+
+	if (!dk->processed) {
+		dk_update_envelope(dk);
+		dk_compress_output_q31(dk);
+		dk->processed = 1;
+	}
+
+	int offset = dk->pre_delay_write_index & DIVISION_FRAMES_MASK;
+	while (i < count) {
+		fragment = min(DIVISION_FRAMES - offset, count - i);
+		dk_copy_fragment(dk, delay_buffers, data, i, fragment);
+		i += fragment;
+		offset = (offset + fragment) & DIVISION_FRAMES_MASK;
+
+		if (offset == 0)
+			dk_process_one_division_q31(dk);
+	}
+}
@@ -15,8 +15,15 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 #define DRC_NUM_CHANNELS 2
 
+/* The fixed-point kernel leaves this many bits of headroom above full scale,
+ * so the samples it processes are Q28 (1.0 is 1 << 28) stored in int32_t. The
+ * emphasis filter and the crossover bands in front of it can go above 1.0. */
+#define DK_Q31_HEADROOM_BITS 3
+
 struct drc_kernel {
 	float sample_rate;
 
@@ -34,6 +41,7 @@ struct drc_kernel {
 	/* Lookahead section. */
 	unsigned last_pre_delay_frames;
 	float *pre_delay_buffers[DRC_NUM_CHANNELS];
+	int32_t *pre_delay_buffers_q31[DRC_NUM_CHANNELS];
 	int pre_delay_read_index;
 	int pre_delay_write_index;
 
@@ -49,6 +57,8 @@ struct drc_kernel {
 	/* The input to output change below the threshold is 1:1. */
 	float linear_threshold;
 	float db_threshold;
+	/* linear_threshold on the scale of the samples of dk_process_q31(). */
+	int64_t linear_threshold_q31;
 
 	/* db_knee is the number of dB above the threshold before we enter the
 	 * "ratio" portion of the curve.  The portion between db_threshold and
@@ -110,6 +120,19 @@ void dk_set_enabled(struct drc_kernel *dk, int enabled);
  */
 void dk_process(struct drc_kernel *dk, float *data_channels[], unsigned count);
 
+/* Performs stereo-linked compression on fixed-point samples, which have
+ * DK_Q31_HEADROOM_BITS of headroom. The delay line and the gain are applied in
+ * fixed-point, the envelope and the gain curve are still evaluated in float. A
+ * kernel should be used with either dk_process() or dk_process_q31(), not
+ * both.
+ * Args:
+ *    dk - The DRC kernel.
+ *    data - The pointers to the audio sample buffer. One pointer per channel.
+ *    count - The number of audio samples per channel.
+ */
+void dk_process_q31(struct drc_kernel *dk, int32_t *data_channels[],
+		    unsigned count);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -577,6 +577,96 @@ int dsp_util_interleave(float *const *input, uint8_t *output, int channels,
 	return 0;
 }
 
+/* Converts an S24_LE sample to Q31. The top byte of the container is
+ * ignored, the 24 bit value is sign extended and moved up as unsigned so
+ * the shift can't overflow. */
+static inline int32_t s24le_to_q31(int32_t sample)
+{
+	sample = ((sample & 0xffffff) ^ 0x800000) - 0x800000;
+	return (int32_t)((uint32_t)sample << 8);
+}
+
+int dsp_util_deinterleave_q31(uint8_t *input, int32_t *const *output,
+			      int channels, snd_pcm_format_t format, int frames)
+{
+	int i, j;
+
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, input += 2)
+				output[j][i] = *(int16_t *)input * 65536;
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, input += 4)
+				output[j][i] = s24le_to_q31(*(int32_t *)input);
+		break;
+	case SND_PCM_FORMAT_S24_3LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, input += 3) {
+				int32_t sample = 0;
+				memcpy((uint8_t *)&sample + 1, input, 3);
+				output[j][i] = sample;
+			}
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, input += 4)
+				output[j][i] = *(int32_t *)input;
+		break;
+	default:
+		syslog(LOG_ERR, "Invalid format to deinterleave");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Shifts a Q31 sample right by |bits| rounding to nearest, and saturates. */
+static inline int32_t round_shift_q31(int32_t sample, int bits)
+{
+	int64_t v = ((int64_t)sample + (1 << (bits - 1))) >> bits;
+	return min(v, (int64_t)(INT32_MAX >> bits));
+}
+
+int dsp_util_interleave_q31(int32_t *const *input, uint8_t *output,
+			    int channels, snd_pcm_format_t format, int frames)
+{
+	int i, j;
+
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, output += 2)
+				*(int16_t *)output =
+					round_shift_q31(input[j][i], 16);
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, output += 4)
+				*(int32_t *)output =
+					round_shift_q31(input[j][i], 8);
+		break;
+	case SND_PCM_FORMAT_S24_3LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, output += 3) {
+				int32_t sample =
+					round_shift_q31(input[j][i], 8);
+				memcpy(output, &sample, 3);
+			}
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, output += 4)
+				*(int32_t *)output = input[j][i];
+		break;
+	default:
+		syslog(LOG_ERR, "Invalid format to interleave");
+		return -EINVAL;
+	}
+	return 0;
+}
+
 void dsp_enable_flush_denormal_to_zero()
 {
 #if defined(__i386__) || defined(__x86_64__)
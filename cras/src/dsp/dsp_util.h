@@ -43,6 +43,37 @@ int dsp_util_deinterleave(uint8_t *input, float *const *output, int channels,
 int dsp_util_interleave(float *const *input, uint8_t *output, int channels,
 			snd_pcm_format_t format, int frames);
 
+/* Converts from interleaved samples to non-interleaved Q31 samples, for
+ * pipelines running in fixed-point. The samples are only shifted to the top
+ * of an int32_t, no float conversion is involved.
+ * Args:
+ *    input - The interleaved input buffer. Every "channels" samples is a frame.
+ *    output - Pointers to output buffers. There are "channels" output buffers.
+ *    channels - The number of samples per frame.
+ *    format - The sample format of the input buffer.
+ *    frames - The number of frames to convert.
+ * Returns:
+ *    Negative error if format isn't supported, otherwise 0.
+ */
+int dsp_util_deinterleave_q31(uint8_t *input, int32_t *const *output,
+			      int channels, snd_pcm_format_t format,
+			      int frames);
+
+/* Converts from non-interleaved Q31 samples to interleaved samples, rounding
+ * to nearest. This is the inverse of dsp_util_deinterleave_q31().
+ * Args:
+ *    input - Pointers to input buffers. There are "channels" input buffers.
+ *    output - The interleaved output buffer. Every "channels" samples is a
+ *        frame.
+ *    channels - The number of samples per frame.
+ *    format - The sample format of the output buffer.
+ *    frames - The number of frames to convert.
+ * Returns:
+ *    Negative error if format isn't supported, otherwise 0.
+ */
+int dsp_util_interleave_q31(int32_t *const *input, uint8_t *output,
+			    int channels, snd_pcm_format_t format, int frames);
+
 /* Disables denormal numbers in floating point calculation. Denormal numbers
  * happens often in IIR filters, and it can be very slow.
  */
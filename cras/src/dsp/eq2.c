@@ -9,6 +9,8 @@
 struct eq2 {
 	int n[2];
 	struct biquad biquad[MAX_BIQUADS_PER_EQ2][2];
+	/* Fixed-point copies of the biquads, used by eq2_process_q31(). */
+	struct biquad_q31 biquad_q31[MAX_BIQUADS_PER_EQ2][2];
 };
 
 struct eq2 *eq2_new()
@@ -19,8 +21,11 @@ struct eq2 *eq2_new()
 	/* Initialize all biquads to identity filter, so if two channels have
 	 * different numbers of biquads, it still works. */
 	for (i = 0; i < MAX_BIQUADS_PER_EQ2; i++)
-		for (j = 0; j < 2; j++)
+		for (j = 0; j < 2; j++) {
 			biquad_set(&eq2->biquad[i][j], BQ_NONE, 0, 0, 0);
+			biquad_q31_init(&eq2->biquad_q31[i][j],
+					&eq2->biquad[i][j]);
+		}
 
 	return eq2;
 }
@@ -33,19 +38,27 @@ void eq2_free(struct eq2 *eq2)
 int eq2_append_biquad(struct eq2 *eq2, int channel,
 		      enum biquad_type type, float freq, float Q, float gain)
 {
-	if (eq2->n[channel] >= MAX_BIQUADS_PER_EQ2)
+	int i = eq2->n[channel];
+
+	if (i >= MAX_BIQUADS_PER_EQ2)
 		return -1;
-	biquad_set(&eq2->biquad[eq2->n[channel]++][channel], type, freq, Q,
-		   gain);
+	biquad_set(&eq2->biquad[i][channel], type, freq, Q, gain);
+	biquad_q31_init(&eq2->biquad_q31[i][channel],
+			&eq2->biquad[i][channel]);
+	eq2->n[channel]++;
 	return 0;
 }
 
 int eq2_append_biquad_direct(struct eq2 *eq2, int channel,
 			     const struct biquad *biquad)
 {
-	if (eq2->n[channel] >= MAX_BIQUADS_PER_EQ2)
+	int i = eq2->n[channel];
+
+	if (i >= MAX_BIQUADS_PER_EQ2)
 		return -1;
-	eq2->biquad[eq2->n[channel]++][channel] = *biquad;
+	eq2->biquad[i][channel] = *biquad;
+	biquad_q31_init(&eq2->biquad_q31[i][channel], biquad);
+	eq2->n[channel]++;
 	return 0;
 }
 
@@ -340,3 +353,20 @@ void eq2_process(struct eq2 *eq2, float *data0, float *data1, int count)
 		}
 	}
 }
+
+void eq2_process_q31(struct eq2 *eq2, int32_t *data0, int32_t *data1,
+		     int count)
+{
+	int i, j;
+
+	for (i = 0; i < eq2->n[0]; i++) {
+		struct biquad_q31 *q = &eq2->biquad_q31[i][0];
+		for (j = 0; j < count; j++)
+			data0[j] = biquad_q31_step(q, data0[j]);
+	}
+	for (i = 0; i < eq2->n[1]; i++) {
+		struct biquad_q31 *q = &eq2->biquad_q31[i][1];
+		for (j = 0; j < count; j++)
+			data1[j] = biquad_q31_step(q, data1[j]);
+	}
+}
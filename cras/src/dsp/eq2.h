@@ -64,6 +64,18 @@ int eq2_append_biquad_direct(struct eq2 *eq2, int channel,
  */
 void eq2_process(struct eq2 *eq2, float *data0, float *data1, int count);
 
+/* Process a buffer of Q31 audio data through the EQ2 using fixed-point
+ * arithmetic only. The fixed-point filters keep their own history, so one EQ2
+ * should be used with either eq2_process() or eq2_process_q31(), not both.
+ * Args:
+ *    eq2 - The EQ2 we want to use.
+ *    data0 - The array of channel 0 audio samples.
+ *    data1 - The array of channel 1 audio samples.
+ *    count - The number of elements in each of the data array to process.
+ */
+void eq2_process_q31(struct eq2 *eq2, int32_t *data0, int32_t *data1,
+		     int count);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
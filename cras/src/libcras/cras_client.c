@@ -1185,8 +1185,12 @@ static int handle_playback_request(struct client_stream *stream,
 
 	buf = cras_shm_get_write_buffer_base(&stream->play_shm);
 
-	/* Limit the amount of frames to the configured amount. */
-	num_frames = MIN(num_frames, config->cb_threshold);
+	/* Limit the amount of frames to the configured amount. The server
+	 * asks media streams for up to one shm buffer in deep buffer mode. */
+	if (cras_stream_type_allows_deep_buffer(config->stream_type))
+		num_frames = MIN(num_frames, config->buffer_frames);
+	else
+		num_frames = MIN(num_frames, config->cb_threshold);
 
 	cras_timespec_to_timespec(&ts, &shm->area->ts);
 
@@ -2709,6 +2713,21 @@ const struct cras_audio_thread_snapshot_buffer*
 	return snapshot_buffer;
 }
 
+const struct dsp_profile_info *cras_client_get_dsp_profile_info(
+		const struct cras_client *client)
+{
+	const struct dsp_profile_info *profile_info;
+	int lock_rc;
+
+	lock_rc = server_state_rdlock(client);
+	if (lock_rc)
+		return 0;
+
+	profile_info = &client->server_state->dsp_profile_info;
+	server_state_unlock(client, lock_rc);
+	return profile_info;
+}
+
 unsigned cras_client_get_num_active_streams(const struct cras_client *client,
 					    struct timespec *ts)
 {
@@ -3114,6 +3133,45 @@ int cras_client_calc_capture_latency(const struct timespec *sample_time,
 	return 0;
 }
 
+int cras_client_calc_latency_bound(const struct cras_client *client,
+				   cras_stream_id_t stream_id,
+				   const struct timespec *sample_time,
+				   struct timespec *delay,
+				   struct timespec *bound)
+{
+	struct client_stream *stream;
+	const struct cras_audio_shm *shm;
+	int shm_size;
+
+	if (client == NULL || bound == NULL)
+		return -EINVAL;
+
+	stream = stream_from_id(client, stream_id);
+	if (stream == NULL)
+		return -EINVAL;
+
+	if (cras_stream_uses_output_hw(stream->direction)) {
+		shm = &stream->play_shm;
+		shm_size = stream->play_shm_size;
+		if (cras_client_calc_playback_latency(sample_time, delay))
+			return -EINVAL;
+	} else {
+		shm = &stream->capture_shm;
+		shm_size = stream->capture_shm_size;
+		if (cras_client_calc_capture_latency(sample_time, delay))
+			return -EINVAL;
+	}
+
+	if (shm->area == NULL)
+		return -EINVAL;
+	/* Servers from before the bound don't map the trailer. */
+	if (shm_size < (int)cras_shm_total_size(shm))
+		return -ENOTSUP;
+	cras_timespec_to_timespec(bound,
+				  &cras_shm_get_trailer(shm)->ts_bound);
+	return 0;
+}
+
 int cras_client_reload_dsp(struct cras_client *client)
 {
 	struct cras_reload_dsp msg;
@@ -3170,6 +3228,23 @@ int cras_client_update_audio_thread_snapshots(
 	return write_message_to_server(client, &msg.header);
 }
 
+int cras_client_update_dsp_profile_info(
+	struct cras_client *client,
+	void (*debug_info_cb)(struct cras_client *))
+{
+	struct cras_dump_dsp_profile msg;
+
+	if (client == NULL)
+		return -EINVAL;
+
+	if (client->debug_info_callback != NULL)
+		return -EINVAL;
+	client->debug_info_callback = debug_info_cb;
+
+	cras_fill_dump_dsp_profile(&msg);
+	return write_message_to_server(client, &msg.header);
+}
+
 int cras_client_set_node_volume(struct cras_client *client,
 				cras_node_id_t node_id,
 				uint8_t volume)
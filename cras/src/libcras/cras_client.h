@@ -515,6 +515,19 @@ int cras_client_update_audio_debug_info(
 int cras_client_update_audio_thread_snapshots(
 	struct cras_client *client, void (*cb)(struct cras_client *));
 
+/* Asks the server to dump the CPU time profile of the dsp pipelines.
+ * The server only profiles the modules after the first request, so that
+ * one comes back with empty module profiles.
+ *
+ * Args:
+ *    client - The client from cras_client_create.
+ *    cb - A function to call when the data is received.
+ * Returns:
+ *    0 on success, -EINVAL if the client isn't valid or isn't running.
+ */
+int cras_client_update_dsp_profile_info(
+	struct cras_client *client, void (*cb)(struct cras_client *));
+
 /*
  * Stream handling.
  */
@@ -872,6 +885,20 @@ const struct cras_audio_thread_snapshot_buffer *
 	cras_client_get_audio_thread_snapshot_buffer(
 		const struct cras_client *client);
 
+/* Gets the CPU time profile of the dsp pipelines.
+ *
+ * Requires that the connection to the server has been established.
+ * Access to the resulting pointer is not thread-safe.
+ *
+ * Args:
+ *    client - The client from cras_client_create.
+ * Returns:
+ *    A pointer to the profile.  This info is only updated when requested by
+ *    calling cras_client_update_dsp_profile_info.
+ */
+const struct dsp_profile_info *cras_client_get_dsp_profile_info(
+		const struct cras_client *client);
+
 /* Gets the number of streams currently attached to the server.
  *
  * This is the total number of capture and playback streams. If the ts argument
@@ -929,6 +956,30 @@ int cras_client_calc_playback_latency(const struct timespec *sample_time,
 int cras_client_calc_capture_latency(const struct timespec *sample_time,
 				     struct timespec *delay);
 
+/* Calculates the latency of a sample like cras_client_calc_playback_latency
+ * or cras_client_calc_capture_latency, depending on the direction of the
+ * stream, along with a bound on its error. The bound covers the accuracy of
+ * the device delay and of the estimated device rate. It is tight on devices
+ * that time stamp their hardware pointer, and up to a callback period on
+ * others. Only valid when called from the audio callback function for the
+ * stream.
+ * Args:
+ *    client - The client the stream belongs to.
+ *    stream_id - The stream sample_time was passed to.
+ *    sample_time - The sample time stamp passed in to the callback.
+ *    delay - Out parameter will be filled with the latency.
+ *    bound - Out parameter will be filled with the bound on the error of
+ *        delay.
+ * Returns:
+ *    0 on success, -EINVAL if an argument is NULL or the stream doesn't
+ *    exist, -ENOTSUP if the server doesn't report the bound.
+ */
+int cras_client_calc_latency_bound(const struct cras_client *client,
+				   cras_stream_id_t stream_id,
+				   const struct timespec *sample_time,
+				   struct timespec *delay,
+				   struct timespec *bound);
+
 /* Set the volume of the given output node. Only for output nodes.
  *
  * Args:
@@ -0,0 +1,106 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <string.h>
+#include <sys/param.h>
+
+#include "a2dp_link_ctrl.h"
+#include "cras_util.h"
+
+/* Length of a window of write results that is judged as a whole. */
+#define LINK_WINDOW_MS 500
+/* The link must be clean for this long before each step up in quality. */
+#define LINK_RECOVER_SEC 4
+/* Bitpool added per step up. Cuts are multiplicative, by a quarter. */
+#define LINK_BITPOOL_STEP 4
+
+void a2dp_link_ctrl_init(struct a2dp_link_ctrl *ctrl,
+			 unsigned int min_bitpool, unsigned int max_bitpool,
+			 unsigned int min_queue, unsigned int max_queue,
+			 unsigned int queue_step)
+{
+	memset(ctrl, 0, sizeof(*ctrl));
+	ctrl->max_bitpool = max_bitpool;
+	ctrl->min_bitpool = MIN(min_bitpool, max_bitpool);
+	ctrl->bitpool = max_bitpool;
+	ctrl->max_queue = MAX(max_queue, min_queue);
+	ctrl->min_queue = min_queue;
+	ctrl->queue_target = min_queue;
+	ctrl->queue_step = queue_step;
+}
+
+/* Lowers quality and deepens the queue after a congested window. */
+static void back_off(struct a2dp_link_ctrl *ctrl)
+{
+	ctrl->bitpool = MAX(ctrl->bitpool * 3 / 4, ctrl->min_bitpool);
+	ctrl->queue_target = MIN(ctrl->queue_target + ctrl->queue_step,
+				 ctrl->max_queue);
+}
+
+/* Raises quality and shortens the queue by a step after a clean period. */
+static void recover(struct a2dp_link_ctrl *ctrl)
+{
+	ctrl->bitpool = MIN(ctrl->bitpool + LINK_BITPOOL_STEP,
+			    ctrl->max_bitpool);
+	if (ctrl->queue_target >= ctrl->min_queue + ctrl->queue_step)
+		ctrl->queue_target -= ctrl->queue_step;
+	else
+		ctrl->queue_target = ctrl->min_queue;
+}
+
+int a2dp_link_ctrl_update(struct a2dp_link_ctrl *ctrl, int eagain,
+			  unsigned int outq, unsigned int sndbuf,
+			  const struct timespec *now)
+{
+	unsigned int old_bitpool = ctrl->bitpool;
+	unsigned int old_queue = ctrl->queue_target;
+	unsigned long fill_avg;
+	struct timespec diff;
+	int congested, clean;
+
+	if (!timespec_is_nonzero(&ctrl->window_start)) {
+		ctrl->window_start = *now;
+		ctrl->last_change_ts = *now;
+	}
+
+	ctrl->num_writes++;
+	ctrl->num_eagain += !!eagain;
+	if (sndbuf)
+		ctrl->fill_sum += MIN(outq, sndbuf) * 1000UL / sndbuf;
+
+	subtract_timespecs(now, &ctrl->window_start, &diff);
+	if (timespec_to_ms(&diff) < LINK_WINDOW_MS)
+		return 0;
+
+	/* More than one write in ten failing, or the queue staying over
+	 * three quarters full, means the link can't keep up. Clean needs no
+	 * failure and the queue at most half full, sampled right after the
+	 * write so counting the packet just queued. */
+	fill_avg = ctrl->fill_sum / ctrl->num_writes;
+	congested = ctrl->num_eagain * 10 > ctrl->num_writes ||
+		    fill_avg > 750;
+	clean = ctrl->num_eagain == 0 && fill_avg <= 500;
+
+	if (congested) {
+		back_off(ctrl);
+		ctrl->last_change_ts = *now;
+	} else if (!clean) {
+		ctrl->last_change_ts = *now;
+	} else {
+		subtract_timespecs(now, &ctrl->last_change_ts, &diff);
+		if (diff.tv_sec >= LINK_RECOVER_SEC) {
+			recover(ctrl);
+			ctrl->last_change_ts = *now;
+		}
+	}
+
+	ctrl->window_start = *now;
+	ctrl->num_writes = 0;
+	ctrl->num_eagain = 0;
+	ctrl->fill_sum = 0;
+
+	return ctrl->bitpool != old_bitpool ||
+	       ctrl->queue_target != old_queue;
+}
@@ -0,0 +1,78 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Controller of the SBC bitpool and socket queue depth of an A2DP stream,
+ * driven by back pressure from the socket. When writes fail with EAGAIN or
+ * the socket send queue stays full, the link can't carry the encoded rate:
+ * the bitpool is cut multiplicatively and the queue deepened to ride out
+ * the bursts. After the link has been clean for a while the bitpool is
+ * raised back step by step and the queue made shallow again, so quality
+ * and latency recover when the link improves.
+ */
+#ifndef A2DP_LINK_CTRL_H_
+#define A2DP_LINK_CTRL_H_
+
+#include <time.h>
+
+/* Members:
+ *    bitpool - The SBC bitpool to encode with.
+ *    min_bitpool, max_bitpool - Bounds of bitpool.
+ *    queue_target - Bytes the socket send queue is sized to.
+ *    min_queue, max_queue - Bounds of queue_target.
+ *    queue_step - Change of queue_target per adjustment, in bytes.
+ *    num_writes - Write attempts in the current window.
+ *    num_eagain - Writes in the current window that failed with EAGAIN.
+ *    fill_sum - Sum of the send queue fill sampled in the window, in
+ *        thousandths of the queue size.
+ *    window_start - Start of the current window.
+ *    last_change_ts - Time of the last adjustment or congestion.
+ */
+struct a2dp_link_ctrl {
+	unsigned int bitpool;
+	unsigned int min_bitpool;
+	unsigned int max_bitpool;
+	unsigned int queue_target;
+	unsigned int min_queue;
+	unsigned int max_queue;
+	unsigned int queue_step;
+	unsigned int num_writes;
+	unsigned int num_eagain;
+	unsigned long fill_sum;
+	struct timespec window_start;
+	struct timespec last_change_ts;
+};
+
+/* Initializes the controller at the best quality and shallowest queue.
+ * Args:
+ *    ctrl - The controller to initialize.
+ *    min_bitpool, max_bitpool - Bounds of the bitpool.
+ *    min_queue, max_queue - Bounds of the send queue size in bytes.
+ *    queue_step - Change of the send queue size per adjustment.
+ */
+void a2dp_link_ctrl_init(struct a2dp_link_ctrl *ctrl,
+			 unsigned int min_bitpool, unsigned int max_bitpool,
+			 unsigned int min_queue, unsigned int max_queue,
+			 unsigned int queue_step);
+
+/* Feeds the result of a write to the socket and the depth of its send
+ * queue after the write. Once a window of samples is complete, adjusts the
+ * bitpool and queue target.
+ * Args:
+ *    ctrl - The controller.
+ *    eagain - Nonzero if the write failed with EAGAIN.
+ *    outq - Bytes in the socket send queue, as accounted by the kernel.
+ *    sndbuf - Size of the socket send queue as accounted by the kernel,
+ *        which isn't queue_target: the kernel doubles it and counts
+ *        buffer overhead.
+ *    now - The current time.
+ * Returns:
+ *    1 if bitpool or queue_target changed, 0 otherwise.
+ */
+int a2dp_link_ctrl_update(struct a2dp_link_ctrl *ctrl, int eagain,
+			  unsigned int outq, unsigned int sndbuf,
+			  const struct timespec *now);
+
+#endif /* A2DP_LINK_CTRL_H_ */
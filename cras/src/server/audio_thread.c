@@ -48,6 +48,7 @@ enum AUDIO_THREAD_COMMAND {
 	AUDIO_THREAD_DEV_START_RAMP,
 	AUDIO_THREAD_REMOVE_CALLBACK,
 	AUDIO_THREAD_AEC_DUMP,
+	AUDIO_THREAD_DEV_SET_EXT_DSP_MODULE,
 };
 
 struct audio_thread_msg {
@@ -88,6 +89,12 @@ struct audio_thread_dev_start_ramp_msg {
 	enum CRAS_IODEV_RAMP_REQUEST request;
 };
 
+struct audio_thread_dev_ext_dsp_module_msg {
+	struct audio_thread_msg header;
+	struct cras_iodev *dev;
+	struct ext_dsp_module *ext;
+};
+
 struct audio_thread_aec_dump_msg {
 	struct audio_thread_msg header;
 	cras_stream_id_t stream_id;
@@ -564,6 +571,12 @@ static void append_dev_dump_info(struct audio_dev_debug_info *di,
 	di->num_severe_underruns = cras_iodev_get_num_severe_underruns(
 			adev->dev);
 	di->highest_hw_level = adev->dev->highest_hw_level;
+	di->adaptive_watermark = adev->dev->adaptive_watermark;
+	di->num_near_misses = adev->dev->adaptive_watermark ?
+			adev->dev->watermark.num_near_misses : 0;
+	di->num_hw_calls = cras_iodev_get_num_hw_calls(adev->dev);
+	di->num_overruns = cras_iodev_get_num_overruns(adev->dev);
+	di->num_wakes = adev->num_wakes;
 	if (fmt) {
 		di->frame_rate = fmt->frame_rate;
 		di->num_channels = fmt->num_channels;
@@ -578,7 +591,7 @@ static void append_dev_dump_info(struct audio_dev_debug_info *di,
 /* Put stream info for the given stream into the info struct. */
 static void append_stream_dump_info(struct audio_debug_info *info,
 				    struct dev_stream *stream,
-				    unsigned int dev_idx,
+				    struct cras_iodev *dev,
 				    int index)
 {
 	struct audio_stream_debug_info *si;
@@ -586,7 +599,7 @@ static void append_stream_dump_info(struct audio_debug_info *info,
 	si = &info->streams[index];
 
 	si->stream_id = stream->stream->stream_id;
-	si->dev_idx = dev_idx;
+	si->dev_idx = dev->info.idx;
 	si->direction = stream->stream->direction;
 	si->stream_type = stream->stream->stream_type;
 	si->buffer_frames = stream->stream->buffer_frames;
@@ -599,6 +612,8 @@ static void append_stream_dump_info(struct audio_debug_info *info,
 	si->longest_fetch_nsec = stream->stream->longest_fetch_interval.tv_nsec;
 	si->num_overruns = cras_shm_num_overruns(&stream->stream->shm);
 	si->effects = cras_apm_list_get_effects(stream->stream->apm_list);
+	si->apm_users = cras_apm_list_get_num_users(
+			cras_apm_list_get(stream->stream->apm_list, dev));
 
 	longest_wake.tv_sec = 0;
 	longest_wake.tv_nsec = 0;
@@ -672,6 +687,7 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 		struct audio_debug_info *info;
 		unsigned int num_streams = 0;
 		unsigned int num_devs = 0;
+		unsigned int pool_hits, pool_misses;
 
 		ret = 0;
 		dmsg = (struct audio_thread_dump_debug_info_msg *)msg;
@@ -686,7 +702,7 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 				if (num_streams == MAX_DEBUG_STREAMS)
 					break;
 				append_stream_dump_info(info, curr,
-							adev->dev->info.idx,
+							adev->dev,
 							num_streams++);
 			}
 		}
@@ -698,7 +714,7 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 				if (num_streams == MAX_DEBUG_STREAMS)
 					break;
 				append_stream_dump_info(info, curr,
-							adev->dev->info.idx,
+							adev->dev,
 							num_streams++);
 			}
 			++num_devs;
@@ -707,6 +723,11 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 
 		info->num_streams = num_streams;
 
+		cras_fmt_conv_pool_get_stats(&pool_hits, &pool_misses);
+		info->fmt_conv_pool_hits = pool_hits;
+		info->fmt_conv_pool_misses = pool_misses;
+		info->num_apms = cras_apm_list_get_num_instances();
+
 		memcpy(&info->log, atlog, sizeof(info->log));
 		break;
 	}
@@ -751,6 +772,13 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 					  rmsg->start, rmsg->fd);
 		break;
 	}
+	case AUDIO_THREAD_DEV_SET_EXT_DSP_MODULE: {
+		struct audio_thread_dev_ext_dsp_module_msg *rmsg;
+
+		rmsg = (struct audio_thread_dev_ext_dsp_module_msg *)msg;
+		ret = cras_iodev_connect_ext_dsp_module(rmsg->dev, rmsg->ext);
+		break;
+	}
 	default:
 		ret = -EINVAL;
 		break;
@@ -1304,6 +1332,25 @@ int audio_thread_dev_start_ramp(struct audio_thread *thread,
 	return audio_thread_post_message(thread, &msg.header);
 }
 
+int audio_thread_dev_set_ext_dsp_module(struct audio_thread *thread,
+					struct cras_iodev *dev,
+					struct ext_dsp_module *ext)
+{
+	struct audio_thread_dev_ext_dsp_module_msg msg;
+
+	assert(thread && dev);
+
+	if (!thread->started)
+		return -EINVAL;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.header.id = AUDIO_THREAD_DEV_SET_EXT_DSP_MODULE;
+	msg.header.length = sizeof(msg);
+	msg.dev = dev;
+	msg.ext = ext;
+	return audio_thread_post_message(thread, &msg.header);
+}
+
 int audio_thread_start(struct audio_thread *thread)
 {
 	int rc;
@@ -1345,6 +1392,7 @@ void audio_thread_destroy(struct audio_thread *thread)
 
 	if (thread->remix_converter)
 		cras_fmt_conv_destroy(&thread->remix_converter);
+	cras_fmt_conv_pool_flush();
 
 	free(thread);
 }
@@ -18,6 +18,7 @@ struct cras_fmt_conv;
 struct cras_iodev;
 struct cras_rstream;
 struct dev_stream;
+struct ext_dsp_module;
 
 /* Hold communication pipes and pthread info for the thread used to play or
  * record audio.
@@ -208,4 +209,21 @@ int audio_thread_config_global_remix(struct audio_thread *thread,
 int audio_thread_dev_start_ramp(struct audio_thread *thread,
 				struct cras_iodev *dev,
 				enum CRAS_IODEV_RAMP_REQUEST request);
+
+/* Connects an external dsp module to the sink of a device's dsp pipeline.
+ *
+ * The audio thread may be running the pipeline, so the main thread asks it
+ * to change the sink between two runs.
+ *
+ * Args:
+ *   thread - a pointer to the audio thread.
+ *   dev - the device whose pipeline to change.
+ *   ext - the external dsp module to connect, or NULL to disconnect the
+ *       current one.
+ * Returns:
+ *    0 on success, negative if error.
+ */
+int audio_thread_dev_set_ext_dsp_module(struct audio_thread *thread,
+					struct cras_iodev *dev,
+					struct ext_dsp_module *ext);
 #endif /* AUDIO_THREAD_H_ */
@@ -0,0 +1,88 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <string.h>
+#include <sys/param.h>
+
+#include "buffer_watermark.h"
+#include "cras_util.h"
+
+/* Play cleanly for this long before shrinking the watermark. */
+#define WATERMARK_SHRINK_SEC 10
+/* Play cleanly for this long before lowering the floor. */
+#define WATERMARK_DECAY_SEC 300
+
+void buffer_watermark_init(struct buffer_watermark *wm, unsigned int level,
+			   unsigned int min_level, unsigned int max_level,
+			   unsigned int step)
+{
+	memset(wm, 0, sizeof(*wm));
+	wm->min_level = min_level;
+	wm->max_level = MAX(max_level, min_level);
+	wm->level = MIN(MAX(level, wm->min_level), wm->max_level);
+	wm->initial_level = level;
+	wm->floor = wm->min_level;
+	wm->step = MAX(step, 1);
+}
+
+/* Sets a new watermark and floor, and restarts the clean play timers. */
+static void raise_level(struct buffer_watermark *wm, unsigned int level,
+			unsigned int floor, const struct timespec *now)
+{
+	wm->floor = MIN(floor, wm->max_level);
+	wm->level = MIN(MAX(level, wm->floor), wm->max_level);
+	wm->last_shrink_ts = *now;
+	wm->last_decay_ts = *now;
+}
+
+int buffer_watermark_update(struct buffer_watermark *wm, unsigned int hw_level,
+			    const struct timespec *tstamp)
+{
+	struct timespec diff;
+	unsigned int old = wm->level;
+	unsigned int dec;
+
+	if (!timespec_is_nonzero(&wm->last_shrink_ts))
+		wm->last_shrink_ts = *tstamp;
+	if (!timespec_is_nonzero(&wm->last_decay_ts))
+		wm->last_decay_ts = *tstamp;
+
+	/* Nearly ran dry, step up before it becomes an underrun. */
+	if (hw_level < wm->step / 2) {
+		wm->num_near_misses++;
+		raise_level(wm, wm->level + wm->step, wm->level + wm->step,
+			    tstamp);
+		return wm->level != old;
+	}
+
+	subtract_timespecs(tstamp, &wm->last_decay_ts, &diff);
+	if (diff.tv_sec >= WATERMARK_DECAY_SEC) {
+		wm->floor -= wm->floor / 8;
+		wm->floor = MAX(wm->floor, wm->min_level);
+		wm->last_decay_ts = *tstamp;
+	}
+
+	subtract_timespecs(tstamp, &wm->last_shrink_ts, &diff);
+	if (diff.tv_sec >= WATERMARK_SHRINK_SEC) {
+		dec = MAX(wm->level / 8, wm->step);
+		if (wm->level > wm->floor + dec)
+			wm->level -= dec;
+		else
+			wm->level = wm->floor;
+		wm->level = MAX(wm->level, wm->min_level);
+		wm->last_shrink_ts = *tstamp;
+	}
+
+	return wm->level != old;
+}
+
+int buffer_watermark_underrun(struct buffer_watermark *wm,
+			      const struct timespec *now)
+{
+	unsigned int old = wm->level;
+
+	raise_level(wm, wm->level * 2, wm->level + wm->step, now);
+	return wm->level != old;
+}
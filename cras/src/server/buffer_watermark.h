@@ -0,0 +1,74 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Online controller for the number of frames a playback device keeps in its
+ * hardware buffer as a safety margin. The watermark grows quickly after an
+ * underrun or a near miss and shrinks slowly while the device plays
+ * cleanly. This finds the lowest latency a device can sustain without every
+ * board configuring it by hand.
+ */
+#ifndef BUFFER_WATERMARK_H_
+#define BUFFER_WATERMARK_H_
+
+#include <time.h>
+
+/* Members:
+ *    level - The current watermark in frames.
+ *    initial_level - The configured watermark the controller started from.
+ *    floor - level doesn't shrink below this. It's just above the level of
+ *        the last underrun or near miss and decays slowly.
+ *    min_level - Lower bound of level.
+ *    max_level - Upper bound of level.
+ *    step - Smallest change of level, in frames. A hardware level below
+ *        half of this counts as a near miss.
+ *    num_near_misses - Number of near misses since init.
+ *    last_shrink_ts - Time of the last raise or shrink of level.
+ *    last_decay_ts - Time of the last raise or decay of floor.
+ */
+struct buffer_watermark {
+	unsigned int level;
+	unsigned int initial_level;
+	unsigned int floor;
+	unsigned int min_level;
+	unsigned int max_level;
+	unsigned int step;
+	unsigned int num_near_misses;
+	struct timespec last_shrink_ts;
+	struct timespec last_decay_ts;
+};
+
+/* Initializes the controller.
+ * Args:
+ *    wm - The controller to initialize.
+ *    level - The configured watermark to start from.
+ *    min_level, max_level - Bounds of the watermark.
+ *    step - Smallest change of the watermark, in frames.
+ */
+void buffer_watermark_init(struct buffer_watermark *wm, unsigned int level,
+			   unsigned int min_level, unsigned int max_level,
+			   unsigned int step);
+
+/* Feeds the hardware level read from the device while it plays. Raises the
+ * watermark if the level was close to empty, otherwise lowers it if the
+ * device has played cleanly for long enough.
+ * Args:
+ *    wm - The controller.
+ *    hw_level - Frames in the hardware buffer.
+ *    tstamp - The time hw_level was read.
+ * Returns:
+ *    1 if the watermark changed, 0 otherwise.
+ */
+int buffer_watermark_update(struct buffer_watermark *wm, unsigned int hw_level,
+			    const struct timespec *tstamp);
+
+/* Raises the watermark after an underrun at time now.
+ * Returns:
+ *    1 if the watermark changed, 0 otherwise.
+ */
+int buffer_watermark_underrun(struct buffer_watermark *wm,
+			      const struct timespec *now);
+
+#endif /* BUFFER_WATERMARK_H_ */
@@ -0,0 +1,83 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "clock_domain.h"
+#include "cras_util.h"
+
+/* Gains of the PI controller, per second and per second squared. These
+ * give a critically damped loop with a time constant of about 20 seconds,
+ * slow enough that the rate changes are inaudible. */
+#define CLOCK_KP 0.1
+#define CLOCK_KI (CLOCK_KP * CLOCK_KP / 4)
+/* Time constant of the low pass filter on the phase error, it smooths out
+ * the granularity of the buffer levels. */
+#define CLOCK_SMOOTH_SEC 0.5
+/* The largest correction applied, as a fraction of the rate. */
+#define CLOCK_MAX_CORRECTION 0.001
+/* Phase errors bigger than this aren't drift, e.g. one of the devices
+ * underran. Restart the lock instead of slewing for minutes. */
+#define CLOCK_MAX_PHASE_ERR 0.05
+/* Measurements further apart than this restart the lock. */
+#define CLOCK_MAX_GAP_SEC 1.0
+/* Only update the streams when the correction moved by this much. */
+#define CLOCK_APPLY_THRESHOLD 0.000002
+
+void clock_slave_reset(struct clock_slave *slave, const void *master)
+{
+	memset(slave, 0, sizeof(*slave));
+	slave->master = master;
+}
+
+int clock_slave_update(struct clock_slave *slave, const void *master,
+		       double phase_err, const struct timespec *now)
+{
+	struct timespec diff;
+	double dt, alpha, c;
+	int was_applied;
+
+	if (slave->master != master ||
+	    fabs(phase_err) > CLOCK_MAX_PHASE_ERR) {
+		was_applied = slave->applied != 0;
+		clock_slave_reset(slave, master);
+		return was_applied;
+	}
+
+	if (!timespec_is_nonzero(&slave->last_ts) ||
+	    !timespec_after(now, &slave->last_ts)) {
+		slave->last_ts = *now;
+		slave->phase_err = phase_err;
+		return 0;
+	}
+	subtract_timespecs(now, &slave->last_ts, &diff);
+	slave->last_ts = *now;
+	dt = diff.tv_sec + diff.tv_nsec / 1000000000.0;
+	if (dt > CLOCK_MAX_GAP_SEC) {
+		slave->phase_err = phase_err;
+		slave->integral = 0;
+		return 0;
+	}
+
+	alpha = MIN(1.0, dt / CLOCK_SMOOTH_SEC);
+	slave->phase_err += alpha * (phase_err - slave->phase_err);
+
+	/* Clamp the integral so that it can't wind up past what the
+	 * correction can deliver. */
+	slave->integral += slave->phase_err * dt;
+	slave->integral = MIN(slave->integral,
+			      CLOCK_MAX_CORRECTION / CLOCK_KI);
+	slave->integral = MAX(slave->integral,
+			      -CLOCK_MAX_CORRECTION / CLOCK_KI);
+
+	c = CLOCK_KP * slave->phase_err + CLOCK_KI * slave->integral;
+	slave->correction = MAX(MIN(c, CLOCK_MAX_CORRECTION),
+				-CLOCK_MAX_CORRECTION);
+
+	return fabs(slave->correction - slave->applied) >=
+	       CLOCK_APPLY_THRESHOLD;
+}
@@ -0,0 +1,63 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Clock domain of the open output devices. One device is the master clock
+ * and every other device is a slave that is phase locked to it. The phase
+ * error of a slave, measured on a stream that both devices play, drives a
+ * PI controller. Its output is a fine rate correction that is applied to
+ * the resampling of every stream on the slave, on top of the rate ratio
+ * from the rate estimators. Without the phase term small errors in the
+ * estimated rates accumulate and the devices slowly drift apart.
+ */
+#ifndef CLOCK_DOMAIN_H_
+#define CLOCK_DOMAIN_H_
+
+#include <time.h>
+
+/* State of a slave device.
+ * Members:
+ *    master - The master device the slave is locked to. Changing master
+ *        restarts the lock.
+ *    last_ts - Time of the last phase measurement, zero if there is none.
+ *    phase_err - Low pass filtered phase error in seconds, positive when
+ *        the slave plays ahead of the master.
+ *    integral - Integral of the phase error.
+ *    correction - Rate correction to apply to the slave, as a fraction.
+ *    applied - The correction last applied to the streams.
+ */
+struct clock_slave {
+	const void *master;
+	struct timespec last_ts;
+	double phase_err;
+	double integral;
+	double correction;
+	double applied;
+};
+
+/* Restarts the phase lock of |slave| against |master|. */
+void clock_slave_reset(struct clock_slave *slave, const void *master);
+
+/* Feeds a new phase error measurement to the controller.
+ * Args:
+ *    slave - The slave device state.
+ *    master - The current master device.
+ *    phase_err - Seconds the slave plays ahead of the master.
+ *    now - The time of the measurement.
+ * Returns:
+ *    1 if the correction moved far enough from the applied one that the
+ *    streams need to be updated, otherwise 0. The caller marks it applied
+ *    with clock_slave_applied().
+ */
+int clock_slave_update(struct clock_slave *slave, const void *master,
+		       double phase_err, const struct timespec *now);
+
+/* Records that the current correction has been applied to the streams. */
+static inline void clock_slave_applied(struct clock_slave *slave)
+{
+	slave->applied = slave->correction;
+}
+
+#endif /* CLOCK_DOMAIN_H_ */
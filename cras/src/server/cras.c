@@ -135,6 +135,7 @@ int main(int argc, char **argv)
 		cras_system_state_set_internal_ucm_suffix(internal_ucm_suffix);
 	cras_dsp_init(dsp_config);
 	cras_apm_list_init(device_config_dir);
+	cras_apm_list_enable_offload();
 	cras_iodev_list_init();
 
 	/* Start the server. */
@@ -94,6 +94,12 @@ int a2dp_codesize(struct a2dp_info *a2dp)
 	return a2dp->codesize;
 }
 
+void a2dp_set_bitpool(struct a2dp_info *a2dp, unsigned int bitpool)
+{
+	cras_sbc_set_bitpool(a2dp->codec, bitpool);
+	a2dp->frame_length = cras_sbc_get_frame_length(a2dp->codec);
+}
+
 int a2dp_block_size(struct a2dp_info *a2dp, int a2dp_bytes)
 {
 	return a2dp_bytes / a2dp->frame_length * a2dp->codesize;
@@ -49,6 +49,11 @@ void destroy_a2dp(struct a2dp_info *a2dp);
  */
 int a2dp_codesize(struct a2dp_info *a2dp);
 
+/*
+ * Sets the SBC bitpool used for the following encoded frames.
+ */
+void a2dp_set_bitpool(struct a2dp_info *a2dp, unsigned int bitpool);
+
 /*
  * Gets original size of a2dp encoded bytes.
  */
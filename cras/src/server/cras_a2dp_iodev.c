@@ -12,6 +12,7 @@
 #include <syslog.h>
 #include <time.h>
 
+#include "a2dp_link_ctrl.h"
 #include "audio_thread.h"
 #include "audio_thread_log.h"
 #include "byte_buffer.h"
@@ -29,6 +30,11 @@
 
 #define PCM_BUF_MAX_SIZE_FRAMES (4096*4)
 #define PCM_BUF_MAX_SIZE_BYTES (PCM_BUF_MAX_SIZE_FRAMES * 4)
+/* Bounds of the socket send queue, in MTUs. */
+#define SOCK_DEPTH_MIN_MTUS 2
+#define SOCK_DEPTH_MAX_MTUS 6
+/* Lowest bitpool to adapt down to when the link is congested. */
+#define MIN_ADAPTIVE_BITPOOL 18
 
 /* Child of cras_iodev to handle bluetooth A2DP streaming.
  * Members:
@@ -43,6 +49,8 @@
  *        together with the device open timestamp to estimate how many virtual
  *        buffer is queued there.
  *    dev_open_time - The last time a2dp_ios is opened.
+ *    link_ctrl - Adapts the bitpool and socket depth to the link.
+ *    sndbuf - Size of the socket send buffer as set by the kernel.
  */
 struct a2dp_io {
 	struct cras_iodev base;
@@ -54,6 +62,8 @@ struct a2dp_io {
 	int pre_fill_complete;
 	uint64_t bt_written_frames;
 	struct timespec dev_open_time;
+	struct a2dp_link_ctrl link_ctrl;
+	int sndbuf;
 };
 
 static int flush_data(void *arg);
@@ -122,6 +132,53 @@ static int bt_queued_frames(const struct cras_iodev *iodev, int fr)
 }
 
 
+/* Sizes the socket send queue to hold |mtus| MTUs of data before returning
+ * EAGAIN, which throttles the writes when a reasonable amount of data is
+ * queued. */
+static void set_sock_depth(struct a2dp_io *a2dpio, unsigned int mtus)
+{
+	struct cras_iodev *iodev = &a2dpio->base;
+	size_t mtu = cras_bt_transport_write_mtu(a2dpio->transport);
+	int fd = cras_bt_transport_fd(a2dpio->transport);
+	int sock_depth = mtus * mtu;
+	socklen_t len = sizeof(a2dpio->sndbuf);
+
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sock_depth, sizeof(sock_depth));
+	if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &a2dpio->sndbuf, &len))
+		a2dpio->sndbuf = 0;
+
+	a2dpio->sock_depth_frames =
+		a2dp_block_size(&a2dpio->a2dp, mtu)
+			/ cras_get_format_bytes(iodev->format) * mtus;
+	iodev->min_buffer_level = a2dpio->sock_depth_frames;
+}
+
+/* Feeds the result of a socket write and the depth of the send queue to
+ * the link controller, and applies the bitpool and socket depth it picks.
+ */
+static void update_link(struct a2dp_io *a2dpio, int eagain)
+{
+	struct a2dp_link_ctrl *ctrl = &a2dpio->link_ctrl;
+	struct timespec now;
+	int space, outq = 0;
+
+	/* On bluetooth sockets SIOCOUTQ reports the free space left in the
+	 * send buffer rather than the bytes queued. */
+	if (ioctl(cras_bt_transport_fd(a2dpio->transport), SIOCOUTQ,
+		  &space) == 0)
+		outq = MAX(a2dpio->sndbuf - space, 0);
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	if (!a2dp_link_ctrl_update(ctrl, eagain, outq, a2dpio->sndbuf, &now))
+		return;
+
+	syslog(LOG_DEBUG, "A2DP link adapts to bitpool %u, queue %u bytes",
+	       ctrl->bitpool, ctrl->queue_target);
+	a2dp_set_bitpool(&a2dpio->a2dp, ctrl->bitpool);
+	set_sock_depth(a2dpio, ctrl->queue_target /
+			       cras_bt_transport_write_mtu(a2dpio->transport));
+}
+
 static int frames_queued(const struct cras_iodev *iodev,
 			 struct timespec *tstamp)
 {
@@ -139,7 +196,9 @@ static int frames_queued(const struct cras_iodev *iodev,
 static int configure_dev(struct cras_iodev *iodev)
 {
 	struct a2dp_io *a2dpio = (struct a2dp_io *)iodev;
-	int sock_depth;
+	a2dp_sbc_t a2dp;
+	size_t mtu;
+	int codesize;
 	int err;
 
 	err = cras_bt_transport_acquire(a2dpio->transport);
@@ -159,24 +218,31 @@ static int configure_dev(struct cras_iodev *iodev)
 	iodev->format->format = SND_PCM_FORMAT_S16_LE;
 	cras_iodev_init_audio_area(iodev, iodev->format->num_channels);
 
-	a2dpio->pcm_buf = byte_buffer_create(PCM_BUF_MAX_SIZE_BYTES);
+	/* Size the PCM buffer to whole SBC input blocks, so the encoder never
+	 * finds a partial block at the end of the buffer and every flush can
+	 * encode a full batch of blocks. */
+	codesize = a2dp_codesize(&a2dpio->a2dp);
+	a2dpio->pcm_buf = byte_buffer_create(
+			PCM_BUF_MAX_SIZE_BYTES / codesize * codesize);
 	if (!a2dpio->pcm_buf)
 		return -ENOMEM;
 
-	iodev->buffer_size = PCM_BUF_MAX_SIZE_FRAMES;
-
-	/* Set up the socket to hold two MTUs full of data before returning
-	 * EAGAIN.  This will allow the write to be throttled when a reasonable
-	 * amount of data is queued. */
-	sock_depth = 2 * cras_bt_transport_write_mtu(a2dpio->transport);
-	setsockopt(cras_bt_transport_fd(a2dpio->transport),
-		   SOL_SOCKET, SO_SNDBUF, &sock_depth, sizeof(sock_depth));
+	iodev->buffer_size = MIN(PCM_BUF_MAX_SIZE_FRAMES,
+				 a2dpio->pcm_buf->used_size /
+				 cras_get_format_bytes(iodev->format));
 
-	a2dpio->sock_depth_frames =
-		a2dp_block_size(&a2dpio->a2dp,
-				cras_bt_transport_write_mtu(a2dpio->transport))
-			/ cras_get_format_bytes(iodev->format) * 2;
-	iodev->min_buffer_level = a2dpio->sock_depth_frames;
+	/* Start at the negotiated quality with a shallow socket queue, the
+	 * link controller backs off from there if the link can't keep up. */
+	cras_bt_transport_configuration(a2dpio->transport, &a2dp,
+					sizeof(a2dp));
+	mtu = cras_bt_transport_write_mtu(a2dpio->transport);
+	a2dp_link_ctrl_init(&a2dpio->link_ctrl,
+			    MAX(a2dp.min_bitpool, MIN_ADAPTIVE_BITPOOL),
+			    a2dp.max_bitpool,
+			    SOCK_DEPTH_MIN_MTUS * mtu,
+			    SOCK_DEPTH_MAX_MTUS * mtu, mtu);
+	a2dp_set_bitpool(&a2dpio->a2dp, a2dpio->link_ctrl.bitpool);
+	set_sock_depth(a2dpio, SOCK_DEPTH_MIN_MTUS);
 
 	a2dpio->pre_fill_complete = 0;
 
@@ -307,6 +373,7 @@ encode_more:
 				    written,
 				    a2dp_queued_frames(&a2dpio->a2dp), 0);
 	if (written == -EAGAIN) {
+		update_link(a2dpio, 1);
 		/* If EAGAIN error lasts longer than 5 seconds, suspend the
 		 * a2dp connection. */
 		cras_bt_device_schedule_suspend(device, 5000);
@@ -324,6 +391,8 @@ encode_more:
 	/* Data succcessfully written to a2dp socket, cancel any scheduled
 	 * suspend timer. */
 	cras_bt_device_cancel_suspend(device);
+	if (written)
+		update_link(a2dpio, 0);
 
 	/* If it looks okay to write more and we do have queued data, try
 	 * encode more. But avoid the case when PCM buffer level is too close
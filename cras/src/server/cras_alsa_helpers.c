@@ -733,6 +733,30 @@ int cras_alsa_get_delay_frames(snd_pcm_t *handle, snd_pcm_uframes_t buf_size,
 	return 0;
 }
 
+int cras_alsa_get_delay_frames_tstamp(snd_pcm_t *handle,
+				      snd_pcm_uframes_t buf_size,
+				      snd_pcm_sframes_t *delay,
+				      struct timespec *tstamp)
+{
+	snd_pcm_status_t *status;
+	int rc;
+
+	/* The status reports the delay and the time stamp of the same
+	 * hardware pointer update. */
+	snd_pcm_status_alloca(&status);
+	rc = snd_pcm_status(handle, status);
+	if (rc < 0)
+		return rc;
+
+	snd_pcm_status_get_htstamp(status, tstamp);
+	*delay = snd_pcm_status_get_delay(status);
+	if (*delay > (snd_pcm_sframes_t)buf_size)
+		*delay = buf_size;
+	if (*delay < 0)
+		*delay = 0;
+	return 0;
+}
+
 /*
  * Attempts to resume a PCM.
  * Note that this path does not get executed for default playback/capture
@@ -788,6 +812,29 @@ int cras_alsa_mmap_get_whole_buffer(snd_pcm_t *handle, uint8_t **dst)
 	return cras_alsa_mmap_begin(handle, 0, dst, &offset, &frames);
 }
 
+int cras_alsa_mmap_begin_ring(snd_pcm_t *handle, snd_pcm_uframes_t *offset,
+			      snd_pcm_uframes_t *avail)
+{
+	snd_pcm_sframes_t frames;
+	snd_pcm_uframes_t contig = 1;
+	uint8_t *dst;
+	int rc;
+
+	/* Only the offset of appl_ptr matters here. mmap_begin doesn't sync
+	 * the hardware pointer, the frames it returns are computed from the
+	 * last sync and stop at the end of the ring. snd_pcm_avail_update()
+	 * below is what syncs the hardware pointer for avail. */
+	rc = cras_alsa_mmap_begin(handle, 0, &dst, offset, &contig);
+	if (rc < 0)
+		return rc;
+
+	frames = snd_pcm_avail_update(handle);
+	if (frames < 0)
+		return frames;
+	*avail = frames;
+	return 0;
+}
+
 int cras_alsa_mmap_begin(snd_pcm_t *handle, unsigned int format_bytes,
 			 uint8_t **dst, snd_pcm_uframes_t *offset,
 			 snd_pcm_uframes_t *frames)
@@ -182,6 +182,22 @@ int cras_alsa_get_avail_frames(snd_pcm_t *handle, snd_pcm_uframes_t buf_size,
 int cras_alsa_get_delay_frames(snd_pcm_t *handle, snd_pcm_uframes_t buf_size,
 			       snd_pcm_sframes_t *delay);
 
+/* Get the current alsa delay together with the htimestamp of the hardware
+ * pointer it was computed from. The delay is capped like in
+ * cras_alsa_get_delay_frames.
+ * Args:
+ *    handle - The open PCM to configure.
+ *    buf_size - Number of frames in the ALSA buffer.
+ *    delay - Filled with the number of delay frames.
+ *    tstamp - Filled with the htimestamp of the delay.
+ * Returns:
+ *    0 on success, negative error on failure.
+ */
+int cras_alsa_get_delay_frames_tstamp(snd_pcm_t *handle,
+				      snd_pcm_uframes_t buf_size,
+				      snd_pcm_sframes_t *delay,
+				      struct timespec *tstamp);
+
 /* Wrapper for snd_pcm_mmap_begin where only buffer is concerned.
  * Offset and frames from cras_alsa_mmap_begin are neglected.
  * Args:
@@ -192,6 +208,20 @@ int cras_alsa_get_delay_frames(snd_pcm_t *handle, snd_pcm_uframes_t buf_size,
  */
 int cras_alsa_mmap_get_whole_buffer(snd_pcm_t *handle, uint8_t **dst);
 
+/* Starts writing a round of frames to the whole mmapped ring. Gets where
+ * appl_ptr is in the ring and how many frames can be written from there,
+ * including the part that wraps to the start of the ring.
+ * Args:
+ *    handle - The open PCM to configure.
+ *    offset - Filled with the offset of appl_ptr in the ring, to pass back
+ *        to commit.
+ *    avail - Filled with the number of frames that can be written.
+ * Returns:
+ *    zero on success, negative error code for fatal errors.
+ */
+int cras_alsa_mmap_begin_ring(snd_pcm_t *handle, snd_pcm_uframes_t *offset,
+			      snd_pcm_uframes_t *avail);
+
 /* Wrapper for snd_pcm_mmap_begin
  * Args:
  *    handle - The open PCM to configure.
@@ -34,6 +34,7 @@
 #include "cras_types.h"
 #include "cras_util.h"
 #include "cras_volume_curve.h"
+#include "hw_ptr_model.h"
 #include "sfh.h"
 #include "softvol_curve.h"
 #include "utlist.h"
@@ -126,6 +127,19 @@ struct alsa_input_node {
  * severe_underrun_frames - The threshold for severe underrun.
  * default_volume_curve - Default volume curve that converts from an index
  *                        to dBFS.
+ * timer_sched - True when playback is scheduled from hw_model. It only
+ *               takes effect when enable_htimestamp is also set.
+ * hw_model - Model of the hardware pointer, used when timer_sched is set.
+ * batch_mmap - True to write each round of playback straight into the
+ *              mmapped ring and commit it once, instead of one mmap
+ *              begin/commit pair for each contiguous region.
+ * ring - Start of the mmapped ring, used when batch_mmap is set.
+ * batch_open - True while a round of batched writes is uncommitted.
+ * batch_offset - Offset in the ring of appl_ptr when the round began.
+ * batch_avail - Frames that can be written in the round.
+ * batch_pending - Frames written in the round so far.
+ * num_hw_calls - Number of ALSA calls that may enter the kernel since the
+ *                device was configured.
  */
 struct alsa_io {
 	struct cras_iodev base;
@@ -155,6 +169,15 @@ struct alsa_io {
 	snd_pcm_uframes_t severe_underrun_frames;
 	struct cras_volume_curve *default_volume_curve;
 	int hwparams_set;
+	int timer_sched;
+	struct hw_ptr_model hw_model;
+	int batch_mmap;
+	uint8_t *ring;
+	int batch_open;
+	snd_pcm_uframes_t batch_offset;
+	snd_pcm_uframes_t batch_avail;
+	snd_pcm_uframes_t batch_pending;
+	unsigned int num_hw_calls;
 };
 
 static void init_device_settings(struct alsa_io *aio);
@@ -273,6 +296,35 @@ static int set_hwparams(struct cras_iodev *iodev)
 	return 0;
 }
 
+/*
+ * Returns true if the buffer level of the device is taken from hw_model
+ * when it can be predicted.
+ */
+static int uses_hw_model(const struct alsa_io *aio)
+{
+	return aio->timer_sched && aio->enable_htimestamp &&
+	       aio->base.direction == CRAS_STREAM_OUTPUT;
+}
+
+/*
+ * Commits the round of batched writes, if there is one open. Operations
+ * that look at the device pointers call this first, in case the round was
+ * left open by an error.
+ */
+static int commit_batch(struct alsa_io *aio)
+{
+	snd_pcm_uframes_t pending = aio->batch_pending;
+
+	if (!aio->batch_open)
+		return 0;
+	aio->batch_open = 0;
+	aio->batch_pending = 0;
+	if (!pending)
+		return 0;
+	aio->num_hw_calls++;
+	return cras_alsa_mmap_commit(aio->handle, aio->batch_offset, pending);
+}
+
 /*
  * iodev callbacks.
  */
@@ -283,7 +335,33 @@ static int frames_queued(const struct cras_iodev *iodev,
 	struct alsa_io *aio = (struct alsa_io *)iodev;
 	int rc;
 	snd_pcm_uframes_t frames;
+	unsigned int level;
+	struct timespec now;
+
+	rc = commit_batch(aio);
+	if (rc < 0)
+		return rc;
+
+	if (uses_hw_model(aio)) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+		rc = hw_ptr_model_predict(
+				&aio->hw_model,
+				iodev->format->frame_rate *
+					cras_iodev_get_est_rate_ratio(iodev),
+				&now,
+				iodev->min_buffer_level +
+					iodev->format->frame_rate / 1000,
+				&level);
+		if (rc == 0) {
+			/* Not a new measurement of the device, keep it out
+			 * of the rate estimation. */
+			tstamp->tv_sec = 0;
+			tstamp->tv_nsec = 0;
+			return MIN(level, iodev->buffer_size);
+		}
+	}
 
+	aio->num_hw_calls++;
 	rc = cras_alsa_get_avail_frames(aio->handle,
 					aio->base.buffer_size,
 					aio->severe_underrun_frames,
@@ -300,7 +378,10 @@ static int frames_queued(const struct cras_iodev *iodev,
 		return (int)frames;
 
 	/* For output, return number of frames that are used. */
-	return iodev->buffer_size - frames;
+	level = iodev->buffer_size - frames;
+	if (uses_hw_model(aio) && timespec_is_nonzero(tstamp))
+		hw_ptr_model_update(&aio->hw_model, level, tstamp);
+	return level;
 }
 
 static int delay_frames(const struct cras_iodev *iodev)
@@ -309,6 +390,11 @@ static int delay_frames(const struct cras_iodev *iodev)
 	snd_pcm_sframes_t delay;
 	int rc;
 
+	rc = commit_batch(aio);
+	if (rc < 0)
+		return rc;
+
+	aio->num_hw_calls++;
 	rc = cras_alsa_get_delay_frames(aio->handle,
 					iodev->buffer_size,
 					&delay);
@@ -318,6 +404,27 @@ static int delay_frames(const struct cras_iodev *iodev)
 	return (int)delay;
 }
 
+static int delay_frames_tstamp(const struct cras_iodev *iodev,
+			       struct timespec *tstamp)
+{
+	struct alsa_io *aio = (struct alsa_io *)iodev;
+	snd_pcm_sframes_t delay;
+	int rc;
+
+	rc = commit_batch(aio);
+	if (rc < 0)
+		return rc;
+
+	aio->num_hw_calls++;
+	rc = cras_alsa_get_delay_frames_tstamp(aio->handle,
+					       iodev->buffer_size,
+					       &delay, tstamp);
+	if (rc < 0)
+		return rc;
+
+	return (int)delay;
+}
+
 static int close_dev(struct cras_iodev *iodev)
 {
 	struct alsa_io *aio = (struct alsa_io *)iodev;
@@ -329,6 +436,8 @@ static int close_dev(struct cras_iodev *iodev)
 				aio->poll_fd);
 	if (!aio->handle)
 		return 0;
+	commit_batch(aio);
+	aio->ring = NULL;
 	cras_alsa_pcm_close(aio->handle);
 	aio->handle = NULL;
 	aio->is_free_running = 0;
@@ -405,6 +514,9 @@ static int configure_dev(struct cras_iodev *iodev)
 	if (rc < 0)
 		return rc;
 
+	hw_ptr_model_invalidate(&aio->hw_model);
+	aio->num_hw_calls = 0;
+
 	/* Initialize device settings. */
 	init_device_settings(aio);
 
@@ -494,6 +606,45 @@ static int start(const struct cras_iodev *iodev)
 	return 0;
 }
 
+/*
+ * Gets the next region of the round of batched writes. The first call of a
+ * round syncs the pointers once, later ones continue from the previous
+ * region and wrap at the end of the ring.
+ */
+static int get_batch_buffer(struct alsa_io *aio, size_t format_bytes,
+			    uint8_t **dst, snd_pcm_uframes_t *frames)
+{
+	snd_pcm_uframes_t buffer_size = aio->base.buffer_size;
+	snd_pcm_uframes_t pos;
+	int rc;
+
+	if (!aio->ring) {
+		rc = cras_alsa_mmap_get_whole_buffer(aio->handle, &aio->ring);
+		if (rc < 0)
+			return rc;
+	}
+
+	if (!aio->batch_open) {
+		aio->num_hw_calls++;
+		rc = cras_alsa_mmap_begin_ring(aio->handle, &aio->batch_offset,
+					       &aio->batch_avail);
+		if (rc < 0)
+			return rc;
+		aio->batch_avail = MIN(aio->batch_avail, buffer_size);
+		aio->batch_pending = 0;
+		aio->batch_open = 1;
+	}
+
+	pos = (aio->batch_offset + aio->batch_pending) % buffer_size;
+	*frames = MIN(*frames, buffer_size - pos);
+	*frames = MIN(*frames, aio->batch_avail - aio->batch_pending);
+	/* Like mmap_begin, no room in the ring for playback is an error. */
+	if (*frames == 0)
+		return -EIO;
+	*dst = aio->ring + pos * format_bytes;
+	return 0;
+}
+
 static int get_buffer(struct cras_iodev *iodev,
 		      struct cras_audio_area **area,
 		      unsigned *frames)
@@ -507,12 +658,21 @@ static int get_buffer(struct cras_iodev *iodev,
 	aio->mmap_offset = 0;
 	format_bytes = cras_get_format_bytes(iodev->format);
 
+	if (aio->batch_mmap && iodev->direction == CRAS_STREAM_OUTPUT) {
+		rc = get_batch_buffer(aio, format_bytes, &dst, &nframes);
+		if (rc < 0)
+			nframes = 0;
+		goto out;
+	}
+
+	aio->num_hw_calls++;
 	rc = cras_alsa_mmap_begin(aio->handle,
 				  format_bytes,
 				  &dst,
 				  &aio->mmap_offset,
 				  &nframes);
 
+out:
 	iodev->area->frames = nframes;
 	cras_audio_area_config_buf_pointers(iodev->area, iodev->format, dst);
 
@@ -526,11 +686,25 @@ static int put_buffer(struct cras_iodev *iodev, unsigned nwritten)
 {
 	struct alsa_io *aio = (struct alsa_io *)iodev;
 
+	if (uses_hw_model(aio))
+		hw_ptr_model_add_frames(&aio->hw_model, nwritten);
+
+	if (aio->batch_open) {
+		aio->batch_pending += nwritten;
+		return 0;
+	}
+
+	aio->num_hw_calls++;
 	return cras_alsa_mmap_commit(aio->handle,
 				     aio->mmap_offset,
 				     nwritten);
 }
 
+static int commit_buffer(struct cras_iodev *iodev)
+{
+	return commit_batch((struct alsa_io *)iodev);
+}
+
 static int flush_buffer(struct cras_iodev *iodev)
 {
 	struct alsa_io *aio = (struct alsa_io *)iodev;
@@ -1741,6 +1915,7 @@ static int adjust_appl_ptr(struct cras_iodev *odev)
 	/* Move appl_ptr to min_buffer_level + min_cb_level frames ahead of
 	 * hw_ptr when resuming from free run or adjusting appl_ptr from
 	 * underrun. */
+	hw_ptr_model_invalidate(&aio->hw_model);
 	return cras_alsa_resume_appl_ptr(
 			aio->handle,
 			odev->min_buffer_level + odev->min_cb_level);
@@ -1784,6 +1959,7 @@ static int adjust_appl_ptr_samples_remaining(struct cras_iodev *odev)
 		if (rc)
 			return rc;
 	}
+	hw_ptr_model_invalidate(&aio->hw_model);
 	return cras_alsa_resume_appl_ptr(aio->handle, offset);
 }
 
@@ -1795,6 +1971,11 @@ static int alsa_output_underrun(struct cras_iodev *odev)
 	/* Update number of underruns we got. */
 	aio->num_underruns++;
 
+	/* The round is lost anyway, but keep appl_ptr consistent. */
+	rc = commit_batch(aio);
+	if (rc < 0)
+		return rc;
+
 	/* Fill whole buffer with zeros. This avoids samples left in buffer causing
 	 * noise when device plays them. */
 	rc = fill_whole_buffer_with_zeros(odev);
@@ -1881,6 +2062,12 @@ static int leave_free_run(struct cras_iodev *odev)
  */
 static int no_stream(struct cras_iodev *odev, int enable)
 {
+	int rc;
+
+	rc = commit_batch((struct alsa_io *)odev);
+	if (rc < 0)
+		return rc;
+
 	if (enable)
 		return possibly_enter_free_run(odev);
 	else
@@ -1899,6 +2086,12 @@ static int output_should_wake(const struct cras_iodev *odev)
 					CRAS_IODEV_STATE_NORMAL_RUN));
 }
 
+static unsigned int get_num_hw_calls(const struct cras_iodev *iodev)
+{
+	const struct alsa_io *aio = (const struct alsa_io *)iodev;
+	return aio->num_hw_calls;
+}
+
 static unsigned int get_num_underruns(const struct cras_iodev *iodev)
 {
 	const struct alsa_io *aio = (const struct alsa_io *)iodev;
@@ -2001,6 +2194,7 @@ struct cras_iodev *alsa_iodev_create(size_t card_index,
 	iodev->delay_frames = delay_frames;
 	iodev->get_buffer = get_buffer;
 	iodev->put_buffer = put_buffer;
+	iodev->commit_buffer = commit_buffer;
 	iodev->flush_buffer = flush_buffer;
 	iodev->start = start;
 	iodev->update_active_node = update_active_node;
@@ -2011,6 +2205,7 @@ struct cras_iodev *alsa_iodev_create(size_t card_index,
 	iodev->output_should_wake = output_should_wake;
 	iodev->get_num_underruns = get_num_underruns;
 	iodev->get_num_severe_underruns = get_num_severe_underruns;
+	iodev->get_num_hw_calls = get_num_hw_calls;
 	iodev->set_swap_mode_for_node = cras_iodev_dsp_set_swap_mode_for_node;
 
 	if (card_type == ALSA_CARD_TYPE_USB)
@@ -2049,6 +2244,24 @@ struct cras_iodev *alsa_iodev_create(size_t card_index,
 
 		aio->enable_htimestamp =
 			ucm_get_enable_htimestamp_flag(ucm);
+		/* Stream time stamps come from the delay of the hardware
+		 * pointer at its htimestamp instead of at the time of the
+		 * call. */
+		if (aio->enable_htimestamp)
+			iodev->delay_frames_tstamp = delay_frames_tstamp;
+		if (ucm_get_kalman_rate_estimator_flag(ucm))
+			iodev->rate_est_type = RATE_ESTIMATOR_KALMAN;
+		/* The model runs the buffer close to the watermark, so the
+		 * watermark has to follow the underruns. */
+		aio->timer_sched = ucm_get_timer_scheduling_flag(ucm);
+		if (direction == CRAS_STREAM_OUTPUT &&
+		    (aio->timer_sched ||
+		     ucm_get_adaptive_watermark_flag(ucm)))
+			iodev->adaptive_watermark = 1;
+		aio->batch_mmap = ucm_get_batched_mmap_flag(ucm);
+		if (direction == CRAS_STREAM_OUTPUT)
+			iodev->allow_deep_buffer =
+				ucm_get_deep_buffer_flag(ucm);
 	}
 
 	set_iodev_name(iodev, card_name, dev_name, card_index, device_index,
@@ -55,6 +55,11 @@ static const char hotword_model_prefix[] = "Hotword Model";
 static const char fully_specified_ucm_var[] = "FullySpecifiedUCM";
 static const char main_volume_names[] = "MainVolumeNames";
 static const char enable_htimestamp_var[] = "EnableHtimestamp";
+static const char kalman_rate_estimator_var[] = "KalmanRateEstimator";
+static const char timer_scheduling_var[] = "TimerScheduling";
+static const char adaptive_watermark_var[] = "AdaptiveWatermark";
+static const char batched_mmap_var[] = "BatchedMmap";
+static const char deep_buffer_var[] = "DeepBuffer";
 
 /* Use case verbs corresponding to CRAS_STREAM_TYPE. */
 static const char *use_case_verbs[] = {
@@ -1117,3 +1122,63 @@ unsigned int ucm_get_enable_htimestamp_flag(struct cras_use_case_mgr *mgr)
 	free(flag);
 	return ret;
 }
+
+unsigned int ucm_get_kalman_rate_estimator_flag(struct cras_use_case_mgr *mgr)
+{
+	char *flag;
+	int ret = 0;
+	flag = ucm_get_flag(mgr, kalman_rate_estimator_var);
+	if (!flag)
+		return 0;
+	ret = !strcmp(flag, "1");
+	free(flag);
+	return ret;
+}
+
+unsigned int ucm_get_timer_scheduling_flag(struct cras_use_case_mgr *mgr)
+{
+	char *flag;
+	int ret = 0;
+	flag = ucm_get_flag(mgr, timer_scheduling_var);
+	if (!flag)
+		return 0;
+	ret = !strcmp(flag, "1");
+	free(flag);
+	return ret;
+}
+
+unsigned int ucm_get_adaptive_watermark_flag(struct cras_use_case_mgr *mgr)
+{
+	char *flag;
+	int ret = 0;
+	flag = ucm_get_flag(mgr, adaptive_watermark_var);
+	if (!flag)
+		return 0;
+	ret = !strcmp(flag, "1");
+	free(flag);
+	return ret;
+}
+
+unsigned int ucm_get_batched_mmap_flag(struct cras_use_case_mgr *mgr)
+{
+	char *flag;
+	int ret = 0;
+	flag = ucm_get_flag(mgr, batched_mmap_var);
+	if (!flag)
+		return 0;
+	ret = !strcmp(flag, "1");
+	free(flag);
+	return ret;
+}
+
+unsigned int ucm_get_deep_buffer_flag(struct cras_use_case_mgr *mgr)
+{
+	char *flag;
+	int ret = 0;
+	flag = ucm_get_flag(mgr, deep_buffer_var);
+	if (!flag)
+		return 0;
+	ret = !strcmp(flag, "1");
+	free(flag);
+	return ret;
+}
@@ -466,4 +466,48 @@ unsigned int ucm_get_optimize_no_stream_flag(struct cras_use_case_mgr *mgr);
  */
 unsigned int ucm_get_enable_htimestamp_flag(struct cras_use_case_mgr *mgr);
 
+/* Retrieve the flag that selects the Kalman filter rate estimator.
+ * Args:
+ *    mgr - The cras_use_case_mgr pointer returned from alsa_ucm_create.
+ * Returns:
+ *    1 if the flag is enabled. 0 otherwise.
+ */
+unsigned int ucm_get_kalman_rate_estimator_flag(struct cras_use_case_mgr *mgr);
+
+/* Retrieve the flag that schedules playback from a model of the hardware
+ * pointer. It only takes effect when htimestamp is enabled.
+ * Args:
+ *    mgr - The cras_use_case_mgr pointer returned from alsa_ucm_create.
+ * Returns:
+ *    1 if the flag is enabled. 0 otherwise.
+ */
+unsigned int ucm_get_timer_scheduling_flag(struct cras_use_case_mgr *mgr);
+
+/* Retrieve the flag that lets the playback buffer level adapt to the
+ * underruns of the device instead of staying at MinBufferLevel.
+ * Args:
+ *    mgr - The cras_use_case_mgr pointer returned from alsa_ucm_create.
+ * Returns:
+ *    1 if the flag is enabled. 0 otherwise.
+ */
+unsigned int ucm_get_adaptive_watermark_flag(struct cras_use_case_mgr *mgr);
+
+/* Retrieve the flag that writes each round of playback straight into the
+ * mmapped ring and commits it once.
+ * Args:
+ *    mgr - The cras_use_case_mgr pointer returned from alsa_ucm_create.
+ * Returns:
+ *    1 if the flag is enabled. 0 otherwise.
+ */
+unsigned int ucm_get_batched_mmap_flag(struct cras_use_case_mgr *mgr);
+
+/* Retrieve the flag that lets media streams play in large chunks with few
+ * wake ups while no latency sensitive stream plays on the device.
+ * Args:
+ *    mgr - The cras_use_case_mgr pointer returned from alsa_ucm_create.
+ * Returns:
+ *    1 if the flag is enabled. 0 otherwise.
+ */
+unsigned int ucm_get_deep_buffer_flag(struct cras_use_case_mgr *mgr);
+
 #endif /* _CRAS_ALSA_UCM_H */
@@ -3,6 +3,8 @@
  * found in the LICENSE file.
  */
 
+#include <pthread.h>
+#include <semaphore.h>
 #include <string.h>
 #include <syslog.h>
 
@@ -14,18 +16,40 @@
 #include "cras_apm_list.h"
 #include "cras_audio_area.h"
 #include "cras_audio_format.h"
+#include "cras_config.h"
 #include "cras_dsp_pipeline.h"
 #include "cras_iodev.h"
 #include "cras_iodev_list.h"
+#include "cras_util.h"
 #include "dsp_util.h"
 #include "dumper.h"
 #include "float_buffer.h"
 #include "utlist.h"
 
+/*
+ * Number of processed 10ms blocks an APM instance keeps when processing is
+ * offloaded to the worker thread. The worker processes one block while the
+ * streams read the other, so offloading holds at most one block more than
+ * processing inline.
+ */
+#define APM_NUM_BLOCKS 2
+
+/*
+ * A 10ms block of capture data processed by APM.
+ * Members:
+ *    fbuf - The deinterleaved input from device for APM to process.
+ *    buf - The processed/interleaved data ready for streams to read.
+ */
+struct cras_apm_block {
+	struct float_buffer *fbuf;
+	struct byte_buffer *buf;
+};
 
 /*
  * Structure holding a WebRTC audio processing module and necessary
- * info to process and transfer input buffer from device to stream.
+ * info to process and transfer input buffer from device to streams.
+ * Streams capturing from the same device with the same effects share one
+ * instance, and each reads the processed blocks at its own pace.
  *
  * Below chart describes the buffer structure inside APM and how an input buffer
  * flows from a device through the APM to stream. APM processes audio buffers in
@@ -35,13 +59,13 @@
  * (2) to store the interleaved buffer, of 10ms size also, after APM processing.
  *
  *  ________   _______     _______________________________
- *  |      |   |     |     |_____________APM ____________|
- *  |input |-> | DSP |---> ||           |    |          || -> stream 1
- *  |device|   |     | |   || float buf | -> | byte buf ||
+ *  |      |   |     |     |_____________APM ____________|    -> stream 1
+ *  |input |-> | DSP |---> ||           |    |          || --|
+ *  |device|   |     | |   || float buf | -> | byte buf ||    -> stream 2
  *  |______|   |_____| |   ||___________|    |__________||
  *                     |   |_____________________________|
  *                     |   _______________________________
- *                     |-> |             APM 2           | -> stream 2
+ *                     |-> |             APM 2           | -> stream 3
  *                     |   |_____________________________|
  *                     |                                       ...
  *                     |
@@ -50,25 +74,89 @@
  * Members:
  *    apm_ptr - An APM instance from libwebrtc_audio_processing
  *    dev_ptr - Pointer to the device this APM is associated with.
- *    buffer - Stores the processed/interleaved data ready for stream to read.
+ *    effects - Bit map of the effects this APM applies.
  *    fbuffer - Stores the floating pointer buffer from input device waiting
  *        for APM to process.
  *    dev_fmt - The format used by the iodev this APM attaches to.
  *    fmt - The audio data format configured for this APM.
- *    area - The cras_audio_area used for copying processed data to client
- *        stream.
+ *    channel_map - Index of the device channel each APM channel reads
+ *        from, -1 if there's none.
+ *    in_place - Set if APM can process the device's float buffer in place,
+ *        because no other APM reads it and |channel_map| maps each APM
+ *        channel to the device channel of the same index.
  *    work_queue - A task queue instance created and destroyed by
  *        libwebrtc_apm.
+ *    blocks - Ring of processed blocks. A full |fbuffer| is swapped into a
+ *        block once every stream has read that block.
+ *    num_blocks - Number of blocks in use, one when processing inline and
+ *        APM_NUM_BLOCKS when offloaded to the worker thread.
+ *    offload - Set if the worker thread processes this APM.
+ *    taken - Count of frames taken from the input device.
+ *    submitted - Count of blocks filled by the audio thread.
+ *    processed - Count of blocks processed.
+ *    users - Links to the cras_apm of each stream reading from this
+ *        instance. Only changed and walked on the audio thread.
+ *    num_users - Number of cras_apm sharing this instance, counted by the
+ *        main thread which creates and destroys them.
  */
-struct cras_apm {
+struct cras_apm_instance {
 	webrtc_apm apm_ptr;
 	void *dev_ptr;
-	struct byte_buffer *buffer;
+	uint64_t effects;
 	struct float_buffer *fbuffer;
 	struct cras_audio_format dev_fmt;
 	struct cras_audio_format fmt;
-	struct cras_audio_area *area;
+	int8_t channel_map[CRAS_CH_MAX];
+	int in_place;
 	void *work_queue;
+	struct cras_apm_block blocks[APM_NUM_BLOCKS];
+	unsigned int num_blocks;
+	int offload;
+	unsigned int taken;
+	unsigned int submitted;
+	unsigned int processed;
+	struct cras_apm_user *users;
+	unsigned int num_users;
+	struct cras_apm_instance *prev, *next;
+};
+
+/* Link of a cras_apm in the user list of its instance. The cras_apm itself
+ * is linked in the cras_apm_list of its stream. */
+struct cras_apm_user {
+	struct cras_apm *apm;
+	struct cras_apm_user *prev, *next;
+};
+
+/*
+ * A stream's handle to the APM instance processing its input from one
+ * device.
+ * Members:
+ *    inst - The APM instance, possibly shared with other streams.
+ *    dev_ptr - Pointer to the device this APM is associated with.
+ *    area - The cras_audio_area used for copying processed data to client
+ *        stream.
+ *    taken - Count of frames this stream has passed to |inst|, behind
+ *        inst->taken when another stream sharing |inst| went first.
+ *    consumed - Count of blocks fully read by the stream.
+ *    offset - Frames read by the stream in the block it is reading.
+ *    failed - Set by the audio thread when processing fails. The stream
+ *        then reads unprocessed input until it leaves the device, when
+ *        the main thread removes this APM.
+ *    joined - Set while |user| is linked in the user list of |inst|, from
+ *        when the audio thread adds the stream to the device until it
+ *        removes it.
+ *    user - Link in the user list of |inst|.
+ */
+struct cras_apm {
+	struct cras_apm_instance *inst;
+	void *dev_ptr;
+	struct cras_audio_area *area;
+	unsigned int taken;
+	unsigned int consumed;
+	unsigned int offset;
+	int failed;
+	int joined;
+	struct cras_apm_user user;
 	struct cras_apm *prev, *next;
 };
 
@@ -98,6 +186,9 @@ struct cras_apm_list {
  *    dev_rate - The sample rate odev is opened for.
  *    process_reverse - Flag to indicate if there's APM has effect that
  *        needs to process reverse stream.
+ *    blocks - Ring of reverse data blocks queued for the worker thread.
+ *    submitted - Count of blocks filled by the audio thread.
+ *    processed - Count of blocks analyzed by the worker thread.
  */
 struct cras_apm_reverse_module {
 	struct ext_dsp_module ext;
@@ -105,13 +196,52 @@ struct cras_apm_reverse_module {
 	struct cras_iodev *odev;
 	unsigned int dev_rate;
 	unsigned process_reverse;
+	struct float_buffer *blocks[APM_NUM_BLOCKS];
+	unsigned int submitted;
+	unsigned int processed;
+};
+
+/*
+ * Thread running APM processing off the audio thread. The audio thread
+ * never blocks on it: blocks are passed through the single producer, single
+ * consumer counters in cras_apm_instance and cras_apm_reverse_module.
+ * Members:
+ *    tid - The worker thread.
+ *    wake - Posted by the audio thread each time it submits a block.
+ *    lock - Held by the worker while processing, and by the main thread
+ *        while APM instances are added or removed.
+ *    running - Cleared to ask the worker thread to exit.
+ */
+struct cras_apm_worker {
+	pthread_t tid;
+	sem_t wake;
+	pthread_mutex_t lock;
+	int running;
 };
 
 static struct cras_apm_reverse_module *rmodule = NULL;
 static struct cras_apm_list *apm_list = NULL;
+static struct cras_apm_instance *instances = NULL;
+static unsigned int num_instances = 0;
 static struct aec_config *aec_config = NULL;
 static struct apm_config *apm_config = NULL;
 static const char *aec_config_dir = NULL;
+static struct cras_apm_worker *worker = NULL;
+static int offload_enabled = 0;
+
+static int start_worker();
+
+static void worker_lock()
+{
+	if (worker)
+		pthread_mutex_lock(&worker->lock);
+}
+
+static void worker_unlock()
+{
+	if (worker)
+		pthread_mutex_unlock(&worker->lock);
+}
 
 /* Update the global process reverse flag. Should be called when apms are added
  * or removed. */
@@ -128,16 +258,70 @@ static void update_process_reverse_flag()
 	}
 }
 
+static void instance_destroy(struct cras_apm_instance **inst)
+{
+	unsigned int i;
+
+	if (*inst == NULL)
+		return;
+	float_buffer_destroy(&(*inst)->fbuffer);
+	for (i = 0; i < (*inst)->num_blocks; i++) {
+		byte_buffer_destroy(&(*inst)->blocks[i].buf);
+		float_buffer_destroy(&(*inst)->blocks[i].fbuf);
+	}
+
+	/* Any unfinished AEC dump handle will be closed. */
+	webrtc_apm_destroy((*inst)->apm_ptr);
+	free(*inst);
+	*inst = NULL;
+}
+
+/* Re-evaluates which instances on |dev_ptr| may process the device's float
+ * buffer in place. Should be called when instances are added or removed. */
+static void update_in_place(void *dev_ptr)
+{
+	struct cras_apm_instance *inst;
+	unsigned int count = 0;
+	int i, identity;
+
+	DL_FOREACH(instances, inst)
+		count += (inst->dev_ptr == dev_ptr);
+
+	DL_FOREACH(instances, inst) {
+		if (inst->dev_ptr != dev_ptr)
+			continue;
+		identity = 1;
+		for (i = 0; i < inst->fmt.num_channels; i++)
+			identity &= (inst->channel_map[i] == i);
+		inst->in_place = !inst->offload && count == 1 && identity;
+	}
+}
+
+/* Detaches |apm| from its instance, destroying the instance once no stream
+ * uses it. Called with the worker lock held, after the stream has left the
+ * device on the audio thread. */
 static void apm_destroy(struct cras_apm **apm)
 {
+	struct cras_apm_instance *inst;
+	void *dev_ptr;
+
 	if (*apm == NULL)
 		return;
-	byte_buffer_destroy(&(*apm)->buffer);
-	float_buffer_destroy(&(*apm)->fbuffer);
-	cras_audio_area_destroy((*apm)->area);
 
-	/* Any unfinished AEC dump handle will be closed. */
-	webrtc_apm_destroy((*apm)->apm_ptr);
+	inst = (*apm)->inst;
+	if ((*apm)->joined) {
+		syslog(LOG_WARNING, "APM destroyed before leaving its instance");
+		DL_DELETE(inst->users, &(*apm)->user);
+	}
+	if (--inst->num_users == 0) {
+		dev_ptr = inst->dev_ptr;
+		DL_DELETE(instances, inst);
+		num_instances--;
+		instance_destroy(&inst);
+		update_in_place(dev_ptr);
+	}
+
+	cras_audio_area_destroy((*apm)->area);
 	free(*apm);
 	*apm = NULL;
 }
@@ -158,7 +342,9 @@ struct cras_apm_list *cras_apm_list_create(void *stream_ptr,
 	list->stream_ptr = stream_ptr;
 	list->effects = effects;
 	list->apms = NULL;
+	worker_lock();
 	DL_APPEND(apm_list, list);
+	worker_unlock();
 
 	return list;
 }
@@ -172,7 +358,7 @@ struct cras_apm *cras_apm_list_get(struct cras_apm_list *list, void *dev_ptr)
 
 	DL_FOREACH(list->apms, apm) {
 		if (apm->dev_ptr == dev_ptr)
-			return apm;
+			return apm->failed ? NULL : apm;
 	}
 	return NULL;
 }
@@ -189,12 +375,14 @@ void cras_apm_list_remove(struct cras_apm_list *list, void *dev_ptr)
 {
 	struct cras_apm *apm;
 
+	worker_lock();
 	DL_FOREACH(list->apms, apm) {
 		if (apm->dev_ptr == dev_ptr ) {
 			DL_DELETE(list->apms, apm);
 			apm_destroy(&apm);
 		}
 	}
+	worker_unlock();
 }
 
 /*
@@ -236,59 +424,144 @@ static void get_best_channels(struct cras_audio_format *apm_fmt)
 		apm_fmt->channel_layout[ch] = layout[ch];
 }
 
-struct cras_apm *cras_apm_list_add(struct cras_apm_list *list,
-				   void *dev_ptr,
-				   const struct cras_audio_format *dev_fmt)
+static int is_format_equal(const struct cras_audio_format *a,
+			   const struct cras_audio_format *b)
 {
-	struct cras_apm *apm;
+	return a->format == b->format &&
+	       a->frame_rate == b->frame_rate &&
+	       a->num_channels == b->num_channels &&
+	       !memcmp(a->channel_layout, b->channel_layout,
+		       sizeof(a->channel_layout));
+}
 
-	DL_FOREACH(list->apms, apm) {
-		if (apm->dev_ptr == dev_ptr) {
-			DL_DELETE(list->apms, apm);
-			apm_destroy(&apm);
-		}
+/* Finds an instance another stream already runs on |dev_ptr| with the
+ * same effects and format, so its processed output can be shared. */
+static struct cras_apm_instance *find_instance(
+		void *dev_ptr,
+		uint64_t effects,
+		const struct cras_audio_format *dev_fmt)
+{
+	struct cras_apm_instance *inst;
+
+	DL_FOREACH(instances, inst) {
+		if (inst->dev_ptr == dev_ptr && inst->effects == effects &&
+		    is_format_equal(&inst->dev_fmt, dev_fmt))
+			return inst;
 	}
+	return NULL;
+}
 
-	// TODO(hychao): Remove the check when we enable more effects.
-	if (!(list->effects & APM_ECHO_CANCELLATION))
-		return NULL;
+/* Resolves which device channel feeds each APM channel, so copying input
+ * doesn't search the channel layouts on every capture. */
+static void resolve_channel_map(struct cras_apm_instance *inst)
+{
+	int ch, i;
 
-	apm = (struct cras_apm *)calloc(1, sizeof(*apm));
+	for (i = 0; i < CRAS_CH_MAX; i++)
+		inst->channel_map[i] = -1;
+
+	for (ch = 0; ch < CRAS_CH_MAX; ch++) {
+		i = inst->fmt.channel_layout[ch];
+		if (i < 0 || i >= inst->fmt.num_channels ||
+		    inst->channel_map[i] != -1)
+			continue;
+		inst->channel_map[i] = inst->dev_fmt.channel_layout[ch];
+	}
+}
+
+static struct cras_apm_instance *instance_create(
+		void *dev_ptr,
+		uint64_t effects,
+		const struct cras_audio_format *dev_fmt)
+{
+	struct cras_apm_instance *inst;
+	unsigned int frames, i;
+
+	inst = (struct cras_apm_instance *)calloc(1, sizeof(*inst));
 
 	/* Configures APM to the format used by input device. If the channel
 	 * count is larger than stereo, use the standard channel count/layout
 	 * in APM. */
-	apm->dev_fmt = *dev_fmt;
-	apm->fmt = *dev_fmt;
-	get_best_channels(&apm->fmt);
-
-	apm->apm_ptr = webrtc_apm_create(
-			apm->fmt.num_channels,
-			apm->fmt.frame_rate,
+	inst->dev_fmt = *dev_fmt;
+	inst->fmt = *dev_fmt;
+	get_best_channels(&inst->fmt);
+	resolve_channel_map(inst);
+
+	inst->apm_ptr = webrtc_apm_create(
+			inst->fmt.num_channels,
+			inst->fmt.frame_rate,
 			aec_config,
 			apm_config);
-	if (apm->apm_ptr == NULL) {
+	if (inst->apm_ptr == NULL) {
 		syslog(LOG_ERR, "Fail to create webrtc apm for ch %zu"
 				" rate %zu effect %lu",
 				dev_fmt->num_channels,
 				dev_fmt->frame_rate,
-				list->effects);
-		free(apm);
+				effects);
+		free(inst);
 		return NULL;
 	}
 
-	apm->dev_ptr = dev_ptr;
-	apm->work_queue = NULL;
+	inst->dev_ptr = dev_ptr;
+	inst->effects = effects;
+	inst->work_queue = NULL;
+	inst->offload = !!worker;
+	inst->num_blocks = inst->offload ? APM_NUM_BLOCKS : 1;
 
 	/* WebRTC APM wants 10 ms equivalence of data to process. */
-	apm->buffer = byte_buffer_create(10 * apm->fmt.frame_rate / 1000 *
-					 cras_get_format_bytes(&apm->fmt));
-	apm->fbuffer = float_buffer_create(10 * apm->fmt.frame_rate / 1000,
-					   apm->fmt.num_channels);
-	apm->area = cras_audio_area_create(apm->fmt.num_channels);
-	cras_audio_area_config_channels(apm->area, &apm->fmt);
+	frames = 10 * inst->fmt.frame_rate / 1000;
+	inst->fbuffer = float_buffer_create(frames, inst->fmt.num_channels);
+	for (i = 0; i < inst->num_blocks; i++) {
+		inst->blocks[i].buf = byte_buffer_create(
+				frames * cras_get_format_bytes(&inst->fmt));
+		inst->blocks[i].fbuf = float_buffer_create(
+				frames, inst->fmt.num_channels);
+	}
+
+	return inst;
+}
+
+struct cras_apm *cras_apm_list_add(struct cras_apm_list *list,
+				   void *dev_ptr,
+				   const struct cras_audio_format *dev_fmt)
+{
+	struct cras_apm_instance *inst;
+	struct cras_apm *apm;
+
+	cras_apm_list_remove(list, dev_ptr);
+
+	// TODO(hychao): Remove the check when we enable more effects.
+	if (!(list->effects & APM_ECHO_CANCELLATION))
+		return NULL;
+
+	/* Start the worker before taking its lock, for the instance that
+	 * may be created below. */
+	if (offload_enabled)
+		start_worker();
+
+	worker_lock();
+	inst = find_instance(dev_ptr, list->effects, dev_fmt);
+	if (inst == NULL) {
+		inst = instance_create(dev_ptr, list->effects, dev_fmt);
+		if (inst == NULL) {
+			worker_unlock();
+			return NULL;
+		}
+		DL_APPEND(instances, inst);
+		num_instances++;
+		update_in_place(dev_ptr);
+	}
+
+	apm = (struct cras_apm *)calloc(1, sizeof(*apm));
+	apm->inst = inst;
+	apm->dev_ptr = dev_ptr;
+	apm->area = cras_audio_area_create(inst->fmt.num_channels);
+	cras_audio_area_config_channels(apm->area, &inst->fmt);
+	apm->user.apm = apm;
+	inst->num_users++;
 
 	DL_APPEND(list->apms, apm);
+	worker_unlock();
 	update_process_reverse_flag();
 
 	return apm;
@@ -299,6 +572,7 @@ int cras_apm_list_destroy(struct cras_apm_list *list)
 	struct cras_apm_list *tmp;
 	struct cras_apm *apm;
 
+	worker_lock();
 	DL_FOREACH(apm_list, tmp) {
 		if (tmp == list) {
 			DL_DELETE(apm_list, tmp);
@@ -306,13 +580,16 @@ int cras_apm_list_destroy(struct cras_apm_list *list)
 		}
 	}
 
-	if (tmp == NULL)
+	if (tmp == NULL) {
+		worker_unlock();
 		return 0;
+	}
 
 	DL_FOREACH(list->apms, apm) {
 		DL_DELETE(list->apms, apm);
 		apm_destroy(&apm);
 	}
+	worker_unlock();
 	free(list);
 
 	update_process_reverse_flag();
@@ -351,6 +628,12 @@ static void update_first_output_dev_to_process()
 		return;
 
 	echo_ref = get_echo_reference_target(iodev);
+
+	/* Attaching reconfigures rmodule's buffers on this thread, so it must
+	 * not be left in the pipeline of the previous echo reference. */
+	if (rmodule->odev && rmodule->odev != echo_ref)
+		cras_iodev_set_ext_dsp_module(rmodule->odev, NULL);
+
 	rmodule->odev = echo_ref;
 	cras_iodev_set_ext_dsp_module(echo_ref, &rmodule->ext);
 }
@@ -384,8 +667,7 @@ static void handle_device_disabled(struct cras_iodev *iodev, void *cb_data)
 
 static int process_reverse(struct float_buffer *fbuf, unsigned int frame_rate)
 {
-	struct cras_apm_list *list;
-	struct cras_apm *apm;
+	struct cras_apm_instance *inst;
 	int ret;
 	float *const *wp;
 
@@ -394,27 +676,75 @@ static int process_reverse(struct float_buffer *fbuf, unsigned int frame_rate)
 
 	wp = float_buffer_write_pointer(fbuf);
 
-	DL_FOREACH(apm_list, list) {
-		if (!(list->effects & APM_ECHO_CANCELLATION))
+	DL_FOREACH(instances, inst) {
+		if (!(inst->effects & APM_ECHO_CANCELLATION))
 			continue;
 
-		DL_FOREACH(list->apms, apm) {
-			ret = webrtc_apm_process_reverse_stream_f(
-					apm->apm_ptr,
-					fbuf->num_channels,
-					frame_rate,
-					wp);
-			if (ret) {
-				syslog(LOG_ERR,
-				       "APM process reverse err");
-				return ret;
-			}
+		ret = webrtc_apm_process_reverse_stream_f(
+				inst->apm_ptr,
+				fbuf->num_channels,
+				frame_rate,
+				wp);
+		if (ret) {
+			syslog(LOG_ERR, "APM process reverse err");
+			return ret;
 		}
 	}
 	float_buffer_reset(fbuf);
 	return 0;
 }
 
+/*
+ * Copies reverse data into the block ring for the worker thread to analyze.
+ * If the worker falls behind by the whole ring, the remaining frames are
+ * dropped rather than blocking the audio thread.
+ */
+static void queue_reverse(struct cras_apm_reverse_module *rmod,
+			  unsigned int nframes)
+{
+	struct float_buffer *fbuf;
+	unsigned int writable, processed;
+	int i, offset = 0;
+	float *const *wp;
+
+	while (nframes) {
+		processed = __sync_fetch_and_add(&rmod->processed, 0);
+		if (rmod->submitted - processed >= APM_NUM_BLOCKS)
+			return;
+
+		fbuf = rmod->blocks[rmod->submitted % APM_NUM_BLOCKS];
+		writable = float_buffer_writable(fbuf);
+		writable = MIN(nframes, writable);
+		wp = float_buffer_write_pointer(fbuf);
+		for (i = 0; i < fbuf->num_channels; i++)
+			memcpy(wp[i], rmod->ext.ports[i] + offset,
+			       writable * sizeof(float));
+
+		offset += writable;
+		float_buffer_written(fbuf, writable);
+		nframes -= writable;
+
+		if (float_buffer_writable(fbuf) == 0) {
+			__sync_fetch_and_add(&rmod->submitted, 1);
+			sem_post(&worker->wake);
+		}
+	}
+}
+
+/* Analyzes the reverse data blocks submitted by the audio thread. Called
+ * on the worker thread. */
+static void process_queued_reverse(struct cras_apm_reverse_module *rmod)
+{
+	struct float_buffer *fbuf;
+
+	while (rmod->processed != __sync_fetch_and_add(&rmod->submitted, 0)) {
+		fbuf = rmod->blocks[rmod->processed % APM_NUM_BLOCKS];
+		process_reverse(fbuf, rmod->dev_rate);
+		float_buffer_reset(fbuf);
+		__sync_fetch_and_add(&rmod->processed, 1);
+	}
+}
+
 void reverse_data_run(struct ext_dsp_module *ext,
 		      unsigned int nframes)
 {
@@ -427,6 +757,11 @@ void reverse_data_run(struct ext_dsp_module *ext,
 	if (!rmod->process_reverse)
 		return;
 
+	if (worker) {
+		queue_reverse(rmod, nframes);
+		return;
+	}
+
 	while (nframes) {
 		process_reverse(rmod->fbuf, rmod->dev_rate);
 		writable = float_buffer_writable(rmod->fbuf);
@@ -442,6 +777,11 @@ void reverse_data_run(struct ext_dsp_module *ext,
 	}
 }
 
+/*
+ * Recreates the reverse data buffers for the new format. Called on the main
+ * thread when rmodule is attached to an iodev, before the audio thread adds
+ * it to a pipeline, so only the worker thread can be using the buffers.
+ */
 void reverse_data_configure(struct ext_dsp_module *ext,
 			    unsigned int buffer_size,
 			    unsigned int num_channels,
@@ -449,11 +789,22 @@ void reverse_data_configure(struct ext_dsp_module *ext,
 {
 	struct cras_apm_reverse_module *rmod =
 			(struct cras_apm_reverse_module *)ext;
+	unsigned int i;
+
+	worker_lock();
 	if (rmod->fbuf)
 		float_buffer_destroy(&rmod->fbuf);
 	rmod->fbuf = float_buffer_create(rate / 100,
 					 num_channels);
+	for (i = 0; i < APM_NUM_BLOCKS; i++) {
+		float_buffer_destroy(&rmod->blocks[i]);
+		rmod->blocks[i] = float_buffer_create(rate / 100,
+						      num_channels);
+	}
+	rmod->submitted = 0;
+	rmod->processed = 0;
 	rmod->dev_rate = rate;
+	worker_unlock();
 }
 
 int cras_apm_list_init(const char *device_config_dir)
@@ -504,114 +855,470 @@ void cras_apm_list_reload_aec_config()
 		apm_config_dump(apm_config);
 }
 
+/* Runs APM on a full block of |fbuf| and moves the result to |buf|. */
+static int process_block(struct cras_apm_instance *inst,
+			 struct float_buffer *fbuf,
+			 struct byte_buffer *buf)
+{
+	unsigned int nread;
+	float *const *rp;
+	int ret;
+
+	nread = float_buffer_level(fbuf);
+	rp = float_buffer_read_pointer(fbuf, 0, &nread);
+	ret = webrtc_apm_process_stream_f(inst->apm_ptr,
+					  inst->fmt.num_channels,
+					  inst->fmt.frame_rate,
+					  rp);
+	if (ret) {
+		syslog(LOG_ERR, "APM process stream f err");
+		return ret;
+	}
+
+	dsp_util_interleave(rp,
+			    buf_write_pointer(buf),
+			    fbuf->num_channels,
+			    inst->fmt.format,
+			    nread);
+	buf_increment_write(buf, nread * cras_get_format_bytes(&inst->fmt));
+	return 0;
+}
+
+/* Processes the capture blocks submitted by the audio thread. Called on the
+ * worker thread. A block that fails to process is passed on empty. */
+static void process_queued_blocks(struct cras_apm_instance *inst)
+{
+	struct cras_apm_block *block;
+
+	while (inst->processed != __sync_fetch_and_add(&inst->submitted, 0)) {
+		block = &inst->blocks[inst->processed % inst->num_blocks];
+		process_block(inst, block->fbuf, block->buf);
+		__sync_fetch_and_add(&inst->processed, 1);
+	}
+}
+
+static void *apm_worker_thread(void *arg)
+{
+	struct cras_apm_worker *w = (struct cras_apm_worker *)arg;
+	struct cras_apm_instance *inst;
+
+	/* Stay below the audio thread so it can always preempt APM. */
+	if (cras_set_rt_scheduling(CRAS_SERVER_RT_THREAD_PRIORITY) == 0)
+		cras_set_thread_priority(CRAS_SERVER_RT_THREAD_PRIORITY - 1);
+
+	while (1) {
+		if (sem_wait(&w->wake) && errno == EINTR)
+			continue;
+		if (!__sync_fetch_and_add(&w->running, 0))
+			break;
+
+		pthread_mutex_lock(&w->lock);
+		if (rmodule && rmodule->blocks[0])
+			process_queued_reverse(rmodule);
+		DL_FOREACH(instances, inst) {
+			if (inst->offload)
+				process_queued_blocks(inst);
+		}
+		pthread_mutex_unlock(&w->lock);
+	}
+	return NULL;
+}
+
+/* Starts the worker thread for the first offloaded instance. Once started
+ * the worker runs until cras_apm_list_deinit(), because the audio thread
+ * may be posting to it at any time. */
+static int start_worker()
+{
+	struct cras_apm_worker *w;
+	int rc;
+
+	if (worker)
+		return 0;
+
+	w = (struct cras_apm_worker *)calloc(1, sizeof(*w));
+	if (!w)
+		return -ENOMEM;
+	sem_init(&w->wake, 0, 0);
+	pthread_mutex_init(&w->lock, NULL);
+	w->running = 1;
+
+	rc = pthread_create(&w->tid, NULL, apm_worker_thread, w);
+	if (rc) {
+		syslog(LOG_ERR, "Failed to start APM worker, process inline");
+		sem_destroy(&w->wake);
+		pthread_mutex_destroy(&w->lock);
+		free(w);
+		return -rc;
+	}
+
+	/* Publish the worker only when it's ready for the audio thread to
+	 * queue reverse data to. */
+	__sync_synchronize();
+	worker = w;
+	return 0;
+}
+
+void cras_apm_list_enable_offload()
+{
+	offload_enabled = 1;
+}
+
+static void stop_worker()
+{
+	if (!worker)
+		return;
+
+	__sync_fetch_and_and(&worker->running, 0);
+	sem_post(&worker->wake);
+	pthread_join(worker->tid, NULL);
+	sem_destroy(&worker->wake);
+	pthread_mutex_destroy(&worker->lock);
+	free(worker);
+	worker = NULL;
+}
+
 int cras_apm_list_deinit()
 {
+	unsigned int i;
+
+	stop_worker();
+	offload_enabled = 0;
 	if (rmodule) {
 		if (rmodule->fbuf)
 			float_buffer_destroy(&rmodule->fbuf);
+		for (i = 0; i < APM_NUM_BLOCKS; i++)
+			float_buffer_destroy(&rmodule->blocks[i]);
 		free(rmodule);
+		rmodule = NULL;
 	}
 	return 0;
 }
 
-int cras_apm_list_process(struct cras_apm *apm,
-			  struct float_buffer *input,
-			  unsigned int offset)
+/*
+ * Copies as much of |input| from |offset| as fits into the input buffer of
+ * |inst|, picking the channels APM uses. Returns the number of frames
+ * copied.
+ */
+static unsigned int copy_input(struct cras_apm_instance *inst,
+			       struct float_buffer *input,
+			       unsigned int offset)
 {
+	struct float_buffer *fbuf = inst->fbuffer;
 	unsigned int writable, nframes, nread;
-	int ch, i, j, ret;
+	int i, j;
 	float *const *wp;
 	float *const *rp;
 
-	nread = float_buffer_level(input);
-	if (nread < offset) {
-		syslog(LOG_ERR, "Process offset exceeds read level");
-		return -EINVAL;
-	}
-
-	writable = float_buffer_writable(apm->fbuffer);
-	writable = MIN(nread - offset, writable);
+	writable = float_buffer_writable(fbuf);
+	writable = MIN(float_buffer_level(input) - offset, writable);
 
 	nframes = writable;
 	while (nframes) {
 		nread = nframes;
-		wp = float_buffer_write_pointer(apm->fbuffer);
+		wp = float_buffer_write_pointer(fbuf);
 		rp = float_buffer_read_pointer(input, offset, &nread);
 
-		for (i = 0; i < apm->fbuffer->num_channels; i++) {
-			/* Look up the channel position and copy from
-			 * the correct index of |input| buffer.
-			 */
-			for (ch = 0; ch < CRAS_CH_MAX; ch++)
-				if (apm->fmt.channel_layout[ch] == i)
-					break;
-			if (ch == CRAS_CH_MAX)
-				continue;
-
-			j = apm->dev_fmt.channel_layout[ch];
+		for (i = 0; i < fbuf->num_channels; i++) {
+			j = inst->channel_map[i];
 			if (j == -1)
-				continue;
-
-			memcpy(wp[i], rp[j], nread * sizeof(float));
+				memset(wp[i], 0, nread * sizeof(float));
+			else
+				memcpy(wp[i], rp[j], nread * sizeof(float));
 		}
 
 		nframes -= nread;
 		offset += nread;
 
-		float_buffer_written(apm->fbuffer, nread);
+		float_buffer_written(fbuf, nread);
 	}
+	return writable;
+}
 
-	/* process and move to int buffer */
-	if ((float_buffer_writable(apm->fbuffer) == 0) &&
-            (buf_queued(apm->buffer) == 0)) {
-		nread = float_buffer_level(apm->fbuffer);
-		rp = float_buffer_read_pointer(apm->fbuffer, 0, &nread);
-		ret = webrtc_apm_process_stream_f(apm->apm_ptr,
-						  apm->fmt.num_channels,
-						  apm->fmt.frame_rate,
-						  rp);
-		if (ret) {
-			syslog(LOG_ERR, "APM process stream f err");
+/* Gets the number of blocks still waiting for some stream to read. A failed
+ * stream doesn't read any more, so it doesn't hold blocks. */
+static unsigned int blocks_in_use(struct cras_apm_instance *inst)
+{
+	struct cras_apm_user *user;
+	unsigned int used = 0;
+
+	DL_FOREACH(inst->users, user) {
+		if (user->apm->failed)
+			continue;
+		used = MAX(used, inst->submitted - user->apm->consumed);
+	}
+	return used;
+}
+
+/*
+ * Processes a full input buffer once a block is free, or hands it to the
+ * worker thread when |inst| is offloaded.
+ */
+static int submit_input(struct cras_apm_instance *inst)
+{
+	struct cras_apm_block *block;
+	struct float_buffer *fbuf;
+	int ret;
+
+	if (float_buffer_writable(inst->fbuffer) ||
+	    blocks_in_use(inst) >= inst->num_blocks)
+		return 0;
+
+	block = &inst->blocks[inst->submitted % inst->num_blocks];
+	buf_reset(block->buf);
+
+	if (!inst->offload) {
+		ret = process_block(inst, inst->fbuffer, block->buf);
+		if (ret)
 			return ret;
-		}
+		float_buffer_reset(inst->fbuffer);
+		inst->submitted++;
+		inst->processed++;
+		return 0;
+	}
+
+	/* Swap buffers so the audio thread keeps filling while the worker
+	 * processes the full one. */
+	fbuf = block->fbuf;
+	block->fbuf = inst->fbuffer;
+	inst->fbuffer = fbuf;
+	float_buffer_reset(inst->fbuffer);
+	__sync_fetch_and_add(&inst->submitted, 1);
+	sem_post(&worker->wake);
+	return 0;
+}
 
-		dsp_util_interleave(rp,
-				    buf_write_pointer(apm->buffer),
-				    apm->fbuffer->num_channels,
-				    apm->fmt.format,
-				    nread);
-		buf_increment_write(apm->buffer,
-				    nread * cras_get_format_bytes(&apm->fmt));
-		float_buffer_reset(apm->fbuffer);
+/*
+ * Runs APM directly on 10ms of |input| from |offset| and interleaves the
+ * result into the next block, skipping the copy into |fbuffer|. Only
+ * possible for an in_place instance with nothing buffered and a free block,
+ * when the 10ms don't wrap around |input|. Returns the number of frames
+ * processed, zero if the regular path must be used.
+ */
+static int process_input_in_place(struct cras_apm_instance *inst,
+				  struct float_buffer *input,
+				  unsigned int offset)
+{
+	struct cras_apm_block *block;
+	unsigned int frames, nread;
+	float *const *rp;
+	int ret;
+
+	if (!inst->in_place || float_buffer_level(inst->fbuffer) ||
+	    blocks_in_use(inst) >= inst->num_blocks)
+		return 0;
+
+	frames = float_buffer_writable(inst->fbuffer);
+	nread = frames;
+	rp = float_buffer_read_pointer(input, offset, &nread);
+	if (nread < frames)
+		return 0;
+
+	block = &inst->blocks[inst->submitted % inst->num_blocks];
+	buf_reset(block->buf);
+	ret = webrtc_apm_process_stream_f(inst->apm_ptr,
+					  inst->fmt.num_channels,
+					  inst->fmt.frame_rate,
+					  rp);
+	if (ret) {
+		syslog(LOG_ERR, "APM process stream f err");
+		return ret;
+	}
+
+	dsp_util_interleave(rp,
+			    buf_write_pointer(block->buf),
+			    inst->fmt.num_channels,
+			    inst->fmt.format,
+			    frames);
+	buf_increment_write(block->buf,
+			    frames * cras_get_format_bytes(&inst->fmt));
+	inst->submitted++;
+	inst->processed++;
+	return frames;
+}
+
+static int process_input(struct cras_apm *apm,
+			 struct float_buffer *input,
+			 unsigned int offset)
+{
+	struct cras_apm_instance *inst = apm->inst;
+	unsigned int nread, writable;
+	int ret;
+
+	nread = float_buffer_level(input);
+	if (nread < offset) {
+		syslog(LOG_ERR, "Process offset exceeds read level");
+		return -EINVAL;
 	}
 
+	/* Another stream sharing the instance already passed this input. */
+	if (inst->taken != apm->taken) {
+		writable = MIN(inst->taken - apm->taken, nread - offset);
+		apm->taken += writable;
+		return writable;
+	}
+
+	ret = process_input_in_place(inst, input, offset);
+	if (ret < 0)
+		return ret;
+	if (ret > 0) {
+		inst->taken += ret;
+		apm->taken = inst->taken;
+		return ret;
+	}
+
+	ret = submit_input(inst);
+	if (ret)
+		return ret;
+
+	writable = copy_input(inst, input, offset);
+	inst->taken += writable;
+	apm->taken = inst->taken;
+
+	/* process and move to int buffer */
+	ret = submit_input(inst);
+	if (ret)
+		return ret;
+
 	return writable;
 }
 
+int cras_apm_list_process(struct cras_apm *apm,
+			  struct float_buffer *input,
+			  unsigned int offset)
+{
+	int ret;
+
+	ret = process_input(apm, input, offset);
+	if (ret < 0)
+		apm->failed = 1;
+	return ret;
+}
+
+/* Gets the block |apm| reads processed data from, or NULL if it has read
+ * every processed block. */
+static struct cras_apm_block *processed_block(struct cras_apm *apm)
+{
+	struct cras_apm_instance *inst = apm->inst;
+
+	if (apm->consumed == __sync_fetch_and_add(&inst->processed, 0))
+		return NULL;
+	return &inst->blocks[apm->consumed % inst->num_blocks];
+}
+
 struct cras_audio_area *cras_apm_list_get_processed(struct cras_apm *apm)
 {
+	struct cras_apm_instance *inst = apm->inst;
+	unsigned int frame_bytes = cras_get_format_bytes(&inst->fmt);
+	struct cras_apm_block *block;
 	uint8_t *buf_ptr;
 
-	buf_ptr = buf_read_pointer_size(apm->buffer, &apm->area->frames);
-	apm->area->frames /= cras_get_format_bytes(&apm->fmt);
-	cras_audio_area_config_buf_pointers(apm->area, &apm->fmt, buf_ptr);
+	block = processed_block(apm);
+	if (block == NULL) {
+		apm->area->frames = 0;
+		buf_ptr = inst->blocks[0].buf->bytes;
+	} else {
+		apm->area->frames = buf_queued(block->buf) / frame_bytes -
+				    apm->offset;
+		buf_ptr = block->buf->bytes + apm->offset * frame_bytes;
+	}
+	cras_audio_area_config_buf_pointers(apm->area, &inst->fmt, buf_ptr);
 	return apm->area;
 }
 
 void cras_apm_list_put_processed(struct cras_apm *apm, unsigned int frames)
 {
-	buf_increment_read(apm->buffer,
-			   frames * cras_get_format_bytes(&apm->fmt));
+	struct cras_apm_instance *inst = apm->inst;
+	struct cras_apm_block *block;
+
+	block = processed_block(apm);
+	if (block == NULL)
+		return;
+
+	apm->offset += frames;
+	if (apm->offset * cras_get_format_bytes(&inst->fmt) >=
+	    buf_queued(block->buf)) {
+		apm->offset = 0;
+		apm->consumed++;
+	}
+}
+
+unsigned int cras_apm_list_get_delay_frames(struct cras_apm *apm)
+{
+	struct cras_apm_instance *inst = apm->inst;
+	unsigned int frame_bytes = cras_get_format_bytes(&inst->fmt);
+	unsigned int processed, i, frames;
+	struct cras_apm_block *block;
+
+	frames = float_buffer_level(inst->fbuffer);
+	processed = __sync_fetch_and_add(&inst->processed, 0);
+	for (i = apm->consumed; i != inst->submitted; i++) {
+		block = &inst->blocks[i % inst->num_blocks];
+		if (i - apm->consumed < processed - apm->consumed)
+			frames += buf_queued(block->buf) / frame_bytes;
+		else
+			frames += float_buffer_level(block->fbuf);
+	}
+	if (apm->consumed != inst->submitted)
+		frames -= apm->offset;
+	return frames;
+}
+
+void cras_apm_list_join(struct cras_apm_list *list, void *dev_ptr)
+{
+	struct cras_apm_instance *inst;
+	struct cras_apm *apm;
+
+	if (list == NULL)
+		return;
+
+	DL_SEARCH_SCALAR(list->apms, apm, dev_ptr, dev_ptr);
+	if (apm == NULL || apm->joined)
+		return;
+
+	/* A stream joining a shared instance starts with the next block. */
+	inst = apm->inst;
+	apm->taken = inst->taken;
+	apm->consumed = inst->submitted;
+	apm->offset = 0;
+	DL_APPEND(inst->users, &apm->user);
+	apm->joined = 1;
+}
+
+void cras_apm_list_leave(struct cras_apm_list *list, void *dev_ptr)
+{
+	struct cras_apm *apm;
+
+	if (list == NULL)
+		return;
+
+	DL_SEARCH_SCALAR(list->apms, apm, dev_ptr, dev_ptr);
+	if (apm == NULL || !apm->joined)
+		return;
+	DL_DELETE(apm->inst->users, &apm->user);
+	apm->joined = 0;
+}
+
+unsigned int cras_apm_list_get_num_users(struct cras_apm *apm)
+{
+	if (apm == NULL)
+		return 0;
+	return __sync_fetch_and_add(&apm->inst->num_users, 0);
+}
+
+unsigned int cras_apm_list_get_num_instances()
+{
+	return __sync_fetch_and_add(&num_instances, 0);
 }
 
 struct cras_audio_format *cras_apm_list_get_format(struct cras_apm *apm)
 {
-	return &apm->fmt;
+	return &apm->inst->fmt;
 }
 
 void cras_apm_list_set_aec_dump(struct cras_apm_list *list, void *dev_ptr,
 				int start, int fd)
 {
+	struct cras_apm_instance *inst;
 	struct cras_apm *apm;
 	char file_name[256];
 	int rc;
@@ -620,6 +1327,7 @@ void cras_apm_list_set_aec_dump(struct cras_apm_list *list, void *dev_ptr,
 	DL_SEARCH_SCALAR(list->apms, apm, dev_ptr, dev_ptr);
 	if (apm == NULL)
 		return;
+	inst = apm->inst;
 
 	if (start) {
 		handle = fdopen(fd, "w");
@@ -629,13 +1337,13 @@ void cras_apm_list_set_aec_dump(struct cras_apm_list *list, void *dev_ptr,
 			return ;
 		}
 		/* webrtc apm will own the FILE handle and close it. */
-		rc = webrtc_apm_aec_dump(apm->apm_ptr, &apm->work_queue, start,
-					 handle);
+		rc = webrtc_apm_aec_dump(inst->apm_ptr, &inst->work_queue,
+					 start, handle);
 		if (rc)
 			syslog(LOG_ERR, "Fail to dump debug file %s, rc %d",
 			       file_name, rc);
 	} else {
-		rc = webrtc_apm_aec_dump(apm->apm_ptr, &apm->work_queue, 0,
+		rc = webrtc_apm_aec_dump(inst->apm_ptr, &inst->work_queue, 0,
 					 NULL);
 		if (rc)
 			syslog(LOG_ERR, "Failed to stop apm debug, rc %d", rc);
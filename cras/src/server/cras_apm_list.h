@@ -25,6 +25,16 @@ void cras_apm_list_reload_aec_config();
 /* Deinitialize apm list to free all allocated resources. */
 int cras_apm_list_deinit();
 
+/*
+ * Enables running APM processing off the audio thread. APM instances added
+ * after this call hand 10ms blocks to a worker thread instead of processing
+ * inline, which holds at most one more block of capture data. That data is
+ * accounted for in cras_apm_list_get_delay_frames(). The worker thread is
+ * started with the first such instance, and reverse stream analysis moves
+ * to it from then on.
+ */
+void cras_apm_list_enable_offload();
+
 /*
  * Creates an list to hold all APM instances created when a stream
  * attaches to an iodev.
@@ -80,6 +90,10 @@ void cras_apm_list_remove(struct cras_apm_list *list, void *dev_ptr);
  *    input - Float buffer from device for apm to process.
  *    offset - Offset in |input| to note the data position to start
  *        reading.
+ * Returns:
+ *    The number of frames taken from |input|, or a negative error code.
+ *    After an error cras_apm_list_get() no longer returns |apm|, and the
+ *    stream reads unprocessed input until |apm| is removed.
  */
 int cras_apm_list_process(struct cras_apm *apm,
 			  struct float_buffer *input,
@@ -109,6 +123,43 @@ void cras_apm_list_put_processed(struct cras_apm *apm, unsigned int frames);
  */
 struct cras_audio_format *cras_apm_list_get_format(struct cras_apm *apm);
 
+/* Gets the number of frames taken from the input device that |apm| holds
+ * and hasn't yet passed to the stream.
+ * Args:
+ *    apm - The cras_apm instance holding audio data.
+ */
+unsigned int cras_apm_list_get_delay_frames(struct cras_apm *apm);
+
+/*
+ * Attaches the stream holding |list| to the APM instance it reads on
+ * |dev_ptr|, so the instance keeps processed blocks until the stream has
+ * read them. Called on the audio thread when the stream is added to the
+ * device, because only the audio thread runs the streams sharing an
+ * instance.
+ * Args:
+ *    list - The list holding APM instances.
+ *    dev_ptr - The iodev the stream is added to.
+ */
+void cras_apm_list_join(struct cras_apm_list *list, void *dev_ptr);
+
+/*
+ * Detaches the stream holding |list| from the APM instance it reads on
+ * |dev_ptr|. Called on the audio thread when the stream is removed from the
+ * device.
+ * Args:
+ *    list - The list holding APM instances.
+ *    dev_ptr - The iodev the stream is removed from.
+ */
+void cras_apm_list_leave(struct cras_apm_list *list, void *dev_ptr);
+
+/* Gets the number of streams sharing the APM instance behind |apm|, zero if
+ * |apm| is NULL. Streams capturing from the same device with the same
+ * effects and format share one instance. */
+unsigned int cras_apm_list_get_num_users(struct cras_apm *apm);
+
+/* Gets the number of APM instances running. */
+unsigned int cras_apm_list_get_num_instances();
+
 /* Sets debug recording to start or stop.
  * Args:
  *    list - List contains the apm instance to start/stop debug recording.
@@ -135,6 +186,9 @@ static inline int cras_apm_list_init(const char *device_config_dir)
 static inline void cras_apm_list_reload_aec_config()
 {
 }
+static inline void cras_apm_list_enable_offload()
+{
+}
 static inline struct cras_apm_list *cras_apm_list_create(void *stream_ptr,
 							 unsigned int effects)
 {
@@ -189,6 +243,27 @@ static inline struct cras_audio_format *cras_apm_list_get_format(
 	return NULL;
 }
 
+static inline unsigned int cras_apm_list_get_delay_frames(
+		struct cras_apm *apm)
+{
+	return 0;
+}
+static inline void cras_apm_list_join(struct cras_apm_list *list,
+				      void *dev_ptr)
+{
+}
+static inline void cras_apm_list_leave(struct cras_apm_list *list,
+				       void *dev_ptr)
+{
+}
+static inline unsigned int cras_apm_list_get_num_users(struct cras_apm *apm)
+{
+	return 0;
+}
+static inline unsigned int cras_apm_list_get_num_instances()
+{
+	return 0;
+}
 static inline void cras_apm_list_set_aec_dump(struct cras_apm_list *list,
 					      void *dev_ptr,
 					      int start,
@@ -3,12 +3,14 @@
  * found in the LICENSE file.
  */
 
-#include <pthread.h>
+#include <sched.h>
 #include <syslog.h>
 #include "dumper.h"
 #include "cras_expr.h"
 #include "cras_dsp_ini.h"
 #include "cras_dsp_pipeline.h"
+#include "cras_system_state.h"
+#include "cras_tm.h"
 #include "dsp_util.h"
 #include "utlist.h"
 
@@ -20,20 +22,50 @@
  * (1) The client asks to (re-)load it with cras_load_pipeline().
  * (2) The client asks to reload the ini with cras_reload_ini().
  *
- * The pipeline is (re-)loaded asynchronously in an internal thread,
+ * The pipeline may be (re-)loaded while the audio thread is using it,
  * so the client needs to use cras_dsp_get_pipeline() and
- * cras_dsp_put_pipeline() to safely access the pipeline.
+ * cras_dsp_put_pipeline() to safely access the pipeline. These never
+ * block: the new pipeline is published by atomically exchanging the
+ * pointer, and the old one is kept on the retired list. The new pipeline
+ * crossfades from the old one for DSP_CROSSFADE_MSECS. A timer frees
+ * retired pipelines once their crossfade has finished and no reader that
+ * could have seen the old pointer is left. A published pipeline may be
+ * running on the audio thread, so only the audio thread changes it.
  */
 struct cras_dsp_context {
-	pthread_mutex_t mutex;
 	struct pipeline *pipeline;
 
+	/* The number of callers between cras_dsp_get_pipeline() and
+	 * cras_dsp_put_pipeline(). */
+	int readers;
+
+	/* Pipelines replaced by a load, still used by a reader or a
+	 * crossfade. */
+	struct retired_pipeline *retired;
+
+	/* Timer to free the retired pipelines, armed while there are any. */
+	struct cras_timer *reclaim_timer;
+
+	/* Non-zero to load pipelines in float, see
+	 * cras_dsp_disable_fixed_point(). */
+	int float_only;
+
 	struct cras_expr_env env;
 	int sample_rate;
 	const char *purpose;
 	struct cras_dsp_context *prev, *next;
 };
 
+/* A replaced pipeline waiting for its readers and crossfade to finish. */
+struct retired_pipeline {
+	struct pipeline *pipeline;
+	int done;
+	struct retired_pipeline *prev, *next;
+};
+
+/* The length of the crossfade when a pipeline is replaced. */
+#define DSP_CROSSFADE_MSECS 20
+
 static struct dumper *syslog_dumper;
 static const char *ini_filename;
 static struct ini *ini;
@@ -64,6 +96,9 @@ static struct pipeline *prepare_pipeline(
 		goto bail;
 	}
 
+	if (ctx->float_only)
+		cras_dsp_pipeline_disable_fixed_point(pipeline);
+
 	if (cras_dsp_pipeline_load(pipeline) != 0) {
 		syslog(LOG_ERR, "cannot load pipeline");
 		goto bail;
@@ -89,21 +124,120 @@ bail:
 	return NULL;
 }
 
+/* Returns true if |pipeline| can still be reached through the crossfade
+ * chain of the current pipeline. */
+static int is_fading_from(struct cras_dsp_context *ctx,
+			  struct pipeline *pipeline)
+{
+	struct pipeline *p = ctx->pipeline;
+
+	while (p) {
+		p = cras_dsp_pipeline_get_crossfade_source(p);
+		if (p == pipeline)
+			return 1;
+	}
+	return 0;
+}
+
+/* Frees retired pipelines whose crossfade has finished, if no reader is
+ * left that could still be running them. */
+static void reclaim_retired(struct cras_dsp_context *ctx)
+{
+	struct retired_pipeline *retired;
+	int any_done = 0;
+
+	/* A reader finishing the crossfade clears the source while it still
+	 * runs the old pipeline, so look for finished crossfades before
+	 * checking the readers have drained. */
+	DL_FOREACH(ctx->retired, retired) {
+		retired->done = !is_fading_from(ctx, retired->pipeline);
+		any_done |= retired->done;
+	}
+	if (!any_done)
+		return;
+	__sync_synchronize();
+	if (__sync_fetch_and_add(&ctx->readers, 0))
+		return;
+
+	DL_FOREACH(ctx->retired, retired) {
+		if (!retired->done)
+			continue;
+		DL_DELETE(ctx->retired, retired);
+		cras_dsp_pipeline_free(retired->pipeline);
+		free(retired);
+	}
+}
+
+static void schedule_reclaim(struct cras_dsp_context *ctx);
+
+static void reclaim_timer_cb(struct cras_timer *timer, void *arg)
+{
+	struct cras_dsp_context *ctx = (struct cras_dsp_context *)arg;
+
+	ctx->reclaim_timer = NULL;
+	reclaim_retired(ctx);
+	schedule_reclaim(ctx);
+}
+
+/* Arms the reclaim timer if there are retired pipelines left. */
+static void schedule_reclaim(struct cras_dsp_context *ctx)
+{
+	struct cras_tm *tm;
+
+	if (!ctx->retired || ctx->reclaim_timer)
+		return;
+	tm = cras_system_state_get_tm();
+	if (!tm)
+		return;
+	ctx->reclaim_timer = cras_tm_create_timer(tm, DSP_CROSSFADE_MSECS,
+						  reclaim_timer_cb, ctx);
+}
+
+/* Waits until every reader that might have loaded the old pipeline
+ * pointer has called cras_dsp_put_pipeline(). Only used when the old
+ * pipeline can't be left to the reclaim timer. */
+static void wait_for_readers(struct cras_dsp_context *ctx)
+{
+	while (__sync_fetch_and_add(&ctx->readers, 0))
+		sched_yield();
+}
+
 static void cmd_load_pipeline(struct cras_dsp_context *ctx,
 			      struct ini *target_ini)
 {
 	struct pipeline *pipeline, *old_pipeline;
+	struct retired_pipeline *retired = NULL;
 
 	pipeline = target_ini ? prepare_pipeline(ctx, target_ini) : NULL;
 
-	/* This locking is short to avoild blocking audio thread. */
-	pthread_mutex_lock(&ctx->mutex);
+	/* Allocate the retired entry before publishing. Without one the old
+	 * pipeline is freed right away, so it must not be crossfaded. */
 	old_pipeline = ctx->pipeline;
-	ctx->pipeline = pipeline;
-	pthread_mutex_unlock(&ctx->mutex);
-
 	if (old_pipeline)
+		retired = calloc(1, sizeof(*retired));
+	if (pipeline && old_pipeline && retired)
+		cras_dsp_pipeline_set_crossfade(
+				pipeline, old_pipeline,
+				ctx->sample_rate * DSP_CROSSFADE_MSECS / 1000);
+
+	/* Publish the new pipeline without blocking the audio thread. The
+	 * exchange only implies an acquire barrier, so add a full one before
+	 * the reclaim checks for readers. */
+	old_pipeline = __sync_lock_test_and_set(&ctx->pipeline, pipeline);
+	__sync_synchronize();
+
+	/* A reader may still be running the old pipeline, and so may the
+	 * crossfade of the new one. Leave it to the reclaim to free. */
+	if (retired) {
+		retired->pipeline = old_pipeline;
+		DL_APPEND(ctx->retired, retired);
+	} else if (old_pipeline) {
+		syslog(LOG_ERR, "no memory to retire pipeline, free it now");
+		wait_for_readers(ctx);
 		cras_dsp_pipeline_free(old_pipeline);
+	}
+	reclaim_retired(ctx);
+	schedule_reclaim(ctx);
 }
 
 static void cmd_reload_ini()
@@ -151,7 +285,6 @@ struct cras_dsp_context *cras_dsp_context_new(int sample_rate,
 {
 	struct cras_dsp_context *ctx = calloc(1, sizeof(*ctx));
 
-	pthread_mutex_init(&ctx->mutex, NULL);
 	initialize_environment(&ctx->env);
 	ctx->sample_rate = sample_rate;
 	ctx->purpose = strdup(purpose);
@@ -162,9 +295,18 @@ struct cras_dsp_context *cras_dsp_context_new(int sample_rate,
 
 void cras_dsp_context_free(struct cras_dsp_context *ctx)
 {
+	struct retired_pipeline *retired;
+
 	DL_DELETE(context_list, ctx);
 
-	pthread_mutex_destroy(&ctx->mutex);
+	if (ctx->reclaim_timer)
+		cras_tm_cancel_timer(cras_system_state_get_tm(),
+				     ctx->reclaim_timer);
+	DL_FOREACH(ctx->retired, retired) {
+		DL_DELETE(ctx->retired, retired);
+		cras_dsp_pipeline_free(retired->pipeline);
+		free(retired);
+	}
 	if (ctx->pipeline) {
 		cras_dsp_pipeline_free(ctx->pipeline);
 		ctx->pipeline = NULL;
@@ -174,6 +316,11 @@ void cras_dsp_context_free(struct cras_dsp_context *ctx)
 	free(ctx);
 }
 
+void cras_dsp_disable_fixed_point(struct cras_dsp_context *ctx)
+{
+	ctx->float_only = 1;
+}
+
 void cras_dsp_set_variable_string(struct cras_dsp_context *ctx, const char *key,
 			   const char *value)
 {
@@ -203,17 +350,19 @@ void cras_dsp_load_dummy_pipeline(struct cras_dsp_context *ctx,
 
 struct pipeline *cras_dsp_get_pipeline(struct cras_dsp_context *ctx)
 {
-	pthread_mutex_lock(&ctx->mutex);
-	if (!ctx->pipeline) {
-		pthread_mutex_unlock(&ctx->mutex);
-		return NULL;
-	}
-	return ctx->pipeline;
+	struct pipeline *pipeline;
+
+	/* Full barrier, the pointer can't be loaded before we are counted. */
+	__sync_fetch_and_add(&ctx->readers, 1);
+	pipeline = ctx->pipeline;
+	if (!pipeline)
+		__sync_fetch_and_sub(&ctx->readers, 1);
+	return pipeline;
 }
 
 void cras_dsp_put_pipeline(struct cras_dsp_context *ctx)
 {
-	pthread_mutex_unlock(&ctx->mutex);
+	__sync_fetch_and_sub(&ctx->readers, 1);
 }
 
 void cras_dsp_reload_ini()
@@ -236,6 +385,26 @@ void cras_dsp_dump_info()
 	}
 }
 
+void cras_dsp_get_profile_info(struct dsp_profile_info *info)
+{
+	struct pipeline *pipeline;
+	struct cras_dsp_context *ctx;
+
+	cras_dsp_pipeline_enable_profile();
+
+	info->num_pipelines = 0;
+	DL_FOREACH(context_list, ctx) {
+		if (info->num_pipelines >= MAX_DEBUG_DSP_PIPELINES)
+			break;
+		pipeline = cras_dsp_get_pipeline(ctx);
+		if (!pipeline)
+			continue;
+		cras_dsp_pipeline_get_profile(
+			pipeline, &info->pipelines[info->num_pipelines++]);
+		cras_dsp_put_pipeline(ctx);
+	}
+}
+
 unsigned int cras_dsp_num_output_channels(const struct cras_dsp_context *ctx)
 {
 	return cras_dsp_pipeline_get_num_output_channels(ctx->pipeline);
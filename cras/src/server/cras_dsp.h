@@ -27,7 +27,7 @@ void cras_dsp_stop();
 /* Creates a dsp context. The context holds a pipeline and its
  * parameters.  To use the pipeline in the context, first use
  * cras_dsp_load_pipeline() to load it and then use
- * cras_dsp_get_pipeline() to lock it for access.
+ * cras_dsp_get_pipeline() to access it.
  * Args:
  *    sample_rate - The sampling rate of the pipeline.
  *    purpose - The purpose of the pipeline, "playback" or "capture".
@@ -40,6 +40,12 @@ struct cras_dsp_context *cras_dsp_context_new(int sample_rate,
 /* Frees a dsp context. */
 void cras_dsp_context_free(struct cras_dsp_context *ctx);
 
+/* Makes the pipelines loaded to the context process floats, even if the
+ * ini asks for fixed point. This is for contexts an external module may
+ * connect to, because external modules only take floats and a loaded
+ * pipeline keeps its sample type. Takes effect on the next load. */
+void cras_dsp_disable_fixed_point(struct cras_dsp_context *ctx);
+
 /* Sets a configuration string variable in the context. */
 void cras_dsp_set_variable_string(struct cras_dsp_context *ctx, const char *key,
 				  const char *value);
@@ -50,8 +56,10 @@ void cras_dsp_set_variable_boolean(struct cras_dsp_context *ctx, const char *key
 
 /* Loads the pipeline to the context. This should be called again when
  * new values of configuration variables may change the plugin
- * graph. The actual loading happens in another thread to avoid
- * blocking the audio thread. */
+ * graph. The new pipeline replaces the current one without blocking the
+ * audio thread, and crossfades from it so the swap is glitch-free. The
+ * replaced pipeline is freed later on the main thread, once its users
+ * have called cras_dsp_put_pipeline(). */
 void cras_dsp_load_pipeline(struct cras_dsp_context *ctx);
 
 /* Loads a dummy pipeline of source directly connects to sink, of given
@@ -60,14 +68,15 @@ void cras_dsp_load_pipeline(struct cras_dsp_context *ctx);
 void cras_dsp_load_dummy_pipeline(struct cras_dsp_context *ctx,
 				  unsigned int num_channels);
 
-/* Locks the pipeline in the context for access. Returns NULL if the
- * pipeline is still being loaded or cannot be loaded. */
+/* Gets the pipeline in the context for access. This never blocks.
+ * The audio thread may be running the pipeline, so anything changing it,
+ * like connecting an external module to its sink, must run on the audio
+ * thread. Returns NULL if the pipeline is not loaded or cannot be loaded. */
 struct pipeline *cras_dsp_get_pipeline(struct cras_dsp_context *ctx);
 
 /* Releases the pipeline in the context. This must be called in pair
  * with cras_dsp_get_pipeline() once the client finishes using the
- * pipeline. This should be called in the same thread as
- * cras_dsp_get_pipeline() was called. */
+ * pipeline, unless cras_dsp_get_pipeline() returned NULL. */
 void cras_dsp_put_pipeline(struct cras_dsp_context *ctx);
 
 /* Re-reads the ini file and reloads all pipelines in the system. */
@@ -76,6 +85,10 @@ void cras_dsp_reload_ini();
 /* Dump current dsp information to syslog. */
 void cras_dsp_dump_info();
 
+/* Fills |info| with the CPU time profile of the loaded pipelines. The
+ * first call turns profiling on, so its module profiles are empty. */
+void cras_dsp_get_profile_info(struct dsp_profile_info *info);
+
 /* Number of channels output. */
 unsigned int cras_dsp_num_output_channels(const struct cras_dsp_context *ctx);
 
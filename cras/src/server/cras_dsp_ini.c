@@ -32,6 +32,12 @@
 - Each plugin can have an optional "disable expression", which defines
   under which conditions the plugin is disabled.
 
+- The "source" built-in plugin can have an optional "fixed_point"
+  expression. When it is true the pipeline starting from that source
+  processes Q31 samples with fixed-point arithmetic instead of floats,
+  for boards without a fast FPU. It only takes effect if every plugin
+  in the pipeline has a fixed-point implementation.
+
 - Each plugin have some ports which specify the parameters for the
   plugin or to specify connections to other plugins. The ports in each
   plugin are numbered from 0. Each port is either an input port or an
@@ -151,6 +157,8 @@ static int parse_plugin_section(struct ini *ini, const char *sec_name,
 	p->purpose = getstring(ini, sec_name, "purpose");
 	p->disable_expr = cras_expr_expression_parse(
 		getstring(ini, sec_name, "disable"));
+	p->fixed_point_expr = cras_expr_expression_parse(
+		getstring(ini, sec_name, "fixed_point"));
 
 	if (p->library == NULL || p->label == NULL) {
 		syslog(LOG_ERR, "A plugin must have library and label: %s",
@@ -418,6 +426,7 @@ void cras_dsp_ini_free(struct ini *ini)
 	/* free plugins */
 	FOR_ARRAY_ELEMENT(&ini->plugins, i, p) {
 		cras_expr_expression_free(p->disable_expr);
+		cras_expr_expression_free(p->fixed_point_expr);
 		ARRAY_FREE(&p->ports);
 	}
 	ARRAY_FREE(&ini->plugins);
@@ -473,6 +482,7 @@ void cras_dsp_ini_dump(struct dumper *d, struct ini *ini)
 		dumpf(d, "label=%s\n", plugin->label);
 		dumpf(d, "purpose=%s\n", plugin->purpose);
 		dumpf(d, "disable=%p\n", plugin->disable_expr);
+		dumpf(d, "fixed_point=%p\n", plugin->fixed_point_expr);
 		FOR_ARRAY_ELEMENT(&plugin->ports, j, port) {
 			dumpf(d,
 			      "  [%s port %d] type=%s, flow_id=%d, value=%g\n",
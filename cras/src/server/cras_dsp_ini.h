@@ -49,6 +49,8 @@ struct plugin {
 	const char *purpose;  /* like "playback" or "capture" */
 	struct cras_expr_expression *disable_expr;  /* the disable expression of
 					     this plugin */
+	struct cras_expr_expression *fixed_point_expr;  /* for a source plugin,
+					     whether the pipeline runs in Q31 */
 	port_array ports;
 };
 
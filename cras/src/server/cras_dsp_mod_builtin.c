@@ -50,6 +50,7 @@ static void empty_init_module(struct dsp_module *module)
 	module->connect_port = &empty_connect_port;
 	module->get_delay = &empty_get_delay;
 	module->run = &empty_run;
+	module->run_q31 = &empty_run;
 	module->deinstantiate = &empty_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
@@ -90,6 +91,19 @@ static void swap_lr_run(struct dsp_module *module,
 	}
 }
 
+static void swap_lr_run_q31(struct dsp_module *module,
+			    unsigned long sample_count)
+{
+	size_t i;
+	int32_t **ports = (int32_t **)module->data;
+
+	for (i = 0; i < sample_count; i++) {
+		int32_t temp = ports[0][i];
+		ports[2][i] = ports[1][i];
+		ports[3][i] = temp;
+	}
+}
+
 static void swap_lr_deinstantiate(struct dsp_module *module)
 {
 	free(module->data);
@@ -101,6 +115,7 @@ static void swap_lr_init_module(struct dsp_module *module)
 	module->connect_port = &swap_lr_connect_port;
 	module->get_delay = &empty_get_delay;
 	module->run = &swap_lr_run;
+	module->run_q31 = &swap_lr_run_q31;
 	module->deinstantiate = &swap_lr_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
@@ -136,6 +151,20 @@ static void invert_lr_run(struct dsp_module *module,
 	}
 }
 
+static void invert_lr_run_q31(struct dsp_module *module,
+			      unsigned long sample_count)
+{
+	size_t i;
+	int32_t **ports = (int32_t **)module->data;
+
+	/* -INT32_MIN doesn't fit, saturate it. */
+	for (i = 0; i < sample_count; i++) {
+		int32_t x = ports[0][i];
+		ports[2][i] = (x == INT32_MIN) ? INT32_MAX : -x;
+		ports[3][i] = ports[1][i];
+	}
+}
+
 static void invert_lr_deinstantiate(struct dsp_module *module)
 {
 	free(module->data);
@@ -147,6 +176,7 @@ static void invert_lr_init_module(struct dsp_module *module)
 	module->connect_port = &invert_lr_connect_port;
 	module->get_delay = &empty_get_delay;
 	module->run = &invert_lr_run;
+	module->run_q31 = &invert_lr_run_q31;
 	module->deinstantiate = &invert_lr_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
@@ -184,6 +214,24 @@ static void mix_stereo_run(struct dsp_module *module,
 	}
 }
 
+static void mix_stereo_run_q31(struct dsp_module *module,
+			       unsigned long sample_count)
+{
+	size_t i;
+	int64_t tmp;
+	int32_t **ports = (int32_t **)module->data;
+
+	for (i = 0; i < sample_count; i++) {
+		tmp = (int64_t)ports[0][i] + ports[1][i];
+		if (tmp > INT32_MAX)
+			tmp = INT32_MAX;
+		else if (tmp < INT32_MIN)
+			tmp = INT32_MIN;
+		ports[2][i] = tmp;
+		ports[3][i] = tmp;
+	}
+}
+
 static void mix_stereo_deinstantiate(struct dsp_module *module)
 {
 	free(module->data);
@@ -195,6 +243,7 @@ static void mix_stereo_init_module(struct dsp_module *module)
 	module->connect_port = &mix_stereo_connect_port;
 	module->get_delay = &empty_get_delay;
 	module->run = &mix_stereo_run;
+	module->run_q31 = &mix_stereo_run_q31;
 	module->deinstantiate = &mix_stereo_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
@@ -367,9 +416,8 @@ static void eq2_connect_port(struct dsp_module *module,
 	data->ports[port] = data_location;
 }
 
-static void eq2_run(struct dsp_module *module, unsigned long sample_count)
+static void eq2_init_filters(struct eq2_data *data)
 {
-	struct eq2_data *data = (struct eq2_data *) module->data;
 	if (!data->eq2) {
 		float nyquist = data->sample_rate / 2;
 		int i, channel;
@@ -389,7 +437,13 @@ static void eq2_run(struct dsp_module *module, unsigned long sample_count)
 			}
 		}
 	}
+}
 
+static void eq2_run(struct dsp_module *module, unsigned long sample_count)
+{
+	struct eq2_data *data = (struct eq2_data *) module->data;
+
+	eq2_init_filters(data);
 
 	if (data->ports[0] != data->ports[2])
 		memcpy(data->ports[2], data->ports[0],
@@ -402,6 +456,24 @@ static void eq2_run(struct dsp_module *module, unsigned long sample_count)
 		    (int) sample_count);
 }
 
+static void eq2_run_q31(struct dsp_module *module, unsigned long sample_count)
+{
+	struct eq2_data *data = (struct eq2_data *) module->data;
+	int32_t *in[2] = { (int32_t *)data->ports[0],
+			   (int32_t *)data->ports[1] };
+	int32_t *out[2] = { (int32_t *)data->ports[2],
+			    (int32_t *)data->ports[3] };
+
+	eq2_init_filters(data);
+
+	if (in[0] != out[0])
+		memcpy(out[0], in[0], sizeof(int32_t) * sample_count);
+	if (in[1] != out[1])
+		memcpy(out[1], in[1], sizeof(int32_t) * sample_count);
+
+	eq2_process_q31(data->eq2, out[0], out[1], (int) sample_count);
+}
+
 static void eq2_deinstantiate(struct dsp_module *module)
 {
 	struct eq2_data *data = (struct eq2_data *) module->data;
@@ -416,6 +488,7 @@ static void eq2_init_module(struct dsp_module *module)
 	module->connect_port = &eq2_connect_port;
 	module->get_delay = &empty_get_delay;
 	module->run = &eq2_run;
+	module->run_q31 = &eq2_run_q31;
 	module->deinstantiate = &eq2_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
@@ -457,9 +530,8 @@ static int drc_get_delay(struct dsp_module *module)
 	return DRC_DEFAULT_PRE_DELAY * data->sample_rate;
 }
 
-static void drc_run(struct dsp_module *module, unsigned long sample_count)
+static void drc_init_drc(struct drc_data *data)
 {
-	struct drc_data *data = (struct drc_data *) module->data;
 	if (!data->drc) {
 		int i;
 		float nyquist = data->sample_rate / 2;
@@ -489,6 +561,13 @@ static void drc_run(struct dsp_module *module, unsigned long sample_count)
 		}
 		drc_init(drc);
 	}
+}
+
+static void drc_run(struct dsp_module *module, unsigned long sample_count)
+{
+	struct drc_data *data = (struct drc_data *) module->data;
+
+	drc_init_drc(data);
 	if (data->ports[0] != data->ports[2])
 		memcpy(data->ports[2], data->ports[0],
 		       sizeof(float) * sample_count);
@@ -499,6 +578,23 @@ static void drc_run(struct dsp_module *module, unsigned long sample_count)
 	drc_process(data->drc, &data->ports[2], (int) sample_count);
 }
 
+static void drc_run_q31(struct dsp_module *module, unsigned long sample_count)
+{
+	struct drc_data *data = (struct drc_data *) module->data;
+	int32_t *in[2] = { (int32_t *)data->ports[0],
+			   (int32_t *)data->ports[1] };
+	int32_t *out[2] = { (int32_t *)data->ports[2],
+			    (int32_t *)data->ports[3] };
+
+	drc_init_drc(data);
+	if (in[0] != out[0])
+		memcpy(out[0], in[0], sizeof(int32_t) * sample_count);
+	if (in[1] != out[1])
+		memcpy(out[1], in[1], sizeof(int32_t) * sample_count);
+
+	drc_process_q31(data->drc, out, (int) sample_count);
+}
+
 static void drc_deinstantiate(struct dsp_module *module)
 {
 	struct drc_data *data = (struct drc_data *) module->data;
@@ -513,6 +609,7 @@ static void drc_init_module(struct dsp_module *module)
 	module->connect_port = &drc_connect_port;
 	module->get_delay = &drc_get_delay;
 	module->run = &drc_run;
+	module->run_q31 = &drc_run_q31;
 	module->deinstantiate = &drc_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
@@ -562,6 +659,7 @@ static void sink_init_module(struct dsp_module *module)
 	module->connect_port = &sink_connect_port;
 	module->get_delay = &empty_get_delay;
 	module->run = &sink_run;
+	module->run_q31 = &empty_run;
 	module->deinstantiate = &sink_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
@@ -574,6 +672,8 @@ void cras_dsp_module_set_sink_ext_module(struct dsp_module *module,
 	struct sink_data *data = (struct sink_data *)module->data;
 	int i;
 	data->ext_module = ext_module;
+	if (!ext_module)
+		return;
 
 	for (i = 0; i < MAX_EXT_DSP_PORTS; i++)
 		ext_module->ports[i] = data->ports[i];
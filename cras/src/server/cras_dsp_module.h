@@ -54,6 +54,15 @@ struct dsp_module {
 	 */
 	void (*run)(struct dsp_module *mod, unsigned long sample_count);
 
+	/* The fixed-point version of run(), used when the pipeline runs in
+	 * Q31. The audio ports connected by connect_port() then hold int32_t
+	 * Q31 samples instead of floats, control ports are still floats. This
+	 * is NULL if the module can only process float samples.
+	 * Args:
+	 *    sample_count - The number of samples to be processed.
+	 */
+	void (*run_q31)(struct dsp_module *mod, unsigned long sample_count);
+
 	/* Free resources used by the module. This module can be used
 	 * again by calling instantiate() */
 	void (*deinstantiate)(struct dsp_module *mod);
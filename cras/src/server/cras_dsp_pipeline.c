@@ -3,7 +3,10 @@
  * found in the LICENSE file.
  */
 
+#include <errno.h>
 #include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
 #include <sys/param.h>
 #include <syslog.h>
 
@@ -92,6 +95,13 @@ struct instance {
 	/* This is the total buffering delay from source to this instance. It is
 	 * in number of frames. */
 	int total_delay;
+
+	/* The CPU time spent in run() of this module. See
+	 * struct dsp_module_profile_info for the histogram buckets. */
+	uint64_t runs;
+	uint64_t total_ns;
+	uint32_t max_ns;
+	uint32_t histogram[DSP_PROFILE_NUM_BUCKETS];
 };
 
 DECLARE_ARRAY_TYPE(struct instance, instance_array)
@@ -142,6 +152,25 @@ struct pipeline {
 
 	/* The total number of sample frames the pipeline processed */
 	int64_t total_samples;
+
+	/* The external module connected to the sink instance, if any. */
+	struct ext_dsp_module *sink_ext_module;
+
+	/* Non-zero if the audio buffers hold Q31 samples and the modules are
+	 * run with run_q31(). See the "fixed_point" key in cras_dsp_ini.c.
+	 * Fixed once the pipeline is loaded. */
+	int fixed_point;
+
+	/* The pipeline this one is crossfading from, or NULL. While set,
+	 * the old pipeline is fed the same input and its output fades out
+	 * as the output of this pipeline fades in. It is cleared by the
+	 * thread running the pipeline once the crossfade completes. */
+	struct pipeline *fade_from;
+
+	/* The length of the crossfade and how far it has progressed, in
+	 * frames. */
+	unsigned int fade_frames;
+	unsigned int fade_pos;
 };
 
 static struct instance *find_instance_by_plugin(instance_array *instances,
@@ -274,6 +303,15 @@ static char is_disabled(struct plugin *plugin, struct cras_expr_env *env)
 		disabled == 1);
 }
 
+static char is_fixed_point(struct plugin *source, struct cras_expr_env *env)
+{
+	char fixed_point;
+	return (source->fixed_point_expr &&
+		cras_expr_expression_eval_boolean(
+			source->fixed_point_expr, env, &fixed_point) == 0 &&
+		fixed_point == 1);
+}
+
 static int topological_sort(struct pipeline *pipeline,
 			    struct cras_expr_env *env,
 			    struct plugin *plugin, char* visited)
@@ -426,6 +464,7 @@ struct pipeline *cras_dsp_pipeline_create(struct ini *ini,
 
 	pipeline->ini = ini;
 	pipeline->purpose = purpose;
+	pipeline->fixed_point = is_fixed_point(source, env);
 	/* create instances for needed plugins, in the order of dependency */
 	n = ARRAY_COUNT(&ini->plugins);
 	visited = calloc(1, n);
@@ -602,6 +641,12 @@ int cras_dsp_pipeline_load(struct pipeline *pipeline)
 		struct plugin *plugin = instance->plugin;
 		if (load_module(plugin, instance) != 0)
 			return -1;
+		if (pipeline->fixed_point && !instance->module->run_q31) {
+			syslog(LOG_WARNING,
+			       "%s has no fixed-point version, run in float",
+			       plugin->title);
+			pipeline->fixed_point = 0;
+		}
 	}
 
 	if (allocate_buffers(pipeline) != 0)
@@ -780,22 +825,199 @@ float *cras_dsp_pipeline_get_sink_buffer(struct pipeline *pipeline, int index)
 			   index);
 }
 
-void cras_dsp_pipeline_set_sink_ext_module(struct pipeline *pipeline,
-					   struct ext_dsp_module *ext_module)
+void cras_dsp_pipeline_disable_fixed_point(struct pipeline *pipeline)
 {
+	pipeline->fixed_point = 0;
+}
+
+int cras_dsp_pipeline_set_sink_ext_module(struct pipeline *pipeline,
+					  struct ext_dsp_module *ext_module)
+{
+	/* External modules only process floats. */
+	if (ext_module && pipeline->fixed_point) {
+		syslog(LOG_ERR, "ext module on a fixed-point pipeline");
+		return -EINVAL;
+	}
+	pipeline->sink_ext_module = ext_module;
 	cras_dsp_module_set_sink_ext_module(
 			pipeline->sink_instance->module,
 			ext_module);
+	return 0;
 }
 
-void cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count)
+/* Non-zero once per-module profiling is turned on. Written by the main
+ * thread, read by the audio thread before each block. */
+static int profile_enabled;
+
+void cras_dsp_pipeline_enable_profile()
+{
+	profile_enabled = 1;
+}
+
+static inline int64_t timespec_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+/* Accounts |ns| of CPU time to one run of |instance|. */
+static void add_instance_time(struct instance *instance, int64_t ns)
+{
+	uint32_t us;
+	int bucket;
+
+	if (ns < 0)
+		ns = 0;
+	if (ns > UINT32_MAX)
+		ns = UINT32_MAX;
+
+	us = ns / 1000;
+	bucket = us ? 32 - __builtin_clz(us) : 0;
+	if (bucket >= DSP_PROFILE_NUM_BUCKETS)
+		bucket = DSP_PROFILE_NUM_BUCKETS - 1;
+
+	instance->runs++;
+	instance->total_ns += ns;
+	instance->max_ns = MAX(instance->max_ns, (uint32_t)ns);
+	instance->histogram[bucket]++;
+}
+
+/* Runs the modules of the pipeline with the sample type the caller read
+ * once for the whole block. */
+static void run_modules(struct pipeline *pipeline, int sample_count,
+			int fixed_point)
 {
 	int i;
 	struct instance *instance;
+	struct timespec ts;
+	int64_t begin, end;
+
+	if (!profile_enabled) {
+		FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+			struct dsp_module *module = instance->module;
+			if (fixed_point)
+				module->run_q31(module, sample_count);
+			else
+				module->run(module, sample_count);
+		}
+		return;
+	}
+
+	/* The end of one module is the beginning of the next one, so this
+	 * costs only one clock read per module. */
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	begin = timespec_to_ns(&ts);
 
 	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
 		struct dsp_module *module = instance->module;
-		module->run(module, sample_count);
+		if (fixed_point)
+			module->run_q31(module, sample_count);
+		else
+			module->run(module, sample_count);
+
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		end = timespec_to_ns(&ts);
+		add_instance_time(instance, end - begin);
+		begin = end;
+	}
+}
+
+void cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count)
+{
+	run_modules(pipeline, sample_count, pipeline->fixed_point);
+}
+
+int cras_dsp_pipeline_is_fixed_point(struct pipeline *pipeline)
+{
+	return pipeline->fixed_point;
+}
+
+int cras_dsp_pipeline_set_crossfade(struct pipeline *pipeline,
+				    struct pipeline *old_pipeline,
+				    unsigned int frames)
+{
+	if (frames == 0 ||
+	    old_pipeline->input_channels != pipeline->input_channels ||
+	    old_pipeline->output_channels != pipeline->output_channels ||
+	    old_pipeline->sample_rate != pipeline->sample_rate ||
+	    old_pipeline->fixed_point != pipeline->fixed_point ||
+	    old_pipeline->sink_ext_module)
+		return -EINVAL;
+
+	pipeline->fade_frames = frames;
+	pipeline->fade_pos = 0;
+	pipeline->fade_from = old_pipeline;
+	return 0;
+}
+
+struct pipeline *cras_dsp_pipeline_get_crossfade_source(
+		struct pipeline *pipeline)
+{
+	return pipeline->fade_from;
+}
+
+/* The Q31 version of the crossfade ramp in run_with_crossfade(). */
+static void crossfade_q31(int32_t *new_buf, const int32_t *old_buf, int count,
+			  int64_t pos, int64_t frames)
+{
+	int j;
+
+	for (j = 0; j < count && pos < frames; j++, pos++)
+		new_buf[j] = old_buf[j] +
+			     ((int64_t)new_buf[j] - old_buf[j]) * pos / frames;
+}
+
+/* Runs the pipeline on sample_count frames already in its source buffers.
+ * If the pipeline is crossfading from an old one, the old pipeline (and
+ * whatever it is still fading from) processes a copy of the same input and
+ * the two outputs are mixed with a linear ramp. */
+static void run_with_crossfade(struct pipeline *pipeline, int sample_count,
+			       int fixed_point)
+{
+	struct pipeline *old = pipeline->fade_from;
+	float *new_buf, *old_buf;
+	float gain, step;
+	int i, j;
+
+	if (!old) {
+		run_modules(pipeline, sample_count, fixed_point);
+		return;
+	}
+
+	/* Copy the input first, the new pipeline may process in place. */
+	for (i = 0; i < pipeline->input_channels; i++)
+		memcpy(cras_dsp_pipeline_get_source_buffer(old, i),
+		       cras_dsp_pipeline_get_source_buffer(pipeline, i),
+		       sample_count * sizeof(float));
+
+	run_with_crossfade(old, sample_count, fixed_point);
+	run_modules(pipeline, sample_count, fixed_point);
+
+	step = 1.0f / pipeline->fade_frames;
+	for (i = 0; i < pipeline->output_channels; i++) {
+		new_buf = cras_dsp_pipeline_get_sink_buffer(pipeline, i);
+		old_buf = cras_dsp_pipeline_get_sink_buffer(old, i);
+		if (fixed_point) {
+			crossfade_q31((int32_t *)new_buf, (int32_t *)old_buf,
+				      sample_count, pipeline->fade_pos,
+				      pipeline->fade_frames);
+			continue;
+		}
+		gain = pipeline->fade_pos * step;
+		for (j = 0; j < sample_count; j++) {
+			if (gain >= 1.0f)
+				break;
+			new_buf[j] = old_buf[j] + (new_buf[j] - old_buf[j]) *
+				     gain;
+			gain += step;
+		}
+	}
+
+	pipeline->fade_pos += sample_count;
+	if (pipeline->fade_pos >= pipeline->fade_frames) {
+		/* Make sure we are done with the old pipeline before
+		 * telling the main thread it can be freed. */
+		__sync_synchronize();
+		pipeline->fade_from = NULL;
 	}
 }
 
@@ -807,7 +1029,7 @@ void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
 	if (samples <= 0)
 		return;
 
-	t = time_delta->tv_sec * 1000000000LL + time_delta->tv_nsec;
+	t = timespec_to_ns(time_delta);
 
 	if (pipeline->total_blocks == 0) {
 		pipeline->max_time = t;
@@ -832,6 +1054,7 @@ int cras_dsp_pipeline_apply(struct pipeline *pipeline, uint8_t *buf,
 	unsigned int output_channels = pipeline->output_channels;
 	float *source[input_channels];
 	float *sink[output_channels];
+	int fixed_point = pipeline->fixed_point;
 	struct timespec begin, end, delta;
 	int rc;
 
@@ -852,18 +1075,28 @@ int cras_dsp_pipeline_apply(struct pipeline *pipeline, uint8_t *buf,
 	while (remaining > 0) {
 		chunk = MIN(remaining, (size_t)DSP_BUFFER_SIZE);
 
-		/* deinterleave and convert to float */
-		rc = dsp_util_deinterleave(buf, source, input_channels,
-					   format, chunk);
+		/* deinterleave and convert to float, or Q31 */
+		if (fixed_point)
+			rc = dsp_util_deinterleave_q31(
+					buf, (int32_t *const *)source,
+					input_channels, format, chunk);
+		else
+			rc = dsp_util_deinterleave(buf, source, input_channels,
+						   format, chunk);
 		if (rc)
 			return rc;
 
 		/* Run the pipeline */
-		cras_dsp_pipeline_run(pipeline, chunk);
+		run_with_crossfade(pipeline, chunk, fixed_point);
 
 		/* interleave and convert back to int16_t */
-		rc = dsp_util_interleave(sink, buf, output_channels,
-					 format, chunk);
+		if (fixed_point)
+			rc = dsp_util_interleave_q31(
+					(int32_t *const *)sink, buf,
+					output_channels, format, chunk);
+		else
+			rc = dsp_util_interleave(sink, buf, output_channels,
+						 format, chunk);
 		if (rc)
 			return rc;
 
@@ -909,6 +1142,67 @@ void cras_dsp_pipeline_free(struct pipeline *pipeline)
 	free(pipeline);
 }
 
+void cras_dsp_pipeline_get_profile(struct pipeline *pipeline,
+				   struct dsp_pipeline_profile_info *info)
+{
+	int i;
+	struct instance *instance;
+	struct dsp_module_profile_info *mod_info;
+
+	memset(info, 0, sizeof(*info));
+	snprintf(info->purpose, sizeof(info->purpose), "%s",
+		 pipeline->purpose ? pipeline->purpose : "");
+	info->sample_rate = pipeline->sample_rate;
+	info->fixed_point = pipeline->fixed_point;
+	info->total_samples = pipeline->total_samples;
+	info->total_ns = pipeline->total_time;
+	info->max_ns = pipeline->max_time;
+
+	FOR_ARRAY_ELEMENT(&pipeline->instances, i, instance) {
+		if (i >= MAX_DEBUG_DSP_MODULES)
+			break;
+		mod_info = &info->modules[i];
+		snprintf(mod_info->name, sizeof(mod_info->name), "%s",
+			 instance->plugin->title);
+		mod_info->runs = instance->runs;
+		mod_info->total_ns = instance->total_ns;
+		mod_info->max_ns = instance->max_ns;
+		memcpy(mod_info->histogram, instance->histogram,
+		       sizeof(mod_info->histogram));
+		info->num_modules++;
+	}
+}
+
+static void dump_instance_profile(struct dumper *d, struct instance *instance)
+{
+	char hist[DSP_PROFILE_NUM_BUCKETS * 24];
+	int len = 0;
+	int i;
+
+	dumpf(d, "   runs=%" PRIu64 ", total=%" PRIu64 "ns, max=%uns",
+	      instance->runs, instance->total_ns, instance->max_ns);
+	if (instance->runs)
+		dumpf(d, ", avg=%" PRIu64 "ns",
+		      instance->total_ns / instance->runs);
+	dumpf(d, "\n");
+
+	/* Only the non-empty buckets, labeled by their upper bound in us. */
+	hist[0] = '\0';
+	for (i = 0; i < DSP_PROFILE_NUM_BUCKETS; i++) {
+		if (!instance->histogram[i])
+			continue;
+		if (i == DSP_PROFILE_NUM_BUCKETS - 1)
+			len += snprintf(hist + len, sizeof(hist) - len,
+					" >=%u:%u", 1u << (i - 1),
+					instance->histogram[i]);
+		else
+			len += snprintf(hist + len, sizeof(hist) - len,
+					" <%u:%u", 1u << i,
+					instance->histogram[i]);
+	}
+	dumpf(d, "   histogram(us):%s\n", hist);
+}
+
 static void dump_audio_ports(struct dumper *d, const char *name,
 			     audio_port_array *audio_ports)
 {
@@ -955,6 +1249,11 @@ void cras_dsp_pipeline_dump(struct dumper *d, struct pipeline *pipeline)
 	dumpf(d, " input channels: %d\n", pipeline->input_channels);
 	dumpf(d, " output channels: %d\n", pipeline->output_channels);
 	dumpf(d, " sample_rate: %d\n", pipeline->sample_rate);
+	dumpf(d, " fixed_point: %d\n", pipeline->fixed_point);
+	if (pipeline->fade_from)
+		dumpf(d, " crossfading from %p: %u/%u frames\n",
+		      pipeline->fade_from, pipeline->fade_pos,
+		      pipeline->fade_frames);
 	dumpf(d, " processed samples: %" PRId64 "\n", pipeline->total_samples);
 	dumpf(d, " processed blocks: %" PRId64 "\n", pipeline->total_blocks);
 	dumpf(d, " total processing time: %" PRId64 "ns\n",
@@ -980,6 +1279,7 @@ void cras_dsp_pipeline_dump(struct dumper *d, struct pipeline *pipeline)
 		      instance->total_delay);
 		if (module)
 			module->dump(module, d);
+		dump_instance_profile(d, instance);
 		dump_audio_ports(d, "input_audio_ports",
 				 &instance->input_audio_ports);
 		dump_audio_ports(d, "output_audio_ports",
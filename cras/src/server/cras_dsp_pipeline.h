@@ -16,6 +16,7 @@ extern "C" {
 #include "cras_audio_format.h"
 #include "cras_dsp_ini.h"
 #include "cras_dsp_module.h"
+#include "cras_types.h"
 
 /* These are the functions to create and use dsp pipelines. A dsp
  * pipeline is a collection of dsp plugins that process audio
@@ -49,6 +50,10 @@ struct pipeline *cras_dsp_pipeline_create(struct ini* ini,
 /* Frees the resources used by the pipeline. */
 void cras_dsp_pipeline_free(struct pipeline *pipeline);
 
+/* Makes the pipeline process floats even if the source plugin asks for
+ * fixed point. Must be called before cras_dsp_pipeline_load(). */
+void cras_dsp_pipeline_disable_fixed_point(struct pipeline *pipeline);
+
 /* Loads the implementation of the plugins in the pipeline (from
  * shared libraries). Must be called before
  * cras_dsp_pipeline_instantiate().
@@ -106,10 +111,14 @@ float *cras_dsp_pipeline_get_sink_buffer(struct pipeline *pipeline, int index);
  * Connects |ext_module| to the sink of given dsp pipeline.
  * Args:
  *    pipeline - The pipeline whose sink should connect to ext_module.
- *    ext_module - The external dsp module to connect to pipeline sink.
+ *    ext_module - The external dsp module to connect to pipeline sink,
+ *        or NULL to disconnect the current one.
+ * Returns:
+ *    0 if successful. -EINVAL if the pipeline runs in fixed point, as
+ *    external modules only process floats.
  */
-void cras_dsp_pipeline_set_sink_ext_module(struct pipeline *pipeline,
-					   struct ext_dsp_module *ext_module);
+int cras_dsp_pipeline_set_sink_ext_module(struct pipeline *pipeline,
+					  struct ext_dsp_module *ext_module);
 
 /* Returns the number of internal audio buffers allocated by the
  * pipeline. This is used by the unit test only */
@@ -123,6 +132,37 @@ int cras_dsp_pipeline_get_sample_rate(struct pipeline *pipeline);
  * than DSP_BUFFER_SIZE */
 void cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count);
 
+/* Returns non-zero if the pipeline processes Q31 samples with the fixed-point
+ * version of its modules. This is requested by the "fixed_point" expression
+ * of the source plugin, and only honored if every module supports it and
+ * fixed point wasn't disabled. It doesn't change once the pipeline is loaded.
+ */
+int cras_dsp_pipeline_is_fixed_point(struct pipeline *pipeline);
+
+/* Makes the pipeline crossfade from an old pipeline it replaces. For the
+ * next |frames| frames cras_dsp_pipeline_apply() also runs the old pipeline
+ * on the same input and ramps linearly from its output to the output of
+ * the new one, so swapping pipelines doesn't reset the filter state
+ * audibly. The old pipeline must stay valid until
+ * cras_dsp_pipeline_get_crossfade_source() returns NULL.
+ * Args:
+ *    pipeline - The new pipeline, instantiated.
+ *    old_pipeline - The pipeline being replaced.
+ *    frames - The length of the crossfade.
+ * Returns:
+ *    0 if successful. -EINVAL if the pipelines have different channel
+ *    counts, sample rates or sample types, or an external module is
+ *    attached to the sink of the old pipeline.
+ */
+int cras_dsp_pipeline_set_crossfade(struct pipeline *pipeline,
+				    struct pipeline *old_pipeline,
+				    unsigned int frames);
+
+/* Returns the pipeline this one is still crossfading from, or NULL when
+ * there is no crossfade in progress. */
+struct pipeline *cras_dsp_pipeline_get_crossfade_source(
+		struct pipeline *pipeline);
+
 /* Add a statistic of running time for the pipeline.
  *
  * Args:
@@ -146,6 +186,21 @@ void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
 int cras_dsp_pipeline_apply(struct pipeline *pipeline, uint8_t *buf,
 			    snd_pcm_format_t format, unsigned int frames);
 
+/* Starts timing every instance with CLOCK_THREAD_CPUTIME_ID each time a
+ * pipeline runs. Profiling is off by default and stays on once enabled. */
+void cras_dsp_pipeline_enable_profile();
+
+/* Copies the CPU time profile of the pipeline and its instances. The
+ * profile is cumulative from the creation of the pipeline, or from the
+ * call to cras_dsp_pipeline_enable_profile() if that came later.
+ * Args:
+ *    pipeline - The pipeline to get the profile of.
+ *    info - Filled with the profile. Only the first MAX_DEBUG_DSP_MODULES
+ *        instances are reported.
+ */
+void cras_dsp_pipeline_get_profile(struct pipeline *pipeline,
+				   struct dsp_pipeline_profile_info *info);
+
 /* Dumps the current state of the pipeline. For debugging only */
 void cras_dsp_pipeline_dump(struct dumper *d, struct pipeline *pipeline);
 
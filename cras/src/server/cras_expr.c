@@ -5,6 +5,7 @@
 
 #include <ctype.h>
 #include <stdlib.h>
+#include <sys/param.h>
 #include <syslog.h>
 
 #include "array.h"
@@ -114,36 +115,57 @@ void cras_expr_value_dump(struct dumper *d, const struct cras_expr_value *value)
 	}
 }
 
-static struct cras_expr_value *find_value(struct cras_expr_env *env,
-					  const char *name)
+/* Returns the slot of the variable, or -1 if it is not defined. */
+static int find_slot(struct cras_expr_env *env, const char *name)
 {
 	int i;
 	const char **key;
 
 	FOR_ARRAY_ELEMENT(&env->keys, i, key) {
 		if (strcmp(*key, name) == 0)
-			return ARRAY_ELEMENT(&env->values, i);
+			return i;
 	}
-	return NULL;
+	return -1;
 }
 
 /* Insert a (key, value) pair to the environment. The value is
- * initialized to zero. Return the pointer to value so it can be set
+ * initialized to zero. Return the slot of the value so it can be set
  * to the proper value. */
-static struct cras_expr_value *insert_value(struct cras_expr_env *env,
-					    const char *key)
+static int insert_slot(struct cras_expr_env *env, const char *key)
 {
 	*ARRAY_APPEND_ZERO(&env->keys) = strdup(key);
-	return ARRAY_APPEND_ZERO(&env->values);
+	ARRAY_APPEND_ZERO(&env->values);
+	ARRAY_APPEND_ZERO(&env->changed);
+	return ARRAY_COUNT(&env->keys) - 1;
 }
 
-static struct cras_expr_value *find_or_insert_value(struct cras_expr_env *env,
-						    const char *key)
+static int find_or_insert_slot(struct cras_expr_env *env, const char *key)
 {
-	struct cras_expr_value *value = find_value(env, key);
-	if (!value)
-		value = insert_value(env, key);
-	return value;
+	int slot = find_slot(env, key);
+	if (slot < 0)
+		slot = insert_slot(env, key);
+	return slot;
+}
+
+static char values_equal(const struct cras_expr_value *a,
+			 const struct cras_expr_value *b)
+{
+	if (a->type != b->type)
+		return 0;
+
+	switch (a->type) {
+	case CRAS_EXPR_VALUE_TYPE_NONE:
+		return 1;
+	case CRAS_EXPR_VALUE_TYPE_BOOLEAN:
+		return a->u.boolean == b->u.boolean;
+	case CRAS_EXPR_VALUE_TYPE_INT:
+		return a->u.integer == b->u.integer;
+	case CRAS_EXPR_VALUE_TYPE_STRING:
+		return strcmp(a->u.string, b->u.string) == 0;
+	case CRAS_EXPR_VALUE_TYPE_FUNCTION:
+		return a->u.function == b->u.function;
+	}
+	return 0;
 }
 
 static void function_not(cras_expr_value_array *operands,
@@ -222,30 +244,8 @@ static char function_equal_real(cras_expr_value_array *operands)
 		/* compare with the previous operand */
 
 		prev = ARRAY_ELEMENT(operands, i - 1);
-
-		if (prev->type != value->type)
+		if (!values_equal(prev, value))
 			return 0;
-
-		switch (prev->type) {
-		case CRAS_EXPR_VALUE_TYPE_NONE:
-			break;
-		case CRAS_EXPR_VALUE_TYPE_BOOLEAN:
-			if (prev->u.boolean != value->u.boolean)
-				return 0;
-			break;
-		case CRAS_EXPR_VALUE_TYPE_INT:
-			if (prev->u.integer != value->u.integer)
-				return 0;
-			break;
-		case CRAS_EXPR_VALUE_TYPE_STRING:
-			if (strcmp(prev->u.string, value->u.string) != 0)
-				return 0;
-			break;
-		case CRAS_EXPR_VALUE_TYPE_FUNCTION:
-			if (prev->u.function != value->u.function)
-				return 0;
-			break;
-		}
 	}
 
 	return 1;
@@ -257,54 +257,69 @@ static void function_equal(cras_expr_value_array *operands,
 	value_set_boolean(result, function_equal_real(operands));
 }
 
+/* Sets the variable, and records the change if the value is different so
+ * the expressions reading it are evaluated again. */
 static void env_set_variable(struct cras_expr_env *env, const char *name,
 			     struct cras_expr_value *new_value)
 {
-	struct cras_expr_value *value = find_or_insert_value(env, name);
+	int slot = find_or_insert_slot(env, name);
+	struct cras_expr_value *value = ARRAY_ELEMENT(&env->values, slot);
+
+	if (values_equal(value, new_value))
+		return;
 	copy_value(value, new_value);
+	*ARRAY_ELEMENT(&env->changed, slot) = ++env->generation;
 }
 
 void cras_expr_env_install_builtins(struct cras_expr_env *env)
 {
-	struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
-
 	/* initialize env with builtin functions */
-	cras_expr_value_set_function(&value, &function_not);
-	env_set_variable(env, "not", &value);
-
-	cras_expr_value_set_function(&value, &function_and);
-	env_set_variable(env, "and", &value);
-
-	cras_expr_value_set_function(&value, &function_or);
-	env_set_variable(env, "or", &value);
-
-	cras_expr_value_set_function(&value, &function_equal);
-	env_set_variable(env, "equal?", &value);
-
-	cras_expr_value_free(&value);
+	cras_expr_env_set_variable_function(env, "not", &function_not);
+	cras_expr_env_set_variable_function(env, "and", &function_and);
+	cras_expr_env_set_variable_function(env, "or", &function_or);
+	cras_expr_env_set_variable_function(env, "equal?", &function_equal);
 }
 
 void cras_expr_env_set_variable_boolean(struct cras_expr_env *env,
 					const char *name, char boolean)
 {
-	struct cras_expr_value *value = find_or_insert_value(env, name);
-	value_set_boolean(value, boolean);
+	struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
+
+	value_set_boolean(&value, boolean);
+	env_set_variable(env, name, &value);
 }
 
 void cras_expr_env_set_variable_integer(struct cras_expr_env *env,
 					const char *name, int integer)
 {
-	struct cras_expr_value *value = find_or_insert_value(env, name);
-	value_set_integer(value, integer);
+	struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
+
+	value_set_integer(&value, integer);
+	env_set_variable(env, name, &value);
 }
 
 void cras_expr_env_set_variable_string(struct cras_expr_env *env,
 				       const char *name, const char *str)
 {
-	struct cras_expr_value *value = find_or_insert_value(env, name);
-	value_set_string(value, str);
+	struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
+
+	value_set_string(&value, str);
+	env_set_variable(env, name, &value);
+	cras_expr_value_free(&value);
 }
 
+void cras_expr_env_set_variable_function(struct cras_expr_env *env,
+					 const char *name,
+					 cras_expr_function_type function)
+{
+	struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
+
+	cras_expr_value_set_function(&value, function);
+	env_set_variable(env, name, &value);
+}
+
+static void program_destroy(struct cras_expr_program *program);
+
 void cras_expr_env_free(struct cras_expr_env *env)
 {
 	int i;
@@ -319,8 +334,14 @@ void cras_expr_env_free(struct cras_expr_env *env)
 		cras_expr_value_free(value);
 	}
 
+	while (ARRAY_COUNT(&env->programs))
+		program_destroy(*ARRAY_ELEMENT(&env->programs, 0));
+
 	ARRAY_FREE(&env->keys);
 	ARRAY_FREE(&env->values);
+	ARRAY_FREE(&env->changed);
+	ARRAY_FREE(&env->programs);
+	env->generation = 0;
 }
 
 void cras_expr_env_dump(struct dumper *d, const struct cras_expr_env *env)
@@ -339,11 +360,19 @@ void cras_expr_env_dump(struct dumper *d, const struct cras_expr_env *env)
 	}
 }
 
-static struct cras_expr_expression *new_boolean_literal(char boolean)
+static struct cras_expr_expression *new_expression(enum expr_type type)
 {
 	struct cras_expr_expression *expr;
+
 	expr = calloc(1, sizeof(struct cras_expr_expression));
-	expr->type = EXPR_TYPE_LITERAL;
+	expr->type = type;
+	return expr;
+}
+
+static struct cras_expr_expression *new_boolean_literal(char boolean)
+{
+	struct cras_expr_expression *expr;
+	expr = new_expression(EXPR_TYPE_LITERAL);
 	value_set_boolean(&expr->u.literal, boolean);
 	return expr;
 }
@@ -351,8 +380,7 @@ static struct cras_expr_expression *new_boolean_literal(char boolean)
 static struct cras_expr_expression *new_integer_literal(int integer)
 {
 	struct cras_expr_expression *expr;
-	expr = calloc(1, sizeof(struct cras_expr_expression));
-	expr->type = EXPR_TYPE_LITERAL;
+	expr = new_expression(EXPR_TYPE_LITERAL);
 	value_set_integer(&expr->u.literal, integer);
 	return expr;
 }
@@ -361,8 +389,7 @@ static struct cras_expr_expression *new_string_literal(const char *begin,
 						       const char *end)
 {
 	struct cras_expr_expression *expr;
-	expr = calloc(1, sizeof(struct cras_expr_expression));
-	expr->type = EXPR_TYPE_LITERAL;
+	expr = new_expression(EXPR_TYPE_LITERAL);
 	value_set_string2(&expr->u.literal, begin, end);
 	return expr;
 }
@@ -371,8 +398,7 @@ static struct cras_expr_expression *new_variable(const char *begin,
 						 const char *end)
 {
 	struct cras_expr_expression *expr;
-	expr = calloc(1, sizeof(struct cras_expr_expression));
-	expr->type = EXPR_TYPE_VARIABLE;
+	expr = new_expression(EXPR_TYPE_VARIABLE);
 	expr->u.variable = copy_str(begin, end);
 	return expr;
 }
@@ -380,8 +406,7 @@ static struct cras_expr_expression *new_variable(const char *begin,
 static struct cras_expr_expression *new_compound_expression()
 {
 	struct cras_expr_expression *expr;
-	expr = calloc(1, sizeof(struct cras_expr_expression));
-	expr->type = EXPR_TYPE_COMPOUND;
+	expr = new_expression(EXPR_TYPE_COMPOUND);
 	return expr;
 }
 
@@ -545,6 +570,10 @@ void cras_expr_expression_free(struct cras_expr_expression *expr)
 	if (!expr)
 		return;
 
+	while (ARRAY_COUNT(&expr->programs))
+		program_destroy(*ARRAY_ELEMENT(&expr->programs, 0));
+	ARRAY_FREE(&expr->programs);
+
 	switch (expr->type) {
 	case EXPR_TYPE_NONE:
 		break;
@@ -568,61 +597,262 @@ void cras_expr_expression_free(struct cras_expr_expression *expr)
 	free(expr);
 }
 
-void cras_expr_expression_eval(struct cras_expr_expression *expr,
-			       struct cras_expr_env *env,
-			       struct cras_expr_value *result)
-{
-	cras_expr_value_free(result);
+/* Bytecode */
+
+enum expr_opcode {
+	/* Pushes literals[arg]. */
+	EXPR_OP_PUSH_LITERAL,
+	/* Pushes the value of the variable in slot arg. */
+	EXPR_OP_LOAD_VARIABLE,
+	/* Calls the function arg values down the stack with the values above
+	 * it as operands, and replaces them all with the result. */
+	EXPR_OP_CALL,
+};
+
+struct expr_instruction {
+	enum expr_opcode op;
+	int arg;
+};
+
+DECLARE_ARRAY_TYPE(struct expr_instruction, expr_instruction_array);
+DECLARE_ARRAY_TYPE(int, slot_array);
+
+struct cras_expr_program {
+	/* The expression this was compiled from, and the environment it was
+	 * compiled against. */
+	struct cras_expr_expression *expr;
+	struct cras_expr_env *env;
+	/* Set if the expression reads variables the environment didn't
+	 * define, then the number of variables it had. */
+	int has_undefined;
+	unsigned int num_keys;
+	expr_instruction_array code;
+	cras_expr_value_array literals;
+	/* The slots of the variables the expression reads. */
+	slot_array deps;
+	/* The evaluation stack, sized to the maximum depth. */
+	cras_expr_value_array stack;
+	/* The cached result, valid if evaluated is set and no variable in deps
+	 * changed after generation evaluated_at. */
+	struct cras_expr_value result;
+	int evaluated;
+	unsigned int evaluated_at;
+};
+
+static void emit(struct cras_expr_program *program, enum expr_opcode op,
+		 int arg)
+{
+	struct expr_instruction *ins = ARRAY_APPEND_ZERO(&program->code);
+	ins->op = op;
+	ins->arg = arg;
+}
+
+/* Compiles expr in postfix order. Returns the stack depth needed. */
+static int compile_one_expression(struct cras_expr_program *program,
+				  const struct cras_expr_expression *expr,
+				  struct cras_expr_env *env)
+{
+	int i, depth, sub_depth, max_depth;
+	int slot;
+	struct cras_expr_expression **psub;
 
 	switch (expr->type) {
 	case EXPR_TYPE_NONE:
-		break;
+	push_none:
+		/* Evaluates to none, same as a literal of no value. */
+		ARRAY_APPEND_ZERO(&program->literals);
+		emit(program, EXPR_OP_PUSH_LITERAL,
+		     ARRAY_COUNT(&program->literals) - 1);
+		return 1;
 	case EXPR_TYPE_LITERAL:
-		copy_value(result, &expr->u.literal);
-		break;
+		copy_value(ARRAY_APPEND_ZERO(&program->literals),
+			   (struct cras_expr_value *)&expr->u.literal);
+		emit(program, EXPR_OP_PUSH_LITERAL,
+		     ARRAY_COUNT(&program->literals) - 1);
+		return 1;
 	case EXPR_TYPE_VARIABLE:
-	{
-		struct cras_expr_value *value = find_value(env,
-							   expr->u.variable);
-		if (value == NULL) {
-			syslog(LOG_ERR, "cannot find value for %s",
-			       expr->u.variable);
-		} else {
-			copy_value(result, value);
+		/* Undefined variables evaluate to none. The program is
+		 * compiled again once more variables are defined. */
+		slot = find_slot(env, expr->u.variable);
+		if (slot < 0) {
+			program->has_undefined = 1;
+			goto push_none;
 		}
-		break;
-	}
+		if (ARRAY_FIND(&program->deps, slot) < 0)
+			ARRAY_APPEND(&program->deps, slot);
+		emit(program, EXPR_OP_LOAD_VARIABLE, slot);
+		return 1;
 	case EXPR_TYPE_COMPOUND:
-	{
-		int i;
-		struct cras_expr_expression **psub;
-		cras_expr_value_array values = ARRAY_INIT;
-		struct cras_expr_value *value;
-
+		depth = 0;
+		max_depth = 1;
 		FOR_ARRAY_ELEMENT(&expr->u.children, i, psub) {
-			value = ARRAY_APPEND_ZERO(&values);
-			cras_expr_expression_eval(*psub, env, value);
+			sub_depth = compile_one_expression(program, *psub, env);
+			max_depth = MAX(max_depth, depth + sub_depth);
+			depth++;
+		}
+		emit(program, EXPR_OP_CALL, ARRAY_COUNT(&expr->u.children));
+		return max_depth;
+	}
+	return 0;
+}
+
+/* Compiles the expression of |program| into it. */
+static void compile(struct cras_expr_program *program)
+{
+	int i, depth;
+
+	program->num_keys = ARRAY_COUNT(&program->env->keys);
+	depth = compile_one_expression(program, program->expr, program->env);
+	for (i = 0; i < depth; i++)
+		ARRAY_APPEND_ZERO(&program->stack);
+}
+
+/* Frees what was compiled into |program|, and its cached result. */
+static void program_clear(struct cras_expr_program *program)
+{
+	int i;
+	struct cras_expr_value *value;
+
+	FOR_ARRAY_ELEMENT(&program->literals, i, value) {
+		cras_expr_value_free(value);
+	}
+	ARRAY_FREE(&program->literals);
+	ARRAY_FREE(&program->code);
+	ARRAY_FREE(&program->deps);
+	ARRAY_FREE(&program->stack);
+	cras_expr_value_free(&program->result);
+	program->has_undefined = 0;
+	program->evaluated = 0;
+}
+
+/* Removes |program| from |programs|, the order is not kept. */
+static void remove_program(cras_expr_program_array *programs,
+			   struct cras_expr_program *program)
+{
+	int i = ARRAY_FIND(programs, program);
+
+	if (i < 0)
+		return;
+	*ARRAY_ELEMENT(programs, i) =
+		*ARRAY_ELEMENT(programs, ARRAY_COUNT(programs) - 1);
+	programs->count--;
+}
+
+/* Drops |program| from its expression and environment, and frees it. */
+static void program_destroy(struct cras_expr_program *program)
+{
+	remove_program(&program->expr->programs, program);
+	remove_program(&program->env->programs, program);
+	program_clear(program);
+	free(program);
+}
+
+static struct cras_expr_program *find_or_compile(
+		struct cras_expr_expression *expr,
+		struct cras_expr_env *env)
+{
+	int i;
+	struct cras_expr_program **pprogram, *program;
+
+	FOR_ARRAY_ELEMENT(&expr->programs, i, pprogram) {
+		program = *pprogram;
+		if (program->env != env)
+			continue;
+		/* Variables it read before they were defined may be now. */
+		if (program->has_undefined &&
+		    program->num_keys != ARRAY_COUNT(&env->keys)) {
+			program_clear(program);
+			compile(program);
 		}
+		return program;
+	}
+
+	program = calloc(1, sizeof(*program));
+	program->expr = expr;
+	program->env = env;
+	compile(program);
+	ARRAY_APPEND(&expr->programs, program);
+	ARRAY_APPEND(&env->programs, program);
+	return program;
+}
+
+static int program_is_stale(const struct cras_expr_program *program,
+			    const struct cras_expr_env *env)
+{
+	int i;
+	int *slot;
 
-		if (ARRAY_COUNT(&values) > 0) {
-			struct cras_expr_value *f = ARRAY_ELEMENT(&values, 0);
-			if (f->type == CRAS_EXPR_VALUE_TYPE_FUNCTION)
-				f->u.function(&values, result);
+	if (!program->evaluated)
+		return 1;
+	FOR_ARRAY_ELEMENT(&program->deps, i, slot) {
+		if (*ARRAY_ELEMENT(&env->changed, *slot) >
+		    program->evaluated_at)
+			return 1;
+	}
+	return 0;
+}
+
+static void program_run(struct cras_expr_program *program,
+			struct cras_expr_env *env)
+{
+	int i, j, sp = 0;
+	struct expr_instruction *ins;
+	struct cras_expr_value *stack = program->stack.element;
+	struct cras_expr_value result;
+	cras_expr_value_array operands;
+
+	FOR_ARRAY_ELEMENT(&program->code, i, ins) {
+		switch (ins->op) {
+		case EXPR_OP_PUSH_LITERAL:
+			copy_value(&stack[sp++],
+				   ARRAY_ELEMENT(&program->literals, ins->arg));
+			break;
+		case EXPR_OP_LOAD_VARIABLE:
+			copy_value(&stack[sp++],
+				   ARRAY_ELEMENT(&env->values, ins->arg));
+			break;
+		case EXPR_OP_CALL:
+			memset(&result, 0, sizeof(result));
+			sp -= ins->arg;
+			operands.count = ins->arg;
+			operands.size = ins->arg;
+			operands.element = &stack[sp];
+			if (ins->arg == 0)
+				syslog(LOG_ERR, "empty compound expression?");
+			else if (stack[sp].type ==
+				 CRAS_EXPR_VALUE_TYPE_FUNCTION)
+				stack[sp].u.function(&operands, &result);
 			else
 				syslog(LOG_ERR,
 				       "first element is not a function");
-		} else {
-			syslog(LOG_ERR, "empty compound expression?");
-		}
-
-		FOR_ARRAY_ELEMENT(&values, i, value) {
-			cras_expr_value_free(value);
+			for (j = 0; j < ins->arg; j++)
+				cras_expr_value_free(&stack[sp + j]);
+			stack[sp++] = result;
+			break;
 		}
-
-		ARRAY_FREE(&values);
-		break;
 	}
+
+	cras_expr_value_free(&program->result);
+	if (sp > 0) {
+		program->result = stack[0];
+		memset(&stack[0], 0, sizeof(stack[0]));
 	}
+	program->evaluated = 1;
+	program->evaluated_at = env->generation;
+}
+
+void cras_expr_expression_eval(struct cras_expr_expression *expr,
+			       struct cras_expr_env *env,
+			       struct cras_expr_value *result)
+{
+	struct cras_expr_program *program;
+
+	cras_expr_value_free(result);
+
+	program = find_or_compile(expr, env);
+	if (program_is_stale(program, env))
+		program_run(program, env);
+	copy_value(result, &program->result);
 }
 
 int cras_expr_expression_eval_int(struct cras_expr_expression *expr,
@@ -51,8 +51,19 @@ enum expr_type {
 
 DECLARE_ARRAY_TYPE(struct cras_expr_expression *, expr_array);
 
+/* An expression compiled against an environment. Variable references are
+ * resolved to slots in the environment, and the last result is cached
+ * until one of the variables it reads changes. A program is kept by both
+ * the expression and the environment, and freed with whichever goes
+ * first. */
+struct cras_expr_program;
+DECLARE_ARRAY_TYPE(struct cras_expr_program *, cras_expr_program_array);
+
 struct cras_expr_expression {
 	enum expr_type type;
+	/* The compiled forms of the expression, one per environment it was
+	 * evaluated in. */
+	cras_expr_program_array programs;
 	union {
 		struct cras_expr_value literal;
 		const char *variable;
@@ -63,10 +74,22 @@ struct cras_expr_expression {
 /* Environment */
 
 DECLARE_ARRAY_TYPE(const char *, string_array);
-
+DECLARE_ARRAY_TYPE(unsigned int, cras_expr_generation_array);
+
+/* The variables of an environment are stored in slots. A slot is never
+ * removed, so compiled expressions can refer to variables by index.
+ * Members:
+ *    keys, values - The name and value of the variable in each slot.
+ *    changed - The generation at which each slot last changed value.
+ *    generation - Incremented every time a variable changes value.
+ *    programs - The expressions evaluated in this environment so far.
+ */
 struct cras_expr_env {
 	string_array keys;
 	cras_expr_value_array values;
+	cras_expr_generation_array changed;
+	unsigned int generation;
+	cras_expr_program_array programs;
 };
 
 /* initial value for the environment type is zero */
@@ -79,10 +102,19 @@ void cras_expr_env_set_variable_integer(struct cras_expr_env *env,
 					const char *name, int integer);
 void cras_expr_env_set_variable_string(struct cras_expr_env *env,
 				       const char *name, const char *str);
+void cras_expr_env_set_variable_function(struct cras_expr_env *env,
+					 const char *name,
+					 cras_expr_function_type function);
 void cras_expr_env_free(struct cras_expr_env *env);
 void cras_expr_env_dump(struct dumper *d, const struct cras_expr_env *env);
 
 struct cras_expr_expression *cras_expr_expression_parse(const char *str);
+
+/* Evaluates an expression in the environment. The first evaluation
+ * compiles the expression to bytecode for this environment. After that,
+ * the cached result is returned unless a variable the expression reads
+ * has changed value since the last evaluation. Compiled expressions are
+ * kept until the expression or the environment is freed. */
 void cras_expr_expression_eval(struct cras_expr_expression *expr,
 			       struct cras_expr_env *env,
 			       struct cras_expr_value *value);
@@ -3,21 +3,19 @@
  * found in the LICENSE file.
  */
 
-/* For now just use speex, can add more resamplers later. */
-#include <speex/speex_resampler.h>
 #include <sys/param.h>
 #include <syslog.h>
 
 #include "cras_fmt_conv.h"
 #include "cras_audio_format.h"
+#include "cras_resampler.h"
 #include "cras_util.h"
 #include "linear_resampler.h"
 
-/* The quality level is a value between 0 and 10. This is a tradeoff between
- * performance, latency, and quality. */
-#define SPEEX_QUALITY_LEVEL 4
 /* Max number of converters, src, down/up mix, 2xformat, and linear resample. */
 #define MAX_NUM_CONVERTERS 5
+/* Number of idle converters kept for reuse by cras_fmt_conv_pool_get. */
+#define FMT_CONV_POOL_SIZE 8
 /* Channel index for stereo. */
 #define STEREO_L 0
 #define STEREO_R 1
@@ -32,7 +30,7 @@ typedef size_t (*channel_converter_t)(struct cras_fmt_conv *conv,
 
 /* Member data for the resampler. */
 struct cras_fmt_conv {
-	SpeexResamplerState *speex_state;
+	struct cras_resampler *src;
 	channel_converter_t channel_converter;
 	float **ch_conv_mtx; /* Coefficient matrix for mixing channels. */
 	sample_format_converter_t in_format_converter;
@@ -44,8 +42,16 @@ struct cras_fmt_conv {
 	size_t tmp_buf_frames;
 	size_t pre_linear_resample;
 	size_t num_converters; /* Incremented once for SRC, channel, format. */
+	enum CRAS_RESAMPLER_TYPE src_type;
 };
 
+/* Idle converters released by cras_fmt_conv_pool_put, oldest first. Only
+ * touched from the audio thread so no locking is needed. */
+static struct cras_fmt_conv *conv_pool[FMT_CONV_POOL_SIZE];
+static unsigned int conv_pool_size;
+static unsigned int conv_pool_hits;
+static unsigned int conv_pool_misses;
+
 /* Add and clip two s16 samples. */
 static int16_t s16_add_and_clip(int16_t a, int16_t b)
 {
@@ -492,10 +498,10 @@ static void surround51_to_stereo_downmix_mtx(float **mtx,
 struct cras_fmt_conv *cras_fmt_conv_create(const struct cras_audio_format *in,
 					   const struct cras_audio_format *out,
 					   size_t max_frames,
-					   size_t pre_linear_resample)
+					   size_t pre_linear_resample,
+					   enum CRAS_RESAMPLER_TYPE src_type)
 {
 	struct cras_fmt_conv *conv;
-	int rc;
 	unsigned i;
 
 	conv = calloc(1, sizeof(*conv));
@@ -505,6 +511,7 @@ struct cras_fmt_conv *cras_fmt_conv_create(const struct cras_audio_format *in,
 	conv->out_fmt = *out;
 	conv->tmp_buf_frames = max_frames;
 	conv->pre_linear_resample = pre_linear_resample;
+	conv->src_type = src_type;
 
 	/* Set up sample format conversion. */
 	/* TODO(dgreid) - modify channel and sample rate conversion so
@@ -624,29 +631,36 @@ struct cras_fmt_conv *cras_fmt_conv_create(const struct cras_audio_format *in,
 		conv->num_converters++;
 		syslog(LOG_DEBUG, "Convert from %zu to %zu Hz.",
 		       in->frame_rate, out->frame_rate);
-		conv->speex_state = speex_resampler_init(out->num_channels,
-							 in->frame_rate,
-							 out->frame_rate,
-							 SPEEX_QUALITY_LEVEL,
-							 &rc);
-		if (conv->speex_state == NULL) {
-			syslog(LOG_ERR, "Fail to create speex:%zu %zu %zu %d",
+		conv->src = cras_resampler_create(src_type,
+						  out->num_channels,
+						  in->frame_rate,
+						  out->frame_rate);
+		if (conv->src == NULL) {
+			syslog(LOG_ERR, "Fail to create %s:%zu %zu %zu",
+			       cras_resampler_type_str(src_type),
 			       out->num_channels,
 			       in->frame_rate,
-			       out->frame_rate,
-			       rc);
+			       out->frame_rate);
 			cras_fmt_conv_destroy(&conv);
 			return NULL;
 		}
 	}
 
-	/* Set up linear resampler. */
+	/* Set up linear resampler. It runs either on the raw input frames or
+	 * on the S16_LE frames ahead of the output format conversion. */
 	conv->num_converters++;
-	conv->resampler = linear_resampler_create(
-			out->num_channels,
-			cras_get_format_bytes(out),
-			out->frame_rate,
-			out->frame_rate);
+	if (pre_linear_resample)
+		conv->resampler = linear_resampler_create(
+				in->num_channels,
+				in->format,
+				out->frame_rate,
+				out->frame_rate);
+	else
+		conv->resampler = linear_resampler_create(
+				out->num_channels,
+				SND_PCM_FORMAT_S16_LE,
+				out->frame_rate,
+				out->frame_rate);
 	if (conv->resampler == NULL) {
 		syslog(LOG_ERR, "Fail to create linear resampler");
 		cras_fmt_conv_destroy(&conv);
@@ -679,8 +693,8 @@ void cras_fmt_conv_destroy(struct cras_fmt_conv **convp)
 	if (conv->ch_conv_mtx)
 		cras_channel_conv_matrix_destroy(conv->ch_conv_mtx,
 						 conv->out_fmt.num_channels);
-	if (conv->speex_state)
-		speex_resampler_destroy(conv->speex_state);
+	if (conv->src)
+		cras_resampler_destroy(conv->src);
 	if (conv->resampler)
 		linear_resampler_destroy(conv->resampler);
 	for (i = 0; i < MAX_NUM_CONVERTERS - 1; i++)
@@ -689,6 +703,85 @@ void cras_fmt_conv_destroy(struct cras_fmt_conv **convp)
 	*convp = NULL;
 }
 
+static int is_format_equal(const struct cras_audio_format *a,
+			   const struct cras_audio_format *b)
+{
+	return a->format == b->format &&
+	       a->frame_rate == b->frame_rate &&
+	       a->num_channels == b->num_channels &&
+	       is_channel_layout_equal(a, b);
+}
+
+/* Puts a pooled converter back in the state cras_fmt_conv_create leaves
+ * it in, so a reused converter doesn't carry over filter history or the
+ * rate adjustment of its previous stream. */
+static void fmt_conv_reset(struct cras_fmt_conv *conv)
+{
+	if (conv->src)
+		cras_resampler_reset(conv->src);
+	linear_resampler_set_rates(conv->resampler,
+				   conv->out_fmt.frame_rate,
+				   conv->out_fmt.frame_rate);
+}
+
+struct cras_fmt_conv *cras_fmt_conv_pool_get(
+		const struct cras_audio_format *in,
+		const struct cras_audio_format *out,
+		size_t max_frames,
+		size_t pre_linear_resample,
+		enum CRAS_RESAMPLER_TYPE src_type)
+{
+	struct cras_fmt_conv *conv;
+	int i;
+
+	/* Search newest first, the most recently released converter is
+	 * the likeliest to match a stream that is reopened. */
+	for (i = conv_pool_size - 1; i >= 0; i--) {
+		conv = conv_pool[i];
+		if (conv->tmp_buf_frames != max_frames ||
+		    conv->pre_linear_resample != pre_linear_resample ||
+		    conv->src_type != src_type ||
+		    !is_format_equal(&conv->in_fmt, in) ||
+		    !is_format_equal(&conv->out_fmt, out))
+			continue;
+
+		conv_pool_size--;
+		memmove(&conv_pool[i], &conv_pool[i + 1],
+			(conv_pool_size - i) * sizeof(conv_pool[0]));
+		fmt_conv_reset(conv);
+		conv_pool_hits++;
+		return conv;
+	}
+
+	conv_pool_misses++;
+	return cras_fmt_conv_create(in, out, max_frames, pre_linear_resample,
+				    src_type);
+}
+
+void cras_fmt_conv_pool_put(struct cras_fmt_conv **convp)
+{
+	if (conv_pool_size == FMT_CONV_POOL_SIZE) {
+		cras_fmt_conv_destroy(&conv_pool[0]);
+		conv_pool_size--;
+		memmove(&conv_pool[0], &conv_pool[1],
+			conv_pool_size * sizeof(conv_pool[0]));
+	}
+	conv_pool[conv_pool_size++] = *convp;
+	*convp = NULL;
+}
+
+void cras_fmt_conv_pool_flush()
+{
+	while (conv_pool_size)
+		cras_fmt_conv_destroy(&conv_pool[--conv_pool_size]);
+}
+
+void cras_fmt_conv_pool_get_stats(unsigned int *hits, unsigned int *misses)
+{
+	*hits = conv_pool_hits;
+	*misses = conv_pool_misses;
+}
+
 struct cras_fmt_conv *cras_channel_remix_conv_create(
 		unsigned int num_channels,
 		const float *coefficient)
@@ -823,7 +916,7 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
 	}
 
 	/* If no SRC, then in_frames should = out_frames. */
-	if (conv->speex_state == NULL) {
+	if (conv->src == NULL) {
 		fr_in = MIN(*in_frames, out_frames);
 		if (out_frames < *in_frames && !logged_frames_dont_fit) {
 			syslog(LOG_INFO,
@@ -858,7 +951,7 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
 		 * resample limit and round it to the lower bound in order
 		 * not to convert too many frames in the pre linear resampler.
 		 */
-		if (conv->speex_state != NULL) {
+		if (conv->src != NULL) {
 			resample_limit = resample_limit *
 					conv->in_fmt.frame_rate /
 					conv->out_fmt.frame_rate;
@@ -900,7 +993,7 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
 	}
 
 	/* Then SRC. */
-	if (conv->speex_state != NULL) {
+	if (conv->src != NULL) {
 		unsigned int out_limit = out_frames;
 
 		if (post_linear_resample)
@@ -918,8 +1011,8 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
 		}
 		/* limit frames to the output size. */
 		fr_out = MIN(fr_out, out_limit);
-		speex_resampler_process_interleaved_int(
-				conv->speex_state,
+		cras_resampler_process(
+				conv->src,
 				(int16_t *)buffers[buf_idx],
 				&fr_in,
 				(int16_t *)buffers[buf_idx + 1],
@@ -959,7 +1052,7 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
 		 * leak and, if accumulated, causes delay in multiple devices
 		 * use case.
 		 */
-		if (conv->speex_state && (fr_in == 0))
+		if (conv->src && (fr_in == 0))
 			*in_frames = 0;
 	} else {
 		*in_frames = fr_in;
@@ -980,7 +1073,8 @@ int config_format_converter(struct cras_fmt_conv **conv,
 			    enum CRAS_STREAM_DIRECTION dir,
 			    const struct cras_audio_format *from,
 			    const struct cras_audio_format *to,
-			    unsigned int frames)
+			    unsigned int frames,
+			    enum CRAS_RESAMPLER_TYPE src_type)
 {
 	struct cras_audio_format target;
 
@@ -1000,8 +1094,8 @@ int config_format_converter(struct cras_fmt_conv **conv,
 	       from->format, from->frame_rate, from->num_channels,
 	       target.format, target.frame_rate, target.num_channels,
 	       frames);
-	*conv = cras_fmt_conv_create(from, &target, frames,
-				     (dir == CRAS_STREAM_INPUT));
+	*conv = cras_fmt_conv_pool_get(from, &target, frames,
+				       (dir == CRAS_STREAM_INPUT), src_type);
 	if (!*conv) {
 		syslog(LOG_ERR, "Failed to create format converter");
 		return -ENOMEM;
@@ -4,8 +4,8 @@
  */
 
 /*
- * Used to convert from one audio format to another.  Currently only supports
- * sample rate conversion with the speex backend.
+ * Used to convert from one audio format to another.  Sample rate conversion
+ * is done by one of the cras_resampler backends.
  */
 #ifndef CRAS_FMT_CONV_H_
 #define CRAS_FMT_CONV_H_
@@ -13,18 +13,44 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "cras_resampler.h"
 #include "cras_types.h"
 
 struct cras_audio_format;
 struct cras_fmt_conv;
 
-/* Create and destroy format converters. */
+/* Create and destroy format converters. |src_type| selects the resampler
+ * backend used when the rates of |in| and |out| differ. */
 struct cras_fmt_conv *cras_fmt_conv_create(const struct cras_audio_format *in,
 					   const struct cras_audio_format *out,
 					   size_t max_frames,
-					   size_t pre_linear_resample);
+					   size_t pre_linear_resample,
+					   enum CRAS_RESAMPLER_TYPE src_type);
 void cras_fmt_conv_destroy(struct cras_fmt_conv **conv);
 
+/* Converter pool. Building a converter allocates buffers and resampler
+ * state, so converters released by short lived streams are kept around
+ * and handed to the next stream that asks for the same conversion. The
+ * pool is not locked, only use it from the audio thread.
+ */
+
+/* Returns an idle converter matching the arguments of cras_fmt_conv_create,
+ * reset to its initial state, or creates a new one if there is none. */
+struct cras_fmt_conv *cras_fmt_conv_pool_get(
+		const struct cras_audio_format *in,
+		const struct cras_audio_format *out,
+		size_t max_frames,
+		size_t pre_linear_resample,
+		enum CRAS_RESAMPLER_TYPE src_type);
+/* Releases |*conv| to the pool and sets it to NULL. When the pool is full
+ * the least recently released converter is destroyed. */
+void cras_fmt_conv_pool_put(struct cras_fmt_conv **conv);
+/* Destroys all the idle converters in the pool. */
+void cras_fmt_conv_pool_flush();
+/* Gets the number of cras_fmt_conv_pool_get calls served from the pool and
+ * the number that had to create a new converter. */
+void cras_fmt_conv_pool_get_stats(unsigned int *hits, unsigned int *misses);
+
 /* Creates the format converter for channel remixing. The conversion takes
  * a N by N float matrix, to multiply each N-channels sample.
  * Args:
@@ -100,11 +126,13 @@ int cras_fmt_conversion_needed(const struct cras_fmt_conv *conv);
  *    from - Format to convert from.
  *    to - Format to convert to.
  *    frames - size of buffer.
+ *    src_type - The resampler backend to use if rates differ.
  */
 int config_format_converter(struct cras_fmt_conv **conv,
 			    enum CRAS_STREAM_DIRECTION dir,
 			    const struct cras_audio_format *from,
 			    const struct cras_audio_format *to,
-			    unsigned int frames);
+			    unsigned int frames,
+			    enum CRAS_RESAMPLER_TYPE src_type);
 
 #endif /* CRAS_FMT_CONV_H_ */
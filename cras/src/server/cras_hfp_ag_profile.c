@@ -24,11 +24,14 @@
 
 #define HFP_AG_PROFILE_NAME "Hands-Free Voice gateway"
 #define HFP_AG_PROFILE_PATH "/org/chromium/Cras/Bluetooth/HFPAG"
-#define HFP_VERSION_1_5 0x0105
+#define HFP_VERSION_1_6 0x0106
 #define HSP_AG_PROFILE_NAME "Headset Voice gateway"
 #define HSP_AG_PROFILE_PATH "/org/chromium/Cras/Bluetooth/HSPAG"
 #define HSP_VERSION_1_2 0x0102
 
+/* Wide band speech bit of the AG supported features in the SDP record. */
+#define HFP_SDP_WIDEBAND_SPEECH 0x0020
+
 #define HSP_AG_RECORD 							\
 	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"			\
 	"<record>"							\
@@ -259,9 +262,9 @@ static struct cras_bt_profile cras_hfp_ag_profile = {
 	.name = HFP_AG_PROFILE_NAME,
 	.object_path = HFP_AG_PROFILE_PATH,
 	.uuid = HFP_AG_UUID,
-	.version = HFP_VERSION_1_5,
+	.version = HFP_VERSION_1_6,
 	.role = NULL,
-	.features = HFP_SUPPORTED_FEATURE & 0x1F,
+	.features = (HFP_SUPPORTED_FEATURE & 0x1F) | HFP_SDP_WIDEBAND_SPEECH,
 	.record = NULL,
 	.release = cras_hfp_ag_release,
 	.new_connection = cras_hfp_ag_new_connection,
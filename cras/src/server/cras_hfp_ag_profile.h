@@ -34,7 +34,8 @@
 /* Codec negotiation */
 #define HFP_CODEC_NEGOTIATION           0x0200
 
-#define HFP_SUPPORTED_FEATURE           (HFP_ENHANCED_CALL_STATUS)
+#define HFP_SUPPORTED_FEATURE           (HFP_ENHANCED_CALL_STATUS | \
+					 HFP_CODEC_NEGOTIATION)
 
 struct hfp_slc_handle;
 
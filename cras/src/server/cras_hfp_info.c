@@ -3,9 +3,15 @@
  * found in the LICENSE file.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for recvmmsg, sendmmsg */
+#endif
+
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 #include <sys/socket.h>
 #include <syslog.h>
 
@@ -13,6 +19,8 @@
 #include "byte_buffer.h"
 #include "cras_iodev_list.h"
 #include "cras_hfp_info.h"
+#include "cras_hfp_slc.h"
+#include "hfp_msbc.h"
 #include "utlist.h"
 
 /* The max buffer size. Note that the actual used size must set to multiple
@@ -24,6 +32,9 @@
 /* rate(8kHz) * sample_size(2 bytes) * channels(1) */
 #define HFP_BYTE_RATE 16000
 
+/* Most SCO packets moved by one recvmmsg or sendmmsg call. */
+#define HFP_MAX_BATCH_PACKETS 16
+
 /* Structure to hold variables for a HFP connection. Since HFP supports
  * bi-direction audio, two iodevs should share one hfp_info if they
  * represent two directions of the same HFP headset
@@ -35,10 +46,14 @@
  *         adapter, could be different than mtu.
  *     capture_buf - The buffer to hold samples read from SCO socket.
  *     playback_buf - The buffer to hold samples about to write to SCO socket.
+ *     msbc - The mSBC stream when the codec is mSBC, NULL for CVSD.
+ *     sco_rx - Packets read from the SCO socket, before mSBC decoding.
+ *     sco_tx_buf - Packets encoded to mSBC, to write to the SCO socket.
  *     idev - The input iodev using this hfp_info.
  *     odev - The output iodev using this hfp_info.
  *     packet_size_changed_cbs - The callbacks to trigger when SCO packet
  *         size changed.
+ *     stats - Statistics of the SCO transfer since start.
  */
 struct hfp_info {
 	int fd;
@@ -47,10 +62,14 @@ struct hfp_info {
 	unsigned int packet_size;
 	struct byte_buffer *capture_buf;
 	struct byte_buffer *playback_buf;
+	struct hfp_msbc *msbc;
+	uint8_t *sco_rx;
+	struct byte_buffer *sco_tx_buf;
 
 	struct cras_iodev *idev;
 	struct cras_iodev *odev;
 	struct hfp_packet_size_changed_callback *packet_size_changed_cbs;
+	struct hfp_info_stats stats;
 };
 
 int hfp_info_add_iodev(struct hfp_info *info, struct cras_iodev *dev)
@@ -141,40 +160,80 @@ int hfp_buf_queued(struct hfp_info *info, const struct cras_iodev *dev)
 		return buf_queued(info->capture_buf) / format_bytes;
 }
 
-int hfp_write(struct hfp_info *info)
+/* Points |iov| and |msgs| at consecutive packets of |buf|. Returns the
+ * number of whole packets in |len| bytes, at most |max_packets| and
+ * HFP_MAX_BATCH_PACKETS. */
+static unsigned int setup_batch(struct hfp_info *info, uint8_t *buf,
+				unsigned int len, struct iovec *iov,
+				struct mmsghdr *msgs, unsigned int max_packets)
+{
+	unsigned int i, n;
+
+	n = MIN(len / info->packet_size, max_packets);
+	n = MIN(n, HFP_MAX_BATCH_PACKETS);
+	memset(msgs, 0, n * sizeof(*msgs));
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = buf + i * info->packet_size;
+		iov[i].iov_len = info->packet_size;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	return n;
+}
+
+int hfp_write(struct hfp_info *info, unsigned int max_packets)
 {
-	int err = 0;
-	unsigned to_send;
+	struct iovec iov[HFP_MAX_BATCH_PACKETS];
+	struct mmsghdr msgs[HFP_MAX_BATCH_PACKETS];
+	struct byte_buffer *src = info->playback_buf;
+	unsigned int to_send, n, i;
 	uint8_t *samples;
+	int err;
+
+	/* Encode no more than the packets about to be sent, the rest of the
+	 * audio waits as PCM. */
+	if (info->msbc) {
+		err = hfp_msbc_encode(info->msbc, info->playback_buf,
+				      info->sco_tx_buf,
+				      max_packets * info->packet_size);
+		if (err < 0)
+			return err;
+		src = info->sco_tx_buf;
+	}
 
 	/* Write something */
-	samples = buf_read_pointer_size(info->playback_buf, &to_send);
-	if (to_send < info->packet_size)
+	samples = buf_read_pointer_size(src, &to_send);
+	n = setup_batch(info, samples, to_send, iov, msgs, max_packets);
+	if (n == 0)
 		return 0;
-	to_send = info->packet_size;
 
 send_sample:
-	err = send(info->fd, samples, to_send, 0);
+	err = sendmmsg(info->fd, msgs, n, MSG_DONTWAIT);
 	if (err < 0) {
 		if (errno == EINTR)
 			goto send_sample;
+		if (errno == EAGAIN)
+			return 0;
 
 		return err;
 	}
 
-	if (err != (int)info->packet_size) {
-		syslog(LOG_ERR,
-		       "Partially write %d bytes for SCO packet size %u",
-		       err, info->packet_size);
-		return -1;
+	for (i = 0; i < (unsigned int)err; i++) {
+		if (msgs[i].msg_len != info->packet_size) {
+			syslog(LOG_ERR,
+			       "Partially write %u bytes for SCO packet size %u",
+			       msgs[i].msg_len, info->packet_size);
+			return -1;
+		}
 	}
 
-	buf_increment_read(info->playback_buf, to_send);
+	to_send = err * info->packet_size;
+	buf_increment_read(src, to_send);
+	info->stats.packets_written += err;
 
-	return err;
+	return to_send;
 }
 
-
 static void hfp_info_set_packet_size(struct hfp_info *info,
 				     unsigned int packet_size)
 {
@@ -182,6 +241,14 @@ static void hfp_info_set_packet_size(struct hfp_info *info,
 	unsigned int used_size =
 		MAX_HFP_BUF_SIZE_BYTES / packet_size * packet_size;
 	info->packet_size = packet_size;
+
+	/* With mSBC the packets are in the encoded buffer, and the audio
+	 * buffers move a whole frame at a time. */
+	if (info->msbc) {
+		byte_buffer_set_used_size(info->sco_tx_buf, used_size);
+		used_size = MAX_HFP_BUF_SIZE_BYTES / MSBC_CODE_SIZE *
+			    MSBC_CODE_SIZE;
+	}
 	byte_buffer_set_used_size(info->playback_buf, used_size);
 	byte_buffer_set_used_size(info->capture_buf, used_size);
 
@@ -215,44 +282,95 @@ void hfp_unregister_packet_size_changed_callback(struct hfp_info *info,
 
 int hfp_read(struct hfp_info *info)
 {
-	int err = 0;
-	unsigned to_read;
+	struct iovec iov[HFP_MAX_BATCH_PACKETS];
+	struct mmsghdr msgs[HFP_MAX_BATCH_PACKETS];
+	unsigned int to_read, n, i;
 	uint8_t *capture_buf;
+	int err;
 
-	capture_buf = buf_write_pointer_size(info->capture_buf, &to_read);
+	if (info->msbc) {
+		capture_buf = info->sco_rx;
+		to_read = HFP_MAX_BATCH_PACKETS * info->mtu;
+	} else {
+		capture_buf = buf_write_pointer_size(info->capture_buf,
+						     &to_read);
+	}
 
-	if (to_read < info->packet_size)
+	/* Until the first packet tells the size the adapter uses, read one
+	 * packet at a time. */
+	n = setup_batch(info, capture_buf, to_read, iov, msgs,
+			info->stats.packets_read ? HFP_MAX_BATCH_PACKETS : 1);
+	if (n == 0)
 		return 0;
-	to_read = info->packet_size;
 
 recv_sample:
-	err = recv(info->fd, capture_buf, to_read, 0);
+	err = recvmmsg(info->fd, msgs, n, MSG_DONTWAIT, NULL);
 	if (err < 0) {
-		syslog(LOG_ERR, "Read error %s", strerror(errno));
 		if (errno == EINTR)
 			goto recv_sample;
+		if (errno == EAGAIN)
+			return 0;
 
+		syslog(LOG_ERR, "Read error %s", strerror(errno));
 		return err;
 	}
 
-	if (err != (int)info->packet_size) {
+	if (err == 1 && msgs[0].msg_len &&
+	    msgs[0].msg_len != info->packet_size &&
+	    info->packet_size == info->mtu &&
+	    info->stats.packets_read == 0) {
 		/* Allow the SCO packet size be modified from the default MTU
 		 * value to the size of SCO data we first read. This is for
 		 * some adapters who prefers a different value than MTU for
 		 * transmitting SCO packet.
 		 */
-		if (err && (info->packet_size == info->mtu)) {
-			hfp_info_set_packet_size(info, err);
-		} else {
-			syslog(LOG_ERR, "Partially read %d bytes for %u size SCO packet",
-			       err, info->packet_size);
+		hfp_info_set_packet_size(info, msgs[0].msg_len);
+	}
+
+	for (i = 0; i < (unsigned int)err; i++) {
+		if (msgs[i].msg_len != info->packet_size) {
+			syslog(LOG_ERR,
+			       "Partially read %u bytes for %u size SCO packet",
+			       msgs[i].msg_len, info->packet_size);
 			return -1;
 		}
 	}
 
-	buf_increment_write(info->capture_buf, err);
+	to_read = err * info->packet_size;
+	if (info->msbc)
+		hfp_msbc_decode(info->msbc, capture_buf, to_read,
+				info->capture_buf);
+	else
+		buf_increment_write(info->capture_buf, to_read);
+	info->stats.packets_read += err;
+	info->stats.max_read_batch = MAX(info->stats.max_read_batch,
+					 (unsigned int)err);
 
-	return err;
+	return to_read;
+}
+
+/* Records the depth of the jitter buffers after a callback. */
+static void update_depth_stats(struct hfp_info *info)
+{
+	struct hfp_info_stats *stats = &info->stats;
+	unsigned int queued;
+
+	stats->callbacks++;
+	if (info->idev) {
+		queued = buf_queued(info->capture_buf);
+		stats->capture_depth_max = MAX(stats->capture_depth_max,
+					       queued);
+	}
+	if (info->odev) {
+		queued = buf_queued(info->playback_buf);
+		if (!stats->playback_depth_samples ||
+		    queued < stats->playback_depth_min)
+			stats->playback_depth_min = queued;
+		stats->playback_depth_max = MAX(stats->playback_depth_max,
+						queued);
+		stats->playback_depth_sum += queued;
+		stats->playback_depth_samples++;
+	}
 }
 
 /* Callback function to handle sample read and write.
@@ -260,13 +378,15 @@ recv_sample:
  * there is actual some sample to read while the socket always reports
  * writable even when device buffer is full.
  * The strategy is to synchronize read & write operations:
- * 1. Read one chunk of MTU bytes of data.
+ * 1. Read all the packets queued in the socket, in one call.
  * 2. When input device not attached, ignore the data just read.
- * 3. When output device attached, write one chunk of MTU bytes of data.
+ * 3. When output device attached, write as many packets as were read, at
+ *    least one, so the playback rate follows the rate of the headset.
  */
 static int hfp_info_callback(void *arg)
 {
 	struct hfp_info *info = (struct hfp_info *)arg;
+	unsigned int packets;
 	int err;
 
 	if (!info->started)
@@ -277,19 +397,22 @@ static int hfp_info_callback(void *arg)
 		syslog(LOG_ERR, "Read error");
 		goto read_write_error;
 	}
+	packets = err / info->packet_size;
 
-	/* Ignore the MTU bytes just read if input dev not in present */
+	/* Ignore the samples just read if input dev not in present */
 	if (!info->idev)
-		buf_increment_read(info->capture_buf, info->packet_size);
+		buf_increment_read(info->capture_buf,
+				   buf_queued(info->capture_buf));
 
 	if (info->odev) {
-		err = hfp_write(info);
+		err = hfp_write(info, MAX(packets, 1));
 		if (err < 0) {
 			syslog(LOG_ERR, "Write error");
 			goto read_write_error;
 		}
 	}
 
+	update_depth_stats(info);
 	return 0;
 
 read_write_error:
@@ -331,10 +454,49 @@ int hfp_info_running(struct hfp_info *info)
 	return info->started;
 }
 
-int hfp_info_start(int fd, unsigned int mtu, struct hfp_info *info)
+void hfp_info_get_stats(const struct hfp_info *info,
+			struct hfp_info_stats *stats)
+{
+	*stats = info->stats;
+}
+
+static void free_msbc(struct hfp_info *info)
+{
+	if (info->msbc)
+		hfp_msbc_destroy(info->msbc);
+	if (info->sco_tx_buf)
+		byte_buffer_destroy(&info->sco_tx_buf);
+	free(info->sco_rx);
+	info->msbc = NULL;
+	info->sco_rx = NULL;
+}
+
+static int alloc_msbc(struct hfp_info *info, unsigned int mtu)
+{
+	info->msbc = hfp_msbc_create();
+	info->sco_rx = (uint8_t *)malloc(HFP_MAX_BATCH_PACKETS * mtu);
+	info->sco_tx_buf = byte_buffer_create(MAX_HFP_BUF_SIZE_BYTES);
+	if (!info->msbc || !info->sco_rx || !info->sco_tx_buf) {
+		free_msbc(info);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+int hfp_info_start(int fd, unsigned int mtu, int codec,
+		   struct hfp_info *info)
 {
+	int err;
+
+	if (codec == HFP_CODEC_ID_MSBC) {
+		err = alloc_msbc(info, mtu);
+		if (err)
+			return err;
+	}
+
 	info->fd = fd;
 	info->mtu = mtu;
+	memset(&info->stats, 0, sizeof(info->stats));
 
 	/* Make sure buffer size is multiple of packet size, which initially
 	 * set to MTU. */
@@ -354,6 +516,20 @@ int hfp_info_stop(struct hfp_info *info)
 	if (!info->started)
 		return 0;
 
+	syslog(LOG_DEBUG,
+	       "SCO read %u packets in %u callbacks, max batch %u, wrote %u",
+	       info->stats.packets_read, info->stats.callbacks,
+	       info->stats.max_read_batch, info->stats.packets_written);
+	if (info->msbc) {
+		struct hfp_msbc_stats stats;
+
+		hfp_msbc_get_stats(info->msbc, &stats);
+		syslog(LOG_DEBUG,
+		       "mSBC decoded %u frames, concealed %u, dropped %u",
+		       stats.frames_decoded, stats.frames_concealed,
+		       stats.frames_dropped);
+	}
+
 	audio_thread_rm_callback_sync(
 		cras_iodev_list_get_audio_thread(),
 		info->fd);
@@ -361,12 +537,15 @@ int hfp_info_stop(struct hfp_info *info)
 	close(info->fd);
 	info->fd = 0;
 	info->started = 0;
+	free_msbc(info);
 
 	return 0;
 }
 
 void hfp_info_destroy(struct hfp_info *info)
 {
+	free_msbc(info);
+
 	if (info->capture_buf)
 		byte_buffer_destroy(&info->capture_buf);
 
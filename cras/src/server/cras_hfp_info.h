@@ -24,6 +24,31 @@ struct hfp_packet_size_changed_callback {
  */
 struct hfp_info;
 
+/* Statistics of the SCO transfer of an hfp_info since it started.
+ * Members:
+ *    callbacks - Number of times the SCO socket was serviced.
+ *    packets_read, packets_written - SCO packets received and sent.
+ *    max_read_batch - Most packets received by one call.
+ *    capture_depth_max - Most bytes left in the capture buffer after a
+ *        callback, while an input iodev is attached.
+ *    playback_depth_min, playback_depth_max - Range of bytes left in the
+ *        playback buffer after a callback, while an output iodev is
+ *        attached.
+ *    playback_depth_sum, playback_depth_samples - Sum and number of the
+ *        playback buffer depth samples, for the average.
+ */
+struct hfp_info_stats {
+	unsigned int callbacks;
+	unsigned int packets_read;
+	unsigned int packets_written;
+	unsigned int max_read_batch;
+	unsigned int capture_depth_max;
+	unsigned int playback_depth_min;
+	unsigned int playback_depth_max;
+	unsigned long playback_depth_sum;
+	unsigned int playback_depth_samples;
+};
+
 /* Creates an hfp_info instance. */
 struct hfp_info *hfp_info_create();
 
@@ -33,10 +58,21 @@ void hfp_info_destroy(struct hfp_info *info);
 /* Checks if given hfp_info is running. */
 int hfp_info_running(struct hfp_info *info);
 
+/* Gets the statistics of the SCO transfer since hfp_info_start. */
+void hfp_info_get_stats(const struct hfp_info *info,
+			struct hfp_info_stats *stats);
+
 /* Starts the hfp_info to transmit and reveice samples to and from the file
  * descriptor of a SCO socket.
+ * Args:
+ *    fd - The SCO socket.
+ *    mtu - The MTU of the SCO socket.
+ *    codec - HFP_CODEC_ID_CVSD for 8kHz samples carried as is, or
+ *        HFP_CODEC_ID_MSBC for 16kHz samples coded to mSBC.
+ *    info - The hfp_info to start.
  */
-int hfp_info_start(int fd, unsigned int mtu, struct hfp_info *info);
+int hfp_info_start(int fd, unsigned int mtu, int codec,
+		   struct hfp_info *info);
 
 /* Stops given hfp_info. This implies sample transmission will
  * stop and socket be closed.
@@ -37,6 +37,9 @@
  * command AT+CMER. Used for indicator events reporting in HFP. */
 #define FORWARD_UNSOLICIT_RESULT_CODE	3
 
+/* The codec negotiation bit of the HF supported features in AT+BRSF. */
+#define HF_CODEC_NEGOTIATION		0x0080
+
 /* Handle object to hold required info to initialize and maintain
  * an HFP service level connection.
  * Args:
@@ -52,6 +55,11 @@
  *    service - Current service availability of AG stored in SLC.
  *    callheld - Current callheld status of AG stored in SLC.
  *    ind_event_report - Activate status of indicator events reporting.
+ *    hf_supported_features - Supported features of the HF from AT+BRSF.
+ *    hf_codecs - Bit map of the codec IDs the HF listed in AT+BAC.
+ *    proposed_codec - The codec sent in +BCS, waiting for the HF to
+ *        confirm. 0 if none.
+ *    selected_codec - The codec for the audio connection.
  *    telephony - A reference of current telephony handle.
  *    device - The associated bt device.
  */
@@ -71,6 +79,10 @@ struct hfp_slc_handle {
 	int service;
 	int callheld;
 	int ind_event_report;
+	int hf_supported_features;
+	unsigned int hf_codecs;
+	int proposed_codec;
+	int selected_codec;
 	struct cras_bt_device *device;
 
 	struct cras_telephony_handle *telephony;
@@ -209,6 +221,85 @@ static int dtmf_tone(struct hfp_slc_handle *handle, const char *buf)
 	return hfp_send(handle, "OK");
 }
 
+/* Starts codec selection when both sides support codec negotiation and the
+ * HF listed mSBC. The AG proposes the codec with +BCS, and the HF confirms
+ * with AT+BCS.
+ */
+static int select_codec(struct hfp_slc_handle *handle)
+{
+	char response[16];
+
+	if (!(handle->hf_supported_features & HF_CODEC_NEGOTIATION) ||
+	    !(handle->hf_codecs & (1 << HFP_CODEC_ID_MSBC)))
+		return 0;
+
+	handle->proposed_codec = HFP_CODEC_ID_MSBC;
+	snprintf(response, 16, "+BCS:%d", HFP_CODEC_ID_MSBC);
+	return hfp_send(handle, response);
+}
+
+/* AT+BAC command notifies the AG of the codecs the HF supports. Mandatory
+ * support per spec 4.34.1 when codec negotiation is supported.
+ */
+static int available_codecs(struct hfp_slc_handle *handle, const char *cmd)
+{
+	char *tokens, *id;
+	int err;
+
+	/* AT+BAC=<codec id 1>,<codec id 2>,... */
+	tokens = strdup(cmd);
+	strtok(tokens, "=");
+	handle->hf_codecs = 0;
+	while ((id = strtok(NULL, ",")))
+		if (atoi(id) > 0 && atoi(id) < 32)
+			handle->hf_codecs |= 1 << atoi(id);
+	free(tokens);
+
+	err = hfp_send(handle, "OK");
+	if (err)
+		return err;
+
+	/* The HF sends the list again when the codecs it supports changed,
+	 * select again. */
+	if (handle->initialized)
+		return select_codec(handle);
+	return 0;
+}
+
+/* AT+BCS command confirms the codec proposed by the AG in +BCS. */
+static int codec_selection(struct hfp_slc_handle *handle, const char *cmd)
+{
+	int id;
+
+	if (strlen(cmd) < 8)
+		return -EINVAL;
+
+	/* AT+BCS=<codec id> */
+	id = atoi(cmd + 7);
+	if (id != handle->proposed_codec) {
+		syslog(LOG_ERR, "HF selected codec %d instead of %d", id,
+		       handle->proposed_codec);
+		handle->proposed_codec = 0;
+		handle->selected_codec = HFP_CODEC_ID_CVSD;
+		return hfp_send(handle, "ERROR");
+	}
+
+	handle->proposed_codec = 0;
+	handle->selected_codec = id;
+	return hfp_send(handle, "OK");
+}
+
+/* AT+BCC command asks the AG to start the codec connection. */
+static int codec_connection(struct hfp_slc_handle *handle, const char *cmd)
+{
+	int err;
+
+	err = hfp_send(handle, "OK");
+	if (err)
+		return err;
+	return select_codec(handle);
+}
+
 /* AT+CMER command enables the registration status update function in AG.
  * The service level connection is consider initialized when successfully
  * responded OK to the AT+CMER command. Mandatory support per spec 4.4.
@@ -256,6 +347,7 @@ static int event_reporting(struct hfp_slc_handle *handle, const char *cmd)
 		handle->initialized = 1;
 		if (handle->init_cb)
 			handle->init_cb(handle);
+		err = select_codec(handle);
 	}
 
 event_reporting_err:
@@ -451,10 +543,11 @@ static int supported_features(struct hfp_slc_handle *handle, const char *cmd)
 	if (strlen(cmd) < 9)
 		return -EINVAL;
 
-	/* AT+BRSF=<feature> command received, ignore the HF supported feature
-	 * for now. Respond with +BRSF:<feature> to notify mandatory supported
-	 * features in AG(audio gateway).
+	/* AT+BRSF=<feature> command received, keep the HF supported feature
+	 * for codec negotiation. Respond with +BRSF:<feature> to notify
+	 * mandatory supported features in AG(audio gateway).
 	 */
+	handle->hf_supported_features = atoi(cmd + 8);
 	snprintf(response, 128, "+BRSF: %u", HFP_SUPPORTED_FEATURE);
 	err = hfp_send(handle, response);
 	if (err < 0)
@@ -526,6 +619,9 @@ static int terminate_call(struct hfp_slc_handle *handle, const char *cmd)
 static struct at_command at_commands[] = {
 	{ "ATA", answer_call },
 	{ "ATD", dial_number },
+	{ "AT+BAC", available_codecs },
+	{ "AT+BCC", codec_connection },
+	{ "AT+BCS", codec_selection },
 	{ "AT+BIA", indicator_activation },
 	{ "AT+BLDN", last_dialed_number },
 	{ "AT+BRSF", supported_features },
@@ -636,6 +732,7 @@ struct hfp_slc_handle *hfp_slc_create(int fd,
 	handle->signal = 5;
 	handle->service = 1;
 	handle->ind_event_report = 0;
+	handle->selected_codec = HFP_CODEC_ID_CVSD;
 	handle->telephony = cras_telephony_get();
 
 	cras_system_add_select_fd(handle->rfcomm_fd,
@@ -651,6 +748,11 @@ void hfp_slc_destroy(struct hfp_slc_handle *slc_handle)
 	free(slc_handle);
 }
 
+int hfp_slc_get_selected_codec(struct hfp_slc_handle *handle)
+{
+	return handle->selected_codec;
+}
+
 int hfp_set_call_status(struct hfp_slc_handle *handle, int call)
 {
 	int old_call = handle->telephony->call;
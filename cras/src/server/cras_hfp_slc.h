@@ -6,8 +6,13 @@
 #ifndef CRAS_HFP_SLC_H_
 #define CRAS_HFP_SLC_H_
 
+struct cras_bt_device;
 struct hfp_slc_handle;
 
+/* Codec IDs of the audio connection, HFP spec appendix B. */
+#define HFP_CODEC_ID_CVSD 1
+#define HFP_CODEC_ID_MSBC 2
+
 /* Callback to call when service level connection initialized. */
 typedef int (*hfp_slc_init_cb)(struct hfp_slc_handle *handle);
 
@@ -65,4 +70,8 @@ int hfp_event_set_service(struct hfp_slc_handle *handle, int value);
 /* Sets speaker gain value to headsfree device. */
 int hfp_event_speaker_gain(struct hfp_slc_handle *handle, int gain);
 
+/* Gets the codec for the audio connection, HFP_CODEC_ID_CVSD unless the
+ * handsfree device confirmed another one in codec negotiation. */
+int hfp_slc_get_selected_codec(struct hfp_slc_handle *handle);
+
 #endif /* CRAS_HFP_SLC_H_ */
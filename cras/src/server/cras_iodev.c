@@ -343,11 +343,41 @@ static snd_pcm_format_t get_best_pcm_format(struct cras_iodev *iodev,
 	return iodev->supported_formats[0];
 }
 
-/* Applies the DSP to the samples for the iodev if applicable. */
-static int apply_dsp(struct cras_iodev *iodev, uint8_t *buf, size_t frames)
+/* How long the DSP must have turned silence into silence before it is
+ * skipped, on top of the pipeline delay. Long enough for filter ringing
+ * and the DRC lookahead to drain. */
+#define DSP_SILENT_TAIL_MSECS 100
+
+/* Returns true if the DSP output has been all zero for long enough that
+ * running the pipeline on more zeros would produce zeros again. */
+static int dsp_tail_decayed(const struct cras_iodev *iodev,
+			    struct pipeline *pipeline)
+{
+	unsigned int tail_frames;
+
+	if (cras_dsp_pipeline_get_crossfade_source(pipeline))
+		return 0;
+	tail_frames = cras_dsp_pipeline_get_delay(pipeline) +
+		      cras_frames_at_rate(1000, DSP_SILENT_TAIL_MSECS,
+				cras_dsp_pipeline_get_sample_rate(pipeline));
+	return iodev->dsp_silent_frames >= tail_frames;
+}
+
+/* Applies the DSP to the samples for the iodev if applicable.
+ * Args:
+ *    iodev - The device.
+ *    buf - The samples, processed in place.
+ *    frames - The number of frames in buf.
+ *    is_silent - If not NULL, set if the samples are all zero. Silent input
+ *        skips the pipeline once its tail has decayed, and is cleared if the
+ *        pipeline still produced a non-zero tail.
+ */
+static int apply_dsp(struct cras_iodev *iodev, uint8_t *buf, size_t frames,
+		     int *is_silent)
 {
 	struct cras_dsp_context *ctx;
 	struct pipeline *pipeline;
+	size_t out_bytes;
 	int rc;
 
 	ctx = iodev->dsp_context;
@@ -358,11 +388,31 @@ static int apply_dsp(struct cras_iodev *iodev, uint8_t *buf, size_t frames)
 	if (!pipeline)
 		return 0;
 
+	out_bytes = frames * cras_get_format_bytes(iodev->format);
+
+	if (!is_silent || !*is_silent) {
+		iodev->dsp_silent_frames = 0;
+	} else if (dsp_tail_decayed(iodev, pipeline)) {
+		/* The output may have more channels than the input. */
+		memset(buf, 0, out_bytes);
+		cras_dsp_put_pipeline(ctx);
+		return 0;
+	}
+
 	rc = cras_dsp_pipeline_apply(pipeline,
 				     buf,
 				     iodev->format->format,
 				     frames);
 
+	if (is_silent && *is_silent) {
+		if (!rc && cras_mix_buffer_is_zero(buf, out_bytes)) {
+			iodev->dsp_silent_frames += frames;
+		} else {
+			iodev->dsp_silent_frames = 0;
+			*is_silent = 0;
+		}
+	}
+
 	cras_dsp_put_pipeline(ctx);
 	return rc;
 }
@@ -497,7 +547,8 @@ int cras_iodev_set_format(struct cras_iodev *iodev,
 			iodev->rate_est = rate_estimator_create(
 						actual_rate,
 						&rate_estimation_window_sz,
-						rate_estimation_smooth_factor);
+						rate_estimation_smooth_factor,
+						iodev->rate_est_type);
 		else
 			rate_estimator_reset_rate(iodev->rate_est, actual_rate);
 	}
@@ -513,48 +564,88 @@ error:
 }
 
 /*
- * Configures the external dsp module and adds it to the existing dsp pipeline.
+ * Configures the external dsp module and makes sure there is a dsp pipeline
+ * to connect it to, loading a dummy one if needed. Must not be called while
+ * the module is connected to a pipeline the audio thread runs.
  */
-static void add_ext_dsp_module_to_pipeline(struct cras_iodev *iodev)
+static void prepare_ext_dsp_module(struct cras_iodev *iodev)
 {
-	struct pipeline *pipeline;
-
-	if (!iodev->ext_dsp_module)
-		return;
-
 	iodev->ext_dsp_module->configure(
 			iodev->ext_dsp_module,
 			iodev->buffer_size,
 			iodev->ext_format->num_channels,
 			iodev->ext_format->frame_rate);
 
-	pipeline = iodev->dsp_context
-			? cras_dsp_get_pipeline(iodev->dsp_context)
-			: NULL;
-
-	if (!pipeline) {
+	/* Keep the context, the audio thread may be reading it. */
+	if (!iodev->dsp_context)
 		cras_iodev_alloc_dsp(iodev);
+	if (cras_dsp_get_pipeline(iodev->dsp_context))
+		cras_dsp_put_pipeline(iodev->dsp_context);
+	else
 		cras_dsp_load_dummy_pipeline(
 			iodev->dsp_context,
 			iodev->format->num_channels);
-		pipeline = cras_dsp_get_pipeline(iodev->dsp_context);
-	}
+}
 
-	cras_dsp_pipeline_set_sink_ext_module(
-			pipeline,
-			iodev->ext_dsp_module);
+/*
+ * Configures the external dsp module and adds it to the existing dsp pipeline.
+ * Only for a device the audio thread isn't running yet.
+ */
+static void add_ext_dsp_module_to_pipeline(struct cras_iodev *iodev)
+{
+	if (!iodev->ext_dsp_module)
+		return;
+
+	prepare_ext_dsp_module(iodev);
+	cras_iodev_connect_ext_dsp_module(iodev, iodev->ext_dsp_module);
+}
+
+int cras_iodev_connect_ext_dsp_module(struct cras_iodev *iodev,
+				      struct ext_dsp_module *ext)
+{
+	struct pipeline *pipeline;
+	int rc;
+
+	if (!iodev->dsp_context)
+		return ext ? -EINVAL : 0;
+	pipeline = cras_dsp_get_pipeline(iodev->dsp_context);
+	if (!pipeline)
+		return ext ? -EINVAL : 0;
+
+	rc = cras_dsp_pipeline_set_sink_ext_module(pipeline, ext);
 
 	cras_dsp_put_pipeline(iodev->dsp_context);
+	return rc;
 }
 
 void cras_iodev_set_ext_dsp_module(struct cras_iodev *iodev,
 				   struct ext_dsp_module *ext)
 {
-	iodev->ext_dsp_module = ext;
+	struct audio_thread *thread;
+	int rc;
 
-	if (!ext || !cras_iodev_is_open(iodev))
+	if (!cras_iodev_is_open(iodev)) {
+		iodev->ext_dsp_module = ext;
 		return;
-	add_ext_dsp_module_to_pipeline(iodev);
+	}
+
+	/* The audio thread may be running the pipeline, let it change the
+	 * sink between two runs. */
+	thread = cras_iodev_list_get_audio_thread();
+	rc = audio_thread_dev_set_ext_dsp_module(thread, iodev, NULL);
+	if (rc < 0) {
+		syslog(LOG_ERR, "Failed to disconnect ext dsp module: %d", rc);
+		return;
+	}
+
+	iodev->ext_dsp_module = ext;
+	if (!ext)
+		return;
+
+	prepare_ext_dsp_module(iodev);
+	rc = audio_thread_dev_set_ext_dsp_module(thread, iodev, ext);
+	if (rc < 0)
+		syslog(LOG_ERR, "Failed to connect ext dsp module: %d", rc);
 }
 
 void cras_iodev_update_dsp(struct cras_iodev *iodev)
@@ -643,6 +734,16 @@ static void cras_iodev_alloc_dsp(struct cras_iodev *iodev)
 	cras_iodev_free_dsp(iodev);
 	iodev->dsp_context = cras_dsp_context_new(iodev->format->frame_rate,
 						  purpose);
+
+	/* External dsp modules only take floats. Input devices always have
+	 * one for the streams, and with APM any output device can become the
+	 * echo reference. */
+#ifdef HAVE_WEBRTC_APM
+	cras_dsp_disable_fixed_point(iodev->dsp_context);
+#else
+	if (iodev->direction == CRAS_STREAM_INPUT)
+		cras_dsp_disable_fixed_point(iodev->dsp_context);
+#endif
 }
 
 void cras_iodev_fill_time_from_frames(size_t frames,
@@ -789,6 +890,41 @@ float cras_iodev_get_software_gain_scaler(const struct cras_iodev *iodev) {
 	return scaler;
 }
 
+/* A stream playing on several devices keeps the schedule of the device it
+ * follows. */
+static int stream_allows_deep_buffer(const struct cras_rstream *rstream)
+{
+	if (rstream->num_attached_devs > 1)
+		return 0;
+	return cras_stream_type_allows_deep_buffer(rstream->stream_type);
+}
+
+/* Plays the streams of an output device in deep buffer mode while all of
+ * them are media streams. A latency sensitive stream joining takes the others
+ * back to their own callback threshold. What is already queued in the device
+ * drains at the normal rate, so the switch doesn't glitch. */
+static void update_deep_buffer(struct cras_iodev *iodev,
+			       struct dev_stream *removed)
+{
+	struct dev_stream *stream;
+	struct timespec now;
+	int deep = iodev->allow_deep_buffer &&
+		   iodev->direction == CRAS_STREAM_OUTPUT;
+
+	DL_FOREACH(iodev->streams, stream) {
+		if (!stream_allows_deep_buffer(stream->stream))
+			deep = 0;
+	}
+	iodev->deep_buffer = deep && iodev->streams;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	if (removed)
+		cras_rstream_set_deep_buffer(removed->stream, 0, &now);
+	DL_FOREACH(iodev->streams, stream)
+		cras_rstream_set_deep_buffer(stream->stream,
+					     iodev->deep_buffer, &now);
+}
+
 int cras_iodev_add_stream(struct cras_iodev *iodev,
 			  struct dev_stream *stream)
 {
@@ -807,6 +943,9 @@ int cras_iodev_add_stream(struct cras_iodev *iodev,
 
 	iodev->min_cb_level = MIN(iodev->min_cb_level, cb_threshold);
 	iodev->max_cb_level = MAX(iodev->max_cb_level, cb_threshold);
+	if (iodev->input_data)
+		input_data_add_stream(iodev->input_data, stream->stream);
+	update_deep_buffer(iodev, NULL);
 	return 0;
 }
 
@@ -832,6 +971,9 @@ struct dev_stream *cras_iodev_rm_stream(struct cras_iodev *iodev,
 		iodev->max_cb_level = MAX(iodev->max_cb_level, cb_threshold);
 	}
 
+	if (ret && iodev->input_data)
+		input_data_rm_stream(iodev->input_data, rstream);
+
 	if (!iodev->streams) {
 		buffer_share_destroy(iodev->buf_state);
 		iodev->buf_state = NULL;
@@ -843,6 +985,7 @@ struct dev_stream *cras_iodev_rm_stream(struct cras_iodev *iodev,
 		    (iodev->state == CRAS_IODEV_STATE_NORMAL_RUN))
 			cras_iodev_no_stream_playback_transition(iodev, 1);
 	}
+	update_deep_buffer(iodev, ret);
 	return ret;
 }
 
@@ -920,9 +1063,18 @@ int cras_iodev_open(struct cras_iodev *iodev, unsigned int cb_level,
 	iodev->min_cb_level = MIN(iodev->buffer_size / 2, cb_level);
 	iodev->max_cb_level = 0;
 
+	/* Start from the configured level, it's restored on close. */
+	if (iodev->direction == CRAS_STREAM_OUTPUT &&
+	    iodev->adaptive_watermark)
+		buffer_watermark_init(&iodev->watermark,
+				      iodev->min_buffer_level, 0,
+				      iodev->buffer_size / 2,
+				      iodev->ext_format->frame_rate / 1000);
+
 	iodev->reset_request_pending = 0;
 	iodev->state = CRAS_IODEV_STATE_OPEN;
 	iodev->highest_hw_level = 0;
+	iodev->dsp_silent_frames = 0;
 
 	if (iodev->direction == CRAS_STREAM_OUTPUT) {
 		/* If device supports start ops, device can be in open state.
@@ -974,6 +1126,9 @@ int cras_iodev_close(struct cras_iodev *iodev)
 	if (rc)
 		return rc;
 	iodev->state = CRAS_IODEV_STATE_CLOSE;
+	if (iodev->direction == CRAS_STREAM_OUTPUT &&
+	    iodev->adaptive_watermark)
+		iodev->min_buffer_level = iodev->watermark.initial_level;
 	if (iodev->ramp)
 		cras_ramp_reset(iodev->ramp);
 
@@ -1003,7 +1158,8 @@ int cras_iodev_put_input_buffer(struct cras_iodev *iodev)
 }
 
 int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
-				 unsigned int nframes, int *is_non_empty,
+				 unsigned int nframes, int is_silent,
+				 int *is_non_empty,
 				 struct cras_fmt_conv *remix_converter)
 {
 	const struct cras_audio_format *fmt = iodev->format;
@@ -1024,7 +1180,7 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 		ramp_action = cras_ramp_get_current_action(iodev->ramp);
 	}
 
-	rc = apply_dsp(iodev, frames, nframes);
+	rc = apply_dsp(iodev, frames, nframes, &is_silent);
 	if (rc)
 		return rc;
 
@@ -1032,6 +1188,14 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 		iodev->post_dsp_hook(frames, nframes, fmt,
 				     iodev->post_dsp_hook_cb_data);
 
+	/* Zeros stay zeros through volume, ramp and remix. */
+	if (is_silent) {
+		if (ramp_action.type == CRAS_RAMP_ACTION_PARTIAL)
+			cras_ramp_update_ramped_frames(iodev->ramp, nframes);
+		rate_estimator_add_frames(iodev->rate_est, nframes);
+		return iodev->put_buffer(iodev, nframes);
+	}
+
 	/* Mute samples if adjusted volume is 0 or system is muted, plus
 	 * that this device is not ramping. */
 	if (output_should_mute(iodev) &&
@@ -1081,19 +1245,21 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 	rate_estimator_add_frames(iodev->rate_est, nframes);
 
 	// Calculate whether the final output was non-empty, if requested.
-	if (is_non_empty) {
-		unsigned int i;
-		for (i = 0; i < nframes * cras_get_format_bytes(fmt); i++) {
-			if (frames[i]) {
-				*is_non_empty = 1;
-				break;
-			}
-		}
-	}
+	if (is_non_empty &&
+	    !cras_mix_buffer_is_zero(frames,
+				     nframes * cras_get_format_bytes(fmt)))
+		*is_non_empty = 1;
 
 	return iodev->put_buffer(iodev, nframes);
 }
 
+int cras_iodev_commit_output_buffer(struct cras_iodev *odev)
+{
+	if (odev->commit_buffer)
+		return odev->commit_buffer(odev);
+	return 0;
+}
+
 int cras_iodev_get_input_buffer(struct cras_iodev *iodev, unsigned int *frames)
 {
 	const unsigned int frame_bytes = cras_get_format_bytes(iodev->format);
@@ -1131,7 +1297,7 @@ int cras_iodev_get_input_buffer(struct cras_iodev *iodev, unsigned int *frames)
 	if (*frames > iodev->input_dsp_offset) {
 		rc = apply_dsp(iodev, hw_buffer +
 			       iodev->input_dsp_offset * frame_bytes,
-			       *frames - iodev->input_dsp_offset);
+			       *frames - iodev->input_dsp_offset, NULL);
 		if (rc)
 			return rc;
 	}
@@ -1183,6 +1349,37 @@ double cras_iodev_get_est_rate_ratio(const struct cras_iodev *iodev)
 			iodev->ext_format->frame_rate;
 }
 
+int cras_iodev_get_delay(const struct cras_iodev *iodev,
+			 struct cras_iodev_delay *delay)
+{
+	int rc;
+
+	delay->tstamp.tv_sec = 0;
+	delay->tstamp.tv_nsec = 0;
+	if (iodev->delay_frames_tstamp)
+		rc = iodev->delay_frames_tstamp(iodev, &delay->tstamp);
+	else
+		rc = iodev->delay_frames(iodev);
+	if (rc < 0)
+		return rc;
+
+	if (timespec_is_nonzero(&delay->tstamp)) {
+		delay->frames_err = 1;
+	} else {
+		/* The hardware pointer may be as old as the last period,
+		 * which isn't known here. The shortest callback is the
+		 * granularity the streams are scheduled at anyway. */
+		clock_gettime(CLOCK_MONOTONIC_RAW, &delay->tstamp);
+		delay->frames_err = iodev->min_cb_level;
+	}
+
+	delay->frames = rc + cras_iodev_get_dsp_delay(iodev);
+	delay->rate_ratio = cras_iodev_get_est_rate_ratio(iodev);
+	delay->rate_err = rate_estimator_get_rate_error(iodev->rate_est) /
+			  iodev->ext_format->frame_rate;
+	return 0;
+}
+
 int cras_iodev_get_dsp_delay(const struct cras_iodev *iodev)
 {
 	struct cras_dsp_context *ctx;
@@ -1221,6 +1418,14 @@ int cras_iodev_frames_queued(struct cras_iodev *iodev,
 		return rc;
 	}
 
+	/* Only real levels of a playing device tell how close it came to
+	 * an underrun. */
+	if (iodev->adaptive_watermark &&
+	    iodev->state == CRAS_IODEV_STATE_NORMAL_RUN &&
+	    timespec_is_nonzero(hw_tstamp) &&
+	    buffer_watermark_update(&iodev->watermark, rc, hw_tstamp))
+		iodev->min_buffer_level = iodev->watermark.level;
+
 	if (rc < iodev->min_buffer_level)
 		return 0;
 
@@ -1279,15 +1484,24 @@ int cras_iodev_fill_odev_zeros(struct cras_iodev *odev, unsigned int frames)
 		buf = area->channels[0].buf;
 		memset(buf, 0, frames_written * frame_bytes);
 		cras_iodev_put_output_buffer(odev, buf, frames_written,
-					     NULL, NULL);
+					     1, NULL, NULL);
 		frames -= frames_written;
 	}
 
-	return 0;
+	return cras_iodev_commit_output_buffer(odev);
 }
 
 int cras_iodev_output_underrun(struct cras_iodev *odev) {
+	struct timespec now;
+
 	cras_audio_thread_underrun();
+
+	/* Raise the margin before the device refills its buffer. */
+	if (odev->adaptive_watermark) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+		if (buffer_watermark_underrun(&odev->watermark, &now))
+			odev->min_buffer_level = odev->watermark.level;
+	}
 	if (odev->output_underrun)
 		return odev->output_underrun(odev);
 	else
@@ -1380,6 +1594,20 @@ unsigned int cras_iodev_get_num_severe_underruns(const struct cras_iodev *iodev)
 	return 0;
 }
 
+unsigned int cras_iodev_get_num_hw_calls(const struct cras_iodev *iodev)
+{
+	if (iodev->get_num_hw_calls)
+		return iodev->get_num_hw_calls(iodev);
+	return 0;
+}
+
+unsigned int cras_iodev_get_num_overruns(const struct cras_iodev *iodev)
+{
+	if (iodev->get_num_overruns)
+		return iodev->get_num_overruns(iodev);
+	return 0;
+}
+
 int cras_iodev_reset_request(struct cras_iodev* iodev)
 {
 	/* Ignore requests if there is a pending request.
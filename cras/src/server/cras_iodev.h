@@ -14,9 +14,11 @@
 #ifndef CRAS_IODEV_H_
 #define CRAS_IODEV_H_
 
+#include "buffer_watermark.h"
 #include "cras_dsp.h"
 #include "cras_iodev_info.h"
 #include "cras_messages.h"
+#include "rate_estimator.h"
 
 struct buffer_share;
 struct cras_fmt_conv;
@@ -49,6 +51,22 @@ enum CRAS_IODEV_STATE {
 	CRAS_IODEV_STATE_NO_STREAM_RUN = 3,
 };
 
+/* A delay of a device and what is known about its accuracy.
+ * Members:
+ *    frames - The delay of the next sample in frames, including DSP.
+ *    tstamp - The time the delay was measured.
+ *    rate_ratio - Estimated rate of the device over its nominal rate.
+ *    rate_err - Bound on the error of rate_ratio.
+ *    frames_err - Bound on the error of frames.
+ */
+struct cras_iodev_delay {
+	unsigned int frames;
+	struct timespec tstamp;
+	double rate_ratio;
+	double rate_err;
+	unsigned int frames_err;
+};
+
 /* Holds an output/input node for this device.  An ionode is a control that
  * can be switched on and off such as headphones or speakers.
  * Members:
@@ -112,8 +130,13 @@ struct cras_ionode {
  *                 with the associated timestamp. The timestamp is {0, 0} when
  *                 the device hasn't started processing data (and on error).
  * delay_frames - The delay of the next sample in frames.
+ * delay_frames_tstamp - Like delay_frames, and fills tstamp with the hardware
+ *     time stamp the delay was measured at, {0, 0} if there is none. Optional.
  * get_buffer - Returns a buffer to read/write to/from.
  * put_buffer - Marks a buffer from get_buffer as read/written.
+ * commit_buffer - Commits to the hardware the frames put_buffer deferred,
+ *     called after each round of writes. Only needed by output devices that
+ *     batch the writes of a round.
  * flush_buffer - Flushes the buffer and return the number of frames flushed.
  * start - Starts running device. This is optionally supported on output device.
  *         If device supports this ops, device can be in CRAS_IODEV_STATE_OPEN
@@ -141,10 +164,15 @@ struct cras_ionode {
  * get_num_underruns - Gets number of underrun recorded so far.
  * get_num_severe_underruns - Gets number of severe underrun recorded since
  *                            iodev was created.
+ * get_num_hw_calls - Gets number of calls into the driver that may enter the
+ *                    kernel since the device was opened.
+ * get_num_overruns - Gets number of times captured samples were lost
+ *                    because they weren't read in time.
  * format - The audio format being rendered or captured to hardware.
  * ext_format - The audio format that is visible to the rest of the system.
  *     This can be different than the hardware if the device dsp changes it.
  * rate_est - Rate estimator to estimate the actual device rate.
+ * rate_est_type - Which algorithm rate_est uses, set by the device.
  * area - Information about how the samples are stored.
  * info - Unique identifier for this device (index and name).
  * nodes - The output or input nodes available for this device.
@@ -155,6 +183,13 @@ struct cras_ionode {
  * supported_formats - List of audio formats (s16le, s32le) supported by device.
  * buffer_size - Size of the audio buffer in frames.
  * min_buffer_level - Extra frames to keep queued in addition to requested.
+ * adaptive_watermark - True if watermark adapts min_buffer_level to the
+ *     underruns of the device while it's open, set by the device.
+ * watermark - Controller of min_buffer_level when adaptive_watermark is set.
+ * allow_deep_buffer - True if media streams may play in deep buffer mode on
+ *     this device, set by the device.
+ * deep_buffer - True while only media streams play on the device and they are
+ *     called back in large chunks.
  * dsp_context - The context used for dsp processing on the audio data.
  * dsp_name - The "dsp_name" dsp variable specified in the ucm config.
  * echo_reference_dev - Used only for playback iodev. Pointer to the input
@@ -188,6 +223,9 @@ struct cras_ionode {
  *                     haven't been "put" yet.
  * input_dsp_offset - The number of frames in the HW buffer that have already
  *                    been processed by the input DSP.
+ * dsp_silent_frames - For playback only. The number of consecutive frames the
+ *                     DSP turned from silence into silence. Once past the
+ *                     tail of the pipeline, silent buffers skip the DSP.
  * input_data - Used to pass audio input data to streams with or without
  *              stream side processing.
  */
@@ -206,10 +244,13 @@ struct cras_iodev {
 	int (*frames_queued)(const struct cras_iodev *iodev,
 			     struct timespec *tstamp);
 	int (*delay_frames)(const struct cras_iodev *iodev);
+	int (*delay_frames_tstamp)(const struct cras_iodev *iodev,
+				   struct timespec *tstamp);
 	int (*get_buffer)(struct cras_iodev *iodev,
 			  struct cras_audio_area **area,
 			  unsigned *frames);
 	int (*put_buffer)(struct cras_iodev *iodev, unsigned nwritten);
+	int (*commit_buffer)(struct cras_iodev *iodev);
 	int (*flush_buffer)(struct cras_iodev *iodev);
 	int (*start)(const struct cras_iodev *iodev);
 	int (*output_should_wake)(const struct cras_iodev *iodev);
@@ -223,9 +264,12 @@ struct cras_iodev {
 	char *(*get_hotword_models)(struct cras_iodev *iodev);
 	unsigned int (*get_num_underruns)(const struct cras_iodev *iodev);
 	unsigned int (*get_num_severe_underruns)(const struct cras_iodev *iodev);
+	unsigned int (*get_num_hw_calls)(const struct cras_iodev *iodev);
+	unsigned int (*get_num_overruns)(const struct cras_iodev *iodev);
 	struct cras_audio_format *format;
 	struct cras_audio_format *ext_format;
 	struct rate_estimator *rate_est;
+	enum RATE_ESTIMATOR_TYPE rate_est_type;
 	struct cras_audio_area *area;
 	struct cras_iodev_info info;
 	struct cras_ionode *nodes;
@@ -236,6 +280,10 @@ struct cras_iodev {
 	snd_pcm_format_t *supported_formats;
 	snd_pcm_uframes_t buffer_size;
 	unsigned int min_buffer_level;
+	int adaptive_watermark;
+	struct buffer_watermark watermark;
+	int allow_deep_buffer;
+	int deep_buffer;
 	struct cras_dsp_context *dsp_context;
 	const char *dsp_name;
 	struct cras_iodev *echo_reference_dev;
@@ -260,6 +308,7 @@ struct cras_iodev {
 	unsigned int input_frames_read;
 	unsigned int input_dsp_offset;
 	unsigned int highest_hw_level;
+	unsigned int dsp_silent_frames;
 	struct input_data *input_data;
 	struct cras_iodev *prev, *next;
 };
@@ -533,11 +582,30 @@ int cras_iodev_buffer_avail(struct cras_iodev *iodev, unsigned hw_level);
 /* Marks a buffer from get_buffer as read. */
 int cras_iodev_put_input_buffer(struct cras_iodev *iodev);
 
-/* Marks a buffer from get_buffer as written. */
+/* Marks a buffer from get_buffer as written.
+ * Args:
+ *    iodev - The device.
+ *    frames - The samples to write, in the ext_format of the device.
+ *    nframes - The number of frames to write.
+ *    is_silent - Non-zero if the caller knows the samples are all zero. DSP,
+ *        volume and remix are then skipped once the DSP tail has decayed.
+ *    is_non_empty - If not NULL, set to 1 if the output is not all zero.
+ *    remix_converter - Channel remix to apply, or NULL.
+ */
 int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
-				 unsigned int nframes, int *is_non_empty,
+				 unsigned int nframes, int is_silent,
+				 int *is_non_empty,
 				 struct cras_fmt_conv *remix_converter);
 
+/* Commits the frames written by a round of cras_iodev_put_output_buffer
+ * calls, for devices that defer that.
+ * Args:
+ *    odev - The device.
+ * Returns:
+ *    0 on success, negative error code on failure.
+ */
+int cras_iodev_commit_output_buffer(struct cras_iodev *odev);
+
 /* Returns a buffer to read from.
  * Args:
  *    iodev - The device.
@@ -586,6 +654,18 @@ static inline int cras_iodev_delay_frames(const struct cras_iodev *iodev)
 	return iodev->delay_frames(iodev) + cras_iodev_get_dsp_delay(iodev);
 }
 
+/* Gets the delay of the device along with the time it was measured and
+ * bounds on its error. Devices that time stamp their delay in hardware give
+ * a delay that is exact at tstamp, others are read at the time of the call.
+ * Args:
+ *    iodev - The device.
+ *    delay - Filled with the delay.
+ * Returns:
+ *    0 on success, negative error code on failure.
+ */
+int cras_iodev_get_delay(const struct cras_iodev *iodev,
+			 struct cras_iodev_delay *delay);
+
 /* Returns if input iodev has started streaming. */
 static inline int cras_iodev_input_streaming(const struct cras_iodev *iodev)
 {
@@ -613,14 +693,30 @@ void cras_iodev_register_post_dsp_hook(struct cras_iodev *iodev,
 /*
  * Sets the external dsp module for |iodev| and configures the module
  * accordingly if iodev is already open. This function should be called
- * in main thread.
+ * in main thread. On an open device the current module is disconnected
+ * and the new one connected by the audio thread, and the new module is
+ * configured in between, while no pipeline runs it.
  * Args:
  *    iodev - The iodev to hold the dsp module.
- *    ext - External dsp module to set to iodev.
+ *    ext - External dsp module to set to iodev, or NULL to remove it.
  */
 void cras_iodev_set_ext_dsp_module(struct cras_iodev *iodev,
 				   struct ext_dsp_module *ext);
 
+/*
+ * Connects |ext| to the sink of the dsp pipeline of |iodev|. Called in the
+ * audio thread, or in main thread before the device is added to the audio
+ * thread.
+ * Args:
+ *    iodev - The iodev whose pipeline to change.
+ *    ext - External dsp module to connect, or NULL to disconnect the
+ *        current one.
+ * Returns:
+ *    0 on success, negative error code otherwise.
+ */
+int cras_iodev_connect_ext_dsp_module(struct cras_iodev *iodev,
+				      struct ext_dsp_module *ext);
+
 /* Put 'frames' worth of zero samples into odev. */
 int cras_iodev_fill_odev_zeros(struct cras_iodev *odev, unsigned int frames);
 
@@ -695,6 +791,24 @@ unsigned int cras_iodev_get_num_underruns(const struct cras_iodev *iodev);
 unsigned int cras_iodev_get_num_severe_underruns(
 		const struct cras_iodev *iodev);
 
+/* Get number of driver calls that may enter the kernel.
+ * Args:
+ *    iodev[in] - The device.
+ * Returns:
+ *    The number of calls since the device was opened, 0 if the device
+ *    doesn't count them.
+ */
+unsigned int cras_iodev_get_num_hw_calls(const struct cras_iodev *iodev);
+
+/* Get number of times captured samples were lost before they were read.
+ * Args:
+ *    iodev[in] - The device.
+ * Returns:
+ *    The number of overruns since the device was opened, 0 if the device
+ *    doesn't count them.
+ */
+unsigned int cras_iodev_get_num_overruns(const struct cras_iodev *iodev);
+
 /* Request main thread to re-open device. This should be used in audio thread
  * when it finds device is in a bad state. The request will be ignored if
  * there is still a pending request.
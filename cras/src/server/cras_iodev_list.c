@@ -18,6 +18,7 @@
 #include "cras_types.h"
 #include "cras_system_state.h"
 #include "server_stream.h"
+#include "sim_iodev.h"
 #include "stream_list.h"
 #include "test_iodev.h"
 #include "utlist.h"
@@ -1517,9 +1518,19 @@ void cras_iodev_list_notify_node_capture_gain(struct cras_ionode *node)
 
 void cras_iodev_list_add_test_dev(enum TEST_IODEV_TYPE type)
 {
-	if (type != TEST_IODEV_HOTWORD)
-		return;
-	test_iodev_create(CRAS_STREAM_INPUT, type);
+	switch (type) {
+	case TEST_IODEV_HOTWORD:
+		test_iodev_create(CRAS_STREAM_INPUT, type);
+		break;
+	case TEST_IODEV_SIM_OUTPUT:
+		sim_iodev_create(CRAS_STREAM_OUTPUT);
+		break;
+	case TEST_IODEV_SIM_INPUT:
+		sim_iodev_create(CRAS_STREAM_INPUT);
+		break;
+	default:
+		break;
+	}
 }
 
 void cras_iodev_list_test_dev_command(unsigned int iodev_idx,
@@ -1532,7 +1543,10 @@ void cras_iodev_list_test_dev_command(unsigned int iodev_idx,
 	if (!dev)
 		return;
 
-	test_iodev_command(dev, command, data_len, data);
+	if (command == TEST_IODEV_CMD_SIM_CONFIG)
+		sim_iodev_command(dev, command, data_len, data);
+	else
+		test_iodev_command(dev, command, data_len, data);
 }
 
 struct audio_thread *cras_iodev_list_get_audio_thread()
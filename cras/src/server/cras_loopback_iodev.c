@@ -7,13 +7,13 @@
 #include <sys/param.h>
 #include <syslog.h>
 
-#include "byte_buffer.h"
 #include "cras_audio_area.h"
 #include "cras_config.h"
 #include "cras_iodev.h"
 #include "cras_iodev_list.h"
 #include "cras_types.h"
 #include "cras_util.h"
+#include "loopback_tap.h"
 #include "sfh.h"
 #include "utlist.h"
 
@@ -38,84 +38,39 @@ static snd_pcm_format_t loopback_supported_formats[] = {
 };
 
 /* loopack iodev.  Keep state of a loopback device.
- *    sample_buffer - Pointer to sample buffer.
+ *    reader - Reads the samples from the loopback tap on the first enabled
+ *        output device.
  */
 struct loopback_iodev {
 	struct cras_iodev base;
 	enum CRAS_LOOPBACK_TYPE loopback_type;
-	struct timespec last_filled;
-	struct byte_buffer *sample_buffer;
+	struct loopback_tap_reader *reader;
 };
 
-static int sample_hook(const uint8_t *frames, unsigned int nframes,
-		       const struct cras_audio_format *fmt,
-		       void *cb_data)
+/* Follows the first enabled output device, reading silence if there's
+ * none. */
+static void update_tap(struct loopback_iodev *loopdev)
 {
-	struct loopback_iodev *loopdev = (struct loopback_iodev *)cb_data;
-	struct byte_buffer *sbuf = loopdev->sample_buffer;
-	unsigned int frame_bytes = cras_get_format_bytes(fmt);
-	unsigned int frames_to_copy, bytes_to_copy;
 	struct cras_iodev *edev = cras_iodev_list_get_first_enabled_iodev(
 			CRAS_STREAM_OUTPUT);
 
-	/* If there's no active streams, the logic in frames_queued will fill
-	 * zeros for loopback capture, do not accept zeros for draining device.
-	 */
-	if (!edev || !edev->streams)
-		return 0;
-
-	frames_to_copy = MIN(buf_writable(sbuf) / frame_bytes, nframes);
-	if (!frames_to_copy)
-		return 0;
-
-	bytes_to_copy = frames_to_copy * frame_bytes;
-	memcpy(buf_write_pointer(sbuf), frames, bytes_to_copy);
-	buf_increment_write(sbuf, bytes_to_copy);
-	clock_gettime(CLOCK_MONOTONIC_RAW, &loopdev->last_filled);
-
-	return frames_to_copy;
-}
-
-static void register_loopback_hook(enum CRAS_LOOPBACK_TYPE loopback_type,
-				   struct cras_iodev *iodev,
-				   loopback_hook_t hook, void *cb_data)
-{
-	if (!iodev) {
-		syslog(LOG_ERR, "Failed to register loopback hook.");
-		return;
-	}
-
-	if (loopback_type == LOOPBACK_POST_MIX_PRE_DSP)
-		cras_iodev_register_pre_dsp_hook(iodev, hook, cb_data);
-	else if (loopback_type == LOOPBACK_POST_DSP)
-		cras_iodev_register_post_dsp_hook(iodev, hook, cb_data);
+	loopback_tap_reader_attach(loopdev->reader, edev);
 }
 
 static void device_enabled_hook(struct cras_iodev *iodev, void *cb_data)
 {
-	struct loopback_iodev *loopdev = (struct loopback_iodev *)cb_data;
-	struct cras_iodev *edev;
-
 	if (iodev->direction != CRAS_STREAM_OUTPUT)
 		return;
 
-	/* Register loopback hook onto first enabled iodev. */
-	edev = cras_iodev_list_get_first_enabled_iodev(
-			CRAS_STREAM_OUTPUT);
-	register_loopback_hook(loopdev->loopback_type, edev,
-			       sample_hook, cb_data);
+	update_tap((struct loopback_iodev *)cb_data);
 }
 
 static void device_disabled_hook(struct cras_iodev *iodev, void *cb_data)
 {
-	struct loopback_iodev *loopdev = (struct loopback_iodev *)cb_data;
-
 	if (iodev->direction != CRAS_STREAM_OUTPUT)
 		return;
 
-	/* Unregister loopback hook from disabled iodev. */
-	register_loopback_hook(loopdev->loopback_type, iodev, NULL,
-			       NULL);
+	update_tap((struct loopback_iodev *)cb_data);
 }
 
 /*
@@ -126,29 +81,18 @@ static int frames_queued(const struct cras_iodev *iodev,
 			 struct timespec *hw_tstamp)
 {
 	struct loopback_iodev *loopdev = (struct loopback_iodev *)iodev;
-	struct byte_buffer *sbuf = loopdev->sample_buffer;
 	unsigned int frame_bytes = cras_get_format_bytes(iodev->format);
-	struct cras_iodev *edev = cras_iodev_list_get_first_enabled_iodev(
-			CRAS_STREAM_OUTPUT);
 
-	if (!edev || !edev->streams) {
-		unsigned int frames_since_last, frames_to_fill, bytes_to_fill;
-
-		frames_since_last = cras_frames_since_time(
-				&loopdev->last_filled,
-				iodev->format->frame_rate);
-		frames_to_fill = MIN(buf_writable(sbuf) / frame_bytes,
-				     frames_since_last);
-		if (frames_to_fill > 0) {
-			bytes_to_fill = frames_to_fill * frame_bytes;
-			memset(buf_write_pointer(sbuf), 0, bytes_to_fill);
-			buf_increment_write(sbuf, bytes_to_fill);
-			clock_gettime(CLOCK_MONOTONIC_RAW,
-				      &loopdev->last_filled);
-		}
-	}
-	*hw_tstamp = loopdev->last_filled;
-	return buf_queued(sbuf) / frame_bytes;
+	return loopback_tap_reader_queued(loopdev->reader, frame_bytes,
+					  iodev->format->frame_rate,
+					  hw_tstamp) / frame_bytes;
+}
+
+static unsigned int get_num_overruns(const struct cras_iodev *iodev)
+{
+	struct loopback_iodev *loopdev = (struct loopback_iodev *)iodev;
+
+	return loopback_tap_reader_get_overruns(loopdev->reader);
 }
 
 static int delay_frames(const struct cras_iodev *iodev)
@@ -161,15 +105,16 @@ static int delay_frames(const struct cras_iodev *iodev)
 static int close_record_dev(struct cras_iodev *iodev)
 {
 	struct loopback_iodev *loopdev = (struct loopback_iodev *)iodev;
-	struct byte_buffer *sbuf = loopdev->sample_buffer;
-	struct cras_iodev *edev;
+	unsigned int overruns;
 
 	cras_iodev_free_format(iodev);
 	cras_iodev_free_audio_area(iodev);
-	buf_reset(sbuf);
 
-	edev = cras_iodev_list_get_first_enabled_iodev(CRAS_STREAM_OUTPUT);
-	register_loopback_hook(loopdev->loopback_type, edev, NULL, NULL);
+	overruns = loopback_tap_reader_get_overruns(loopdev->reader);
+	if (overruns)
+		syslog(LOG_INFO, "%s overran %u times", iodev->info.name,
+		       overruns);
+	loopback_tap_reader_detach(loopdev->reader);
 	cras_iodev_list_set_device_enabled_callback(NULL, NULL, (void *)iodev);
 
 	return 0;
@@ -178,14 +123,10 @@ static int close_record_dev(struct cras_iodev *iodev)
 static int configure_record_dev(struct cras_iodev *iodev)
 {
 	struct loopback_iodev *loopdev = (struct loopback_iodev *)iodev;
-	struct cras_iodev *edev;
 
 	cras_iodev_init_audio_area(iodev, iodev->format->num_channels);
-	clock_gettime(CLOCK_MONOTONIC_RAW, &loopdev->last_filled);
 
-	edev = cras_iodev_list_get_first_enabled_iodev(CRAS_STREAM_OUTPUT);
-	register_loopback_hook(loopdev->loopback_type, edev, sample_hook,
-			       (void *)iodev);
+	update_tap(loopdev);
 	cras_iodev_list_set_device_enabled_callback(device_enabled_hook,
 						    device_disabled_hook,
 						    (void *)iodev);
@@ -198,14 +139,16 @@ static int get_record_buffer(struct cras_iodev *iodev,
 		      unsigned *frames)
 {
 	struct loopback_iodev *loopdev = (struct loopback_iodev *)iodev;
-	struct byte_buffer *sbuf = loopdev->sample_buffer;
 	unsigned int frame_bytes = cras_get_format_bytes(iodev->format);
-	unsigned int avail_frames = buf_readable(sbuf) / frame_bytes;
+	unsigned int readable;
+	uint8_t *read_ptr;
 
-	*frames = MIN(avail_frames, *frames);
+	read_ptr = loopback_tap_reader_read_pointer(loopdev->reader,
+						    &readable);
+	*frames = MIN(readable / frame_bytes, *frames);
 	iodev->area->frames = *frames;
 	cras_audio_area_config_buf_pointers(iodev->area, iodev->format,
-					    buf_read_pointer(sbuf));
+					    read_ptr);
 	*area = iodev->area;
 
 	return 0;
@@ -214,10 +157,9 @@ static int get_record_buffer(struct cras_iodev *iodev,
 static int put_record_buffer(struct cras_iodev *iodev, unsigned nframes)
 {
 	struct loopback_iodev *loopdev = (struct loopback_iodev *)iodev;
-	struct byte_buffer *sbuf = loopdev->sample_buffer;
 	unsigned int frame_bytes = cras_get_format_bytes(iodev->format);
 
-	buf_increment_read(sbuf, nframes * frame_bytes);
+	loopback_tap_reader_read(loopdev->reader, nframes * frame_bytes);
 
 	return 0;
 }
@@ -225,9 +167,8 @@ static int put_record_buffer(struct cras_iodev *iodev, unsigned nframes)
 static int flush_record_buffer(struct cras_iodev *iodev)
 {
 	struct loopback_iodev *loopdev = (struct loopback_iodev *)iodev;
-	struct byte_buffer *sbuf = loopdev->sample_buffer;
-	unsigned int queued_bytes = buf_queued(sbuf);
-	buf_increment_read(sbuf, queued_bytes);
+
+	loopback_tap_reader_flush(loopdev->reader);
 	return 0;
 }
 
@@ -245,8 +186,8 @@ static struct cras_iodev *create_loopback_iodev(enum CRAS_LOOPBACK_TYPE type)
 	if (loopback_iodev == NULL)
 		return NULL;
 
-	loopback_iodev->sample_buffer = byte_buffer_create(1024*16*4);
-	if (loopback_iodev->sample_buffer == NULL) {
+	loopback_iodev->reader = loopback_tap_reader_create(type);
+	if (loopback_iodev->reader == NULL) {
 		free(loopback_iodev);
 		return NULL;
 	}
@@ -276,6 +217,7 @@ static struct cras_iodev *create_loopback_iodev(enum CRAS_LOOPBACK_TYPE type)
 	iodev->get_buffer = get_record_buffer;
 	iodev->put_buffer = put_record_buffer;
 	iodev->flush_buffer = flush_record_buffer;
+	iodev->get_num_overruns = get_num_overruns;
 
 	return iodev;
 }
@@ -327,11 +269,10 @@ struct cras_iodev *loopback_iodev_create(enum CRAS_LOOPBACK_TYPE type)
 void loopback_iodev_destroy(struct cras_iodev *iodev)
 {
 	struct loopback_iodev *loopdev = (struct loopback_iodev *)iodev;
-	struct byte_buffer *sbuf = loopdev->sample_buffer;
 
 	cras_iodev_list_rm_input(iodev);
         free(iodev->nodes);
 
-	byte_buffer_destroy(&sbuf);
+	loopback_tap_reader_destroy(loopdev->reader);
 	free(loopdev);
 }
@@ -78,3 +78,8 @@ size_t cras_mix_mute_buffer(uint8_t *dst,
 {
 	return ops->mute_buffer(dst, frame_bytes, count);
 }
+
+int cras_mix_buffer_is_zero(const uint8_t *buf, size_t bytes)
+{
+	return ops->buffer_is_zero(buf, bytes);
+}
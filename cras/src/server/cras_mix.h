@@ -79,4 +79,13 @@ size_t cras_mix_mute_buffer(uint8_t *dst,
 			    size_t frame_bytes,
 			    size_t count);
 
+/* Checks if a buffer holds only zero samples.
+ * Args:
+ *    buf - The buffer to check.
+ *    bytes - Size of the buffer in bytes.
+ * Returns:
+ *    1 if every byte is zero, 0 otherwise.
+ */
+int cras_mix_buffer_is_zero(const uint8_t *buf, size_t bytes);
+
 #endif /* _CRAS_MIX_H */
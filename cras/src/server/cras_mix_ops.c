@@ -853,10 +853,52 @@ static size_t mix_mute_buffer(uint8_t *dst,
 	return count;
 }
 
+/* Words OR-ed together before checking for a non-zero sample. The inner
+ * loop has no branch so it is vectorized for each of the SIMD flavors this
+ * file is built for. */
+#define ZERO_CHECK_BLOCK_WORDS 16
+
+static int mix_buffer_is_zero(const uint8_t *buf, size_t bytes)
+{
+	const uint64_t *words;
+	uint64_t acc;
+	size_t nwords, i, j;
+
+	while (bytes && ((uintptr_t)buf & (sizeof(*words) - 1))) {
+		if (*buf++)
+			return 0;
+		bytes--;
+	}
+
+	words = (const uint64_t *)buf;
+	nwords = bytes / sizeof(*words);
+	for (i = 0; i + ZERO_CHECK_BLOCK_WORDS <= nwords;
+	     i += ZERO_CHECK_BLOCK_WORDS) {
+		acc = 0;
+		for (j = 0; j < ZERO_CHECK_BLOCK_WORDS; j++)
+			acc |= words[i + j];
+		if (acc)
+			return 0;
+	}
+	acc = 0;
+	for (; i < nwords; i++)
+		acc |= words[i];
+	if (acc)
+		return 0;
+
+	buf += nwords * sizeof(*words);
+	bytes -= nwords * sizeof(*words);
+	while (bytes--)
+		if (*buf++)
+			return 0;
+	return 1;
+}
+
 const struct cras_mix_ops OPS(mixer_ops) = {
 	.scale_buffer = scale_buffer,
 	.scale_buffer_increment = scale_buffer_increment,
 	.add = mix_add,
 	.add_scale_stride = mix_add_scale_stride,
 	.mute_buffer = mix_mute_buffer,
+	.buffer_is_zero = mix_buffer_is_zero,
 };
@@ -28,6 +28,7 @@ extern const struct cras_mix_ops mixer_ops_fma;
  *   add: See cras_mix_add.
  *   add_scale_stride: See cras_mix_add_scale_stride.
  *   mute_buffer: cras_mix_mute_buffer.
+ *   buffer_is_zero: cras_mix_buffer_is_zero.
  */
 struct cras_mix_ops {
 	void (*scale_buffer_increment)(snd_pcm_format_t fmt, uint8_t *buff,
@@ -45,5 +46,6 @@ struct cras_mix_ops {
 	size_t (*mute_buffer)(uint8_t *dst,
 			    size_t frame_bytes,
 			    size_t count);
+	int (*buffer_is_zero)(const uint8_t *buf, size_t bytes);
 };
 #endif
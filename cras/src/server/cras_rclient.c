@@ -167,6 +167,18 @@ static void dump_audio_thread_snapshots(struct cras_rclient *client)
 	cras_rclient_send_message(client, &msg.header, NULL, 0);
 }
 
+/* Handles dumping the dsp profile to shared memory for the client. */
+static void dump_dsp_profile(struct cras_rclient *client)
+{
+	struct cras_client_audio_debug_info_ready msg;
+	struct cras_server_state *state;
+
+	cras_fill_client_audio_debug_info_ready(&msg);
+	state = cras_system_state_get_no_lock();
+	cras_dsp_get_profile_info(&state->dsp_profile_info);
+	cras_rclient_send_message(client, &msg.header, NULL, 0);
+}
+
 static void handle_get_hotword_models(struct cras_rclient *client,
 				      cras_node_id_t node_id)
 {
@@ -583,6 +595,9 @@ int cras_rclient_message_from_client(struct cras_rclient *client,
 	case CRAS_SERVER_DUMP_DSP_INFO:
 		cras_dsp_dump_info();
 		break;
+	case CRAS_SERVER_DUMP_DSP_PROFILE:
+		dump_dsp_profile(client);
+		break;
 	case CRAS_SERVER_DUMP_AUDIO_THREAD:
 		dump_audio_thread_info(client);
 		break;
@@ -0,0 +1,544 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <speex/speex_resampler.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <syslog.h>
+
+#include "cras_resampler.h"
+
+/* The quality level is a value between 0 and 10. This is a tradeoff between
+ * performance, latency, and quality. */
+#define SPEEX_QUALITY_LEVEL 4
+/* Frames of new input copied into the sinc history per pass. */
+#define SINC_CHUNK_FRAMES 256
+
+/* Parameters of a windowed sinc filter bank.
+ * Members:
+ *    taps - Length of each polyphase branch in input frames, even.
+ *    max_phases - Cap on the number of branches. When the reduced rate
+ *        ratio needs more, the nearest branch is used.
+ *    beta - Kaiser window shape, sets the stopband attenuation.
+ *    rolloff - Cutoff as a fraction of the lower Nyquist frequency.
+ *    fixed_point - Store history and coefficients as Q15 and accumulate
+ *        in 32 bits instead of using floats.
+ */
+struct sinc_params {
+	unsigned int taps;
+	unsigned int max_phases;
+	double beta;
+	double rolloff;
+	int fixed_point;
+};
+
+static const struct sinc_params fast_params = {
+	.taps = 16,
+	.max_phases = 256,
+	.beta = 5.5,
+	.rolloff = 0.80,
+	.fixed_point = 1,
+};
+
+static const struct sinc_params hq_params = {
+	.taps = 128,
+	.max_phases = 512,
+	.beta = 9.0,
+	.rolloff = 0.95,
+	.fixed_point = 0,
+};
+
+/* State of the polyphase sinc backend.
+ * Members:
+ *    params - The filter bank parameters.
+ *    num_phases - Number of polyphase branches in coef.
+ *    up - Output rate divided by gcd of the rates.
+ *    down - Input rate divided by gcd of the rates.
+ *    coef_q15, coef_f - num_phases * taps coefficients, one branch after
+ *        another. Only one of them is allocated.
+ *    hist_s16, hist_f - Per channel history of the input, deinterleaved so
+ *        that the dot product over taps runs on contiguous memory.
+ *    hist_frames - Capacity of each history buffer.
+ *    avail - Frames currently held in the history buffers.
+ *    pos - Index in history of the first tap for the next output frame.
+ *    frac - Sub-frame position of the next output frame, in [0, up).
+ */
+struct sinc_state {
+	const struct sinc_params *params;
+	unsigned int num_phases;
+	unsigned int up;
+	unsigned int down;
+	int16_t *coef_q15;
+	float *coef_f;
+	int16_t **hist_s16;
+	float **hist_f;
+	unsigned int hist_frames;
+	unsigned int avail;
+	unsigned int pos;
+	unsigned int frac;
+};
+
+/* Operations implemented by each backend.
+ *    init - Allocates the backend state into r->priv.
+ *    process - Same contract as cras_resampler_process.
+ *    reset - Drops filter history.
+ *    destroy - Frees r->priv.
+ *    latency - Filter delay in input frames.
+ */
+struct resampler_ops {
+	int (*init)(struct cras_resampler *r);
+	int (*process)(struct cras_resampler *r, const int16_t *in,
+		       unsigned int *in_frames, int16_t *out,
+		       unsigned int *out_frames);
+	void (*reset)(struct cras_resampler *r);
+	void (*destroy)(struct cras_resampler *r);
+	unsigned int (*latency)(const struct cras_resampler *r);
+};
+
+struct cras_resampler {
+	enum CRAS_RESAMPLER_TYPE type;
+	const struct resampler_ops *ops;
+	unsigned int num_channels;
+	unsigned int in_rate;
+	unsigned int out_rate;
+	void *priv;
+};
+
+/*
+ * Speex backend.
+ */
+
+static int speex_init(struct cras_resampler *r)
+{
+	int rc = 0;
+
+	r->priv = speex_resampler_init(r->num_channels, r->in_rate,
+				       r->out_rate, SPEEX_QUALITY_LEVEL, &rc);
+	if (r->priv == NULL) {
+		syslog(LOG_ERR, "Fail to create speex:%u %u %u %d",
+		       r->num_channels, r->in_rate, r->out_rate, rc);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static int speex_process(struct cras_resampler *r, const int16_t *in,
+			 unsigned int *in_frames, int16_t *out,
+			 unsigned int *out_frames)
+{
+	int rc;
+
+	rc = speex_resampler_process_interleaved_int(r->priv, in, in_frames,
+						     out, out_frames);
+	return rc == RESAMPLER_ERR_SUCCESS ? 0 : -EINVAL;
+}
+
+static void speex_reset(struct cras_resampler *r)
+{
+	speex_resampler_reset_mem(r->priv);
+}
+
+static void speex_destroy(struct cras_resampler *r)
+{
+	speex_resampler_destroy(r->priv);
+}
+
+static unsigned int speex_latency(const struct cras_resampler *r)
+{
+	return speex_resampler_get_input_latency(r->priv);
+}
+
+static const struct resampler_ops speex_ops = {
+	.init = speex_init,
+	.process = speex_process,
+	.reset = speex_reset,
+	.destroy = speex_destroy,
+	.latency = speex_latency,
+};
+
+/*
+ * Polyphase windowed sinc backend, used for both the fast and the high
+ * quality tiers with different filter parameters.
+ */
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* Zeroth order modified Bessel function of the first kind. */
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0, half = x / 2;
+	int k;
+
+	for (k = 1; k < 50; k++) {
+		term *= (half / k) * (half / k);
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+/* Fills one polyphase branch. |offset| is how far the output instant lies
+ * past the center of the branch, in [0, 1) input frames. Each branch is
+ * normalized to unity gain at DC. */
+static void sinc_branch(const struct sinc_params *p, double cutoff,
+			double offset, double *h)
+{
+	unsigned int j, half = p->taps / 2;
+	double sum = 0, i0_beta = bessel_i0(p->beta);
+
+	for (j = 0; j < p->taps; j++) {
+		double d = offset + half - 1.0 - j;
+		double u = d / half;
+		double x = M_PI * cutoff * d;
+
+		h[j] = (fabs(x) < 1e-9) ? cutoff : cutoff * sin(x) / x;
+		if (fabs(u) < 1.0)
+			h[j] *= bessel_i0(p->beta * sqrt(1 - u * u)) / i0_beta;
+		else
+			h[j] = 0;
+		sum += h[j];
+	}
+	for (j = 0; j < p->taps; j++)
+		h[j] /= sum;
+}
+
+static int sinc_init(struct cras_resampler *r)
+{
+	const struct sinc_params *p = r->type == CRAS_RESAMPLER_FAST ?
+			&fast_params : &hq_params;
+	struct sinc_state *s;
+	unsigned int g, ph, j, ch;
+	double cutoff;
+	double *h;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -ENOMEM;
+	r->priv = s;
+
+	g = gcd(r->in_rate, r->out_rate);
+	s->params = p;
+	s->up = r->out_rate / g;
+	s->down = r->in_rate / g;
+	s->num_phases = MIN(s->up, p->max_phases);
+	s->hist_frames = p->taps + SINC_CHUNK_FRAMES;
+
+	cutoff = p->rolloff * MIN(1.0, (double)r->out_rate / r->in_rate);
+	h = malloc(p->taps * sizeof(*h));
+	if (p->fixed_point) {
+		s->coef_q15 = malloc(s->num_phases * p->taps *
+				     sizeof(*s->coef_q15));
+		s->hist_s16 = calloc(r->num_channels, sizeof(*s->hist_s16));
+	} else {
+		s->coef_f = malloc(s->num_phases * p->taps *
+				   sizeof(*s->coef_f));
+		s->hist_f = calloc(r->num_channels, sizeof(*s->hist_f));
+	}
+	if (!h || (!s->coef_q15 && !s->coef_f) ||
+	    (!s->hist_s16 && !s->hist_f)) {
+		free(h);
+		return -ENOMEM;
+	}
+
+	for (ph = 0; ph < s->num_phases; ph++) {
+		sinc_branch(p, cutoff, (double)ph / s->num_phases, h);
+		for (j = 0; j < p->taps; j++) {
+			if (p->fixed_point)
+				s->coef_q15[ph * p->taps + j] =
+					lrint(h[j] * 32768.0);
+			else
+				s->coef_f[ph * p->taps + j] = h[j];
+		}
+	}
+	free(h);
+
+	for (ch = 0; ch < r->num_channels; ch++) {
+		if (p->fixed_point) {
+			s->hist_s16[ch] = calloc(s->hist_frames,
+						 sizeof(int16_t));
+			if (!s->hist_s16[ch])
+				return -ENOMEM;
+		} else {
+			s->hist_f[ch] = calloc(s->hist_frames, sizeof(float));
+			if (!s->hist_f[ch])
+				return -ENOMEM;
+		}
+	}
+
+	/* Prime with zeros so the first output is centered on input 0. */
+	s->avail = p->taps / 2 - 1;
+	return 0;
+}
+
+static void sinc_reset(struct cras_resampler *r)
+{
+	struct sinc_state *s = r->priv;
+	unsigned int ch;
+
+	for (ch = 0; ch < r->num_channels; ch++) {
+		if (s->hist_s16)
+			memset(s->hist_s16[ch], 0,
+			       s->hist_frames * sizeof(int16_t));
+		else
+			memset(s->hist_f[ch], 0,
+			       s->hist_frames * sizeof(float));
+	}
+	s->avail = s->params->taps / 2 - 1;
+	s->pos = 0;
+	s->frac = 0;
+}
+
+static void sinc_destroy(struct cras_resampler *r)
+{
+	struct sinc_state *s = r->priv;
+	unsigned int ch;
+
+	if (!s)
+		return;
+	for (ch = 0; ch < r->num_channels; ch++) {
+		if (s->hist_s16)
+			free(s->hist_s16[ch]);
+		if (s->hist_f)
+			free(s->hist_f[ch]);
+	}
+	free(s->hist_s16);
+	free(s->hist_f);
+	free(s->coef_q15);
+	free(s->coef_f);
+	free(s);
+}
+
+static unsigned int sinc_latency(const struct cras_resampler *r)
+{
+	const struct sinc_state *s = r->priv;
+
+	return s->params->taps / 2;
+}
+
+/* Dot products over one branch, written as plain loops over contiguous
+ * memory for the compiler to vectorize. Integer sums can be reordered
+ * freely; the float one keeps DOT_LANES independent partial sums so that
+ * vectorizing it does not need -ffast-math. Branch lengths are multiples
+ * of DOT_LANES. */
+#define DOT_LANES 8
+
+static inline int16_t dot_q15(const int16_t *x, const int16_t *h,
+			      unsigned int taps)
+{
+	int32_t acc = 1 << 14;
+	unsigned int j;
+
+	for (j = 0; j < taps; j++)
+		acc += (int32_t)x[j] * h[j];
+	acc >>= 15;
+	return (int16_t)MAX(MIN(acc, 0x7fff), -0x8000);
+}
+
+static inline int16_t dot_f(const float *x, const float *h,
+			    unsigned int taps)
+{
+	float lane[DOT_LANES] = { 0 };
+	float acc = 0;
+	unsigned int j, k;
+
+	for (j = 0; j < taps; j += DOT_LANES)
+		for (k = 0; k < DOT_LANES; k++)
+			lane[k] += x[j + k] * h[j + k];
+	for (k = 0; k < DOT_LANES; k++)
+		acc += lane[k];
+	acc = lrintf(acc);
+	return (int16_t)MAX(MIN(acc, 32767.0f), -32768.0f);
+}
+
+/* Drops history before |pos| to make room for new input. */
+static void sinc_compact(struct cras_resampler *r, struct sinc_state *s)
+{
+	unsigned int ch, keep = s->avail - s->pos;
+
+	if (s->pos == 0)
+		return;
+	for (ch = 0; ch < r->num_channels; ch++) {
+		if (s->hist_s16)
+			memmove(s->hist_s16[ch], s->hist_s16[ch] + s->pos,
+				keep * sizeof(int16_t));
+		else
+			memmove(s->hist_f[ch], s->hist_f[ch] + s->pos,
+				keep * sizeof(float));
+	}
+	s->avail = keep;
+	s->pos = 0;
+}
+
+static int sinc_process(struct cras_resampler *r, const int16_t *in,
+			unsigned int *in_frames, int16_t *out,
+			unsigned int *out_frames)
+{
+	struct sinc_state *s = r->priv;
+	unsigned int taps = s->params->taps;
+	unsigned int nch = r->num_channels;
+	unsigned int in_done = 0, out_done = 0;
+	unsigned int i, ch;
+
+	while (out_done < *out_frames) {
+		unsigned int copy, need;
+		uint64_t last;
+
+		sinc_compact(r, s);
+
+		/* Only take the input needed to fill the remaining output,
+		 * so that frames stay with the caller rather than in here. */
+		last = ((uint64_t)s->frac +
+			(uint64_t)(*out_frames - out_done - 1) * s->down) /
+		       s->up;
+		need = MIN(last + taps, s->hist_frames);
+		copy = need > s->avail ? need - s->avail : 0;
+		copy = MIN(copy, *in_frames - in_done);
+		for (i = 0; i < copy; i++) {
+			const int16_t *src = in + (in_done + i) * nch;
+
+			for (ch = 0; ch < nch; ch++) {
+				if (s->hist_s16)
+					s->hist_s16[ch][s->avail + i] = src[ch];
+				else
+					s->hist_f[ch][s->avail + i] = src[ch];
+			}
+		}
+		s->avail += copy;
+		in_done += copy;
+
+		if (s->pos + taps > s->avail)
+			break;
+
+		while (s->pos + taps <= s->avail && out_done < *out_frames) {
+			unsigned int ph = s->num_phases == s->up ? s->frac :
+				(uint64_t)s->frac * s->num_phases / s->up;
+			int16_t *dst = out + out_done * nch;
+
+			for (ch = 0; ch < nch; ch++) {
+				if (s->hist_s16)
+					dst[ch] = dot_q15(
+						s->hist_s16[ch] + s->pos,
+						s->coef_q15 + ph * taps, taps);
+				else
+					dst[ch] = dot_f(
+						s->hist_f[ch] + s->pos,
+						s->coef_f + ph * taps, taps);
+			}
+			out_done++;
+			s->frac += s->down;
+			while (s->frac >= s->up) {
+				s->frac -= s->up;
+				s->pos++;
+			}
+		}
+	}
+
+	*in_frames = in_done;
+	*out_frames = out_done;
+	return 0;
+}
+
+static const struct resampler_ops sinc_ops = {
+	.init = sinc_init,
+	.process = sinc_process,
+	.reset = sinc_reset,
+	.destroy = sinc_destroy,
+	.latency = sinc_latency,
+};
+
+static const struct resampler_ops *const backends[] = {
+	[CRAS_RESAMPLER_FAST] = &sinc_ops,
+	[CRAS_RESAMPLER_SPEEX] = &speex_ops,
+	[CRAS_RESAMPLER_HQ] = &sinc_ops,
+};
+
+/*
+ * Exported interface.
+ */
+
+enum CRAS_RESAMPLER_TYPE cras_resampler_type_for_stream(
+		enum CRAS_STREAM_TYPE stream_type)
+{
+	switch (stream_type) {
+	case CRAS_STREAM_TYPE_VOICE_COMMUNICATION:
+	case CRAS_STREAM_TYPE_SPEECH_RECOGNITION:
+		return CRAS_RESAMPLER_FAST;
+	case CRAS_STREAM_TYPE_PRO_AUDIO:
+		return CRAS_RESAMPLER_HQ;
+	default:
+		return CRAS_RESAMPLER_SPEEX;
+	}
+}
+
+struct cras_resampler *cras_resampler_create(enum CRAS_RESAMPLER_TYPE type,
+					     unsigned int num_channels,
+					     unsigned int in_rate,
+					     unsigned int out_rate)
+{
+	struct cras_resampler *r;
+
+	if (type >= CRAS_RESAMPLER_NUM_TYPES || num_channels == 0 ||
+	    in_rate == 0 || out_rate == 0)
+		return NULL;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+	r->type = type;
+	r->ops = backends[type];
+	r->num_channels = num_channels;
+	r->in_rate = in_rate;
+	r->out_rate = out_rate;
+
+	if (r->ops->init(r)) {
+		cras_resampler_destroy(r);
+		return NULL;
+	}
+	return r;
+}
+
+void cras_resampler_destroy(struct cras_resampler *r)
+{
+	if (r->priv)
+		r->ops->destroy(r);
+	free(r);
+}
+
+enum CRAS_RESAMPLER_TYPE cras_resampler_get_type(
+		const struct cras_resampler *r)
+{
+	return r->type;
+}
+
+unsigned int cras_resampler_latency(const struct cras_resampler *r)
+{
+	return r->ops->latency(r);
+}
+
+void cras_resampler_reset(struct cras_resampler *r)
+{
+	r->ops->reset(r);
+}
+
+int cras_resampler_process(struct cras_resampler *r,
+			   const int16_t *in,
+			   unsigned int *in_frames,
+			   int16_t *out,
+			   unsigned int *out_frames)
+{
+	return r->ops->process(r, in, in_frames, out, out_frames);
+}
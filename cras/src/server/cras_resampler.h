@@ -0,0 +1,93 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CRAS_RESAMPLER_H_
+#define CRAS_RESAMPLER_H_
+
+#include <stdint.h>
+
+#include "cras_types.h"
+
+/* Sample rate converter backends, ordered from cheapest to best quality.
+ *    CRAS_RESAMPLER_FAST - Short fixed-point polyphase filter. Good enough
+ *        for voice, where the band of interest ends well below Nyquist.
+ *    CRAS_RESAMPLER_SPEEX - Speex resampler at the default quality level.
+ *    CRAS_RESAMPLER_HQ - Long Kaiser windowed sinc filter. Costs several
+ *        times more CPU than speex, so only streams that ask for pro audio
+ *        quality get it.
+ */
+enum CRAS_RESAMPLER_TYPE {
+	CRAS_RESAMPLER_FAST,
+	CRAS_RESAMPLER_SPEEX,
+	CRAS_RESAMPLER_HQ,
+	CRAS_RESAMPLER_NUM_TYPES,
+};
+
+struct cras_resampler;
+
+static inline const char *cras_resampler_type_str(
+		enum CRAS_RESAMPLER_TYPE type)
+{
+	switch (type) {
+	ENUM_STR(CRAS_RESAMPLER_FAST)
+	ENUM_STR(CRAS_RESAMPLER_SPEEX)
+	ENUM_STR(CRAS_RESAMPLER_HQ)
+	default:
+		return "INVALID_RESAMPLER_TYPE";
+	}
+}
+
+/* Returns the resampler backend to use for a stream of the given type.
+ * Voice streams get the cheap filter, pro audio streams get the high
+ * quality one and everything else keeps using speex. */
+enum CRAS_RESAMPLER_TYPE cras_resampler_type_for_stream(
+		enum CRAS_STREAM_TYPE stream_type);
+
+/* Creates a sample rate converter for interleaved S16_LE samples.
+ * Args:
+ *    type - Which backend to use.
+ *    num_channels - The number of channels in each frame.
+ *    in_rate - The rate to convert from.
+ *    out_rate - The rate to convert to.
+ * Returns:
+ *    A pointer to the new resampler or NULL on error.
+ */
+struct cras_resampler *cras_resampler_create(enum CRAS_RESAMPLER_TYPE type,
+					     unsigned int num_channels,
+					     unsigned int in_rate,
+					     unsigned int out_rate);
+
+/* Destroys a resampler created by cras_resampler_create. */
+void cras_resampler_destroy(struct cras_resampler *r);
+
+/* Returns the backend type of the resampler. */
+enum CRAS_RESAMPLER_TYPE cras_resampler_get_type(
+		const struct cras_resampler *r);
+
+/* Returns the filter delay of the resampler in input frames. */
+unsigned int cras_resampler_latency(const struct cras_resampler *r);
+
+/* Clears the filter history so that the next call starts a new signal. */
+void cras_resampler_reset(struct cras_resampler *r);
+
+/* Converts interleaved samples.
+ * Args:
+ *    r - The resampler.
+ *    in - The input samples.
+ *    in_frames - Number of frames available in |in|, set to the number
+ *        of frames consumed.
+ *    out - The buffer to fill.
+ *    out_frames - Number of frames that fit in |out|, set to the number
+ *        of frames written.
+ * Returns:
+ *    0 on success or a negative error code.
+ */
+int cras_resampler_process(struct cras_resampler *r,
+			   const int16_t *in,
+			   unsigned int *in_frames,
+			   int16_t *out,
+			   unsigned int *out_frames);
+
+#endif /* CRAS_RESAMPLER_H_ */
@@ -18,6 +18,10 @@
 #include "cras_types.h"
 #include "buffer_share.h"
 #include "cras_system_state.h"
+#include "cras_util.h"
+
+/* Longest callback interval of a stream in deep buffer mode. */
+static const unsigned int deep_buffer_ms = 250;
 
 /* Configure the shm area for the stream. */
 static int setup_shm(struct cras_rstream *stream,
@@ -34,7 +38,8 @@ static int setup_shm(struct cras_rstream *stream,
 			fmt->num_channels;
 	used_size = stream->buffer_frames * frame_bytes;
 	samples_size = used_size * CRAS_NUM_SHM_BUFFERS;
-	shm_info->length = sizeof(struct cras_audio_shm_area) + samples_size;
+	shm_info->length = sizeof(struct cras_audio_shm_area) + samples_size +
+			   sizeof(struct cras_audio_shm_trailer);
 
 	snprintf(shm_info->shm_name, sizeof(shm_info->shm_name),
 		 "/cras-%d-stream-%08x", getpid(), stream->stream_id);
@@ -169,6 +174,20 @@ static int get_audio_request_reply(
 	return rc;
 }
 
+/* Pulls the next callback in to when frames after the last fetch have been
+ * consumed. */
+static void shorten_next_cb(struct cras_rstream *stream, unsigned int frames)
+{
+	struct timespec next, interval;
+
+	cras_frames_to_time(MAX(frames, stream->cb_threshold),
+			    stream->format.frame_rate, &interval);
+	next = stream->last_fetch_ts;
+	add_timespecs(&next, &interval);
+	if (timespec_after(&stream->next_cb_ts, &next))
+		stream->next_cb_ts = next;
+}
+
 /*
  * Reads and handles one audio message from client.
  * Returns:
@@ -202,6 +221,10 @@ static int read_and_handle_client_message(struct cras_rstream *stream) {
 	if (stream->direction == CRAS_STREAM_OUTPUT &&
 	    msg.id == AUDIO_MESSAGE_DATA_READY) {
 		clear_pending_reply(stream);
+		/* Clients that don't fill a deep buffer request are called
+		 * back for the rest once what they did write is played. */
+		if (msg.frames < stream->deep_buffer_frames)
+			shorten_next_cb(stream, msg.frames);
 	}
 
 	return rc;
@@ -334,7 +357,7 @@ int cras_rstream_request_audio(struct cras_rstream *stream,
 	stream->last_fetch_ts = *now;
 
 	init_audio_message(&msg, AUDIO_MESSAGE_REQUEST_DATA,
-			   stream->cb_threshold);
+			   cras_rstream_get_cb_frames(stream));
 	rc = write(stream->fd, &msg, sizeof(msg));
 	if (rc < 0)
 		return -errno;
@@ -344,6 +367,48 @@ int cras_rstream_request_audio(struct cras_rstream *stream,
 	return rc;
 }
 
+void cras_rstream_set_deep_buffer(struct cras_rstream *stream, int enable,
+				  const struct timespec *now)
+{
+	struct timespec next;
+	size_t frames = 0;
+	double interval, rate;
+
+	if (stream->direction != CRAS_STREAM_OUTPUT)
+		return;
+
+	if (enable) {
+		frames = MIN(stream->buffer_frames,
+			     stream->format.frame_rate * deep_buffer_ms / 1000);
+		/* Keep requests a multiple of the client's block size. */
+		frames -= frames % stream->cb_threshold;
+		if (frames <= stream->cb_threshold)
+			frames = 0;
+	}
+
+	if (frames == stream->deep_buffer_frames)
+		return;
+
+	/* Keep the rate the master device corrected sleep_interval_ts to,
+	 * see dev_stream_set_dev_rate(). */
+	interval = stream->sleep_interval_ts.tv_sec +
+		   stream->sleep_interval_ts.tv_nsec / 1000000000.0;
+	rate = interval > 0 ? cras_rstream_get_cb_frames(stream) / interval
+			    : stream->format.frame_rate;
+
+	stream->deep_buffer_frames = frames;
+	cras_frames_to_time_precise(cras_rstream_get_cb_frames(stream), rate,
+				    &stream->sleep_interval_ts);
+
+	if (frames)
+		return;
+
+	next = *now;
+	add_timespecs(&next, &stream->sleep_interval_ts);
+	if (timespec_after(&stream->next_cb_ts, &next))
+		stream->next_cb_ts = next;
+}
+
 int cras_rstream_audio_ready(struct cras_rstream *stream, size_t count)
 {
 	struct audio_message msg;
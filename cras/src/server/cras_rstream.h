@@ -66,6 +66,8 @@ struct master_dev_info {
  *    is_pinned - True if the stream is a pinned stream, false otherwise.
  *    pinned_dev_idx - device the stream is pinned, 0 if none.
  *    triggered - True if already notified TRIGGER_ONLY stream, false otherwise.
+ *    deep_buffer_frames - Frames to request per callback while the stream
+ *        plays in deep buffer mode, 0 otherwise.
  */
 struct cras_rstream {
 	cras_stream_id_t stream_id;
@@ -93,6 +95,7 @@ struct cras_rstream {
 	int is_pinned;
 	uint32_t pinned_dev_idx;
 	int triggered;
+	size_t deep_buffer_frames;
 	struct cras_rstream *prev, *next;
 };
 
@@ -157,6 +160,15 @@ static inline size_t cras_rstream_get_cb_threshold(
 	return stream->cb_threshold;
 }
 
+/* Gets the number of frames to request from the client per callback. */
+static inline size_t cras_rstream_get_cb_frames(
+		const struct cras_rstream *stream)
+{
+	if (stream->deep_buffer_frames)
+		return stream->deep_buffer_frames;
+	return cras_rstream_get_cb_threshold(stream);
+}
+
 /* Gets the max write size for the stream. */
 static inline size_t cras_rstream_get_max_write_frames(
 		const struct cras_rstream *stream)
@@ -285,6 +297,18 @@ void cras_rstream_record_fetch_interval(struct cras_rstream *rstream,
 int cras_rstream_request_audio(struct cras_rstream *stream,
 			       const struct timespec *now);
 
+/* Moves an output stream in or out of deep buffer mode. In deep buffer mode
+ * the client is asked for up to a few hundred ms per callback, and called
+ * back accordingly less often.
+ * Args:
+ *    stream - The stream.
+ *    enable - Non-zero to enter deep buffer mode, zero to leave it.
+ *    now - The current time. Leaving the mode pulls the next callback in to
+ *        at most one normal interval from now.
+ */
+void cras_rstream_set_deep_buffer(struct cras_rstream *stream, int enable,
+				  const struct timespec *now);
+
 /* Tells a capture client that count frames are ready. */
 int cras_rstream_audio_ready(struct cras_rstream *stream, size_t count);
 
@@ -50,6 +50,7 @@ static void update_estimated_rate(struct open_dev *adev)
 	struct cras_iodev *master_dev;
 	struct cras_iodev *dev = adev->dev;
 	struct dev_stream *dev_stream;
+	double dev_rate_ratio;
 
 	DL_FOREACH(dev->streams, dev_stream) {
 		master_dev = get_master_dev(dev_stream);
@@ -58,14 +59,113 @@ static void update_estimated_rate(struct open_dev *adev)
 			continue;
 		}
 
+		/* Streams of another master device are also resampled to
+		 * keep this device in phase with it. */
+		dev_rate_ratio = cras_iodev_get_est_rate_ratio(dev);
+		if (master_dev != dev)
+			dev_rate_ratio *= 1 + adev->clock.correction;
+
 		dev_stream_set_dev_rate(dev_stream,
 				dev->ext_format->frame_rate,
-				cras_iodev_get_est_rate_ratio(dev),
+				dev_rate_ratio,
 				cras_iodev_get_est_rate_ratio(master_dev),
 				adev->coarse_rate_adjust);
 	}
 }
 
+/*
+ * Clock domain of the playback devices. A device that plays a stream it is
+ * not the master device of is a clock slave of that master device, see
+ * clock_domain.h.
+ */
+
+/* The longest a master clock_level is used for to measure a slave against. */
+static const struct timespec clock_master_max_age = {
+	1, 0 /* 1 sec. */
+};
+
+/* Finds a stream on |adev| that another open device is the master of. */
+static struct dev_stream *find_slave_stream(struct open_dev *odevs,
+					    struct open_dev *adev,
+					    struct open_dev **master)
+{
+	struct dev_stream *dev_stream;
+	struct cras_iodev *master_dev;
+	struct open_dev *odev;
+
+	DL_FOREACH(adev->dev->streams, dev_stream) {
+		master_dev = get_master_dev(dev_stream);
+		if (!master_dev || master_dev == adev->dev)
+			continue;
+		DL_SEARCH_SCALAR(odevs, odev, dev, master_dev);
+		if (odev && cras_iodev_is_open(master_dev)) {
+			*master = odev;
+			return dev_stream;
+		}
+	}
+	return NULL;
+}
+
+/* Returns the number of seconds |slave| plays ahead of |master|, measured on
+ * the stream of |dev_stream|. Each device plays the stream frame at its
+ * offset in the shared buffer minus what is queued in the device. The master
+ * position is extrapolated from its last write to the time of |hw_tstamp|. */
+static double clock_phase_error(struct open_dev *master,
+				struct open_dev *slave,
+				struct dev_stream *dev_stream,
+				unsigned int hw_level,
+				const struct timespec *hw_tstamp)
+{
+	struct cras_rstream *rstream = dev_stream->stream;
+	double rate = rstream->format.frame_rate;
+	double master_pos, slave_pos, age;
+
+	age = (hw_tstamp->tv_sec - master->clock_ts.tv_sec) +
+	      (hw_tstamp->tv_nsec - master->clock_ts.tv_nsec) / 1000000000.0;
+	master_pos = cras_rstream_dev_offset(rstream, master->dev->info.idx) -
+		     (double)master->clock_level * rate /
+		     master->dev->ext_format->frame_rate +
+		     rate * age;
+	slave_pos = cras_rstream_dev_offset(rstream, slave->dev->info.idx) -
+		    (double)(hw_level + slave->dev->min_buffer_level) * rate /
+		    slave->dev->ext_format->frame_rate;
+	return (slave_pos - master_pos) / rate;
+}
+
+/* Runs the clock domain for |adev| given its current level. A slave
+ * measures its phase against the master device of one of its streams and
+ * updates the rate of its streams when the correction changes. */
+static void update_clock_domain(struct open_dev *odevs,
+				struct open_dev *adev,
+				unsigned int hw_level,
+				const struct timespec *hw_tstamp)
+{
+	struct open_dev *master;
+	struct dev_stream *shared;
+	struct timespec age;
+	double err;
+
+	shared = find_slave_stream(odevs, adev, &master);
+	if (!shared) {
+		/* Only the streams of other masters use the correction. */
+		if (adev->clock.master)
+			clock_slave_reset(&adev->clock, NULL);
+		return;
+	}
+
+	if (!timespec_is_nonzero(&master->clock_ts))
+		return;
+	subtract_timespecs(hw_tstamp, &master->clock_ts, &age);
+	if (timespec_after(&age, &clock_master_max_age))
+		return;
+
+	err = clock_phase_error(master, adev, shared, hw_level, hw_tstamp);
+	if (clock_slave_update(&adev->clock, master->dev, err, hw_tstamp)) {
+		update_estimated_rate(adev);
+		clock_slave_applied(&adev->clock);
+	}
+}
+
 /*
  * Counts the number of devices which are currently playing/capturing non-empty
  * audio.
@@ -103,12 +203,12 @@ static int fetch_streams(struct open_dev *adev)
 {
 	struct dev_stream *dev_stream;
 	struct cras_iodev *odev = adev->dev;
+	struct cras_iodev_delay delay;
 	int rc;
-	int delay;
 
-	delay = cras_iodev_delay_frames(odev);
-	if (delay < 0)
-		return delay;
+	rc = cras_iodev_get_delay(odev, &delay);
+	if (rc < 0)
+		return rc;
 
 	DL_FOREACH(adev->dev->streams, dev_stream) {
 		struct cras_rstream *rstream = dev_stream->stream;
@@ -149,10 +249,10 @@ static int fetch_streams(struct open_dev *adev)
 			continue;
 		}
 
-		dev_stream_set_delay(dev_stream, delay);
+		dev_stream_set_delay_tstamp(dev_stream, &delay);
 
 		ATLOG(atlog, AUDIO_THREAD_FETCH_STREAM, rstream->stream_id,
-		      cras_rstream_get_cb_threshold(rstream), delay);
+		      cras_rstream_get_cb_threshold(rstream), delay.frames);
 
 		rc = dev_stream_request_playback_samples(dev_stream, &now);
 		if (rc < 0) {
@@ -165,23 +265,28 @@ static int fetch_streams(struct open_dev *adev)
 	return 0;
 }
 
-/* Gets the max delay frames of open input devices. */
-static int input_delay_frames(struct open_dev *adevs)
+/* Gets the max delay of open input devices. */
+static int input_delay(struct open_dev *adevs,
+		       struct cras_iodev_delay *max_delay)
 {
 	struct open_dev *adev;
-	int delay;
-	int max_delay = 0;
+	struct cras_iodev_delay delay;
+	int rc;
+
+	memset(max_delay, 0, sizeof(*max_delay));
+	max_delay->rate_ratio = 1.0;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &max_delay->tstamp);
 
 	DL_FOREACH(adevs, adev) {
 		if (!cras_iodev_is_open(adev->dev))
 			continue;
-		delay = cras_iodev_delay_frames(adev->dev);
-		if (delay < 0)
-			return delay;
-		if (delay > max_delay)
-			max_delay = delay;
+		rc = cras_iodev_get_delay(adev->dev, &delay);
+		if (rc < 0)
+			return rc;
+		if (delay.frames > max_delay->frames)
+			*max_delay = delay;
 	}
-	return max_delay;
+	return 0;
 }
 
 /* Sets the stream delay.
@@ -191,16 +296,21 @@ static int input_delay_frames(struct open_dev *adevs)
 static unsigned int set_stream_delay(struct open_dev *adev)
 {
 	struct dev_stream *stream;
-	int delay;
+	struct cras_iodev_delay delay, stream_delay;
 
 	/* TODO(dgreid) - Setting delay from last dev only. */
-	delay = input_delay_frames(adev);
+	if (input_delay(adev, &delay) < 0)
+		return 0;
 
 	DL_FOREACH(adev->dev->streams, stream) {
 		if (stream->stream->flags & TRIGGER_ONLY)
 			continue;
 
-		dev_stream_set_delay(stream, delay);
+		/* Frames still inside the stream's APM are older still. */
+		stream_delay = delay;
+		stream_delay.frames += input_data_get_delay_frames(
+				adev->dev->input_data, stream->stream);
+		dev_stream_set_delay_tstamp(stream, &stream_delay);
 	}
 
 	return 0;
@@ -479,6 +589,7 @@ static int capture_to_streams(struct open_dev *adev)
  *    adev - The device to write to.
  *    dst - The buffer to put the samples in (returned from snd_pcm_mmap_begin)
  *    write_limit - The maximum number of frames to write to dst.
+ *    is_silent - Set to 1 if the rendered frames are known to be all zero.
  *
  * Returns:
  *    The number of frames rendered on success, a negative error code otherwise.
@@ -488,7 +599,8 @@ static int capture_to_streams(struct open_dev *adev)
 static int write_streams(struct open_dev **odevs,
 			 struct open_dev *adev,
 			 uint8_t *dst,
-			 size_t write_limit)
+			 size_t write_limit,
+			 int *is_silent)
 {
 	struct cras_iodev *odev = adev->dev;
 	struct dev_stream *curr;
@@ -538,6 +650,10 @@ static int write_streams(struct open_dev **odevs,
 		memset(dst + max_offset * frame_bytes, 0,
 		       (write_limit - max_offset) * frame_bytes);
 
+	/* Frames below max_offset were mixed in an earlier pass, only the
+	 * zeroed part is known to be silent. */
+	*is_silent = (max_offset == 0);
+
 	ATLOG(atlog, AUDIO_THREAD_WRITE_STREAMS_MIX,
 	      write_limit, max_offset, 0);
 
@@ -550,7 +666,7 @@ static int write_streams(struct open_dev **odevs,
 			continue;
 		nwritten = dev_stream_mix(curr, odev->ext_format,
 					  dst + frame_bytes * offset,
-					  write_limit - offset);
+					  write_limit - offset, is_silent);
 
 		if (nwritten < 0) {
 			dev_io_remove_stream(odevs, curr->stream, NULL);
@@ -620,9 +736,12 @@ int write_output_samples(struct open_dev **odevs,
 	int rc;
 	int non_empty = 0;
 	int *non_empty_ptr = NULL;
+	int is_silent;
 	uint8_t *dst = NULL;
 	struct cras_audio_area *area = NULL;
 
+	adev->num_wakes++;
+
 	/* Possibly fill zeros for no_stream state and possibly transit state.
 	 */
 	rc = cras_iodev_prepare_output_before_write_samples(odev);
@@ -651,6 +770,7 @@ int write_output_samples(struct open_dev **odevs,
 
 		if (cras_iodev_update_rate(odev, hw_level, &hw_tstamp))
 			update_estimated_rate(adev);
+		update_clock_domain(*odevs, adev, hw_level, &hw_tstamp);
 	}
 	ATLOG(atlog, AUDIO_THREAD_FILL_AUDIO, adev->dev->info.idx, hw_level, 0);
 
@@ -670,7 +790,7 @@ int write_output_samples(struct open_dev **odevs,
 
 		/* TODO(dgreid) - This assumes interleaved audio. */
 		dst = area->channels[0].buf;
-		written = write_streams(odevs, adev, dst, frames);
+		written = write_streams(odevs, adev, dst, frames, &is_silent);
 		if (written < 0) /* pcm has been closed */
 			return (int)written;
 
@@ -696,7 +816,7 @@ int write_output_samples(struct open_dev **odevs,
 		}
 
 		rc = cras_iodev_put_output_buffer(odev, dst, written,
-						  non_empty_ptr,
+						  is_silent, non_empty_ptr,
 						  output_converter);
 
 		if (rc < 0)
@@ -716,9 +836,22 @@ int write_output_samples(struct open_dev **odevs,
 				MIN_EMPTY_PERIOD_SEC);
 	}
 
+	/* Devices that batch their writes commit the round at once. */
+	rc = cras_iodev_commit_output_buffer(odev);
+	if (rc < 0)
+		return rc;
+
 	ATLOG(atlog, AUDIO_THREAD_FILL_AUDIO_DONE, hw_level,
 	      total_written, odev->min_cb_level);
 
+	/* Remember where the master clock is for the slaves that write
+	 * after it. */
+	if (timespec_is_nonzero(&hw_tstamp)) {
+		adev->clock_level = hw_level + odev->min_buffer_level +
+				    total_written;
+		adev->clock_ts = hw_tstamp;
+	}
+
 	return total_written;
 }
 
@@ -9,6 +9,7 @@
 #ifndef DEV_IO_H_
 #define DEV_IO_H_
 
+#include "clock_domain.h"
 #include "cras_iodev.h"
 #include "cras_types.h"
 #include "polled_interval_checker.h"
@@ -20,6 +21,12 @@
  *    last_non_empty_ts - The last time we know the device played/captured
  *        non-empty (zero) audio.
  *    coarse_rate_adjust - Hack for when the sample rate needs heavy correction.
+ *    clock - Phase lock to the master device of the streams this playback
+ *        device plays but isn't the master device of.
+ *    clock_level - Frames queued in the device after the last write, used
+ *        by the clock slaves of this device.
+ *    clock_ts - The time clock_level was measured at.
+ *    num_wakes - Number of times the audio thread wrote to the device.
  */
 struct open_dev {
 	struct cras_iodev *dev;
@@ -27,6 +34,10 @@ struct open_dev {
 	struct polled_interval *non_empty_check_pi;
 	struct polled_interval *empty_pi;
 	int coarse_rate_adjust;
+	struct clock_slave clock;
+	unsigned int clock_level;
+	struct timespec clock_ts;
+	unsigned int num_wakes;
 	struct open_dev *prev, *next;
 };
 
@@ -8,6 +8,7 @@
 #include "audio_thread_log.h"
 #include "byte_buffer.h"
 #include "cras_fmt_conv.h"
+#include "cras_iodev.h"
 #include "dev_stream.h"
 #include "cras_audio_area.h"
 #include "cras_mix.h"
@@ -75,6 +76,7 @@ struct dev_stream *dev_stream_create(struct cras_rstream *stream,
 	int rc = 0;
 	unsigned int max_frames, dev_frames, buf_bytes;
 	const struct cras_audio_format *ofmt;
+	enum CRAS_RESAMPLER_TYPE src_type;
 
 	out = calloc(1, sizeof(*out));
 	out->dev_id = dev_id;
@@ -84,13 +86,15 @@ struct dev_stream *dev_stream_create(struct cras_rstream *stream,
 	max_frames = max_frames_for_conversion(stream->buffer_frames,
 					       stream_fmt->frame_rate,
 					       dev_fmt->frame_rate);
+	src_type = cras_resampler_type_for_stream(stream->stream_type);
 
 	if (stream->direction == CRAS_STREAM_OUTPUT) {
 		rc = config_format_converter(&out->conv,
 					     stream->direction,
 					     stream_fmt,
 					     dev_fmt,
-					     max_frames);
+					     max_frames,
+					     src_type);
 	} else {
 		/*
 		 * For input, take into account the stream specific processing
@@ -103,7 +107,8 @@ struct dev_stream *dev_stream_create(struct cras_rstream *stream,
 					     stream->direction,
 					     ofmt,
 					     stream_fmt,
-					     max_frames);
+					     max_frames,
+					     src_type);
 	}
 	if (rc) {
 		free(out);
@@ -152,7 +157,7 @@ void dev_stream_destroy(struct dev_stream *dev_stream)
 	cras_rstream_dev_detach(dev_stream->stream, dev_stream->dev_id);
 	if (dev_stream->conv) {
 		cras_audio_area_destroy(dev_stream->conv_area);
-		cras_fmt_conv_destroy(&dev_stream->conv);
+		cras_fmt_conv_pool_put(&dev_stream->conv);
 		byte_buffer_destroy(&dev_stream->conv_buffer);
 	}
 	free(dev_stream);
@@ -170,7 +175,7 @@ void dev_stream_set_dev_rate(struct dev_stream *dev_stream,
 				dev_rate,
 				dev_rate);
 		cras_frames_to_time_precise(
-			cras_rstream_get_cb_threshold(dev_stream->stream),
+			cras_rstream_get_cb_frames(dev_stream->stream),
 			dev_stream->stream->format.frame_rate * dev_rate_ratio,
 			&dev_stream->stream->sleep_interval_ts);
 	} else {
@@ -185,12 +190,35 @@ void dev_stream_set_dev_rate(struct dev_stream *dev_stream,
 
 }
 
+/* Works out how many frames the converter would have produced from and
+ * consumed out of |frames| silent input frames, without running it.
+ * Returns 0 if nothing can be produced, then the converter has to run. */
+static unsigned int skip_silent_conversion(struct dev_stream *dev_stream,
+					   size_t frames,
+					   unsigned int max_out,
+					   unsigned int *read_frames)
+{
+	unsigned int dev_frames;
+
+	dev_frames = MIN(cras_fmt_conv_in_frames_to_out(dev_stream->conv,
+							frames),
+			 max_out);
+	*read_frames = MIN(frames,
+			   cras_fmt_conv_out_frames_to_in(dev_stream->conv,
+							  dev_frames));
+	if (*read_frames == 0)
+		return 0;
+	return dev_frames;
+}
+
 int dev_stream_mix(struct dev_stream *dev_stream,
 		   const struct cras_audio_format *fmt,
 		   uint8_t *dst,
-		   unsigned int num_to_write)
+		   unsigned int num_to_write,
+		   int *is_silent)
 {
 	struct cras_rstream *rstream = dev_stream->stream;
+	const unsigned int frame_bytes = cras_get_format_bytes(fmt);
 	uint8_t *src;
 	uint8_t *target = dst;
 	unsigned int fr_written, fr_read;
@@ -200,6 +228,8 @@ int dev_stream_mix(struct dev_stream *dev_stream,
 	size_t frames = 0;
 	unsigned int dev_frames;
 	float mix_vol;
+	int mute, audible;
+	int src_silent, chunk_silent;
 
 	fr_in_buf = dev_stream_playback_frames(dev_stream);
 	if (fr_in_buf <= 0)
@@ -211,6 +241,8 @@ int dev_stream_mix(struct dev_stream *dev_stream,
 
 	/* Stream volume scaler. */
 	mix_vol = cras_rstream_get_volume_scaler(dev_stream->stream);
+	mute = cras_rstream_get_mute(rstream);
+	audible = !mute && mix_vol > 0.0f;
 
 	fr_written = 0;
 	fr_read = 0;
@@ -221,22 +253,47 @@ int dev_stream_mix(struct dev_stream *dev_stream,
 		if (frames == 0)
 			break;
 		if (cras_fmt_conversion_needed(dev_stream->conv)) {
-			read_frames = frames;
-			dev_frames = cras_fmt_conv_convert_frames(
-					dev_stream->conv,
-					src,
-					dev_stream->conv_buffer->bytes,
-					&read_frames,
-					num_to_write - fr_written);
-			src = dev_stream->conv_buffer->bytes;
+			src_silent = cras_mix_buffer_is_zero(
+					src, frames * cras_get_format_bytes(
+						cras_fmt_conv_in_format(
+							dev_stream->conv)));
+			dev_frames = 0;
+			if (src_silent && dev_stream->conv_silent)
+				dev_frames = skip_silent_conversion(
+						dev_stream, frames,
+						num_to_write - fr_written,
+						&read_frames);
+			if (dev_frames) {
+				chunk_silent = 1;
+			} else {
+				read_frames = frames;
+				dev_frames = cras_fmt_conv_convert_frames(
+						dev_stream->conv,
+						src,
+						dev_stream->conv_buffer->bytes,
+						&read_frames,
+						num_to_write - fr_written);
+				src = dev_stream->conv_buffer->bytes;
+				/* Zeros out means any earlier tail has
+				 * drained from the converter. */
+				chunk_silent = src_silent &&
+					cras_mix_buffer_is_zero(
+						src, dev_frames * frame_bytes);
+				dev_stream->conv_silent = chunk_silent;
+			}
 		} else {
 			dev_frames = MIN(frames, num_to_write - fr_written);
 			read_frames = dev_frames;
+			chunk_silent = !audible || cras_mix_buffer_is_zero(
+					src, dev_frames * frame_bytes);
 		}
 		num_samples = dev_frames * fmt->num_channels;
-		cras_mix_add(fmt->format, target, src, num_samples, 1,
-			     cras_rstream_get_mute(rstream), mix_vol);
-		target += dev_frames * cras_get_format_bytes(fmt);
+		if (!chunk_silent && audible) {
+			cras_mix_add(fmt->format, target, src, num_samples, 1,
+				     mute, mix_vol);
+			*is_silent = 0;
+		}
+		target += dev_frames * frame_bytes;
 		fr_written += dev_frames;
 		fr_read += read_frames;
 	}
@@ -645,6 +702,53 @@ void dev_stream_set_delay(const struct dev_stream *dev_stream,
 	}
 }
 
+void dev_stream_set_delay_tstamp(const struct dev_stream *dev_stream,
+				 const struct cras_iodev_delay *delay)
+{
+	struct cras_rstream *rstream = dev_stream->stream;
+	struct cras_audio_shm *shm;
+	struct timespec ts, latency, bound;
+	unsigned int stream_frames, err_frames;
+
+	if (rstream->direction == CRAS_STREAM_OUTPUT) {
+		shm = cras_rstream_output_shm(rstream);
+		stream_frames = cras_fmt_conv_out_frames_to_in(dev_stream->conv,
+							       delay->frames);
+		stream_frames += MAX(cras_shm_get_frames(shm), 0);
+		err_frames = cras_fmt_conv_out_frames_to_in(dev_stream->conv,
+							    delay->frames_err);
+	} else {
+		shm = cras_rstream_input_shm(rstream);
+		if (cras_shm_frames_written(shm))
+			return;
+		stream_frames = cras_fmt_conv_in_frames_to_out(dev_stream->conv,
+							       delay->frames);
+		err_frames = cras_fmt_conv_in_frames_to_out(dev_stream->conv,
+							    delay->frames_err);
+	}
+
+	/* Time the frames at the rate the device really runs at, and allow
+	 * for the error of that rate over the same frames. */
+	cras_frames_to_time_precise(stream_frames,
+				    rstream->format.frame_rate *
+					delay->rate_ratio,
+				    &latency);
+	err_frames += (unsigned int)(stream_frames * delay->rate_err) + 1;
+	cras_frames_to_time(err_frames, rstream->format.frame_rate, &bound);
+
+	if (rstream->direction == CRAS_STREAM_OUTPUT) {
+		ts = delay->tstamp;
+		add_timespecs(&ts, &latency);
+	} else {
+		subtract_timespecs(&delay->tstamp, &latency, &ts);
+	}
+
+	shm->area->ts.tv_sec = ts.tv_sec;
+	shm->area->ts.tv_nsec = ts.tv_nsec;
+	cras_shm_get_trailer(shm)->ts_bound.tv_sec = bound.tv_sec;
+	cras_shm_get_trailer(shm)->ts_bound.tv_nsec = bound.tv_nsec;
+}
+
 int dev_stream_can_fetch(struct dev_stream *dev_stream)
 {
 	struct cras_rstream *rstream = dev_stream->stream;
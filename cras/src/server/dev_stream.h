@@ -15,6 +15,8 @@
 #include "cras_types.h"
 #include "cras_rstream.h"
 
+struct cras_iodev_delay;
+
 struct cras_audio_area;
 struct cras_fmt_conv;
 struct cras_iodev;
@@ -29,6 +31,9 @@ struct cras_iodev;
  *    conv_buffer_size_frames - Size of conv_buffer in frames.
  *    dev_rate - Sampling rate of device. This is set when dev_stream is
  *               created.
+ *    conv_silent - The converter was last fed zeros and produced zeros, so
+ *               it holds no tail of earlier audio and can be skipped while
+ *               the stream stays silent.
  */
 struct dev_stream {
 	unsigned int dev_id;
@@ -38,6 +43,7 @@ struct dev_stream {
 	struct cras_audio_area *conv_area;
 	unsigned int conv_buffer_size_frames;
 	size_t dev_rate;
+	int conv_silent;
 	struct dev_stream *prev, *next;
 };
 
@@ -76,11 +82,15 @@ void dev_stream_set_dev_rate(struct dev_stream *dev_stream,
  *    format - The format of the audio device.
  *    dst - The destination buffer for mixing.
  *    num_to_write - The number of frames written.
+ *    is_silent - Set to 0 if anything but zeros was mixed into dst, left
+ *        untouched otherwise. Muted streams, streams at zero volume and
+ *        all-zero audio are not mixed at all.
  */
 int dev_stream_mix(struct dev_stream *dev_stream,
 		   const struct cras_audio_format *fmt,
 		   uint8_t *dst,
-		   unsigned int num_to_write);
+		   unsigned int num_to_write,
+		   int *is_silent);
 
 /*
  * Reads froms from the source into the dev_stream.
@@ -148,6 +158,15 @@ void cras_set_capture_timestamp(size_t frame_rate,
 void dev_stream_set_delay(const struct dev_stream *dev_stream,
 			  unsigned int delay_frames);
 
+/* Like dev_stream_set_delay, from a delay measured at a known time. The shm
+ * ts is projected from the time of the measurement at the estimated rate of
+ * the device, and ts_bound is filled from the error bounds of the delay.
+ * Args:
+ *    delay - The delay of the device the stream is attached to.
+ */
+void dev_stream_set_delay_tstamp(const struct dev_stream *dev_stream,
+				 const struct cras_iodev_delay *delay);
+
 /* Returns if it's okay to request playback samples for this stream. */
 int dev_stream_can_fetch(struct dev_stream *dev_stream);
 
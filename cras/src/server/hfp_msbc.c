@@ -0,0 +1,379 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "cras_audio_codec.h"
+#include "cras_sbc_codec.h"
+#include "cras_util.h"
+#include "hfp_msbc.h"
+
+/* First byte of the H2 header. */
+#define H2_HEADER_0 0x01
+/* Sync word starting every mSBC frame. */
+#define MSBC_SYNC_WORD 0xad
+/* Bytes of a packet that tell if it's a packet: H2 header and sync word. */
+#define MSBC_PREFIX_LEN 3
+#define MSBC_SAMPLES (MSBC_CODE_SIZE / 2)
+
+/* Packet loss concealment. A lost frame is replaced by the audio that
+ * followed the best match of the last PLC_TEMPLATE_LEN samples in the
+ * history, that is the signal repeated by a whole number of its periods.
+ * The seams where the substitute meets real audio are cross faded over
+ * PLC_OLA_LEN samples. */
+#define PLC_HIST_LEN (MSBC_SAMPLES * 3)
+#define PLC_TEMPLATE_LEN 32
+#define PLC_OLA_LEN 16
+/* Substitutes are faded by 3dB per frame after this many lost in a row, and
+ * muted after PLC_MUTE_FRAMES, 60ms. */
+#define PLC_FADE_FRAMES 2
+#define PLC_FADE_GAIN 0.7f
+#define PLC_MUTE_FRAMES 8
+
+/* Second byte of the H2 header, by sequence number. */
+static const uint8_t h2_header_1[] = { 0x08, 0x38, 0xc8, 0xf8 };
+
+/* State of packet loss concealment.
+ * Members:
+ *    hist - The last samples output, oldest first.
+ *    tail - The continuation of the last substitute, to fade out over the
+ *        start of the next frame.
+ *    bad_frames - Frames concealed in a row.
+ */
+struct plc {
+	int16_t hist[PLC_HIST_LEN];
+	int16_t tail[PLC_OLA_LEN];
+	unsigned int bad_frames;
+};
+
+/* Members:
+ *    enc, dec - The mSBC codecs of the two directions.
+ *    tx_seq - Sequence number of the next packet to send.
+ *    rx_pkt - The packet being received.
+ *    rx_filled - Bytes received of rx_pkt.
+ *    rx_seq - Sequence number of the last packet received, -1 if unknown.
+ *    rx_skipped - Bytes skipped since the last packet, or the last frame
+ *        concealed for the lack of one.
+ *    plc - Concealment of the received frames.
+ *    stats - Statistics of the stream.
+ */
+struct hfp_msbc {
+	struct cras_audio_codec *enc;
+	struct cras_audio_codec *dec;
+	unsigned int tx_seq;
+	uint8_t rx_pkt[MSBC_PKT_SIZE];
+	unsigned int rx_filled;
+	int rx_seq;
+	unsigned int rx_skipped;
+	struct plc plc;
+	struct hfp_msbc_stats stats;
+};
+
+static int16_t saturate(float v)
+{
+	if (v > INT16_MAX)
+		return INT16_MAX;
+	if (v < INT16_MIN)
+		return INT16_MIN;
+	return lrintf(v);
+}
+
+/* Fades from |a| to |b| at sample |i| of the overlap. */
+static int16_t cross_fade(int16_t a, int16_t b, unsigned int i)
+{
+	return ((int)a * (PLC_OLA_LEN - i) + (int)b * i) / PLC_OLA_LEN;
+}
+
+static void plc_update_hist(struct plc *plc, const int16_t *pcm)
+{
+	memmove(plc->hist, plc->hist + MSBC_SAMPLES,
+		(PLC_HIST_LEN - MSBC_SAMPLES) * sizeof(plc->hist[0]));
+	memcpy(plc->hist + PLC_HIST_LEN - MSBC_SAMPLES, pcm,
+	       MSBC_SAMPLES * sizeof(plc->hist[0]));
+}
+
+/* Passes a good frame, fading in from the substitute after a loss. */
+static void plc_good_frame(struct plc *plc, int16_t *pcm)
+{
+	unsigned int i;
+
+	if (plc->bad_frames)
+		for (i = 0; i < PLC_OLA_LEN; i++)
+			pcm[i] = cross_fade(plc->tail[i], pcm[i], i);
+	plc->bad_frames = 0;
+	plc_update_hist(plc, pcm);
+}
+
+/* Fills |pcm| with a substitute for a lost frame. */
+static void plc_bad_frame(struct plc *plc, int16_t *pcm)
+{
+	const int16_t *tmpl = plc->hist + PLC_HIST_LEN - PLC_TEMPLATE_LEN;
+	const int16_t *sub;
+	float best = -1, best_yy = 0, tt = 0, gain;
+	unsigned int p, best_p = 0, i;
+
+	/* Find the segment of history most like the template, by normalized
+	 * cross correlation, leaving room for a frame and the overlap after
+	 * it. */
+	for (p = 0; p + PLC_TEMPLATE_LEN + MSBC_SAMPLES + PLC_OLA_LEN <=
+		    PLC_HIST_LEN; p++) {
+		float xy = 0, yy = 0, score;
+
+		for (i = 0; i < PLC_TEMPLATE_LEN; i++) {
+			xy += (float)tmpl[i] * plc->hist[p + i];
+			yy += (float)plc->hist[p + i] * plc->hist[p + i];
+		}
+		score = yy > 0 ? xy / sqrtf(yy) : 0;
+		if (score > best) {
+			best = score;
+			best_p = p;
+			best_yy = yy;
+		}
+	}
+	for (i = 0; i < PLC_TEMPLATE_LEN; i++)
+		tt += (float)tmpl[i] * tmpl[i];
+
+	/* Match the level of the template, never amplifying. */
+	gain = best_yy > 0 ? MIN(sqrtf(tt / best_yy), 1.0f) : 0;
+	plc->bad_frames++;
+	if (plc->bad_frames >= PLC_MUTE_FRAMES)
+		gain = 0;
+	else if (plc->bad_frames > PLC_FADE_FRAMES)
+		gain *= PLC_FADE_GAIN;
+
+	sub = plc->hist + best_p + PLC_TEMPLATE_LEN;
+	for (i = 0; i < MSBC_SAMPLES; i++)
+		pcm[i] = saturate(sub[i] * gain);
+	if (plc->bad_frames > 1)
+		for (i = 0; i < PLC_OLA_LEN; i++)
+			pcm[i] = cross_fade(plc->tail[i], pcm[i], i);
+	for (i = 0; i < PLC_OLA_LEN; i++)
+		plc->tail[i] = saturate(sub[MSBC_SAMPLES + i] * gain);
+
+	plc_update_hist(plc, pcm);
+}
+
+static int h2_seq(uint8_t header_1)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(h2_header_1); i++)
+		if (h2_header_1[i] == header_1)
+			return i;
+	return -1;
+}
+
+/* Checks the first |n| bytes of |pkt| could start an mSBC packet. */
+static int valid_prefix(const uint8_t *pkt, unsigned int n)
+{
+	if (n > 0 && pkt[0] != H2_HEADER_0)
+		return 0;
+	if (n > 1 && h2_seq(pkt[1]) < 0)
+		return 0;
+	if (n > 2 && pkt[2] != MSBC_SYNC_WORD)
+		return 0;
+	return 1;
+}
+
+/* Writes |len| bytes to |buf|, wrapping around its end. */
+static void write_bytes(struct byte_buffer *buf, const uint8_t *data,
+			unsigned int len)
+{
+	unsigned int writable, n;
+	uint8_t *dst;
+
+	while (len) {
+		dst = buf_write_pointer_size(buf, &writable);
+		n = MIN(len, writable);
+		if (n == 0)
+			return;
+		memcpy(dst, data, n);
+		buf_increment_write(buf, n);
+		data += n;
+		len -= n;
+	}
+}
+
+/* Writes a frame of PCM to |out|, or drops it if |out| is full. Returns
+ * the number of frames written. */
+static int put_frame(struct hfp_msbc *msbc, const int16_t *pcm,
+		     struct byte_buffer *out)
+{
+	unsigned int writable;
+	uint8_t *dst;
+
+	dst = buf_write_pointer_size(out, &writable);
+	if (writable < MSBC_CODE_SIZE) {
+		msbc->stats.frames_dropped++;
+		return 0;
+	}
+	memcpy(dst, pcm, MSBC_CODE_SIZE);
+	buf_increment_write(out, MSBC_CODE_SIZE);
+	return 1;
+}
+
+static int conceal_frame(struct hfp_msbc *msbc, struct byte_buffer *out)
+{
+	int16_t pcm[MSBC_SAMPLES];
+
+	plc_bad_frame(&msbc->plc, pcm);
+	msbc->stats.frames_concealed++;
+	return put_frame(msbc, pcm, out);
+}
+
+/* Handles the complete packet in rx_pkt. */
+static int handle_packet(struct hfp_msbc *msbc, struct byte_buffer *out)
+{
+	int16_t pcm[MSBC_SAMPLES];
+	int seq, processed, frames = 0;
+	unsigned int lost;
+	size_t count;
+
+	/* Packets that never arrived show as a gap in the sequence. */
+	seq = h2_seq(msbc->rx_pkt[1]);
+	if (msbc->rx_seq >= 0) {
+		lost = (seq - msbc->rx_seq - 1) & 3;
+		while (lost--)
+			frames += conceal_frame(msbc, out);
+	}
+	msbc->rx_seq = seq;
+	msbc->rx_skipped = 0;
+
+	processed = msbc->dec->decode(msbc->dec, msbc->rx_pkt + 2,
+				      MSBC_FRAME_SIZE, pcm, MSBC_CODE_SIZE,
+				      &count);
+	if (processed <= 0 || count != MSBC_CODE_SIZE)
+		return frames + conceal_frame(msbc, out);
+
+	msbc->stats.frames_decoded++;
+	plc_good_frame(&msbc->plc, pcm);
+	return frames + put_frame(msbc, pcm, out);
+}
+
+/* Drops bytes from the start of rx_pkt until it could be a packet. */
+static int resync(struct hfp_msbc *msbc, struct byte_buffer *out)
+{
+	int frames = 0;
+
+	while (msbc->rx_filled &&
+	       !valid_prefix(msbc->rx_pkt, msbc->rx_filled)) {
+		msbc->rx_filled--;
+		memmove(msbc->rx_pkt, msbc->rx_pkt + 1, msbc->rx_filled);
+		msbc->stats.bytes_skipped++;
+
+		/* Keep the pace of the audio while the stream is garbled,
+		 * conceal a frame per packet's worth of bytes skipped. */
+		if (++msbc->rx_skipped == MSBC_PKT_SIZE) {
+			msbc->rx_skipped = 0;
+			msbc->rx_seq = -1;
+			frames += conceal_frame(msbc, out);
+		}
+	}
+	return frames;
+}
+
+/*
+ * Exported Interface.
+ */
+
+struct hfp_msbc *hfp_msbc_create()
+{
+	struct hfp_msbc *msbc;
+
+	msbc = (struct hfp_msbc *)calloc(1, sizeof(*msbc));
+	if (!msbc)
+		return NULL;
+
+	msbc->enc = cras_msbc_codec_create();
+	msbc->dec = cras_msbc_codec_create();
+	if (!msbc->enc || !msbc->dec) {
+		hfp_msbc_destroy(msbc);
+		return NULL;
+	}
+	msbc->rx_seq = -1;
+	return msbc;
+}
+
+void hfp_msbc_destroy(struct hfp_msbc *msbc)
+{
+	if (msbc->enc)
+		cras_sbc_codec_destroy(msbc->enc);
+	if (msbc->dec)
+		cras_sbc_codec_destroy(msbc->dec);
+	free(msbc);
+}
+
+int hfp_msbc_encode(struct hfp_msbc *msbc, struct byte_buffer *in,
+		    struct byte_buffer *out, unsigned int target)
+{
+	uint8_t pkt[MSBC_PKT_SIZE];
+	unsigned int readable;
+	int rc, frames = 0;
+	uint8_t *pcm;
+	size_t count;
+
+	while (buf_queued(out) < target &&
+	       buf_available(out) >= MSBC_PKT_SIZE) {
+		pcm = buf_read_pointer_size(in, &readable);
+		if (readable < MSBC_CODE_SIZE)
+			break;
+
+		pkt[0] = H2_HEADER_0;
+		pkt[1] = h2_header_1[msbc->tx_seq];
+		rc = msbc->enc->encode(msbc->enc, pcm, MSBC_CODE_SIZE,
+				       pkt + 2, MSBC_FRAME_SIZE, &count);
+		if (rc < 0)
+			return rc;
+		if (count != MSBC_FRAME_SIZE)
+			return -EIO;
+		pkt[MSBC_PKT_SIZE - 1] = 0;
+
+		msbc->tx_seq = (msbc->tx_seq + 1) % ARRAY_SIZE(h2_header_1);
+		buf_increment_read(in, MSBC_CODE_SIZE);
+		write_bytes(out, pkt, MSBC_PKT_SIZE);
+		msbc->stats.frames_encoded++;
+		frames++;
+	}
+	return frames;
+}
+
+int hfp_msbc_decode(struct hfp_msbc *msbc, const uint8_t *data,
+		    unsigned int len, struct byte_buffer *out)
+{
+	unsigned int n;
+	int frames = 0;
+
+	while (len) {
+		/* Check the header a byte at a time, the rest goes in bulk. */
+		if (msbc->rx_filled < MSBC_PREFIX_LEN) {
+			msbc->rx_pkt[msbc->rx_filled++] = *data++;
+			len--;
+			frames += resync(msbc, out);
+			continue;
+		}
+
+		n = MIN(len, MSBC_PKT_SIZE - msbc->rx_filled);
+		memcpy(msbc->rx_pkt + msbc->rx_filled, data, n);
+		msbc->rx_filled += n;
+		data += n;
+		len -= n;
+
+		if (msbc->rx_filled == MSBC_PKT_SIZE) {
+			frames += handle_packet(msbc, out);
+			msbc->rx_filled = 0;
+		}
+	}
+	return frames;
+}
+
+void hfp_msbc_get_stats(const struct hfp_msbc *msbc,
+			struct hfp_msbc_stats *stats)
+{
+	*stats = msbc->stats;
+}
@@ -0,0 +1,77 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * mSBC transport for HFP wideband speech. Each 7.5ms of 16kHz mono audio is
+ * coded into one 57 byte mSBC frame, carried over SCO in a 60 byte packet:
+ * a two byte H2 synchronization header with a 2-bit sequence number, the
+ * frame and a padding byte. The SCO packets of the adapter don't have to
+ * line up with these, so the receive side searches the byte stream for
+ * H2 headers. Frames that are lost, corrupt or never found are concealed
+ * by waveform substitution from the recently decoded audio.
+ */
+#ifndef HFP_MSBC_H_
+#define HFP_MSBC_H_
+
+#include <stdint.h>
+
+#include "byte_buffer.h"
+
+/* Bytes of an H2 framed mSBC packet. */
+#define MSBC_PKT_SIZE 60
+/* Bytes of an mSBC frame. */
+#define MSBC_FRAME_SIZE 57
+/* Bytes of 16 bit PCM coded in one mSBC frame. */
+#define MSBC_CODE_SIZE 240
+
+struct hfp_msbc;
+
+/* Statistics of an mSBC stream.
+ * Members:
+ *    frames_encoded - Frames sent.
+ *    frames_decoded - Frames received and decoded.
+ *    frames_concealed - Frames missing or corrupt, and concealed.
+ *    frames_dropped - Frames of audio not kept for lack of room.
+ *    bytes_skipped - Bytes of the stream skipped looking for a header.
+ */
+struct hfp_msbc_stats {
+	unsigned int frames_encoded;
+	unsigned int frames_decoded;
+	unsigned int frames_concealed;
+	unsigned int frames_dropped;
+	unsigned int bytes_skipped;
+};
+
+/* Creates the encoder and decoder of an mSBC stream. */
+struct hfp_msbc *hfp_msbc_create();
+
+/* Destroys an mSBC stream created with hfp_msbc_create. */
+void hfp_msbc_destroy(struct hfp_msbc *msbc);
+
+/* Encodes the PCM queued in |in| into H2 framed packets appended to |out|,
+ * a frame at a time, until |out| holds |target| bytes or |in| runs short of
+ * a frame. The read side of |in| must move in whole frames only, and its
+ * used size be a multiple of MSBC_CODE_SIZE.
+ * Returns:
+ *    The number of frames encoded, or negative error code.
+ */
+int hfp_msbc_encode(struct hfp_msbc *msbc, struct byte_buffer *in,
+		    struct byte_buffer *out, unsigned int target);
+
+/* Feeds |len| bytes received from the SCO socket. Each complete frame is
+ * decoded to |out|, and each frame lost since the last one concealed. The
+ * write side of |out| must move in whole frames only, and its used size be
+ * a multiple of MSBC_CODE_SIZE.
+ * Returns:
+ *    The number of frames written to |out|.
+ */
+int hfp_msbc_decode(struct hfp_msbc *msbc, const uint8_t *data,
+		    unsigned int len, struct byte_buffer *out);
+
+/* Gets the statistics of the stream since it was created. */
+void hfp_msbc_get_stats(const struct hfp_msbc *msbc,
+			struct hfp_msbc_stats *stats);
+
+#endif /* HFP_MSBC_H_ */
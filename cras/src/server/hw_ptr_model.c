@@ -0,0 +1,54 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+
+#include "cras_util.h"
+#include "hw_ptr_model.h"
+
+/* Predictions further than this from the anchor aren't trusted. */
+static const struct timespec max_anchor_age = {
+	0, 50 * 1000 * 1000 /* 50 ms. */
+};
+
+void hw_ptr_model_invalidate(struct hw_ptr_model *model)
+{
+	model->anchor_ts.tv_sec = 0;
+	model->anchor_ts.tv_nsec = 0;
+}
+
+void hw_ptr_model_update(struct hw_ptr_model *model, unsigned int level,
+			 const struct timespec *tstamp)
+{
+	model->anchor_ts = *tstamp;
+	model->anchor_level = level;
+}
+
+int hw_ptr_model_predict(const struct hw_ptr_model *model, double rate,
+			 const struct timespec *now, unsigned int margin,
+			 unsigned int *level)
+{
+	struct timespec age;
+	double played, predicted;
+
+	if (!timespec_is_nonzero(&model->anchor_ts) ||
+	    timespec_after(&model->anchor_ts, now))
+		return -EAGAIN;
+
+	subtract_timespecs(now, &model->anchor_ts, &age);
+	if (timespec_after(&age, &max_anchor_age))
+		return -EAGAIN;
+
+	played = rate * (age.tv_sec + age.tv_nsec / 1000000000.0);
+	predicted = model->anchor_level - played;
+
+	/* Close to empty an error in the model is an underrun, ask the
+	 * device instead. */
+	if (predicted < margin)
+		return -EAGAIN;
+
+	*level = (unsigned int)predicted;
+	return 0;
+}
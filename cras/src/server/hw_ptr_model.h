@@ -0,0 +1,61 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Model of the hardware pointer of a playback device, used to schedule the
+ * device from a timer instead of asking the kernel for the buffer level on
+ * every call. The model is anchored at the level and htimestamp of the last
+ * real query and assumes the device plays at the estimated rate since then.
+ */
+#ifndef HW_PTR_MODEL_H_
+#define HW_PTR_MODEL_H_
+
+#include <time.h>
+
+/* Members:
+ *    anchor_ts - htimestamp of the last real level, zero if there is none.
+ *    anchor_level - Level at anchor_ts plus the frames written since.
+ */
+struct hw_ptr_model {
+	struct timespec anchor_ts;
+	double anchor_level;
+};
+
+/* Anchors the model at a level read from the device.
+ * Args:
+ *    model - The model.
+ *    level - Frames in the hardware buffer.
+ *    tstamp - htimestamp of level.
+ */
+void hw_ptr_model_update(struct hw_ptr_model *model, unsigned int level,
+			 const struct timespec *tstamp);
+
+/* Accounts frames written to the device since the anchor. */
+static inline void hw_ptr_model_add_frames(struct hw_ptr_model *model,
+					   unsigned int frames)
+{
+	model->anchor_level += frames;
+}
+
+/* Drops the anchor so that the next level is read from the device. */
+void hw_ptr_model_invalidate(struct hw_ptr_model *model);
+
+/* Predicts the level of the device.
+ * Args:
+ *    model - The model.
+ *    rate - The estimated rate of the device.
+ *    now - The time to predict the level at.
+ *    margin - Predicted levels below this are too close to an underrun to
+ *        be trusted.
+ *    level - Filled with the predicted level.
+ * Returns:
+ *    0 on success. -EAGAIN if the anchor is too old or the predicted level
+ *    is below margin, and the caller should read the level from the device.
+ */
+int hw_ptr_model_predict(const struct hw_ptr_model *model, double rate,
+			 const struct timespec *now, unsigned int margin,
+			 unsigned int *level);
+
+#endif /* HW_PTR_MODEL_H_ */
@@ -93,7 +93,7 @@ int input_data_get_for_stream(struct input_data *data,
 			      struct cras_audio_area **area,
 			      unsigned int *offset)
 {
-	unsigned int apm_processed;
+	int apm_processed;
 	struct cras_apm *apm;
 
 	/*
@@ -110,11 +110,15 @@ int input_data_get_for_stream(struct input_data *data,
 	if (apm == NULL)
 		return 0;
 
+	/*
+	 * Don't remove a failed APM here, that would block the audio thread
+	 * on the APM worker. The stream reads unprocessed input instead,
+	 * until the main thread removes the APM as the stream leaves the
+	 * device.
+	 */
 	apm_processed = cras_apm_list_process(apm, data->fbuffer, *offset);
-	if (apm_processed < 0) {
-		cras_apm_list_remove(stream->apm_list, apm);
+	if (apm_processed < 0)
 		return 0;
-	}
 	buffer_share_offset_update(offsets, stream->stream_id, apm_processed);
 	*area = cras_apm_list_get_processed(apm);
 	*offset = 0;
@@ -122,6 +126,21 @@ int input_data_get_for_stream(struct input_data *data,
 	return 0;
 }
 
+unsigned int input_data_get_delay_frames(struct input_data *data,
+					 struct cras_rstream *stream)
+{
+	struct cras_apm *apm;
+
+	if (data == NULL)
+		return 0;
+
+	apm = cras_apm_list_get(stream->apm_list, data->dev_ptr);
+	if (apm == NULL)
+		return 0;
+
+	return cras_apm_list_get_delay_frames(apm);
+}
+
 int input_data_put_for_stream(struct input_data *data,
 			      struct cras_rstream *stream,
 			      struct buffer_share *offsets,
@@ -137,3 +156,15 @@ int input_data_put_for_stream(struct input_data *data,
 
 	return 0;
 }
+
+void input_data_add_stream(struct input_data *data,
+			   const struct cras_rstream *stream)
+{
+	cras_apm_list_join(stream->apm_list, data->dev_ptr);
+}
+
+void input_data_rm_stream(struct input_data *data,
+			  const struct cras_rstream *stream)
+{
+	cras_apm_list_leave(stream->apm_list, data->dev_ptr);
+}
@@ -62,6 +62,16 @@ int input_data_get_for_stream(
 		struct cras_audio_area **area,
 		unsigned int *offset);
 
+/*
+ * Gets the number of frames read from device that the APM of |stream| still
+ * holds, which adds to the capture delay seen by |stream|.
+ * Args:
+ *    data - The input data |stream| reads from.
+ *    stream - The stream to get the delay for.
+ */
+unsigned int input_data_get_delay_frames(struct input_data *data,
+					 struct cras_rstream *stream);
+
 /*
  * Marks |frames| of audio data as read by |stream|.
  * Args:
@@ -76,4 +86,24 @@ int input_data_put_for_stream(struct input_data *data,
 			   struct buffer_share *offsets,
 			   unsigned int frames);
 
+/*
+ * Attaches |stream| to the APM it reads processed data from on the device
+ * of |data|. Called when |stream| is added to the device.
+ * Args:
+ *    data - The input data |stream| reads from.
+ *    stream - The stream added to the device.
+ */
+void input_data_add_stream(struct input_data *data,
+			   const struct cras_rstream *stream);
+
+/*
+ * Detaches |stream| from the APM it reads processed data from on the
+ * device of |data|. Called when |stream| is removed from the device.
+ * Args:
+ *    data - The input data |stream| reads from.
+ *    stream - The stream removed from the device.
+ */
+void input_data_rm_stream(struct input_data *data,
+			  const struct cras_rstream *stream);
+
 #endif /* INPUT_DATA_H_ */
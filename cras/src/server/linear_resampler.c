@@ -3,42 +3,68 @@
  * found in the LICENSE file.
  */
 
+#include <math.h>
+#include <string.h>
+#include <sys/param.h>
+
 #include "cras_audio_area.h"
+#include "cras_audio_format.h"
 #include "cras_util.h"
 #include "linear_resampler.h"
 
+/* Number of fractional bits in the source position. */
+#define LR_FRAC_BITS 32
+#define LR_FRAC_MASK ((1ULL << LR_FRAC_BITS) - 1)
+
 /* A linear resampler.
  * Members:
  *    num_channels - The number of channles in once frames.
+ *    format - The sample format of the frames to resample.
  *    format_bytes - The size of one frame in bytes.
  *    src_offset - The accumulated offset for resampled src data.
  *    dst_offset - The accumulated offset for resampled dst data.
  *    to_times_100 - The numerator of the rate factor used for SRC.
  *    from_times_100 - The denominator of the rate factor used for SRC.
  *    f - The rate factor used for linear resample.
+ *    step - Source frames advanced per output frame, 1/f in 32.32 fixed
+ *        point.
  */
 struct linear_resampler {
 	unsigned int num_channels;
+	snd_pcm_format_t format;
 	unsigned int format_bytes;
 	unsigned int src_offset;
 	unsigned int dst_offset;
 	unsigned int to_times_100;
 	unsigned int from_times_100;
 	float f;
+	uint64_t step;
 };
 
 struct linear_resampler *linear_resampler_create(unsigned int num_channels,
-					     unsigned int format_bytes,
-					     float src_rate,
-					     float dst_rate)
+						 snd_pcm_format_t format,
+						 float src_rate,
+						 float dst_rate)
 {
 	struct linear_resampler *lr;
 
+	switch (format) {
+	case SND_PCM_FORMAT_U8:
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S24_LE:
+	case SND_PCM_FORMAT_S24_3LE:
+	case SND_PCM_FORMAT_S32_LE:
+		break;
+	default:
+		return NULL;
+	}
+
 	lr = (struct linear_resampler *)calloc(1, sizeof(*lr));
 	if (!lr)
 		return NULL;
 	lr->num_channels = num_channels;
-	lr->format_bytes = format_bytes;
+	lr->format = format;
+	lr->format_bytes = PCM_FORMAT_WIDTH(format) / 8 * num_channels;
 
 	linear_resampler_set_rates(lr, src_rate, dst_rate);
 
@@ -55,6 +81,9 @@ void linear_resampler_set_rates(struct linear_resampler *lr,
 				float from, float to)
 {
 	lr->f = (float)to / from;
+	/* Derive the step from f so that positions landing on a frame
+	 * boundary round the same way the float division used to. */
+	lr->step = llround((1ULL << LR_FRAC_BITS) / (double)lr->f);
 	lr->to_times_100 = to * 100;
 	lr->from_times_100 = from * 100;
 	lr->src_offset = 0;
@@ -107,17 +136,136 @@ int linear_resampler_needed(struct linear_resampler *lr)
 	return lr->from_times_100 != lr->to_times_100;
 }
 
+/* Sign extends the low 24 bits of an S24_LE sample. */
+static inline int32_t s24_value(int32_t v)
+{
+	return (int32_t)((uint32_t)v << 8) >> 8;
+}
+
+static inline int32_t s243_load(const uint8_t *p)
+{
+	return s24_value(p[0] | (p[1] << 8) | (p[2] << 16));
+}
+
+static inline void s243_store(uint8_t *p, int32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+}
+
+/* Interpolates one frame between |in| and the frame after it, |frac| is
+ * the 0.32 fixed point weight of the latter. Like the float implementation
+ * this replaced, the result is truncated toward zero. The channel loops
+ * have a constant trip count once inlined into resample_frames so the
+ * compiler can vectorize across channels. 16 bit and narrower samples need
+ * no more than a float mantissa, wider ones use double. */
+static inline void interpolate_frame(snd_pcm_format_t format,
+				     const uint8_t *in, uint8_t *out,
+				     unsigned int nch, uint32_t frac)
+{
+	const float wf = (int32_t)(frac >> 8) * (1.0f / (1 << 24));
+	const double w = frac * (1.0 / (1ULL << LR_FRAC_BITS));
+	unsigned int ch;
+
+	switch (format) {
+	case SND_PCM_FORMAT_U8: {
+		const uint8_t *a = in, *b = in + nch;
+
+		for (ch = 0; ch < nch; ch++)
+			out[ch] = a[ch] + wf * (b[ch] - a[ch]);
+		break;
+	}
+	case SND_PCM_FORMAT_S16_LE: {
+		const int16_t *a = (const int16_t *)in, *b = a + nch;
+		int16_t *o = (int16_t *)out;
+
+		for (ch = 0; ch < nch; ch++)
+			o[ch] = a[ch] + wf * (b[ch] - a[ch]);
+		break;
+	}
+	case SND_PCM_FORMAT_S24_LE: {
+		const int32_t *a = (const int32_t *)in, *b = a + nch;
+		int32_t *o = (int32_t *)out;
+
+		for (ch = 0; ch < nch; ch++) {
+			int32_t va = s24_value(a[ch]), vb = s24_value(b[ch]);
+
+			o[ch] = va + w * (vb - va);
+		}
+		break;
+	}
+	case SND_PCM_FORMAT_S24_3LE:
+		for (ch = 0; ch < nch; ch++) {
+			int32_t va = s243_load(in + 3 * ch);
+			int32_t vb = s243_load(in + 3 * (nch + ch));
+
+			s243_store(out + 3 * ch, va + w * (vb - va));
+		}
+		break;
+	case SND_PCM_FORMAT_S32_LE: {
+		const int32_t *a = (const int32_t *)in, *b = a + nch;
+		int32_t *o = (int32_t *)out;
+
+		for (ch = 0; ch < nch; ch++)
+			o[ch] = a[ch] + w * ((double)b[ch] - a[ch]);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+/* Produces output frames until |dst_frames| are written or the source
+ * position passes the last input frame.
+ * Args:
+ *    pos - Source position of output frame 0 in 32.32 fixed point, may
+ *        be negative while the source offset is ahead of the output.
+ * Returns:
+ *    The number of frames written.
+ */
+static inline unsigned int resample_frames(const struct linear_resampler *lr,
+					   const uint8_t *src,
+					   unsigned int last,
+					   uint8_t *dst,
+					   unsigned int dst_frames,
+					   int64_t pos,
+					   unsigned int nch)
+{
+	const int64_t last_pos = (int64_t)last << LR_FRAC_BITS;
+	const unsigned int frame_bytes = lr->format_bytes;
+	unsigned int dst_idx;
+
+	for (dst_idx = 0; dst_idx < dst_frames; dst_idx++, pos += lr->step) {
+		int64_t p = MAX(pos, 0);
+		unsigned int src_idx = p >> LR_FRAC_BITS;
+		const uint8_t *in = src + src_idx * frame_bytes;
+		uint8_t *out = dst + dst_idx * frame_bytes;
+
+		if (p > last_pos)
+			break;
+
+		/* Don't do linear interpolcation if src_pos falls on the
+		 * last index. */
+		if (src_idx == last)
+			memcpy(out, in, frame_bytes);
+		else
+			interpolate_frame(lr->format, in, out, nch,
+					  p & LR_FRAC_MASK);
+	}
+	return dst_idx;
+}
+
 unsigned int linear_resampler_resample(struct linear_resampler *lr,
 			     uint8_t *src,
 			     unsigned int *src_frames,
 			     uint8_t *dst,
 			     unsigned dst_frames)
 {
-	int ch;
-	unsigned int src_idx = 0;
-	unsigned int dst_idx = 0;
-	float src_pos;
-	int16_t *in, *out;
+	unsigned int src_idx;
+	unsigned int dst_idx;
+	unsigned int last;
+	int64_t pos, end;
 
 	/* Check for corner cases so that we can assume both src_idx and
 	 * dst_idx are valid with value 0 in the loop below. */
@@ -126,39 +274,42 @@ unsigned int linear_resampler_resample(struct linear_resampler *lr,
 		return 0;
 	}
 
-	for (dst_idx = 0; dst_idx <= dst_frames; dst_idx++) {
-		src_pos = (float)(lr->dst_offset + dst_idx) / lr->f;
-		if (src_pos > lr->src_offset)
-			src_pos -= lr->src_offset;
-		else
-			src_pos = 0;
-		src_idx = (unsigned int)src_pos;
-
-		if (src_pos > *src_frames - 1 || dst_idx >= dst_frames) {
-			if (src_pos > *src_frames - 1)
-				src_idx = *src_frames - 1;
-			/* When this loop stops, dst_idx is always at the last
-			 * used index incremented by 1. */
-			break;
-		}
-
-		in = (int16_t *)(src + src_idx * lr->format_bytes);
-		out = (int16_t *)(dst + dst_idx * lr->format_bytes);
-
-		/* Don't do linear interpolcation if src_pos falls on the
-		 * last index. */
-		if (src_idx == *src_frames - 1) {
-			for (ch = 0; ch < lr->num_channels; ch++)
-				out[ch] = in[ch];
-		} else {
-			for (ch = 0; ch < lr->num_channels; ch++) {
-				out[ch] = in[ch] + (src_pos - src_idx) *
-					(in[lr->num_channels + ch] - in[ch]);
-			}
-		}
+	last = *src_frames - 1;
+	pos = (int64_t)lr->dst_offset * lr->step -
+	      ((int64_t)lr->src_offset << LR_FRAC_BITS);
 
+	/* Specialize the common channel counts. */
+	switch (lr->num_channels) {
+	case 1:
+		dst_idx = resample_frames(lr, src, last, dst, dst_frames,
+					  pos, 1);
+		break;
+	case 2:
+		dst_idx = resample_frames(lr, src, last, dst, dst_frames,
+					  pos, 2);
+		break;
+	case 6:
+		dst_idx = resample_frames(lr, src, last, dst, dst_frames,
+					  pos, 6);
+		break;
+	case 8:
+		dst_idx = resample_frames(lr, src, last, dst, dst_frames,
+					  pos, 8);
+		break;
+	default:
+		dst_idx = resample_frames(lr, src, last, dst, dst_frames,
+					  pos, lr->num_channels);
+		break;
 	}
 
+	/* The input frame the next output would start from is the last one
+	 * consumed. */
+	end = MAX(pos + (int64_t)dst_idx * lr->step, 0);
+	if (end > ((int64_t)last << LR_FRAC_BITS))
+		src_idx = last;
+	else
+		src_idx = end >> LR_FRAC_BITS;
+
 	*src_frames = src_idx + 1;
 
 	lr->src_offset += *src_frames;
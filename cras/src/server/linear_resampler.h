@@ -6,18 +6,22 @@
 #ifndef LINEAR_RESAMPLER_H_
 #define LINEAR_RESAMPLER_H_
 
+#include "cras_audio_format.h"
 
 struct linear_resampler;
 
 /* Creates a linear resampler.
  * Args:
  *    num_channels - The number of channels in each frames.
- *    format_bytes - The length of one frame in bytes.
+ *    format - The sample format, one of U8, S16_LE, S24_LE, S24_3LE or
+ *        S32_LE.
  *    src_rate - The source rate to resample from.
  *    dst_rate - The destination rate to resample to.
+ * Returns:
+ *    The new resampler, or NULL if the format is not supported.
  */
 struct linear_resampler *linear_resampler_create(unsigned int num_channels,
-						 unsigned int format_bytes,
+						 snd_pcm_format_t format,
 						 float src_rate,
 						 float dst_rate);
 
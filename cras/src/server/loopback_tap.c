@@ -0,0 +1,357 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <syslog.h>
+
+#include "cras_iodev.h"
+#include "cras_util.h"
+#include "loopback_tap.h"
+#include "utlist.h"
+
+/* Size of the buffer of a tap in bytes. The ring uses as many whole frames
+ * as fit, so a frame never wraps around the ring end. */
+#define LOOPBACK_TAP_RING_SIZE (1024 * 16 * 4)
+
+/* A tap on one output device.
+ * Members:
+ *    odev - The output device hooked, NULL for a tap of silence.
+ *    type - Which samples of |odev| are hooked.
+ *    ring - The samples, shared by all readers.
+ *    frame_bytes - Bytes in a frame of the samples, 0 until known.
+ *    size - Bytes of |ring| in use, a whole number of frames.
+ *    start - Position of the first byte written in |frame_bytes| frames.
+ *        |ring| starts at this position.
+ *    written - Total number of bytes written to |ring|.
+ *    last_filled - Time of the last write.
+ *    num_readers - Number of readers attached, the tap is unused when zero.
+ */
+struct loopback_tap {
+	struct cras_iodev *odev;
+	enum CRAS_LOOPBACK_TYPE type;
+	uint8_t *ring;
+	unsigned int frame_bytes;
+	unsigned int size;
+	uint64_t start;
+	uint64_t written;
+	struct timespec last_filled;
+	unsigned int num_readers;
+	struct loopback_tap *prev, *next;
+};
+
+/* A consumer of a tap.
+ * Members:
+ *    type - Which samples to read.
+ *    tap - The tap attached to, NULL if none.
+ *    read - Position in the tap of the next byte to read.
+ *    overruns - How many times the reader fell a full ring behind.
+ */
+struct loopback_tap_reader {
+	enum CRAS_LOOPBACK_TYPE type;
+	struct loopback_tap *tap;
+	uint64_t read;
+	unsigned int overruns;
+};
+
+/* Taps, including unused ones. The audio thread may still be in the hook of
+ * a tap as it's released, so unused taps are kept for reuse and freed only
+ * once there's no reader at all. */
+static struct loopback_tap *taps;
+static unsigned int num_readers;
+
+/* Gets the offset in the ring of |tap| of position |pos|. */
+static unsigned int ring_offset(const struct loopback_tap *tap, uint64_t pos)
+{
+	return (pos - tap->start) % tap->size;
+}
+
+/* Sizes the ring of |tap| to whole frames of |frame_bytes|. Samples written
+ * in another frame size are dropped. */
+static void set_frame_bytes(struct loopback_tap *tap,
+			    unsigned int frame_bytes)
+{
+	if (frame_bytes == 0 || frame_bytes == tap->frame_bytes)
+		return;
+
+	tap->frame_bytes = frame_bytes;
+	tap->size = LOOPBACK_TAP_RING_SIZE / frame_bytes * frame_bytes;
+	tap->start = tap->written;
+}
+
+/* Writes |nbytes| from |data|, or zeros if |data| is NULL, to |tap|. */
+static void tap_write(struct loopback_tap *tap, const uint8_t *data,
+		      unsigned int nbytes)
+{
+	unsigned int offset, n;
+
+	/* Only the newest ring full of samples can be kept. */
+	if (nbytes > tap->size) {
+		n = nbytes - tap->size;
+		if (data)
+			data += n;
+		tap->written += n;
+		nbytes = tap->size;
+	}
+
+	while (nbytes) {
+		offset = ring_offset(tap, tap->written);
+		n = MIN(nbytes, tap->size - offset);
+		if (data) {
+			memcpy(tap->ring + offset, data, n);
+			data += n;
+		} else {
+			memset(tap->ring + offset, 0, n);
+		}
+		tap->written += n;
+		nbytes -= n;
+	}
+	clock_gettime(CLOCK_MONOTONIC_RAW, &tap->last_filled);
+}
+
+static int tap_hook(const uint8_t *frames, unsigned int nframes,
+		    const struct cras_audio_format *fmt, void *cb_data)
+{
+	struct loopback_tap *tap = (struct loopback_tap *)cb_data;
+
+	/* If there's no active streams, silence is filled in by time for
+	 * loopback capture, do not accept zeros for draining device.
+	 */
+	if (!tap->odev || !tap->odev->streams)
+		return 0;
+
+	set_frame_bytes(tap, cras_get_format_bytes(fmt));
+	tap_write(tap, frames, nframes * tap->frame_bytes);
+	return nframes;
+}
+
+static void register_tap_hook(struct loopback_tap *tap, loopback_hook_t hook)
+{
+	void *cb_data = hook ? tap : NULL;
+
+	if (!tap->odev)
+		return;
+
+	if (tap->type == LOOPBACK_POST_MIX_PRE_DSP)
+		cras_iodev_register_pre_dsp_hook(tap->odev, hook, cb_data);
+	else if (tap->type == LOOPBACK_POST_DSP)
+		cras_iodev_register_post_dsp_hook(tap->odev, hook, cb_data);
+}
+
+/* Gets an unused tap, allocating one if there's none. */
+static struct loopback_tap *get_unused_tap()
+{
+	struct loopback_tap *tap;
+
+	DL_FOREACH(taps, tap) {
+		if (tap->num_readers == 0)
+			return tap;
+	}
+
+	tap = (struct loopback_tap *)calloc(1, sizeof(*tap));
+	if (!tap)
+		return NULL;
+	tap->ring = (uint8_t *)calloc(1, LOOPBACK_TAP_RING_SIZE);
+	if (!tap->ring) {
+		free(tap);
+		return NULL;
+	}
+	DL_APPEND(taps, tap);
+	return tap;
+}
+
+static void free_taps()
+{
+	struct loopback_tap *tap;
+
+	DL_FOREACH(taps, tap) {
+		DL_DELETE(taps, tap);
+		free(tap->ring);
+		free(tap);
+	}
+}
+
+static void detach_reader(struct loopback_tap_reader *reader)
+{
+	struct loopback_tap *tap = reader->tap;
+
+	if (!tap)
+		return;
+
+	reader->tap = NULL;
+	if (--tap->num_readers == 0) {
+		register_tap_hook(tap, NULL);
+		tap->odev = NULL;
+	}
+}
+
+/* Drops the unread samples of |reader| if it fell a full ring behind and
+ * the writer went over them, or if they were written in another frame
+ * size. Returns the number of bytes left to read. */
+static unsigned int check_overrun(struct loopback_tap_reader *reader)
+{
+	struct loopback_tap *tap = reader->tap;
+
+	if (reader->read < tap->start)
+		reader->read = tap->start;
+	if (tap->written - reader->read > tap->size) {
+		reader->read = tap->written;
+		reader->overruns++;
+	}
+	return tap->written - reader->read;
+}
+
+/*
+ * Exported Interface.
+ */
+
+struct loopback_tap_reader *loopback_tap_reader_create(
+		enum CRAS_LOOPBACK_TYPE type)
+{
+	struct loopback_tap_reader *reader;
+
+	reader = (struct loopback_tap_reader *)calloc(1, sizeof(*reader));
+	if (!reader)
+		return NULL;
+	reader->type = type;
+	num_readers++;
+	return reader;
+}
+
+void loopback_tap_reader_destroy(struct loopback_tap_reader *reader)
+{
+	detach_reader(reader);
+	free(reader);
+	if (--num_readers == 0)
+		free_taps();
+}
+
+int loopback_tap_reader_attach(struct loopback_tap_reader *reader,
+			       struct cras_iodev *odev)
+{
+	struct loopback_tap *tap;
+
+	if (reader->tap && reader->tap->odev == odev)
+		return 0;
+
+	DL_FOREACH(taps, tap) {
+		if (tap->num_readers && tap->odev == odev &&
+		    tap->type == reader->type)
+			break;
+	}
+
+	if (!tap) {
+		tap = get_unused_tap();
+		if (!tap) {
+			syslog(LOG_ERR, "Failed to create loopback tap.");
+			return -ENOMEM;
+		}
+		tap->odev = odev;
+		tap->type = reader->type;
+		tap->frame_bytes = 0;
+		tap->size = LOOPBACK_TAP_RING_SIZE;
+		tap->start = 0;
+		tap->written = 0;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &tap->last_filled);
+		register_tap_hook(tap, tap_hook);
+	}
+
+	/* Take the tap before detaching, or reattaching to the same tap
+	 * would release it. */
+	tap->num_readers++;
+	detach_reader(reader);
+	reader->tap = tap;
+	reader->read = tap->written;
+	return 0;
+}
+
+void loopback_tap_reader_detach(struct loopback_tap_reader *reader)
+{
+	detach_reader(reader);
+	reader->overruns = 0;
+}
+
+struct cras_iodev *loopback_tap_reader_get_dev(
+		const struct loopback_tap_reader *reader)
+{
+	return reader->tap ? reader->tap->odev : NULL;
+}
+
+unsigned int loopback_tap_reader_queued(struct loopback_tap_reader *reader,
+					unsigned int frame_bytes,
+					unsigned int frame_rate,
+					struct timespec *tstamp)
+{
+	struct loopback_tap *tap = reader->tap;
+	unsigned int queued, frames_to_fill;
+
+	if (!tap)
+		return 0;
+
+	if (!tap->odev || !tap->odev->streams)
+		set_frame_bytes(tap, frame_bytes);
+
+	queued = check_overrun(reader);
+	if (!tap->odev || !tap->odev->streams) {
+		frames_to_fill = cras_frames_since_time(&tap->last_filled,
+							frame_rate);
+		frames_to_fill = MIN(frames_to_fill,
+				     (tap->size - queued) / frame_bytes);
+		if (frames_to_fill > 0) {
+			tap_write(tap, NULL, frames_to_fill * frame_bytes);
+			queued += frames_to_fill * frame_bytes;
+		}
+	}
+	*tstamp = tap->last_filled;
+	return queued;
+}
+
+uint8_t *loopback_tap_reader_read_pointer(struct loopback_tap_reader *reader,
+					  unsigned int *readable)
+{
+	struct loopback_tap *tap = reader->tap;
+	unsigned int offset;
+
+	if (!tap) {
+		*readable = 0;
+		return NULL;
+	}
+
+	*readable = check_overrun(reader);
+	offset = ring_offset(tap, reader->read);
+	*readable = MIN(*readable, tap->size - offset);
+	return tap->ring + offset;
+}
+
+void loopback_tap_reader_read(struct loopback_tap_reader *reader,
+			      unsigned int nbytes)
+{
+	if (reader->tap)
+		reader->read += MIN(nbytes, check_overrun(reader));
+}
+
+void loopback_tap_reader_flush(struct loopback_tap_reader *reader)
+{
+	if (reader->tap)
+		reader->read = reader->tap->written;
+}
+
+unsigned int loopback_tap_reader_get_overruns(
+		const struct loopback_tap_reader *reader)
+{
+	return reader->overruns;
+}
+
+unsigned int loopback_tap_get_num_taps()
+{
+	struct loopback_tap *tap;
+	unsigned int num = 0;
+
+	DL_FOREACH(taps, tap)
+		num += !!tap->num_readers;
+	return num;
+}
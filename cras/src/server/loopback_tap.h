@@ -0,0 +1,88 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Loopback taps on output devices. A tap hooks the mixed (pre-DSP) or
+ * post-DSP samples of one output device and keeps a single ring of them
+ * shared by every reader of that device and loopback type. Each reader has
+ * its own read cursor into the ring and reads the samples in place, so
+ * adding a consumer doesn't add a copy. The writer never waits for readers,
+ * a reader that falls a full ring behind loses its unread samples and has
+ * an overrun counted.
+ *
+ * A reader attached to no output device reads from a tap that is filled
+ * with silence as time passes.
+ */
+#ifndef LOOPBACK_TAP_H_
+#define LOOPBACK_TAP_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "cras_types.h"
+
+struct cras_iodev;
+struct loopback_tap_reader;
+
+/* Creates a reader of |type| loopback samples, not attached to any output
+ * device. Returns NULL if out of memory. */
+struct loopback_tap_reader *loopback_tap_reader_create(
+		enum CRAS_LOOPBACK_TYPE type);
+
+/* Detaches and destroys |reader|. */
+void loopback_tap_reader_destroy(struct loopback_tap_reader *reader);
+
+/* Attaches |reader| to the tap on output device |odev|, creating the tap if
+ * it's the first reader there. |odev| can be NULL to read silence. The
+ * reader starts at the newest samples of the tap.
+ * Returns:
+ *    0 on success, -ENOMEM if a tap can't be created.
+ */
+int loopback_tap_reader_attach(struct loopback_tap_reader *reader,
+			       struct cras_iodev *odev);
+
+/* Detaches |reader| from its tap, releasing the tap if it was the last
+ * reader there. Clears the overrun count of |reader|. */
+void loopback_tap_reader_detach(struct loopback_tap_reader *reader);
+
+/* Gets the output device |reader| is attached to. */
+struct cras_iodev *loopback_tap_reader_get_dev(
+		const struct loopback_tap_reader *reader);
+
+/* Gets the number of bytes |reader| hasn't read yet. Checks for an overrun
+ * first, and fills the tap with silence up to now if its output device
+ * plays no stream.
+ * Args:
+ *    reader - The reader to query.
+ *    frame_bytes - Bytes in a frame of the samples.
+ *    frame_rate - Rate to fill silence at.
+ *    tstamp - Filled with the time the tap was last written.
+ */
+unsigned int loopback_tap_reader_queued(struct loopback_tap_reader *reader,
+					unsigned int frame_bytes,
+					unsigned int frame_rate,
+					struct timespec *tstamp);
+
+/* Gets a pointer to the next unread bytes of |reader| in the tap.
+ * |readable| is filled with how many bytes can be read contiguously. */
+uint8_t *loopback_tap_reader_read_pointer(struct loopback_tap_reader *reader,
+					  unsigned int *readable);
+
+/* Marks |nbytes| as read by |reader|. */
+void loopback_tap_reader_read(struct loopback_tap_reader *reader,
+			      unsigned int nbytes);
+
+/* Drops everything |reader| hasn't read yet. */
+void loopback_tap_reader_flush(struct loopback_tap_reader *reader);
+
+/* Gets how many times |reader| fell behind and lost samples since it was
+ * last detached. */
+unsigned int loopback_tap_reader_get_overruns(
+		const struct loopback_tap_reader *reader);
+
+/* Gets the number of taps currently attached to output devices. */
+unsigned int loopback_tap_get_num_taps();
+
+#endif /* LOOPBACK_TAP_H_ */
@@ -3,6 +3,7 @@
  * found in the LICENSE file.
  */
 #include "math.h"
+#include <sys/param.h>
 
 #include "cras_util.h"
 #include "rate_estimator.h"
@@ -10,6 +11,26 @@
 /* The max rate skew that considered reasonable */
 #define MAX_RATE_SKEW 100
 
+/* Tuning of the Kalman filter estimator. The measurement noise covers
+ * timestamp jitter and the granularity of the buffer level, expressed in
+ * seconds. The rate is modeled as a random walk in ppm per sqrt(second),
+ * which is what lets the filter follow slow drift, e.g. from temperature. */
+#define KALMAN_MEAS_NOISE_SEC 0.0002
+#define KALMAN_RATE_WALK_PPM 0.05
+/* Innovations bigger than this many standard deviations are outliers. After
+ * KALMAN_MAX_OUTLIERS in a row the phase is assumed to have jumped, e.g.
+ * the device lost frames, and the filter starts tracking from there. */
+#define KALMAN_OUTLIER_SIGMA 6
+#define KALMAN_MAX_OUTLIERS 3
+/* Standard deviations of the filtered rate covered by its error bound. */
+#define KALMAN_BOUND_SIGMA 3
+/* The reported rate changes by at most this many ppm per second, and only
+ * when it is off by more than KALMAN_PUBLISH_PPM, at most once every
+ * KALMAN_PUBLISH_INTERVAL_NS. */
+#define KALMAN_MAX_SLEW_PPM 200
+#define KALMAN_PUBLISH_PPM 0.5
+#define KALMAN_PUBLISH_INTERVAL_NS 100000000
+
 static void least_square_reset(struct least_square *lsq)
 {
 	memset(lsq, 0, sizeof(*lsq));
@@ -32,6 +53,111 @@ double least_square_best_fit_slope(struct least_square *lsq)
 	return num / denom;
 }
 
+static double timespec_to_sec(const struct timespec *ts)
+{
+	return ts->tv_sec + ts->tv_nsec / 1000000000.0;
+}
+
+/* Restarts phase tracking at the next check. The rate and its variance are
+ * kept so a discontinuity doesn't throw away what has been learned. */
+static void kalman_restart_phase(struct rate_kalman *k)
+{
+	k->last_ts.tv_sec = 0;
+	k->last_ts.tv_nsec = 0;
+	k->phase_err = 0;
+	k->p00 = k->meas_var;
+	k->p01 = 0;
+	k->num_outliers = 0;
+}
+
+static void kalman_init(struct rate_kalman *k, unsigned int rate)
+{
+	k->meas_var = KALMAN_MEAS_NOISE_SEC * rate;
+	k->meas_var *= k->meas_var;
+	k->rate_var = KALMAN_RATE_WALK_PPM * 1e-6 * rate;
+	k->rate_var *= k->rate_var;
+	k->rate = rate;
+	k->p11 = (double)MAX_RATE_SKEW * MAX_RATE_SKEW;
+	kalman_restart_phase(k);
+}
+
+static int kalman_check(struct rate_estimator *re, int level,
+			struct timespec *now)
+{
+	struct rate_kalman *k = &re->kalman;
+	struct timespec td;
+	double dt, s, k0, k1, max_step, diff;
+	int frames;
+
+	frames = abs(re->last_level - level + re->level_diff);
+	re->level_diff = 0;
+	re->last_level = level;
+
+	if (!timespec_is_nonzero(&k->last_ts)) {
+		k->last_ts = *now;
+		if (!timespec_is_nonzero(&k->last_publish_ts))
+			k->last_publish_ts = *now;
+		return 0;
+	}
+
+	/* Time going backward or a long gap, e.g. a suspend, can't be fed to
+	 * the filter. Start over from here. */
+	if (!timespec_after(now, &k->last_ts)) {
+		kalman_restart_phase(k);
+		return 0;
+	}
+	subtract_timespecs(now, &k->last_ts, &td);
+	k->last_ts = *now;
+	if (timespec_after(&td, &re->window_size)) {
+		kalman_restart_phase(k);
+		k->last_ts = *now;
+		return 0;
+	}
+	dt = timespec_to_sec(&td);
+
+	/* Predict. */
+	k->phase_err += frames - k->rate * dt;
+	k->p00 += dt * (2 * k->p01 + dt * k->p11) +
+		  k->rate_var * dt * dt * dt / 3;
+	k->p01 += dt * k->p11 + k->rate_var * dt * dt / 2;
+	k->p11 += k->rate_var * dt;
+
+	/* Update with the measured phase. */
+	s = k->p00 + k->meas_var;
+	if (k->phase_err * k->phase_err >
+	    KALMAN_OUTLIER_SIGMA * KALMAN_OUTLIER_SIGMA * s) {
+		if (++k->num_outliers >= KALMAN_MAX_OUTLIERS) {
+			kalman_restart_phase(k);
+			k->last_ts = *now;
+		}
+		return 0;
+	}
+	k->num_outliers = 0;
+	k0 = k->p00 / s;
+	k1 = k->p01 / s;
+	k->rate += k1 * k->phase_err;
+	k->phase_err -= k0 * k->phase_err;
+	k->p11 -= k1 * k->p01;
+	k->p01 -= k0 * k->p01;
+	k->p00 -= k0 * k->p00;
+
+	k->rate = MIN(k->rate, re->nominal_rate + MAX_RATE_SKEW);
+	k->rate = MAX(k->rate, re->nominal_rate - MAX_RATE_SKEW);
+
+	/* Move the reported rate toward the filtered one, with bounded slew. */
+	subtract_timespecs(now, &k->last_publish_ts, &td);
+	if (td.tv_sec == 0 && td.tv_nsec < KALMAN_PUBLISH_INTERVAL_NS)
+		return 0;
+	diff = k->rate - re->estimated_rate;
+	if (fabs(diff) < KALMAN_PUBLISH_PPM * 1e-6 * re->nominal_rate)
+		return 0;
+	max_step = KALMAN_MAX_SLEW_PPM * 1e-6 * re->nominal_rate *
+		   timespec_to_sec(&td);
+	re->estimated_rate += MAX(MIN(diff, max_step), -max_step);
+	k->last_publish_ts = *now;
+	return 1;
+}
+
 void rate_estimator_destroy(struct rate_estimator *re)
 {
 	if (re)
@@ -40,7 +166,8 @@ void rate_estimator_destroy(struct rate_estimator *re)
 
 struct rate_estimator *rate_estimator_create(unsigned int rate,
 					     const struct timespec *window_size,
-					     double smooth_factor)
+					     double smooth_factor,
+					     enum RATE_ESTIMATOR_TYPE type)
 {
 	struct rate_estimator *re;
 
@@ -51,6 +178,9 @@ struct rate_estimator *rate_estimator_create(unsigned int rate,
 	re->window_size = *window_size;
 	re->estimated_rate = rate;
 	re->smooth_factor = smooth_factor;
+	re->type = type;
+	re->nominal_rate = rate;
+	kalman_init(&re->kalman, rate);
 
 	return re;
 }
@@ -65,8 +195,34 @@ double rate_estimator_get_rate(struct rate_estimator *re)
 	return re->estimated_rate;
 }
 
+double rate_estimator_get_rate_error(struct rate_estimator *re)
+{
+	const struct rate_kalman *k = &re->kalman;
+	double err;
+
+	/* The least square fit doesn't track its variance, all that is known
+	 * is the skew it is clamped to. */
+	if (re->type != RATE_ESTIMATOR_KALMAN)
+		return MAX_RATE_SKEW;
+
+	err = KALMAN_BOUND_SIGMA * sqrt(k->p11) +
+	      fabs(k->rate - re->estimated_rate);
+	return MIN(err, MAX_RATE_SKEW);
+}
+
 void rate_estimator_reset_rate(struct rate_estimator *re, unsigned int rate)
 {
+	if (re->type == RATE_ESTIMATOR_KALMAN && rate == re->nominal_rate) {
+		kalman_restart_phase(&re->kalman);
+		re->level_diff = 0;
+		re->last_level = 0;
+		return;
+	}
+
+	re->nominal_rate = rate;
+	kalman_init(&re->kalman, rate);
+	re->kalman.last_publish_ts.tv_sec = 0;
+	re->kalman.last_publish_ts.tv_nsec = 0;
 	re->estimated_rate = rate;
 	least_square_reset(&re->lsq);
 	re->window_start_ts.tv_sec = 0;
@@ -81,6 +237,9 @@ int rate_estimator_check(struct rate_estimator *re, int level,
 {
 	struct timespec td;
 
+	if (re->type == RATE_ESTIMATOR_KALMAN)
+		return kalman_check(re, level, now);
+
 	if (re->window_start_ts.tv_sec == 0) {
 		re->window_start_ts = *now;
 		return 0;
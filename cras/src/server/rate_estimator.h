@@ -8,6 +8,16 @@
 
 #include <time.h>
 
+/* Algorithms available to estimate the device rate.
+ *    RATE_ESTIMATOR_LSQ - Least square fit of the frames processed over a
+ *        window, smoothed with the previous estimate when the window ends.
+ *    RATE_ESTIMATOR_KALMAN - Kalman filter on the frames processed that
+ *        updates on every check, with the slew of the reported rate bounded.
+ */
+enum RATE_ESTIMATOR_TYPE {
+	RATE_ESTIMATOR_LSQ,
+	RATE_ESTIMATOR_KALMAN,
+};
 
 /* Hold information to calculate linear least square from
  * several (x, y) samples.
@@ -20,6 +30,33 @@ struct least_square {
 	int num_samples;
 };
 
+/* State of the Kalman filter estimator. The state vector is the phase, the
+ * number of frames processed since the filter started, and the rate. Only
+ * the difference between measured and predicted phase is kept so that the
+ * numbers don't grow with the time the device has been open.
+ * Members:
+ *    last_ts - Time of the last check, zero until the first one.
+ *    phase_err - Measured minus predicted phase, in frames.
+ *    rate - Filtered rate in frames per second.
+ *    p00, p01, p11 - The error covariance matrix.
+ *    meas_var - Variance of a phase measurement in frames squared.
+ *    rate_var - Variance of the rate random walk per second.
+ *    num_outliers - Consecutive checks rejected as outliers.
+ *    last_publish_ts - Time the reported rate last changed.
+ */
+struct rate_kalman {
+	struct timespec last_ts;
+	double phase_err;
+	double rate;
+	double p00;
+	double p01;
+	double p11;
+	double meas_var;
+	double rate_var;
+	int num_outliers;
+	struct timespec last_publish_ts;
+};
+
 /* An estimator holding the required information to determine the actual frame
  * rate of an audio device.
  * Members:
@@ -32,8 +69,13 @@ struct least_square {
  *    window_size - The size of the window.
  *    window_frames - The number of frames accumulated in current window.
  *    lsq - The helper used to estimate sample rate.
+ *    type - Which algorithm updates the estimated rate.
+ *    nominal_rate - The rate the device is configured at.
+ *    kalman - State of the Kalman filter estimator.
  */
 struct rate_estimator {
+	enum RATE_ESTIMATOR_TYPE type;
+	unsigned int nominal_rate;
 	int last_level;
 	int level_diff;
 	struct timespec window_start_ts;
@@ -42,6 +84,7 @@ struct rate_estimator {
 	struct least_square lsq;
 	double smooth_factor;
 	double estimated_rate;
+	struct rate_kalman kalman;
 };
 
 /* Creates a rate estimator.
@@ -50,10 +93,14 @@ struct rate_estimator {
  *    window_size - The window size of the rate estimator.
  *    smooth_factor - The coefficient used to calculate moving average
  *        from old estimated rate values.
+ *    type - The algorithm to use. RATE_ESTIMATOR_KALMAN ignores
+ *        smooth_factor, and treats checks further apart than window_size
+ *        as a discontinuity instead of a sample.
  */
 struct rate_estimator *rate_estimator_create(unsigned int rate,
 					     const struct timespec *window_size,
-					     double smooth_factor);
+					     double smooth_factor,
+					     enum RATE_ESTIMATOR_TYPE type);
 /* Destroy a rate estimator. */
 void rate_estimator_destroy(struct rate_estimator *re);
 
@@ -81,7 +128,12 @@ int rate_estimator_check(struct rate_estimator *re, int level,
 /* Gets the estimated rate. */
 double rate_estimator_get_rate(struct rate_estimator *re);
 
-/* Resets the estimated rate. */
+/* Gets a bound on the error of the estimated rate, in frames per second. */
+double rate_estimator_get_rate_error(struct rate_estimator *re);
+
+/* Resets the estimated rate. RATE_ESTIMATOR_KALMAN keeps the rate it has
+ * learned when |rate| is unchanged, because an underrun or a suspend
+ * doesn't change the clock of the device. */
 void rate_estimator_reset_rate(struct rate_estimator *re, unsigned int rate);
 
 #endif /* RATE_ESTIMATOR_H_ */
@@ -0,0 +1,210 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "cras_util.h"
+#include "sim_hw.h"
+
+/* Bound of the clock drift, a sound card off by more is broken. */
+#define SIM_HW_MAX_DRIFT_PPM 100000
+
+/* Mixes the bits of |x|, to derive the jitter of a period from its index
+ * without keeping state. */
+static uint32_t hash32(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+/* Seconds since start, 0 before it. */
+static double elapsed_sec(const struct sim_hw *hw, const struct timespec *now)
+{
+	struct timespec diff;
+
+	if (!timespec_after(now, &hw->start_ts))
+		return 0;
+	subtract_timespecs(now, &hw->start_ts, &diff);
+	return diff.tv_sec + diff.tv_nsec / 1000000000.0;
+}
+
+/* Position of the hardware pointer |elapsed| seconds after start. */
+static uint64_t hw_position(const struct sim_hw *hw, double elapsed)
+{
+	const struct sim_hw_params *params = &hw->params;
+	double rate = hw->rate * (1.0 + params->drift_ppm / 1000000.0);
+	uint64_t frames = elapsed * rate;
+	uint64_t period;
+	unsigned int late_us;
+
+	if (params->period_frames <= 1)
+		return frames;
+
+	/* The pointer steps at each period boundary, once the update for it
+	 * has landed. */
+	period = frames / params->period_frames;
+	if (period && params->jitter_us) {
+		late_us = hash32(params->seed ^ hash32(period)) %
+			  (params->jitter_us + 1);
+		if (elapsed < period * params->period_frames / rate +
+			      late_us / 1000000.0)
+			period--;
+	}
+	return period * params->period_frames;
+}
+
+/* Parses |str| as a whole decimal number within [min, max]. */
+static int parse_long(const char *str, long min, long max, long *value)
+{
+	char *end;
+
+	errno = 0;
+	*value = strtol(str, &end, 10);
+	if (errno || end == str || *end != '\0' ||
+	    *value < min || *value > max)
+		return -EINVAL;
+	return 0;
+}
+
+/* Like parse_long(), for values that may not fit in a long. */
+static int parse_ulong(const char *str, unsigned long max,
+		       unsigned long *value)
+{
+	char *end;
+
+	errno = 0;
+	*value = strtoul(str, &end, 10);
+	/* strtoul() accepts and negates a minus sign. */
+	if (errno || end == str || *end != '\0' || strchr(str, '-') ||
+	    *value > max)
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Exported Interface.
+ */
+
+void sim_hw_default_params(struct sim_hw_params *params)
+{
+	memset(params, 0, sizeof(*params));
+}
+
+int sim_hw_parse_params(const char *str, struct sim_hw_params *params)
+{
+	struct sim_hw_params parsed = *params;
+	char *tokens, *pair, *key, *value, *saveptr = NULL;
+	unsigned long unum;
+	long num;
+	int rc = 0;
+
+	tokens = strdup(str);
+	if (!tokens)
+		return -ENOMEM;
+
+	for (pair = strtok_r(tokens, ",", &saveptr); pair && !rc;
+	     pair = strtok_r(NULL, ",", &saveptr)) {
+		key = pair;
+		value = strchr(pair, '=');
+		if (!value) {
+			rc = -EINVAL;
+			break;
+		}
+		*value++ = '\0';
+
+		if (strcmp(key, "drift_ppm") == 0) {
+			rc = parse_long(value, -SIM_HW_MAX_DRIFT_PPM,
+					SIM_HW_MAX_DRIFT_PPM, &num);
+			parsed.drift_ppm = num;
+		} else if (strcmp(key, "period") == 0) {
+			rc = parse_long(value, 0, 1 << 20, &num);
+			parsed.period_frames = num;
+		} else if (strcmp(key, "jitter_us") == 0) {
+			rc = parse_long(value, 0, 1000000, &num);
+			parsed.jitter_us = num;
+		} else if (strcmp(key, "xrun_ms") == 0) {
+			rc = parse_long(value, 0, 3600 * 1000, &num);
+			parsed.xrun_interval_ms = num;
+		} else if (strcmp(key, "seed") == 0) {
+			rc = parse_ulong(value, UINT32_MAX, &unum);
+			parsed.seed = unum;
+		} else {
+			rc = -EINVAL;
+		}
+	}
+	free(tokens);
+
+	if (rc == 0)
+		*params = parsed;
+	return rc;
+}
+
+void sim_hw_start(struct sim_hw *hw, const struct sim_hw_params *params,
+		  enum CRAS_STREAM_DIRECTION direction, unsigned int rate,
+		  unsigned int buffer_frames, const struct timespec *now)
+{
+	unsigned int period_us;
+
+	memset(hw, 0, sizeof(*hw));
+	hw->params = *params;
+	hw->direction = direction;
+	hw->rate = rate;
+	hw->buffer_frames = buffer_frames;
+	hw->start_ts = *now;
+	hw->next_xrun_ms = params->xrun_interval_ms;
+
+	/* An update landing later than the next one isn't modeled. */
+	if (params->period_frames > 1 && rate) {
+		period_us = (uint64_t)params->period_frames * 1000000 / rate;
+		hw->params.jitter_us = MIN(params->jitter_us, period_us);
+	}
+}
+
+int sim_hw_update(struct sim_hw *hw, const struct timespec *now)
+{
+	double elapsed = elapsed_sec(hw, now);
+	uint64_t pos;
+
+	pos = hw_position(hw, elapsed);
+	if (pos > hw->hw_ptr)
+		hw->hw_ptr = pos;
+
+	if (hw->next_xrun_ms && elapsed * 1000 >= hw->next_xrun_ms) {
+		hw->next_xrun_ms = ((uint64_t)(elapsed * 1000) /
+				    hw->params.xrun_interval_ms + 1) *
+				   hw->params.xrun_interval_ms;
+		hw->num_injected++;
+		hw->appl_ptr = hw->hw_ptr;
+		return -EPIPE;
+	}
+
+	if (hw->direction == CRAS_STREAM_OUTPUT) {
+		/* Ran out of audio, silence was played. */
+		if (hw->hw_ptr > hw->appl_ptr) {
+			hw->num_underruns++;
+			hw->appl_ptr = hw->hw_ptr;
+		}
+	} else {
+		/* Wrapped over audio not read yet. */
+		if (hw->hw_ptr - hw->appl_ptr > hw->buffer_frames) {
+			hw->num_underruns++;
+			hw->appl_ptr = hw->hw_ptr - hw->buffer_frames;
+		}
+	}
+
+	return sim_hw_level(hw);
+}
+
+void sim_hw_commit(struct sim_hw *hw, unsigned int frames)
+{
+	hw->appl_ptr += MIN(frames, sim_hw_avail(hw));
+}
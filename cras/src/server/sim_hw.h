@@ -0,0 +1,124 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Model of the DMA engine of a sound card, for running the audio thread
+ * against realistic hardware timing without hardware. The device clock runs
+ * off nominal by a set drift, the hardware pointer moves in whole periods
+ * as when updated from the period interrupt, each update lands late by a
+ * pseudo random amount, and xruns are injected at a fixed interval. The
+ * position is a function of the time given only, so a run is reproducible
+ * for the same parameters, seed and query times.
+ */
+#ifndef SIM_HW_H_
+#define SIM_HW_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "cras_types.h"
+
+/* Parameters of the simulated hardware.
+ * Members:
+ *    drift_ppm - Error of the device clock in parts per million, positive
+ *        when it runs fast.
+ *    period_frames - The hardware pointer moves in steps of this many
+ *        frames. 0 or 1 for a pointer accurate to the frame.
+ *    jitter_us - Each pointer step lands late by up to this long, at most
+ *        a period.
+ *    xrun_interval_ms - Inject an xrun this often, 0 for never.
+ *    seed - Seed of the pseudo random jitter.
+ */
+struct sim_hw_params {
+	int drift_ppm;
+	unsigned int period_frames;
+	unsigned int jitter_us;
+	unsigned int xrun_interval_ms;
+	unsigned int seed;
+};
+
+/* Members:
+ *    params - The parameters the model runs with.
+ *    direction - Playback or capture.
+ *    rate - Nominal frame rate of the device.
+ *    buffer_frames - Size of the hardware buffer.
+ *    start_ts - Time the device started.
+ *    hw_ptr - Frames played or captured by the device since start.
+ *    appl_ptr - Frames written or read by the application since start.
+ *    next_xrun_ms - Time since start of the next xrun to inject.
+ *    num_underruns - Times playback ran out of audio, or capture
+ *        overwrote audio not read yet.
+ *    num_injected - Xruns injected.
+ */
+struct sim_hw {
+	struct sim_hw_params params;
+	enum CRAS_STREAM_DIRECTION direction;
+	unsigned int rate;
+	unsigned int buffer_frames;
+	struct timespec start_ts;
+	uint64_t hw_ptr;
+	uint64_t appl_ptr;
+	uint64_t next_xrun_ms;
+	unsigned int num_underruns;
+	unsigned int num_injected;
+};
+
+/* Fills |params| with an ideal device: no drift, no jitter, no xrun and a
+ * pointer accurate to the frame. */
+void sim_hw_default_params(struct sim_hw_params *params);
+
+/* Parses a comma separated list of key=value pairs into |params|. Keys are
+ * drift_ppm, period, jitter_us, xrun_ms and seed. Keys not given keep their
+ * value in |params|.
+ * Returns:
+ *    0 on success, -EINVAL if a key or value is invalid.
+ */
+int sim_hw_parse_params(const char *str, struct sim_hw_params *params);
+
+/* Starts the device with an empty buffer.
+ * Args:
+ *    hw - The model.
+ *    params - The parameters to run with.
+ *    direction - Playback or capture.
+ *    rate - Nominal frame rate.
+ *    buffer_frames - Size of the hardware buffer.
+ *    now - The current time.
+ */
+void sim_hw_start(struct sim_hw *hw, const struct sim_hw_params *params,
+		  enum CRAS_STREAM_DIRECTION direction, unsigned int rate,
+		  unsigned int buffer_frames, const struct timespec *now);
+
+/* Advances the device to |now|. Playback that ran out of audio plays
+ * silence, and capture that overran drops the oldest audio, each counted as
+ * an underrun.
+ * Returns:
+ *    The frames queued for playback or captured, or -EPIPE when an xrun is
+ *    injected. The buffer is emptied on an injected xrun.
+ */
+int sim_hw_update(struct sim_hw *hw, const struct timespec *now);
+
+/* Returns the frames queued for playback or captured, as of the last
+ * update. */
+static inline unsigned int sim_hw_level(const struct sim_hw *hw)
+{
+	if (hw->direction == CRAS_STREAM_OUTPUT)
+		return hw->appl_ptr - hw->hw_ptr;
+	return hw->hw_ptr - hw->appl_ptr;
+}
+
+/* Returns the frames that can be written for playback, or read from
+ * capture, as of the last update. */
+static inline unsigned int sim_hw_avail(const struct sim_hw *hw)
+{
+	if (hw->direction == CRAS_STREAM_OUTPUT)
+		return hw->buffer_frames - sim_hw_level(hw);
+	return sim_hw_level(hw);
+}
+
+/* Accounts |frames| written for playback or read from capture, at most
+ * sim_hw_avail. */
+void sim_hw_commit(struct sim_hw *hw, unsigned int frames);
+
+#endif /* SIM_HW_H_ */
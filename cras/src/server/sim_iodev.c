@@ -0,0 +1,293 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "cras_audio_area.h"
+#include "cras_iodev.h"
+#include "cras_iodev_list.h"
+#include "cras_messages.h"
+#include "cras_types.h"
+#include "cras_util.h"
+#include "sim_hw.h"
+#include "sim_iodev.h"
+#include "utlist.h"
+
+#define SIM_BUFFER_FRAMES 8192
+
+static size_t sim_supported_rates[] = {
+	44100, 48000, 0
+};
+
+static size_t sim_supported_channel_counts[] = {
+	1, 2, 0
+};
+
+static snd_pcm_format_t sim_supported_formats[] = {
+	SND_PCM_FORMAT_S16_LE,
+	SND_PCM_FORMAT_S32_LE,
+	0
+};
+
+/* Members:
+ *    base - The iodev.
+ *    hw - Model of the hardware while open.
+ *    params - Parameters the model starts with at the next open.
+ *    audio_buffer - Scratch for the audio played or captured.
+ *    num_underruns - Underruns of the closed runs of the device.
+ *    num_severe_underruns - Xruns injected in the closed runs.
+ */
+struct sim_iodev {
+	struct cras_iodev base;
+	struct sim_hw hw;
+	struct sim_hw_params params;
+	uint8_t *audio_buffer;
+	unsigned int num_underruns;
+	unsigned int num_severe_underruns;
+	struct sim_iodev *prev, *next;
+};
+
+/* The simulated devices, to tell them from other test devices. */
+static struct sim_iodev *sim_iodevs;
+
+/*
+ * iodev callbacks.
+ */
+
+static int frames_queued(const struct cras_iodev *iodev,
+			 struct timespec *tstamp)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, tstamp);
+	return sim_hw_update(&simio->hw, tstamp);
+}
+
+static int delay_frames(const struct cras_iodev *iodev)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+
+	return sim_hw_level(&simio->hw);
+}
+
+static int close_dev(struct cras_iodev *iodev)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+
+	syslog(LOG_DEBUG, "%s: %u underruns, %u xruns injected",
+	       iodev->info.name, simio->hw.num_underruns,
+	       simio->hw.num_injected);
+	simio->num_underruns += simio->hw.num_underruns;
+	simio->num_severe_underruns += simio->hw.num_injected;
+	memset(&simio->hw, 0, sizeof(simio->hw));
+
+	free(simio->audio_buffer);
+	simio->audio_buffer = NULL;
+	cras_iodev_free_audio_area(iodev);
+	return 0;
+}
+
+static int configure_dev(struct cras_iodev *iodev)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+	struct timespec now;
+
+	if (iodev->format == NULL)
+		return -EINVAL;
+
+	simio->audio_buffer = calloc(SIM_BUFFER_FRAMES,
+				     cras_get_format_bytes(iodev->format));
+	if (!simio->audio_buffer)
+		return -ENOMEM;
+	cras_iodev_init_audio_area(iodev, iodev->format->num_channels);
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	sim_hw_start(&simio->hw, &simio->params, iodev->direction,
+		     iodev->format->frame_rate, SIM_BUFFER_FRAMES, &now);
+	return 0;
+}
+
+static int get_buffer(struct cras_iodev *iodev,
+		      struct cras_audio_area **area,
+		      unsigned *frames)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+
+	*frames = MIN(*frames, sim_hw_avail(&simio->hw));
+
+	iodev->area->frames = *frames;
+	cras_audio_area_config_buf_pointers(iodev->area, iodev->format,
+					    simio->audio_buffer);
+	*area = iodev->area;
+	return 0;
+}
+
+static int put_buffer(struct cras_iodev *iodev, unsigned frames)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+
+	sim_hw_commit(&simio->hw, frames);
+	return 0;
+}
+
+static int flush_buffer(struct cras_iodev *iodev)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+	unsigned int frames;
+
+	if (iodev->direction != CRAS_STREAM_INPUT)
+		return 0;
+
+	frames = sim_hw_level(&simio->hw);
+	sim_hw_commit(&simio->hw, frames);
+	return frames;
+}
+
+static void update_active_node(struct cras_iodev *iodev, unsigned node_idx,
+			       unsigned dev_enabled)
+{
+}
+
+static unsigned int get_num_underruns(const struct cras_iodev *iodev)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+
+	return simio->num_underruns + simio->hw.num_underruns;
+}
+
+static unsigned int get_num_severe_underruns(const struct cras_iodev *iodev)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+
+	return simio->num_severe_underruns + simio->hw.num_injected;
+}
+
+/* Sets the parameters of the model from a key=value list, applied at the
+ * next open of the device. */
+static int set_params(struct sim_iodev *simio, unsigned int data_len,
+		      const uint8_t *data)
+{
+	char params[CRAS_MAX_TEST_DATA_LEN + 1];
+	int rc;
+
+	if (data_len > CRAS_MAX_TEST_DATA_LEN)
+		return -EINVAL;
+	memcpy(params, data, data_len);
+	params[data_len] = '\0';
+
+	rc = sim_hw_parse_params(params, &simio->params);
+	if (rc) {
+		syslog(LOG_ERR, "Invalid sim device params: %s", params);
+		return rc;
+	}
+	syslog(LOG_DEBUG,
+	       "%s: drift %dppm, period %u, jitter %uus, xrun every %ums",
+	       simio->base.info.name, simio->params.drift_ppm,
+	       simio->params.period_frames, simio->params.jitter_us,
+	       simio->params.xrun_interval_ms);
+	return 0;
+}
+
+/*
+ * Exported Interface.
+ */
+
+struct cras_iodev *sim_iodev_create(enum CRAS_STREAM_DIRECTION direction)
+{
+	struct sim_iodev *simio;
+	struct cras_iodev *iodev;
+	struct cras_ionode *node;
+
+	if (direction != CRAS_STREAM_INPUT && direction != CRAS_STREAM_OUTPUT)
+		return NULL;
+
+	simio = calloc(1, sizeof(*simio));
+	if (simio == NULL)
+		return NULL;
+	iodev = &simio->base;
+	iodev->direction = direction;
+	sim_hw_default_params(&simio->params);
+
+	iodev->supported_rates = sim_supported_rates;
+	iodev->supported_channel_counts = sim_supported_channel_counts;
+	iodev->supported_formats = sim_supported_formats;
+	iodev->buffer_size = SIM_BUFFER_FRAMES;
+
+	iodev->configure_dev = configure_dev;
+	iodev->close_dev = close_dev;
+	iodev->frames_queued = frames_queued;
+	iodev->delay_frames = delay_frames;
+	iodev->get_buffer = get_buffer;
+	iodev->put_buffer = put_buffer;
+	iodev->flush_buffer = flush_buffer;
+	iodev->update_active_node = update_active_node;
+	iodev->get_num_underruns = get_num_underruns;
+	iodev->get_num_severe_underruns = get_num_severe_underruns;
+	if (direction == CRAS_STREAM_OUTPUT)
+		iodev->no_stream = cras_iodev_default_no_stream_playback;
+
+	/* Create a dummy ionode */
+	node = (struct cras_ionode *)calloc(1, sizeof(*node));
+	node->dev = iodev;
+	node->plugged = 1;
+	node->type = CRAS_NODE_TYPE_UNKNOWN;
+	node->volume = 100;
+	strcpy(node->name, "(default)");
+	cras_iodev_add_node(iodev, node);
+	cras_iodev_set_active_node(iodev, node);
+
+	/* Finally add it to the appropriate iodev list. */
+	snprintf(iodev->info.name, ARRAY_SIZE(iodev->info.name),
+		 "Simulated %s device",
+		 direction == CRAS_STREAM_INPUT ? "capture" : "playback");
+	iodev->info.name[ARRAY_SIZE(iodev->info.name) - 1] = '\0';
+	if (direction == CRAS_STREAM_INPUT)
+		cras_iodev_list_add_input(iodev);
+	else
+		cras_iodev_list_add_output(iodev);
+	DL_APPEND(sim_iodevs, simio);
+
+	return iodev;
+}
+
+void sim_iodev_destroy(struct cras_iodev *iodev)
+{
+	struct sim_iodev *simio = (struct sim_iodev *)iodev;
+
+	DL_DELETE(sim_iodevs, simio);
+	if (iodev->direction == CRAS_STREAM_INPUT)
+		cras_iodev_list_rm_input(iodev);
+	else
+		cras_iodev_list_rm_output(iodev);
+	free(iodev->active_node);
+	cras_iodev_free_resources(iodev);
+	free(simio);
+}
+
+int sim_iodev_command(struct cras_iodev *iodev,
+		      enum CRAS_TEST_IODEV_CMD command,
+		      unsigned int data_len,
+		      const uint8_t *data)
+{
+	struct sim_iodev *simio;
+
+	DL_FOREACH(sim_iodevs, simio)
+		if (&simio->base == iodev)
+			break;
+	if (!simio)
+		return -ENODEV;
+
+	switch (command) {
+	case TEST_IODEV_CMD_SIM_CONFIG:
+		return set_params(simio, data_len, data);
+	default:
+		return -EINVAL;
+	}
+}
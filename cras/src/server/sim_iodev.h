@@ -0,0 +1,37 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef SIM_IODEV_H_
+#define SIM_IODEV_H_
+
+#include "cras_types.h"
+
+struct cras_iodev;
+
+/* Initializes a simulated hardware iodev. The device discards what is
+ * played and captures silence, with the timing of a sound card as modeled
+ * by sim_hw. It starts as an ideal device, TEST_IODEV_CMD_SIM_CONFIG sets
+ * the drift, jitter and faults it runs with.
+ * Args:
+ *    direction - input or output.
+ * Returns:
+ *    A pointer to the newly created iodev if successful, NULL otherwise.
+ */
+struct cras_iodev *sim_iodev_create(enum CRAS_STREAM_DIRECTION direction);
+
+/* Destroys a sim_iodev created with sim_iodev_create. */
+void sim_iodev_destroy(struct cras_iodev *iodev);
+
+/* Handles a test command to the given iodev.
+ * Returns:
+ *    0 on success, -ENODEV if |iodev| isn't a simulated device, -EINVAL if
+ *    the command or its data is invalid.
+ */
+int sim_iodev_command(struct cras_iodev *iodev,
+		      enum CRAS_TEST_IODEV_CMD command,
+		      unsigned int data_len,
+		      const uint8_t *data);
+
+#endif /* SIM_IODEV_H_ */
@@ -25,6 +25,7 @@ static uint8_t codec_create_blocks_val;
 static uint8_t codec_create_bitpool_val;
 static int cras_sbc_get_frame_length_val;
 static int cras_sbc_get_codesize_val;
+static uint8_t cras_sbc_set_bitpool_val;
 static size_t a2dp_write_link_mtu_val;
 static size_t encode_out_encoded_return_val;
 static struct cras_audio_codec *sbc_codec;
@@ -124,6 +125,18 @@ TEST(A2dpInfoInit, DrainA2dp) {
   destroy_a2dp(&a2dp);
 }
 
+TEST(A2dpInfoInit, SetBitpool) {
+  ResetStubData();
+  init_a2dp(&a2dp, &sbc);
+
+  a2dp_set_bitpool(&a2dp, 35);
+  EXPECT_EQ(35, cras_sbc_set_bitpool_val);
+  EXPECT_EQ(83, a2dp.frame_length);
+  EXPECT_EQ(800 / 83 * 5, a2dp_block_size(&a2dp, 800));
+
+  destroy_a2dp(&a2dp);
+}
+
 TEST(A2dpEncode, WriteA2dp) {
   unsigned int processed;
 
@@ -209,3 +222,10 @@ int cras_sbc_get_frame_length(struct cras_audio_codec *codec)
 {
   return cras_sbc_get_frame_length_val;
 }
+
+void cras_sbc_set_bitpool(struct cras_audio_codec *codec, uint8_t bitpool)
+{
+  cras_sbc_set_bitpool_val = bitpool;
+  // Frame length of 8 subbands, 16 blocks joint stereo.
+  cras_sbc_get_frame_length_val = 4 + 8 + (8 + 16 * bitpool + 7) / 8;
+}
@@ -2,8 +2,12 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <gtest/gtest.h>
 
 extern "C" {
@@ -52,6 +56,12 @@ static void *write_callback_data;
 static const char *fake_device_name = "fake device name";
 static const char *cras_bt_device_name_ret;
 static unsigned int cras_bt_transport_write_mtu_ret;
+static int a2dp_codesize_val;
+static uint8_t a2dp_config_max_bitpool;
+static unsigned int a2dp_set_bitpool_val;
+static int setsockopt_sndbuf_val;
+static int ioctl_outq_ret;
+static int ioctl_outq_val;
 
 void ResetStubData() {
   cras_bt_device_append_iodev_called = 0;
@@ -75,6 +85,12 @@ void ResetStubData() {
   a2dp_encode_index = 0;
   a2dp_write_index = 0;
   cras_bt_transport_write_mtu_ret = 800;
+  a2dp_codesize_val = 512;
+  a2dp_config_max_bitpool = 53;
+  a2dp_set_bitpool_val = 0;
+  setsockopt_sndbuf_val = 0;
+  ioctl_outq_ret = -1;
+  ioctl_outq_val = 0;
 
   fake_transport = reinterpret_cast<struct cras_bt_transport *>(0x123);
 
@@ -244,6 +260,95 @@ TEST_F(A2dpIodev, GetPutBuffer) {
   a2dp_iodev_destroy(iodev);
 }
 
+TEST_F(A2dpIodev, BufferHoldsWholeBlocks) {
+  struct cras_iodev *iodev;
+
+  iodev = a2dp_iodev_create(fake_transport);
+  iodev_set_format(iodev, &format);
+
+  iodev->configure_dev(iodev);
+  EXPECT_EQ(4096 * 4, iodev->buffer_size);
+  iodev->close_dev(iodev);
+
+  // 8 subbands, 12 blocks of stereo doesn't divide the buffer.
+  a2dp_codesize_val = 384;
+  iodev->configure_dev(iodev);
+  EXPECT_EQ(65536 / 384 * 384 / 4, iodev->buffer_size);
+  iodev->close_dev(iodev);
+
+  a2dp_iodev_destroy(iodev);
+}
+
+TEST_F(A2dpIodev, AdaptBitpoolToLink) {
+  struct cras_iodev *iodev;
+
+  iodev = a2dp_iodev_create(fake_transport);
+  iodev_set_format(iodev, &format);
+  time_now.tv_sec = 1;
+  time_now.tv_nsec = 0;
+
+  iodev->configure_dev(iodev);
+  ASSERT_NE(write_callback, (void *)NULL);
+  EXPECT_EQ(53, a2dp_set_bitpool_val);
+  EXPECT_EQ(400, iodev->min_buffer_level);
+
+  // Writes keep failing for longer than a controller window.
+  for (int i = 0; i < 3; i++) {
+    time_now.tv_nsec = i * 300000000;
+    a2dp_write_index = 0;
+    a2dp_write_return_val[0] = -EAGAIN;
+    write_callback(write_callback_data);
+  }
+  EXPECT_EQ(53 * 3 / 4, a2dp_set_bitpool_val);
+  // The socket queue deepens by an MTU.
+  EXPECT_EQ(600, iodev->min_buffer_level);
+
+  iodev->close_dev(iodev);
+  a2dp_iodev_destroy(iodev);
+}
+
+TEST_F(A2dpIodev, AdaptToSendQueueFreeSpace) {
+  struct cras_iodev *iodev;
+
+  iodev = a2dp_iodev_create(fake_transport);
+  iodev_set_format(iodev, &format);
+  time_now.tv_sec = 1;
+  time_now.tv_nsec = 0;
+
+  // Two MTUs, the kernel doubles it for bookkeeping.
+  iodev->configure_dev(iodev);
+  EXPECT_EQ(1600, setsockopt_sndbuf_val);
+
+  // Writes go through, but only 400 of the 3200 bytes of the send buffer
+  // are free. That's 2800 bytes queued, over three quarters full.
+  ioctl_outq_ret = 0;
+  ioctl_outq_val = 400;
+  for (int i = 0; i < 3; i++) {
+    time_now.tv_nsec = i * 300000000;
+    a2dp_write_index = 0;
+    a2dp_write_return_val[0] = 800;
+    write_callback(write_callback_data);
+  }
+  EXPECT_EQ(53 * 3 / 4, a2dp_set_bitpool_val);
+  EXPECT_EQ(2400, setsockopt_sndbuf_val);
+
+  // A send buffer that is all free is a clean link.
+  a2dp_set_bitpool_val = 0;
+  ioctl_outq_val = 4800;
+  for (int i = 0; i < 3; i++) {
+    time_now.tv_sec = 2;
+    time_now.tv_nsec = i * 300000000;
+    a2dp_write_index = 0;
+    a2dp_write_return_val[0] = 800;
+    write_callback(write_callback_data);
+  }
+  EXPECT_EQ(0, a2dp_set_bitpool_val);
+  EXPECT_EQ(2400, setsockopt_sndbuf_val);
+
+  iodev->close_dev(iodev);
+  a2dp_iodev_destroy(iodev);
+}
+
 TEST_F(A2dpIodev, FramesQueued) {
   struct cras_iodev *iodev;
   struct cras_audio_area *area;
@@ -375,7 +480,12 @@ extern "C" {
 int cras_bt_transport_configuration(const struct cras_bt_transport *transport,
                                     void *configuration, int len)
 {
+  a2dp_sbc_t *sbc = (a2dp_sbc_t *)configuration;
+
   cras_bt_transport_configuration_called++;
+  memset(sbc, 0, len);
+  sbc->min_bitpool = 2;
+  sbc->max_bitpool = a2dp_config_max_bitpool;
   return 0;
 }
 
@@ -509,7 +619,12 @@ void destroy_a2dp(struct a2dp_info *a2dp)
 
 int a2dp_codesize(struct a2dp_info *a2dp)
 {
-  return 512;
+  return a2dp_codesize_val;
+}
+
+void a2dp_set_bitpool(struct a2dp_info *a2dp, unsigned int bitpool)
+{
+  a2dp_set_bitpool_val = bitpool;
 }
 
 int a2dp_block_size(struct a2dp_info *a2dp, int encoded_bytes)
@@ -551,6 +666,35 @@ int clock_gettime(clockid_t clk_id, struct timespec *tp) {
   return 0;
 }
 
+int setsockopt(int sockfd, int level, int optname, const void *optval,
+               socklen_t optlen) {
+  if (level == SOL_SOCKET && optname == SO_SNDBUF)
+    setsockopt_sndbuf_val = *(const int *)optval;
+  return 0;
+}
+
+int getsockopt(int sockfd, int level, int optname, void *optval,
+               socklen_t *optlen) {
+  if (level != SOL_SOCKET || optname != SO_SNDBUF)
+    return -1;
+  *(int *)optval = setsockopt_sndbuf_val * 2;
+  return 0;
+}
+
+// On bluetooth sockets SIOCOUTQ returns the free space in the send buffer.
+int ioctl(int fd, unsigned long request, ...) {
+  va_list ap;
+  int *arg;
+
+  if (request != SIOCOUTQ)
+    return -1;
+  va_start(ap, request);
+  arg = va_arg(ap, int *);
+  va_end(ap);
+  *arg = ioctl_outq_val;
+  return ioctl_outq_ret;
+}
+
 void cras_iodev_init_audio_area(struct cras_iodev *iodev,
                                 int num_channels) {
   iodev->area = dummy_audio_area;
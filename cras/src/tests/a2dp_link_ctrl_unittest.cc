@@ -0,0 +1,219 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+#include <unistd.h>
+
+extern "C" {
+#include "a2dp_link_ctrl.h"
+}
+
+namespace {
+
+static const unsigned int kMtu = 895;
+static const unsigned int kTickMs = 10;
+// SBC frames per second at 44.1kHz, 8 subbands and 16 blocks.
+static const double kFramesPerSec = 44100.0 / 128;
+
+// Length of a joint stereo SBC frame with 8 subbands and 16 blocks.
+static unsigned int FrameLength(unsigned int bitpool) {
+  return 4 + 8 + (8 + 16 * bitpool + 7) / 8;
+}
+
+static void AddMs(struct timespec *ts, unsigned int ms) {
+  ts->tv_nsec += ms * 1000000;
+  while (ts->tv_nsec >= 1000000000) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+class A2dpLinkCtrlTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      now_.tv_sec = 1;
+      now_.tv_nsec = 0;
+      a2dp_link_ctrl_init(&ctrl_, 18, 53, 2 * kMtu, 6 * kMtu, kMtu);
+    }
+
+    struct a2dp_link_ctrl ctrl_;
+    struct timespec now_;
+};
+
+TEST_F(A2dpLinkCtrlTestSuite, BackOffAndRecover) {
+  unsigned int i;
+
+  EXPECT_EQ(53, ctrl_.bitpool);
+  EXPECT_EQ(2 * kMtu, ctrl_.queue_target);
+
+  // A window with every write failing cuts the bitpool by a quarter and
+  // deepens the queue.
+  EXPECT_EQ(0, a2dp_link_ctrl_update(&ctrl_, 1, 900, 1000, &now_));
+  AddMs(&now_, 500);
+  EXPECT_EQ(1, a2dp_link_ctrl_update(&ctrl_, 1, 900, 1000, &now_));
+  EXPECT_EQ(39, ctrl_.bitpool);
+  EXPECT_EQ(3 * kMtu, ctrl_.queue_target);
+
+  // A queue staying full counts as congestion too, down to the floor.
+  for (i = 0; i < 10; i++) {
+    AddMs(&now_, 500);
+    a2dp_link_ctrl_update(&ctrl_, 0, 800, 1000, &now_);
+  }
+  EXPECT_EQ(18, ctrl_.bitpool);
+  EXPECT_EQ(6 * kMtu, ctrl_.queue_target);
+
+  // Half full is neither congested nor clean, nothing moves.
+  for (i = 0; i < 20; i++) {
+    AddMs(&now_, 500);
+    EXPECT_EQ(0, a2dp_link_ctrl_update(&ctrl_, 0, 600, 1000, &now_));
+  }
+
+  // Quality comes back a step per clean period.
+  for (i = 0; i < 7; i++) {
+    AddMs(&now_, 500);
+    EXPECT_EQ(0, a2dp_link_ctrl_update(&ctrl_, 0, 100, 1000, &now_));
+  }
+  AddMs(&now_, 500);
+  EXPECT_EQ(1, a2dp_link_ctrl_update(&ctrl_, 0, 100, 1000, &now_));
+  EXPECT_EQ(22, ctrl_.bitpool);
+  EXPECT_EQ(5 * kMtu, ctrl_.queue_target);
+
+  for (i = 0; i < 8 * 10; i++) {
+    AddMs(&now_, 500);
+    a2dp_link_ctrl_update(&ctrl_, 0, 100, 1000, &now_);
+  }
+  EXPECT_EQ(53, ctrl_.bitpool);
+  EXPECT_EQ(2 * kMtu, ctrl_.queue_target);
+}
+
+// Streams SBC packets over a socket pair standing in for the L2CAP link.
+// The sender writes without blocking and feeds the results to the
+// controller, the far end drains at the rate the link can carry.
+class LinkSimulation {
+  public:
+    LinkSimulation(struct a2dp_link_ctrl *ctrl, struct timespec *now)
+        : ctrl_(ctrl), now_(now), frames_(0), link_budget_(0),
+          backlog_(0), dropped_(0), eagain_(0) {
+      EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds_));
+      SetQueue();
+    }
+
+    ~LinkSimulation() {
+      close(fds_[0]);
+      close(fds_[1]);
+    }
+
+    // Runs |ms| milliseconds with the link carrying |bytes_per_sec|.
+    void Run(unsigned int ms, unsigned int bytes_per_sec) {
+      uint8_t buf[kMtu];
+      unsigned int t;
+      int rc;
+
+      dropped_ = 0;
+      eagain_ = 0;
+      for (t = 0; t < ms; t += kTickMs) {
+        AddMs(now_, kTickMs);
+
+        // The far end takes what the link carried in this tick.
+        link_budget_ += bytes_per_sec * kTickMs / 1000;
+        while (link_budget_ > 0) {
+          rc = recv(fds_[1], buf, sizeof(buf), MSG_DONTWAIT);
+          if (rc <= 0) {
+            link_budget_ = 0;
+            break;
+          }
+          link_budget_ -= rc;
+        }
+
+        // Audio keeps coming, more than 200ms of it behind is lost.
+        frames_ += kFramesPerSec * kTickMs / 1000;
+        while (frames_ >= FramesPerPacket()) {
+          frames_ -= FramesPerPacket();
+          if (++backlog_ > 20) {
+            backlog_--;
+            dropped_++;
+          }
+        }
+        while (backlog_ && Send())
+          backlog_--;
+      }
+    }
+
+    unsigned int dropped() const { return dropped_; }
+    unsigned int eagain() const { return eagain_; }
+
+  private:
+    unsigned int FramesPerPacket() {
+      return (kMtu - 13) / FrameLength(ctrl_->bitpool);
+    }
+
+    void SetQueue() {
+      int depth = ctrl_->queue_target;
+      socklen_t len = sizeof(sndbuf_);
+
+      setsockopt(fds_[0], SOL_SOCKET, SO_SNDBUF, &depth, sizeof(depth));
+      getsockopt(fds_[0], SOL_SOCKET, SO_SNDBUF, &sndbuf_, &len);
+    }
+
+    // Sends one packet, returns false if the socket is full.
+    bool Send() {
+      uint8_t buf[kMtu] = { 0 };
+      int outq = 0, rc;
+
+      rc = send(fds_[0], buf, 13 + FramesPerPacket() *
+                FrameLength(ctrl_->bitpool), MSG_DONTWAIT);
+      if (rc < 0) {
+        EXPECT_EQ(EAGAIN, errno);
+        eagain_++;
+      }
+      ioctl(fds_[0], SIOCOUTQ, &outq);
+      if (a2dp_link_ctrl_update(ctrl_, rc < 0, outq, sndbuf_, now_))
+        SetQueue();
+      return rc >= 0;
+    }
+
+    struct a2dp_link_ctrl *ctrl_;
+    struct timespec *now_;
+    int fds_[2];
+    int sndbuf_;
+    double frames_;
+    int link_budget_;
+    unsigned int backlog_;
+    unsigned int dropped_;
+    unsigned int eagain_;
+};
+
+TEST_F(A2dpLinkCtrlTestSuite, SimulatedLink) {
+  LinkSimulation link(&ctrl_, &now_);
+
+  // A good link carries the best quality without loss.
+  link.Run(5000, 100000);
+  EXPECT_EQ(53, ctrl_.bitpool);
+  EXPECT_EQ(0, link.dropped());
+
+  // 33kB/s can't carry bitpool 53 at 41kB/s. The bitpool is cut, and after
+  // settling the audio goes through.
+  link.Run(10000, 33000);
+  EXPECT_GT(53, ctrl_.bitpool);
+  link.Run(10000, 33000);
+  EXPECT_GE(43, ctrl_.bitpool);
+  EXPECT_EQ(0, link.dropped());
+
+  // Quality and latency recover with the link.
+  link.Run(60000, 100000);
+  EXPECT_EQ(53, ctrl_.bitpool);
+  EXPECT_EQ(2 * kMtu, ctrl_.queue_target);
+  EXPECT_EQ(0, link.dropped());
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -147,6 +147,7 @@ static int cras_iodev_buffer_avail_ret;
 static int cras_alsa_resume_appl_ptr_called;
 static int cras_alsa_resume_appl_ptr_ahead;
 static int ucm_get_enable_htimestamp_flag_ret;
+static int ucm_get_kalman_rate_estimator_flag_ret;
 static const struct cras_volume_curve *fake_get_dBFS_volume_curve_val;
 static int cras_iodev_dsp_set_swap_mode_for_node_called;
 static std::map<std::string, long> ucm_get_default_node_gain_values;
@@ -239,6 +240,7 @@ void ResetStubData() {
   cras_alsa_resume_appl_ptr_called = 0;
   cras_alsa_resume_appl_ptr_ahead = 0;
   ucm_get_enable_htimestamp_flag_ret = 0;
+  ucm_get_kalman_rate_estimator_flag_ret = 0;
   fake_get_dBFS_volume_curve_val = NULL;
   cras_iodev_dsp_set_swap_mode_for_node_called = 0;
   ucm_get_default_node_gain_values.clear();
@@ -2402,6 +2404,15 @@ int cras_alsa_get_delay_frames(snd_pcm_t *handle, snd_pcm_uframes_t buf_size,
   *delay = 0;
   return 0;
 }
+int cras_alsa_get_delay_frames_tstamp(snd_pcm_t *handle,
+				      snd_pcm_uframes_t buf_size,
+				      snd_pcm_sframes_t *delay,
+				      struct timespec *tstamp)
+{
+  *delay = 0;
+  clock_gettime(CLOCK_MONOTONIC_RAW, tstamp);
+  return 0;
+}
 int cras_alsa_mmap_begin(snd_pcm_t *handle, unsigned int format_bytes,
 			 uint8_t **dst, snd_pcm_uframes_t *offset,
 			 snd_pcm_uframes_t *frames)
@@ -2415,6 +2426,13 @@ int cras_alsa_mmap_commit(snd_pcm_t *handle, snd_pcm_uframes_t offset,
 {
   return 0;
 }
+int cras_alsa_mmap_begin_ring(snd_pcm_t *handle, snd_pcm_uframes_t *offset,
+			      snd_pcm_uframes_t *avail)
+{
+  *offset = 0;
+  *avail = cras_alsa_mmap_begin_frames;
+  return 0;
+}
 int cras_alsa_attempt_resume(snd_pcm_t *handle)
 {
   cras_alsa_attempt_resume_called++;
@@ -2737,6 +2755,36 @@ unsigned int ucm_get_enable_htimestamp_flag(struct cras_use_case_mgr *mgr)
   return ucm_get_enable_htimestamp_flag_ret;
 }
 
+unsigned int ucm_get_kalman_rate_estimator_flag(struct cras_use_case_mgr *mgr)
+{
+  return ucm_get_kalman_rate_estimator_flag_ret;
+}
+
+unsigned int ucm_get_timer_scheduling_flag(struct cras_use_case_mgr *mgr)
+{
+  return 0;
+}
+
+unsigned int ucm_get_adaptive_watermark_flag(struct cras_use_case_mgr *mgr)
+{
+  return 0;
+}
+
+unsigned int ucm_get_batched_mmap_flag(struct cras_use_case_mgr *mgr)
+{
+  return 0;
+}
+
+unsigned int ucm_get_deep_buffer_flag(struct cras_use_case_mgr *mgr)
+{
+  return 0;
+}
+
+double cras_iodev_get_est_rate_ratio(const struct cras_iodev *iodev)
+{
+  return 1.0;
+}
+
 unsigned int ucm_get_disable_software_volume(struct cras_use_case_mgr *mgr)
 {
   return 0;
@@ -899,6 +899,60 @@ TEST(AlsaUcm, EnableHtimestampFlag) {
   ASSERT_FALSE(enable_htimestamp_flag);
 }
 
+TEST(AlsaUcm, KalmanRateEstimatorFlag) {
+  struct cras_use_case_mgr *mgr = &cras_ucm_mgr;
+  std::string id = "=KalmanRateEstimator//HiFi";
+  ResetStubData();
+
+  EXPECT_EQ(0, ucm_get_kalman_rate_estimator_flag(mgr));
+  snd_use_case_get_value[id] = std::string("1");
+  EXPECT_EQ(1, ucm_get_kalman_rate_estimator_flag(mgr));
+  snd_use_case_get_value[id] = std::string("0");
+  EXPECT_EQ(0, ucm_get_kalman_rate_estimator_flag(mgr));
+}
+
+TEST(AlsaUcm, TimerSchedulingFlag) {
+  struct cras_use_case_mgr *mgr = &cras_ucm_mgr;
+  std::string id = "=TimerScheduling//HiFi";
+  ResetStubData();
+
+  EXPECT_EQ(0, ucm_get_timer_scheduling_flag(mgr));
+  snd_use_case_get_value[id] = std::string("1");
+  EXPECT_EQ(1, ucm_get_timer_scheduling_flag(mgr));
+  snd_use_case_get_value[id] = std::string("0");
+  EXPECT_EQ(0, ucm_get_timer_scheduling_flag(mgr));
+}
+
+TEST(AlsaUcm, AdaptiveWatermarkFlag) {
+  struct cras_use_case_mgr *mgr = &cras_ucm_mgr;
+  std::string id = "=AdaptiveWatermark//HiFi";
+  ResetStubData();
+
+  EXPECT_EQ(0, ucm_get_adaptive_watermark_flag(mgr));
+  snd_use_case_get_value[id] = std::string("1");
+  EXPECT_EQ(1, ucm_get_adaptive_watermark_flag(mgr));
+}
+
+TEST(AlsaUcm, BatchedMmapFlag) {
+  struct cras_use_case_mgr *mgr = &cras_ucm_mgr;
+  std::string id = "=BatchedMmap//HiFi";
+  ResetStubData();
+
+  EXPECT_EQ(0, ucm_get_batched_mmap_flag(mgr));
+  snd_use_case_get_value[id] = std::string("1");
+  EXPECT_EQ(1, ucm_get_batched_mmap_flag(mgr));
+}
+
+TEST(AlsaUcm, DeepBufferFlag) {
+  struct cras_use_case_mgr *mgr = &cras_ucm_mgr;
+  std::string id = "=DeepBuffer//HiFi";
+  ResetStubData();
+
+  EXPECT_EQ(0, ucm_get_deep_buffer_flag(mgr));
+  snd_use_case_get_value[id] = std::string("1");
+  EXPECT_EQ(1, ucm_get_deep_buffer_flag(mgr));
+}
+
 TEST(AlsaUcm, GetMixerNameForDevice) {
   struct cras_use_case_mgr *mgr = &cras_ucm_mgr;
   const char *mixer_name_1, *mixer_name_2;
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <stdio.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 extern "C" {
@@ -19,16 +20,23 @@ extern "C" {
 namespace {
 
 static void *stream_ptr = reinterpret_cast<void *>(0x123);
+static void *stream_ptr2 = reinterpret_cast<void *>(0x234);
 static void *dev_ptr = reinterpret_cast<void *>(0x345);
 static void *dev_ptr2 = reinterpret_cast<void *>(0x678);
 static struct cras_apm_list *list;
 static struct cras_audio_area fake_audio_area;
 static unsigned int dsp_util_interleave_frames;
 static unsigned int webrtc_apm_process_stream_f_called;
+static float *webrtc_apm_process_stream_f_data;
+static int webrtc_apm_process_stream_f_ret;
 static unsigned int webrtc_apm_process_reverse_stream_f_called;
 static device_enabled_callback_t device_enabled_callback_val;
 static struct ext_dsp_module *ext_dsp_module_value;
 static struct cras_iodev fake_iodev;
+static struct cras_iodev *first_enabled_iodev_val = &fake_iodev;
+static struct cras_iodev *set_ext_dsp_module_iodev[2];
+static struct ext_dsp_module *set_ext_dsp_module_ext[2];
+static unsigned int set_ext_dsp_module_called;
 
 
 TEST(ApmList, ApmListCreate) {
@@ -82,6 +90,7 @@ TEST(ApmList, ApmProcessForwardBuffer) {
   EXPECT_NE((void *)NULL, list);
 
   apm = cras_apm_list_add(list, dev_ptr, &fmt);
+  cras_apm_list_join(list, dev_ptr);
 
   buf = float_buffer_create(500, 2);
   float_buffer_written(buf, 300);
@@ -161,6 +170,7 @@ TEST(ApmList, ApmProcessReverseData) {
   EXPECT_NE((void *)NULL, list);
 
   apm = cras_apm_list_add(list, dev_ptr, &fmt);
+  cras_apm_list_join(list, dev_ptr);
 
   ext_dsp_module_value->run(ext_dsp_module_value, 250);
   EXPECT_EQ(0, webrtc_apm_process_reverse_stream_f_called);
@@ -172,7 +182,291 @@ TEST(ApmList, ApmProcessReverseData) {
   cras_apm_list_deinit();
 }
 
+TEST(ApmList, ReverseModuleMovesToNewOutput) {
+  struct cras_iodev odev1 = {}, odev2 = {};
+  struct ext_dsp_module *ext;
+
+  odev1.direction = CRAS_STREAM_OUTPUT;
+  odev2.direction = CRAS_STREAM_OUTPUT;
+  first_enabled_iodev_val = &odev1;
+  cras_apm_list_init("");
+  ext = ext_dsp_module_value;
+  EXPECT_NE((void *)NULL, ext);
+
+  /* The module leaves the old output before it is configured for the new
+   * one, so the audio thread never runs it in two pipelines. */
+  set_ext_dsp_module_called = 0;
+  first_enabled_iodev_val = &odev2;
+  device_enabled_callback_val(&odev2, NULL);
+  EXPECT_EQ(2, set_ext_dsp_module_called);
+  EXPECT_EQ(&odev1, set_ext_dsp_module_iodev[0]);
+  EXPECT_EQ((void *)NULL, set_ext_dsp_module_ext[0]);
+  EXPECT_EQ(&odev2, set_ext_dsp_module_iodev[1]);
+  EXPECT_EQ(ext, set_ext_dsp_module_ext[1]);
+
+  /* Enabling another output leaves it where it is. */
+  set_ext_dsp_module_called = 0;
+  device_enabled_callback_val(&odev1, NULL);
+  EXPECT_EQ(1, set_ext_dsp_module_called);
+  EXPECT_EQ(&odev2, set_ext_dsp_module_iodev[0]);
+
+  first_enabled_iodev_val = &fake_iodev;
+  cras_apm_list_deinit();
+}
+
+TEST(ApmList, StreamsShareApmInstance) {
+  struct cras_apm_list *list2;
+  struct cras_apm *apm, *apm2;
+  struct cras_audio_format fmt;
+  struct cras_audio_area *area;
+  struct float_buffer *buf;
+
+  fmt.num_channels = 2;
+  fmt.frame_rate = 48000;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  for (int i = 0; i < CRAS_CH_MAX; i++)
+    fmt.channel_layout[i] = i < 2 ? i : -1;
+
+  list = cras_apm_list_create(stream_ptr, APM_ECHO_CANCELLATION);
+  list2 = cras_apm_list_create(stream_ptr2, APM_ECHO_CANCELLATION);
+  apm = cras_apm_list_add(list, dev_ptr, &fmt);
+  cras_apm_list_join(list, dev_ptr);
+  apm2 = cras_apm_list_add(list2, dev_ptr, &fmt);
+  cras_apm_list_join(list2, dev_ptr);
+  EXPECT_NE(apm, apm2);
+  EXPECT_EQ(1, cras_apm_list_get_num_instances());
+  EXPECT_EQ(2, cras_apm_list_get_num_users(apm));
+  EXPECT_EQ(2, cras_apm_list_get_num_users(apm2));
+
+  /* The second stream catches up on input the first one already passed
+   * to APM, without processing it again. */
+  buf = float_buffer_create(960, 2);
+  float_buffer_written(buf, 960);
+  webrtc_apm_process_stream_f_called = 0;
+  EXPECT_EQ(480, cras_apm_list_process(apm, buf, 0));
+  EXPECT_EQ(480, cras_apm_list_process(apm2, buf, 0));
+  EXPECT_EQ(1, webrtc_apm_process_stream_f_called);
+
+  area = cras_apm_list_get_processed(apm);
+  EXPECT_EQ(480, area->frames);
+  area = cras_apm_list_get_processed(apm2);
+  EXPECT_EQ(480, area->frames);
+
+  /* The block is reused only once both streams read it. */
+  cras_apm_list_put_processed(apm, 480);
+  cras_apm_list_put_processed(apm2, 200);
+  EXPECT_EQ(0, cras_apm_list_get_processed(apm)->frames);
+  EXPECT_EQ(280, cras_apm_list_get_processed(apm2)->frames);
+  EXPECT_EQ(480, cras_apm_list_process(apm, buf, 480));
+  EXPECT_EQ(1, webrtc_apm_process_stream_f_called);
+  cras_apm_list_put_processed(apm2, 280);
+  EXPECT_EQ(480, cras_apm_list_process(apm2, buf, 480));
+  EXPECT_EQ(0, cras_apm_list_process(apm, buf, 960));
+  EXPECT_EQ(2, webrtc_apm_process_stream_f_called);
+  EXPECT_EQ(480, cras_apm_list_get_processed(apm)->frames);
+
+  /* Once the second stream leaves the device, its unread block no longer
+   * holds up the first stream. */
+  cras_apm_list_leave(list2, dev_ptr);
+  EXPECT_EQ(2, cras_apm_list_get_num_users(apm));
+  cras_apm_list_put_processed(apm, 480);
+  float_buffer_read(buf, 960);
+  float_buffer_written(buf, 480);
+  EXPECT_EQ(480, cras_apm_list_process(apm, buf, 0));
+  EXPECT_EQ(3, webrtc_apm_process_stream_f_called);
+
+  /* A different format gets its own instance. */
+  fmt.frame_rate = 44100;
+  EXPECT_NE((void *)NULL, cras_apm_list_add(list2, dev_ptr, &fmt));
+  EXPECT_EQ(2, cras_apm_list_get_num_instances());
+  EXPECT_EQ(1, cras_apm_list_get_num_users(apm));
+
+  cras_apm_list_leave(list, dev_ptr);
+  cras_apm_list_destroy(list);
+  EXPECT_EQ(1, cras_apm_list_get_num_instances());
+  cras_apm_list_destroy(list2);
+  EXPECT_EQ(0, cras_apm_list_get_num_instances());
+  float_buffer_destroy(&buf);
+}
+
+TEST(ApmList, ApmProcessFailure) {
+  struct cras_apm_list *list2;
+  struct cras_apm *apm, *apm2;
+  struct cras_audio_format fmt;
+  struct float_buffer *buf;
+
+  fmt.num_channels = 2;
+  fmt.frame_rate = 48000;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  for (int i = 0; i < CRAS_CH_MAX; i++)
+    fmt.channel_layout[i] = i < 2 ? i : -1;
+
+  list = cras_apm_list_create(stream_ptr, APM_ECHO_CANCELLATION);
+  list2 = cras_apm_list_create(stream_ptr2, APM_ECHO_CANCELLATION);
+  apm = cras_apm_list_add(list, dev_ptr, &fmt);
+  cras_apm_list_join(list, dev_ptr);
+  apm2 = cras_apm_list_add(list2, dev_ptr, &fmt);
+  cras_apm_list_join(list2, dev_ptr);
+
+  buf = float_buffer_create(960, 2);
+  float_buffer_written(buf, 960);
+  webrtc_apm_process_stream_f_ret = -1;
+  EXPECT_GT(0, cras_apm_list_process(apm, buf, 0));
+  webrtc_apm_process_stream_f_ret = 0;
+
+  /* The failed APM is skipped but stays in the list for the main thread
+   * to remove. */
+  EXPECT_EQ((void *)NULL, cras_apm_list_get(list, dev_ptr));
+  EXPECT_EQ(apm2, cras_apm_list_get(list2, dev_ptr));
+
+  /* The other stream sharing the instance isn't held up by it. */
+  EXPECT_EQ(480, cras_apm_list_process(apm2, buf, 0));
+  cras_apm_list_put_processed(apm2, 480);
+  EXPECT_EQ(480, cras_apm_list_process(apm2, buf, 480));
+  EXPECT_EQ(480, cras_apm_list_get_processed(apm2)->frames);
+
+  cras_apm_list_remove(list, dev_ptr);
+  EXPECT_EQ(1, cras_apm_list_get_num_users(apm2));
+
+  cras_apm_list_destroy(list);
+  cras_apm_list_destroy(list2);
+  float_buffer_destroy(&buf);
+}
+
+TEST(ApmList, ApmProcessInPlace) {
+  struct cras_apm *apm;
+  struct cras_audio_format fmt;
+  struct float_buffer *buf, *buf4;
+  float *const *rp;
+  unsigned int nread;
+
+  fmt.num_channels = 2;
+  fmt.frame_rate = 48000;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  for (int i = 0; i < CRAS_CH_MAX; i++)
+    fmt.channel_layout[i] = i < 2 ? i : -1;
+
+  list = cras_apm_list_create(stream_ptr, APM_ECHO_CANCELLATION);
+  apm = cras_apm_list_add(list, dev_ptr, &fmt);
+  cras_apm_list_join(list, dev_ptr);
+
+  /* Aligned 10ms of input is handed to APM without copying. */
+  buf = float_buffer_create(960, 2);
+  float_buffer_written(buf, 960);
+  webrtc_apm_process_stream_f_called = 0;
+  dsp_util_interleave_frames = 0;
+  EXPECT_EQ(480, cras_apm_list_process(apm, buf, 0));
+  EXPECT_EQ(1, webrtc_apm_process_stream_f_called);
+  EXPECT_EQ(480, dsp_util_interleave_frames);
+  nread = 480;
+  rp = float_buffer_read_pointer(buf, 0, &nread);
+  EXPECT_EQ(rp[0], webrtc_apm_process_stream_f_data);
+  EXPECT_EQ(480, cras_apm_list_get_processed(apm)->frames);
+  EXPECT_EQ(480, cras_apm_list_get_delay_frames(apm));
+
+  /* Input that wraps around the buffer end is copied. */
+  cras_apm_list_put_processed(apm, 480);
+  float_buffer_read(buf, 600);
+  float_buffer_written(buf, 480);
+  EXPECT_EQ(480, cras_apm_list_process(apm, buf, 0));
+  EXPECT_EQ(2, webrtc_apm_process_stream_f_called);
+  nread = 480;
+  rp = float_buffer_read_pointer(buf, 0, &nread);
+  EXPECT_NE(rp[0], webrtc_apm_process_stream_f_data);
+  cras_apm_list_destroy(list);
+
+  /* Picking FL and FC from a four channel device is a copy. */
+  fmt.num_channels = 4;
+  fmt.channel_layout[CRAS_CH_FL] = 2;
+  fmt.channel_layout[CRAS_CH_FR] = -1;
+  fmt.channel_layout[CRAS_CH_RL] = 0;
+  fmt.channel_layout[CRAS_CH_FC] = 3;
+  list = cras_apm_list_create(stream_ptr, APM_ECHO_CANCELLATION);
+  apm = cras_apm_list_add(list, dev_ptr, &fmt);
+  cras_apm_list_join(list, dev_ptr);
+  EXPECT_EQ(2, cras_apm_list_get_format(apm)->num_channels);
+
+  buf4 = float_buffer_create(480, 4);
+  nread = 480;
+  rp = float_buffer_read_pointer(buf4, 0, &nread);
+  for (int i = 0; i < 480; i++) {
+    rp[0][i] = 0.5f;
+    rp[2][i] = 0.25f;
+  }
+  float_buffer_written(buf4, 480);
+  EXPECT_EQ(480, cras_apm_list_process(apm, buf4, 0));
+  EXPECT_EQ(3, webrtc_apm_process_stream_f_called);
+  EXPECT_NE(rp[0], webrtc_apm_process_stream_f_data);
+  EXPECT_EQ(0.25f, webrtc_apm_process_stream_f_data[0]);
+
+  cras_apm_list_destroy(list);
+  float_buffer_destroy(&buf4);
+  float_buffer_destroy(&buf);
+}
+
+TEST(ApmList, ApmProcessOnWorkerThread) {
+  struct cras_apm *apm;
+  struct cras_audio_format fmt;
+  struct cras_audio_area *area;
+  struct float_buffer *buf;
+  int i;
+
+  fmt.num_channels = 2;
+  fmt.frame_rate = 48000;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+
+  cras_apm_list_enable_offload();
+
+  list = cras_apm_list_create(stream_ptr, APM_ECHO_CANCELLATION);
+  EXPECT_NE((void *)NULL, list);
+  apm = cras_apm_list_add(list, dev_ptr, &fmt);
+  cras_apm_list_join(list, dev_ptr);
+  EXPECT_NE((void *)NULL, apm);
+
+  buf = float_buffer_create(1500, 2);
+  float_buffer_written(buf, 1500);
+
+  /* Fill the first block and wait for the worker to process it. */
+  EXPECT_EQ(480, cras_apm_list_process(apm, buf, 0));
+  for (i = 0; i < 1000; i++) {
+    area = cras_apm_list_get_processed(apm);
+    if (area->frames)
+      break;
+    usleep(1000);
+  }
+  EXPECT_EQ(480, area->frames);
+  EXPECT_EQ(480, cras_apm_list_get_delay_frames(apm));
+
+  /* Queue more blocks until every block is held, then no more input is
+   * taken until the stream reads. */
+  EXPECT_EQ(480, cras_apm_list_process(apm, buf, 480));
+  EXPECT_EQ(480, cras_apm_list_process(apm, buf, 960));
+  EXPECT_EQ(0, cras_apm_list_process(apm, buf, 1440));
+  EXPECT_EQ(1440, cras_apm_list_get_delay_frames(apm));
+
+  cras_apm_list_put_processed(apm, 200);
+  EXPECT_EQ(1240, cras_apm_list_get_delay_frames(apm));
+  EXPECT_EQ(0, cras_apm_list_process(apm, buf, 1440));
+
+  cras_apm_list_put_processed(apm, 280);
+  EXPECT_EQ(960, cras_apm_list_get_delay_frames(apm));
+  EXPECT_EQ(60, cras_apm_list_process(apm, buf, 1440));
+  EXPECT_EQ(1020, cras_apm_list_get_delay_frames(apm));
+
+  float_buffer_destroy(&buf);
+  cras_apm_list_destroy(list);
+  cras_apm_list_deinit();
+}
+
 extern "C" {
+int cras_set_rt_scheduling(int rt_lim)
+{
+  return 0;
+}
+int cras_set_thread_priority(int priority)
+{
+  return 0;
+}
 int cras_iodev_list_set_device_enabled_callback(
 		device_enabled_callback_t enabled_cb,
 		device_disabled_callback_t disabled_cb,
@@ -184,11 +478,16 @@ int cras_iodev_list_set_device_enabled_callback(
 struct cras_iodev *cras_iodev_list_get_first_enabled_iodev(
 	enum CRAS_STREAM_DIRECTION direction)
 {
-  return &fake_iodev;
+  return first_enabled_iodev_val;
 }
 void cras_iodev_set_ext_dsp_module(struct cras_iodev *iodev,
 				   struct ext_dsp_module *ext)
 {
+  if (set_ext_dsp_module_called < 2) {
+    set_ext_dsp_module_iodev[set_ext_dsp_module_called] = iodev;
+    set_ext_dsp_module_ext[set_ext_dsp_module_called] = ext;
+  }
+  set_ext_dsp_module_called++;
   ext_dsp_module_value = ext;
 }
 struct cras_audio_area *cras_audio_area_create(int num_channels)
@@ -244,7 +543,8 @@ int webrtc_apm_process_stream_f(webrtc_apm ptr,
 				float *const *data)
 {
   webrtc_apm_process_stream_f_called++;
-  return 0;
+  webrtc_apm_process_stream_f_data = data[0];
+  return webrtc_apm_process_stream_f_ret;
 }
 
 int webrtc_apm_process_reverse_stream_f(
@@ -841,13 +841,18 @@ int cras_iodev_put_input_buffer(struct cras_iodev *iodev)
 }
 
 int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
-                                 unsigned int nframes, int* non_empty,
+                                 unsigned int nframes, int is_silent,
+                                 int* non_empty,
                                  struct cras_fmt_conv *output_converter) {
   cras_iodev_put_output_buffer_called++;
   cras_iodev_put_output_buffer_nframes = nframes;
   return 0;
 }
 
+int cras_iodev_commit_output_buffer(struct cras_iodev *odev) {
+  return 0;
+}
+
 int cras_iodev_get_input_buffer(struct cras_iodev *iodev,
 				unsigned *frames)
 {
@@ -868,10 +873,29 @@ int cras_iodev_get_dsp_delay(const struct cras_iodev *iodev)
   return 0;
 }
 
+int cras_iodev_get_delay(const struct cras_iodev *iodev,
+                         struct cras_iodev_delay *delay)
+{
+  memset(delay, 0, sizeof(*delay));
+  delay->frames = iodev->delay_frames(iodev);
+  delay->rate_ratio = 1.0;
+  return 0;
+}
+
 void cras_fmt_conv_destroy(struct cras_fmt_conv **conv)
 {
 }
 
+void cras_fmt_conv_pool_flush()
+{
+}
+
+void cras_fmt_conv_pool_get_stats(unsigned int *hits, unsigned int *misses)
+{
+  *hits = 0;
+  *misses = 0;
+}
+
 struct cras_fmt_conv *cras_channel_remix_conv_create(
     unsigned int num_channels,
     const float *coefficient)
@@ -979,8 +1003,10 @@ void dev_stream_destroy(struct dev_stream *dev_stream)
 int dev_stream_mix(struct dev_stream *dev_stream,
 		   const struct cras_audio_format *fmt,
                    uint8_t *dst,
-                   unsigned int num_to_write)
+                   unsigned int num_to_write,
+                   int *is_silent)
 {
+  *is_silent = 0;
   return num_to_write;
 }
 
@@ -1015,6 +1041,11 @@ void dev_stream_set_delay(const struct dev_stream *dev_stream,
 {
 }
 
+void dev_stream_set_delay_tstamp(const struct dev_stream *dev_stream,
+                                 const struct cras_iodev_delay *delay)
+{
+}
+
 void dev_stream_set_dev_rate(struct dev_stream *dev_stream,
                              unsigned int dev_rate,
                              double dev_rate_ratio,
@@ -1152,6 +1183,16 @@ unsigned int cras_iodev_get_num_severe_underruns(const struct cras_iodev *iodev)
   return 0;
 }
 
+unsigned int cras_iodev_get_num_hw_calls(const struct cras_iodev *iodev)
+{
+  return 0;
+}
+
+unsigned int cras_iodev_get_num_overruns(const struct cras_iodev *iodev)
+{
+  return 0;
+}
+
 void cras_iodev_update_highest_hw_level(struct cras_iodev *iodev,
 		unsigned int hw_level)
 {
@@ -1165,6 +1206,12 @@ int cras_iodev_start_ramp(struct cras_iodev *odev,
   return 0;
 }
 
+int cras_iodev_connect_ext_dsp_module(struct cras_iodev *iodev,
+                                      struct ext_dsp_module *ext)
+{
+  return 0;
+}
+
 int input_data_get_for_stream(
 		struct input_data *data,
 		struct cras_rstream *stream,
@@ -1175,6 +1222,12 @@ int input_data_get_for_stream(
   return 0;
 }
 
+unsigned int input_data_get_delay_frames(struct input_data *data,
+					 struct cras_rstream *stream)
+{
+  return 0;
+}
+
 int input_data_put_for_stream(struct input_data *data,
 			   struct cras_rstream *stream,
 			   struct buffer_share *offsets,
@@ -1190,6 +1243,21 @@ uint64_t cras_apm_list_get_effects(struct cras_apm_list *list)
   return 0;
 }
 
+struct cras_apm *cras_apm_list_get(struct cras_apm_list *list, void *dev_ptr)
+{
+  return NULL;
+}
+
+unsigned int cras_apm_list_get_num_users(struct cras_apm *apm)
+{
+  return 0;
+}
+
+unsigned int cras_apm_list_get_num_instances()
+{
+  return 0;
+}
+
 void cras_apm_list_set_debug_recording(struct cras_apm *apm,
     unsigned int stream_id, int start, const char *file_name_base)
 {
@@ -0,0 +1,107 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "buffer_watermark.h"
+}
+
+namespace {
+
+static struct timespec Ts(time_t sec, long msec) {
+  struct timespec ts = { sec, msec * 1000000 };
+  return ts;
+}
+
+TEST(BufferWatermark, InitClamps) {
+  struct buffer_watermark wm;
+
+  buffer_watermark_init(&wm, 4096, 0, 2048, 48);
+  EXPECT_EQ(2048, wm.level);
+  EXPECT_EQ(4096, wm.initial_level);
+}
+
+TEST(BufferWatermark, UnderrunRaises) {
+  struct buffer_watermark wm;
+  struct timespec ts = Ts(1, 0);
+
+  buffer_watermark_init(&wm, 0, 0, 300, 48);
+  EXPECT_EQ(1, buffer_watermark_underrun(&wm, &ts));
+  EXPECT_EQ(48, wm.level);
+  buffer_watermark_underrun(&wm, &ts);
+  EXPECT_EQ(96, wm.level);
+  buffer_watermark_underrun(&wm, &ts);
+  EXPECT_EQ(192, wm.level);
+  buffer_watermark_underrun(&wm, &ts);
+  EXPECT_EQ(300, wm.level);
+  EXPECT_EQ(0, buffer_watermark_underrun(&wm, &ts));
+}
+
+TEST(BufferWatermark, NearMissRaises) {
+  struct buffer_watermark wm;
+  struct timespec ts = Ts(1, 0);
+
+  buffer_watermark_init(&wm, 96, 0, 2048, 48);
+  EXPECT_EQ(0, buffer_watermark_update(&wm, 24, &ts));
+  EXPECT_EQ(96, wm.level);
+  ts = Ts(1, 10);
+  EXPECT_EQ(1, buffer_watermark_update(&wm, 23, &ts));
+  EXPECT_EQ(144, wm.level);
+  EXPECT_EQ(1, wm.num_near_misses);
+
+  // Doesn't shrink back below the near miss.
+  ts = Ts(20, 0);
+  EXPECT_EQ(0, buffer_watermark_update(&wm, 960, &ts));
+  EXPECT_EQ(144, wm.level);
+}
+
+TEST(BufferWatermark, ShrinkAfterCleanPlayback) {
+  struct buffer_watermark wm;
+  struct timespec ts = Ts(1, 0);
+  time_t sec;
+
+  buffer_watermark_init(&wm, 400, 0, 2048, 48);
+  buffer_watermark_update(&wm, 960, &ts);
+  buffer_watermark_underrun(&wm, &ts);
+  EXPECT_EQ(800, wm.level);
+
+  ts = Ts(11, 0);
+  EXPECT_EQ(1, buffer_watermark_update(&wm, 960, &ts));
+  EXPECT_EQ(700, wm.level);
+  ts = Ts(12, 0);
+  EXPECT_EQ(0, buffer_watermark_update(&wm, 960, &ts));
+
+  // Stops just above the level that underran.
+  for (sec = 21; sec < 300; sec += 10) {
+    ts = Ts(sec, 0);
+    buffer_watermark_update(&wm, 960, &ts);
+  }
+  EXPECT_EQ(448, wm.level);
+
+  // Until that is long ago.
+  ts = Ts(302, 0);
+  buffer_watermark_update(&wm, 960, &ts);
+  EXPECT_EQ(392, wm.level);
+}
+
+TEST(BufferWatermark, ShrinksToMin) {
+  struct buffer_watermark wm;
+  struct timespec ts = Ts(1, 0);
+  time_t sec;
+
+  buffer_watermark_init(&wm, 768, 0, 2048, 48);
+  for (sec = 1; sec < 200; sec += 10) {
+    ts = Ts(sec, 0);
+    buffer_watermark_update(&wm, 960, &ts);
+  }
+  EXPECT_EQ(0, wm.level);
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+extern "C" {
+#include "clock_domain.h"
+}
+
+namespace {
+
+static int master_a, master_b;
+
+static void AdvanceTs(struct timespec *ts, long nsec) {
+  ts->tv_nsec += nsec;
+  while (ts->tv_nsec >= 1000000000) {
+    ts->tv_nsec -= 1000000000;
+    ts->tv_sec++;
+  }
+}
+
+// Runs a slave that drifts |drift| ahead of the master per second, starting
+// |*phase| seconds ahead, measured every 10ms with up to |noise| seconds of
+// error. Applies the correction like dev_io does.
+static void RunSlave(struct clock_slave *slave, struct timespec *ts,
+                     double *phase, double drift, double noise,
+                     int seconds) {
+  for (int i = 0; i < seconds * 100; i++) {
+    *phase += (drift - slave->applied) * 0.01;
+    AdvanceTs(ts, 10000000);
+    double err = *phase + noise * (2.0 * rand() / RAND_MAX - 1);
+    if (clock_slave_update(slave, &master_a, err, ts))
+      clock_slave_applied(slave);
+  }
+}
+
+TEST(ClockDomain, LocksToDrift) {
+  struct clock_slave slave;
+  struct timespec ts = { 1, 0 };
+  double phase = 0.002;
+
+  clock_slave_reset(&slave, &master_a);
+  RunSlave(&slave, &ts, &phase, 50e-6, 0.0005, 200);
+  EXPECT_GT(50e-6, fabs(phase));
+  EXPECT_NEAR(50e-6, slave.applied, 10e-6);
+
+  // Stays locked.
+  RunSlave(&slave, &ts, &phase, 50e-6, 0.0005, 600);
+  EXPECT_GT(50e-6, fabs(phase));
+}
+
+TEST(ClockDomain, CorrectionClamped) {
+  struct clock_slave slave;
+  struct timespec ts = { 1, 0 };
+  double phase = 0;
+
+  clock_slave_reset(&slave, &master_a);
+  RunSlave(&slave, &ts, &phase, -0.01, 0, 2);
+  EXPECT_DOUBLE_EQ(-0.001, slave.correction);
+}
+
+TEST(ClockDomain, ApplyThreshold) {
+  struct clock_slave slave;
+  struct timespec ts = { 1, 0 };
+
+  clock_slave_reset(&slave, &master_a);
+  EXPECT_EQ(0, clock_slave_update(&slave, &master_a, 0, &ts));
+  AdvanceTs(&ts, 10000000);
+  // 1ppm isn't worth resetting the resamplers for.
+  EXPECT_EQ(0, clock_slave_update(&slave, &master_a, 0.0005, &ts));
+  AdvanceTs(&ts, 10000000);
+  EXPECT_EQ(1, clock_slave_update(&slave, &master_a, 0.005, &ts));
+  clock_slave_applied(&slave);
+  AdvanceTs(&ts, 10000000);
+  // Holding the phase only moves the integral a little.
+  EXPECT_EQ(0, clock_slave_update(&slave, &master_a, slave.phase_err, &ts));
+}
+
+TEST(ClockDomain, Restarts) {
+  struct clock_slave slave;
+  struct timespec ts = { 1, 0 };
+  double phase = 0.01;
+
+  clock_slave_reset(&slave, &master_a);
+  RunSlave(&slave, &ts, &phase, 0, 0, 1);
+  ASSERT_NE(0, slave.applied);
+
+  // A jump in phase, e.g. from an underrun, stops the correction.
+  AdvanceTs(&ts, 10000000);
+  EXPECT_EQ(1, clock_slave_update(&slave, &master_a, 0.2, &ts));
+  clock_slave_applied(&slave);
+  EXPECT_EQ(0, slave.correction);
+
+  RunSlave(&slave, &ts, &phase, 0, 0, 1);
+  ASSERT_NE(0, slave.applied);
+
+  // So does a new master.
+  AdvanceTs(&ts, 10000000);
+  EXPECT_EQ(1, clock_slave_update(&slave, &master_b, phase, &ts));
+  EXPECT_EQ(&master_b, slave.master);
+  EXPECT_EQ(0, slave.correction);
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
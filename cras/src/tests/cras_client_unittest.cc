@@ -167,6 +167,44 @@ TEST_F(CrasClientTestSuite, HandleCaptureDataReady) {
   FreeShm(shm);
 }
 
+int playback_samples_needed(cras_client* client,
+                            cras_stream_id_t stream_id,
+                            uint8_t* samples,
+                            size_t frames,
+                            const timespec* sample_ts,
+                            void* arg) {
+  samples_ready_called++;
+  samples_ready_frames_value = frames;
+  return frames;
+}
+
+TEST_F(CrasClientTestSuite, HandlePlaybackRequestLimit) {
+  struct cras_audio_shm *shm = &stream_.play_shm;
+
+  stream_.direction = CRAS_STREAM_OUTPUT;
+  shm_writable_frames_ = 1024;
+  InitShm(shm);
+  stream_.config->aud_cb = playback_samples_needed;
+  stream_.config->unified_cb = 0;
+
+  /* Only media streams are asked for more than cb_threshold, in deep
+   * buffer mode. */
+  stream_.config->stream_type = CRAS_STREAM_TYPE_VOICE_COMMUNICATION;
+  handle_playback_request(&stream_, 1024);
+  EXPECT_EQ(1, samples_ready_called);
+  EXPECT_EQ(512, samples_ready_frames_value);
+
+  stream_.config->stream_type = CRAS_STREAM_TYPE_MULTIMEDIA;
+  handle_playback_request(&stream_, 1024);
+  EXPECT_EQ(2, samples_ready_called);
+  EXPECT_EQ(1024, samples_ready_frames_value);
+
+  handle_playback_request(&stream_, 2048);
+  EXPECT_EQ(3, samples_ready_called);
+  EXPECT_EQ(1024, samples_ready_frames_value);
+  FreeShm(shm);
+}
+
 void CrasClientTestSuite::StreamConnected(CRAS_STREAM_DIRECTION direction) {
   struct cras_client_stream_connected msg;
   int shm_fds[2] = {0, 1};
@@ -52,6 +52,7 @@ struct data {
   float *data_location[MAX_MOCK_PORTS];
 
   int run_called;
+  int run_q31_called;
   float input[MAX_MOCK_PORTS];
   float output[MAX_MOCK_PORTS];
 
@@ -117,6 +118,21 @@ static void run(struct dsp_module *module, unsigned long sample_count)
   }
 }
 
+static void run_q31(struct dsp_module *module, unsigned long sample_count)
+{
+  struct data *data =  (struct data *)module->data;
+  data->run_q31_called++;
+  data->sample_count = sample_count;
+
+  /* multiply the Q31 audio port data by 2 */
+  for (int i = 0; i < std::min(data->nr_in_audio, data->nr_out_audio); i++) {
+    int32_t *from = (int32_t *)data->data_location[data->in_audio[i]];
+    int32_t *to = (int32_t *)data->data_location[data->out_audio[i]];
+    for (unsigned int j = 0; j < sample_count; j++)
+      to[j] = from[j] * 2;
+  }
+}
+
 static void deinstantiate(struct dsp_module *module)
 {
   struct data *data = (struct data *)module->data;
@@ -180,6 +196,8 @@ static struct dsp_module *create_mock_module(struct plugin *plugin)
   module->connect_port = &connect_port;
   module->get_delay = &get_delay;
   module->run = &run;
+  if (strcmp(plugin->label, "float_only") != 0)
+    module->run_q31 = &run_q31;
   module->deinstantiate = &deinstantiate;
   module->free_module = &free_module;
   module->get_properties = &get_properties;
@@ -478,6 +496,7 @@ TEST_F(DspPipelineTestSuite, Complex) {
 
   int16_t *samples = new int16_t[DSP_BUFFER_SIZE];
   fill_test_data(samples, DSP_BUFFER_SIZE);
+  cras_dsp_pipeline_enable_profile();
   cras_dsp_pipeline_apply(p, (uint8_t*)samples, SND_PCM_FORMAT_S16_LE, 100);
   /* the data flow through 2 plugins because m4 is disabled. */
   verify_processed_data(samples, 100, 2);
@@ -490,6 +509,24 @@ TEST_F(DspPipelineTestSuite, Complex) {
   ASSERT_EQ(1, d5->run_called);
   ASSERT_EQ(100, d5->sample_count);
 
+  /* Every instance is profiled once, in the order they run. */
+  struct dsp_pipeline_profile_info profile;
+  cras_dsp_pipeline_get_profile(p, &profile);
+  EXPECT_STREQ("playback", profile.purpose);
+  EXPECT_EQ(48000, profile.sample_rate);
+  EXPECT_EQ(100, profile.total_samples);
+  ASSERT_EQ(5, profile.num_modules);
+  EXPECT_STREQ("m0", profile.modules[0].name);
+  EXPECT_STREQ("m5", profile.modules[4].name);
+  for (int i = 0; i < 5; i++) {
+    uint32_t hist_total = 0;
+    EXPECT_EQ(1, profile.modules[i].runs);
+    EXPECT_LE(profile.modules[i].max_ns, profile.modules[i].total_ns);
+    for (int j = 0; j < DSP_PROFILE_NUM_BUCKETS; j++)
+      hist_total += profile.modules[i].histogram[j];
+    EXPECT_EQ(1, hist_total);
+  }
+
   /* Expect the sink module "m5" is set. */
   cras_dsp_pipeline_set_sink_ext_module(p, &ext_mod);
   struct data *d = (struct data *)
@@ -524,6 +561,165 @@ TEST_F(DspPipelineTestSuite, Complex) {
   really_free_module(m5);
 }
 
+TEST_F(DspPipelineTestSuite, Crossfade) {
+  const char *content =
+      "[M0]\n"
+      "library=builtin\n"
+      "label=source\n"
+      "purpose=playback\n"
+      "output_0={a}\n"
+      "[M1]\n"
+      "library=builtin\n"
+      "label=foo\n"
+      "disable=(not gain)\n"
+      "input_0={a}\n"
+      "output_1={b}\n"
+      "[M2]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=playback\n"
+      "input_0={b}\n";
+  fprintf(fp, "%s", content);
+  CloseFile();
+
+  struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+  cras_expr_env_install_builtins(&env);
+  struct ini *ini = cras_dsp_ini_create(filename);
+  ASSERT_TRUE(ini);
+
+  /* The old pipeline doubles the samples, the new one passes them. */
+  cras_expr_env_set_variable_boolean(&env, "gain", 1);
+  struct pipeline *old_p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(old_p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(old_p));
+  ASSERT_EQ(0, cras_dsp_pipeline_instantiate(old_p, 48000));
+
+  cras_expr_env_set_variable_boolean(&env, "gain", 0);
+  struct pipeline *p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(p));
+  ASSERT_EQ(0, cras_dsp_pipeline_instantiate(p, 44100));
+
+  /* Sample rate mismatch. */
+  EXPECT_EQ(-EINVAL, cras_dsp_pipeline_set_crossfade(p, old_p, 100));
+  cras_dsp_pipeline_deinstantiate(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_instantiate(p, 48000));
+
+  ASSERT_EQ(0, cras_dsp_pipeline_set_crossfade(p, old_p, 100));
+  EXPECT_EQ(old_p, cras_dsp_pipeline_get_crossfade_source(p));
+
+  int16_t samples[150];
+  for (size_t i = 0; i < 150; i++)
+    samples[i] = 1000;
+  cras_dsp_pipeline_apply(p, (uint8_t*)samples, SND_PCM_FORMAT_S16_LE, 60);
+  EXPECT_EQ(old_p, cras_dsp_pipeline_get_crossfade_source(p));
+  cras_dsp_pipeline_apply(p, (uint8_t*)(samples + 60), SND_PCM_FORMAT_S16_LE,
+                          90);
+  EXPECT_EQ(NULL, cras_dsp_pipeline_get_crossfade_source(p));
+
+  /* Ramps from the old output to the new one. */
+  for (size_t i = 0; i < 100; i++)
+    EXPECT_NEAR(2000 - 10 * (int)i, samples[i], 1);
+  for (size_t i = 100; i < 150; i++)
+    EXPECT_EQ(1000, samples[i]);
+
+  cras_dsp_pipeline_free(p);
+  cras_dsp_pipeline_free(old_p);
+  cras_dsp_ini_free(ini);
+  cras_expr_env_free(&env);
+
+  for (int i = 0; i < num_modules; i++)
+    really_free_module(modules[i]);
+}
+
+TEST_F(DspPipelineTestSuite, FixedPoint) {
+  const char *content =
+      "[M0]\n"
+      "library=builtin\n"
+      "label=source\n"
+      "purpose=playback\n"
+      "fixed_point=fixed\n"
+      "output_0={a}\n"
+      "[M1]\n"
+      "library=builtin\n"
+      "label=foo\n"
+      "input_0={a}\n"
+      "output_1={c}\n"
+      "[M2]\n"
+      "library=builtin\n"
+      "label=float_only\n"
+      "disable=(not float_module)\n"
+      "input_0={c}\n"
+      "output_1={e}\n"
+      "[M3]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=playback\n"
+      "disable=float_module\n"
+      "input_0={c}\n"
+      "[M4]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=playback\n"
+      "disable=(not float_module)\n"
+      "input_0={e}\n";
+  fprintf(fp, "%s", content);
+  CloseFile();
+
+  struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+  cras_expr_env_install_builtins(&env);
+  struct ini *ini = cras_dsp_ini_create(filename);
+  ASSERT_TRUE(ini);
+
+  cras_expr_env_set_variable_boolean(&env, "fixed", 1);
+  cras_expr_env_set_variable_boolean(&env, "float_module", 0);
+  struct pipeline *p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(p));
+  ASSERT_EQ(0, cras_dsp_pipeline_instantiate(p, 48000));
+  EXPECT_EQ(1, cras_dsp_pipeline_is_fixed_point(p));
+
+  int16_t samples[100];
+  for (size_t i = 0; i < 100; i++)
+    samples[i] = (i % 2) ? -1000 : 1000;
+  cras_dsp_pipeline_apply(p, (uint8_t*)samples, SND_PCM_FORMAT_S16_LE, 100);
+  for (size_t i = 0; i < 100; i++)
+    EXPECT_EQ((i % 2) ? -2000 : 2000, samples[i]);
+  struct data *d1 = (struct data *)find_module("m1")->data;
+  EXPECT_EQ(1, d1->run_q31_called);
+  EXPECT_EQ(0, d1->run_called);
+
+  /* External modules only take floats, and the sample type of a loaded
+   * pipeline doesn't change. */
+  EXPECT_EQ(-EINVAL, cras_dsp_pipeline_set_sink_ext_module(p, &ext_mod));
+  EXPECT_EQ(1, cras_dsp_pipeline_is_fixed_point(p));
+  cras_dsp_pipeline_free(p);
+
+  /* A pipeline an external module can connect to is loaded in float. */
+  p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(p);
+  cras_dsp_pipeline_disable_fixed_point(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(p));
+  ASSERT_EQ(0, cras_dsp_pipeline_instantiate(p, 48000));
+  EXPECT_EQ(0, cras_dsp_pipeline_is_fixed_point(p));
+  EXPECT_EQ(0, cras_dsp_pipeline_set_sink_ext_module(p, &ext_mod));
+  cras_dsp_pipeline_free(p);
+
+  /* Not all modules support Q31, fall back to float. */
+  cras_expr_env_set_variable_boolean(&env, "float_module", 1);
+  p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(p));
+  EXPECT_EQ(0, cras_dsp_pipeline_is_fixed_point(p));
+  cras_dsp_pipeline_free(p);
+
+  cras_dsp_ini_free(ini);
+  cras_expr_env_free(&env);
+
+  for (int i = 0; i < num_modules; i++)
+    really_free_module(modules[i]);
+}
+
 }  //  namespace
 
 int main(int argc, char **argv) {
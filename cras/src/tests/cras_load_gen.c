@@ -0,0 +1,812 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Load generator for the server. Runs a number of playback and capture
+ * streams with mixed formats, rates and block sizes from one or more
+ * clients, measures the latency, callback jitter and underruns of each
+ * stream together with the CPU use of the server, and prints the results
+ * as JSON so how the server scales can be tracked from run to run. Run
+ * against a simulated or empty device to take the hardware out of the
+ * numbers.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cras_client.h"
+#include "cras_types.h"
+#include "cras_util.h"
+#include "cras_version.h"
+
+#define MAX_LIST_ENTRIES 8
+#define MAX_CLIENTS 32
+#define MAX_STREAMS 256
+
+/* Running statistics of a series of samples. */
+struct stat_acc {
+	uint64_t n;
+	double mean;
+	double m2;
+	double min;
+	double max;
+};
+
+/* A stream of the load and what was measured of it. Written by the audio
+ * thread of its client while running, read once it is removed.
+ * Members:
+ *    direction - Playback or capture.
+ *    client - Index of the client the stream was added from.
+ *    format, rate, channels, block_size - What the stream asked for.
+ *    id - Id of the stream once added.
+ *    added - Whether the stream was added.
+ *    callbacks - Audio callbacks run.
+ *    frames - Frames played or captured.
+ *    last_cb - Time of the previous callback.
+ *    latency_us - Callback to playout latency for playback, capture to
+ *        callback latency for capture.
+ *    jitter_us - How far each callback interval was off the block time.
+ *    underruns - Callbacks that came too late for their audio: playback
+ *        whose first sample was due to play already, capture whose first
+ *        sample was older than the stream buffer.
+ *    errors - Errors reported by the client for the stream.
+ *    noise - State of the noise generator for playback.
+ *    server_overruns - Overruns of the stream reported by the server.
+ *    have_server_info - Whether the server reported on the stream.
+ */
+struct load_stream {
+	enum CRAS_STREAM_DIRECTION direction;
+	unsigned int client;
+	snd_pcm_format_t format;
+	size_t rate;
+	size_t channels;
+	size_t block_size;
+	cras_stream_id_t id;
+	bool added;
+	uint64_t callbacks;
+	uint64_t frames;
+	struct timespec last_cb;
+	struct stat_acc latency_us;
+	struct stat_acc jitter_us;
+	unsigned int underruns;
+	unsigned int errors;
+	uint32_t noise;
+	uint32_t server_overruns;
+	bool have_server_info;
+};
+
+/* A list of values given as a comma separated option. */
+struct value_list {
+	unsigned int num;
+	size_t values[MAX_LIST_ENTRIES];
+};
+
+static struct load_stream streams[MAX_STREAMS];
+
+static struct audio_debug_info debug_info;
+static bool have_debug_info;
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static void stat_add(struct stat_acc *acc, double value)
+{
+	double delta = value - acc->mean;
+
+	if (acc->n == 0 || value < acc->min)
+		acc->min = value;
+	if (acc->n == 0 || value > acc->max)
+		acc->max = value;
+	acc->n++;
+	acc->mean += delta / acc->n;
+	acc->m2 += delta * (value - acc->mean);
+}
+
+static double stat_stddev(const struct stat_acc *acc)
+{
+	if (acc->n < 2)
+		return 0;
+	return sqrt(acc->m2 / (acc->n - 1));
+}
+
+static double timespec_to_us(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000.0 + ts->tv_nsec / 1000.0;
+}
+
+/* Fills |samples| with noise well below audible, so the server doesn't
+ * take the stream for silence and skip it. */
+static void fill_noise(struct load_stream *stream, uint8_t *samples,
+		       size_t frames)
+{
+	size_t i, num_samples = frames * stream->channels;
+	int32_t value;
+
+	for (i = 0; i < num_samples; i++) {
+		stream->noise = stream->noise * 1664525 + 1013904223;
+		value = (int32_t)(stream->noise >> 26) - 32;
+		if (stream->format == SND_PCM_FORMAT_S16_LE)
+			((int16_t *)samples)[i] = value;
+		else
+			((int32_t *)samples)[i] = value * (1 << 16);
+	}
+}
+
+static int stream_cb(struct cras_client *client, cras_stream_id_t stream_id,
+		     uint8_t *samples, size_t frames,
+		     const struct timespec *sample_time, void *arg)
+{
+	struct load_stream *stream = (struct load_stream *)arg;
+	struct timespec now, diff, latency;
+	double block_us, latency_us;
+
+	block_us = 1000000.0 * stream->block_size / stream->rate;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	if (stream->callbacks) {
+		subtract_timespecs(&now, &stream->last_cb, &diff);
+		stat_add(&stream->jitter_us,
+			 fabs(timespec_to_us(&diff) - block_us));
+	}
+	stream->last_cb = now;
+	stream->callbacks++;
+	stream->frames += frames;
+
+	if (stream->direction == CRAS_STREAM_OUTPUT) {
+		fill_noise(stream, samples, frames);
+		/* Due to play already when the time is in the past. */
+		if (!timespec_after(sample_time, &now)) {
+			stream->underruns++;
+			latency_us = 0;
+		} else {
+			cras_client_calc_playback_latency(sample_time,
+							  &latency);
+			latency_us = timespec_to_us(&latency);
+		}
+	} else {
+		cras_client_calc_capture_latency(sample_time, &latency);
+		latency_us = timespec_to_us(&latency);
+		if (latency_us > 2 * block_us)
+			stream->underruns++;
+	}
+	stat_add(&stream->latency_us, latency_us);
+
+	return frames;
+}
+
+static int stream_error_cb(struct cras_client *client,
+			   cras_stream_id_t stream_id, int err, void *arg)
+{
+	struct load_stream *stream = (struct load_stream *)arg;
+
+	stream->errors++;
+	syslog(LOG_WARNING, "Stream %x error %d", stream_id, err);
+	return 0;
+}
+
+static void debug_info_cb(struct cras_client *client)
+{
+	const struct audio_debug_info *info;
+
+	info = cras_client_get_audio_debug_info(client);
+	pthread_mutex_lock(&done_mutex);
+	if (info) {
+		memcpy(&debug_info, info, sizeof(debug_info));
+		have_debug_info = true;
+	}
+	pthread_cond_signal(&done_cond);
+	pthread_mutex_unlock(&done_mutex);
+}
+
+/* Fetches the debug info of the server, for its count of underruns and
+ * overruns. */
+static void fetch_debug_info(struct cras_client *client)
+{
+	struct timespec wait_time;
+
+	clock_gettime(CLOCK_REALTIME, &wait_time);
+	wait_time.tv_sec += 2;
+
+	pthread_mutex_lock(&done_mutex);
+	cras_client_update_audio_debug_info(client, debug_info_cb);
+	while (!have_debug_info)
+		if (pthread_cond_timedwait(&done_cond, &done_mutex,
+					   &wait_time) == ETIMEDOUT)
+			break;
+	pthread_mutex_unlock(&done_mutex);
+
+	if (!have_debug_info)
+		syslog(LOG_WARNING, "No debug info from the server.");
+}
+
+/*
+ * Server CPU use, from the user and system time in /proc/<pid>/stat.
+ */
+
+static pid_t find_server_pid()
+{
+	DIR *dir;
+	struct dirent *ent;
+	char path[64], comm[32];
+	FILE *f;
+	pid_t pid = 0;
+
+	dir = opendir("/proc");
+	if (!dir)
+		return 0;
+	while (!pid && (ent = readdir(dir))) {
+		if (!isdigit(ent->d_name[0]))
+			continue;
+		snprintf(path, sizeof(path), "/proc/%s/comm", ent->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fgets(comm, sizeof(comm), f) && strcmp(comm, "cras\n") == 0)
+			pid = atoi(ent->d_name);
+		fclose(f);
+	}
+	closedir(dir);
+	return pid;
+}
+
+/* Returns the CPU time used by |pid| in clock ticks, -1 on error. */
+static long long read_cpu_ticks(pid_t pid)
+{
+	char path[64], buf[1024], *p;
+	unsigned long long utime, stime;
+	FILE *f;
+	size_t len;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[len] = '\0';
+
+	/* The command name can hold spaces, the fields count from after
+	 * it. utime and stime are fields 14 and 15. */
+	p = strrchr(buf, ')');
+	if (!p || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u "
+				"%*u %llu %llu", &utime, &stime) != 2)
+		return -1;
+	return utime + stime;
+}
+
+/*
+ * Options.
+ */
+
+static int parse_list(const char *str, struct value_list *list)
+{
+	char *tokens, *token, *end, *saveptr = NULL;
+	unsigned long value;
+	int rc = 0;
+
+	tokens = strdup(str);
+	if (!tokens)
+		return -ENOMEM;
+	list->num = 0;
+	for (token = strtok_r(tokens, ",", &saveptr); token;
+	     token = strtok_r(NULL, ",", &saveptr)) {
+		value = strtoul(token, &end, 10);
+		if (end == token || *end != '\0' || value == 0 ||
+		    list->num == MAX_LIST_ENTRIES) {
+			rc = -EINVAL;
+			break;
+		}
+		list->values[list->num++] = value;
+	}
+	free(tokens);
+	if (list->num == 0)
+		rc = -EINVAL;
+	return rc;
+}
+
+static int parse_formats(const char *str, struct value_list *list)
+{
+	char *tokens, *token, *saveptr = NULL;
+	int rc = 0;
+
+	tokens = strdup(str);
+	if (!tokens)
+		return -ENOMEM;
+	list->num = 0;
+	for (token = strtok_r(tokens, ",", &saveptr); token;
+	     token = strtok_r(NULL, ",", &saveptr)) {
+		if (list->num == MAX_LIST_ENTRIES) {
+			rc = -EINVAL;
+			break;
+		}
+		if (strcmp(token, "s16") == 0) {
+			list->values[list->num++] = SND_PCM_FORMAT_S16_LE;
+		} else if (strcmp(token, "s32") == 0) {
+			list->values[list->num++] = SND_PCM_FORMAT_S32_LE;
+		} else {
+			rc = -EINVAL;
+			break;
+		}
+	}
+	free(tokens);
+	if (list->num == 0)
+		rc = -EINVAL;
+	return rc;
+}
+
+/*
+ * JSON output.
+ */
+
+static void print_json_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(out, "\\u%04x", *str);
+		else
+			fputc(*str, out);
+	}
+	fputc('"', out);
+}
+
+static void print_json_stat(FILE *out, const char *name,
+			    const struct stat_acc *acc)
+{
+	fprintf(out, "\"%s\": ", name);
+	if (acc->n == 0) {
+		fprintf(out, "null");
+		return;
+	}
+	fprintf(out, "{\"min\": %.1f, \"mean\": %.1f, \"max\": %.1f, "
+		"\"stddev\": %.1f}",
+		acc->min, acc->mean, acc->max, stat_stddev(acc));
+}
+
+static const char *format_name(snd_pcm_format_t format)
+{
+	return format == SND_PCM_FORMAT_S16_LE ? "s16" : "s32";
+}
+
+static void print_json_formats(FILE *out, const struct value_list *list)
+{
+	unsigned int i;
+
+	fprintf(out, "\"formats\": [");
+	for (i = 0; i < list->num; i++)
+		fprintf(out, "%s\"%s\"", i ? ", " : "",
+			format_name(list->values[i]));
+	fprintf(out, "]");
+}
+
+static void print_json_list(FILE *out, const char *name,
+			    const struct value_list *list)
+{
+	unsigned int i;
+
+	fprintf(out, "\"%s\": [", name);
+	for (i = 0; i < list->num; i++)
+		fprintf(out, "%s%zu", i ? ", " : "", list->values[i]);
+	fprintf(out, "]");
+}
+
+static void print_json_streams(FILE *out, unsigned int num_streams)
+{
+	const struct load_stream *stream;
+	unsigned int i;
+
+	fprintf(out, "  \"streams\": [\n");
+	for (i = 0; i < num_streams; i++) {
+		stream = &streams[i];
+		fprintf(out, "    {\"direction\": \"%s\", \"client\": %u, "
+			"\"format\": \"%s\", \"rate\": %zu, "
+			"\"channels\": %zu, \"block_size\": %zu, "
+			"\"added\": %s, \"callbacks\": %" PRIu64 ", "
+			"\"frames\": %" PRIu64 ",\n     ",
+			stream->direction == CRAS_STREAM_OUTPUT ?
+				"playback" : "capture",
+			stream->client,
+			format_name(stream->format),
+			stream->rate, stream->channels, stream->block_size,
+			stream->added ? "true" : "false",
+			stream->callbacks, stream->frames);
+		print_json_stat(out, "latency_us", &stream->latency_us);
+		fprintf(out, ",\n     ");
+		print_json_stat(out, "jitter_us", &stream->jitter_us);
+		fprintf(out, ",\n     \"underruns\": %u, \"errors\": %u, "
+			"\"server_overruns\": ",
+			stream->underruns, stream->errors);
+		if (stream->have_server_info)
+			fprintf(out, "%u}", stream->server_overruns);
+		else
+			fprintf(out, "null}");
+		fprintf(out, "%s\n", i + 1 < num_streams ? "," : "");
+	}
+	fprintf(out, "  ],\n");
+}
+
+static void print_json_devices(FILE *out)
+{
+	const struct audio_dev_debug_info *dev;
+	unsigned int i, num_devs;
+
+	fprintf(out, "  \"devices\": ");
+	if (!have_debug_info) {
+		fprintf(out, "null,\n");
+		return;
+	}
+	num_devs = MIN(debug_info.num_devs, MAX_DEBUG_DEVS);
+	fprintf(out, "[\n");
+	for (i = 0; i < num_devs; i++) {
+		dev = &debug_info.devs[i];
+		fprintf(out, "    {\"name\": ");
+		print_json_string(out, dev->dev_name);
+		fprintf(out, ", \"direction\": \"%s\", \"rate\": %u, "
+			"\"underruns\": %u, \"severe_underruns\": %u, "
+			"\"est_rate_ratio\": %.6f}%s\n",
+			dev->direction == CRAS_STREAM_OUTPUT ?
+				"playback" : "capture",
+			dev->frame_rate, dev->num_underruns,
+			dev->num_severe_underruns, dev->est_rate_ratio,
+			i + 1 < num_devs ? "," : "");
+	}
+	fprintf(out, "  ],\n");
+}
+
+static void print_json_cpu(FILE *out, pid_t pid,
+			   const struct stat_acc *cpu_percent)
+{
+	fprintf(out, "  \"server_cpu\": ");
+	if (!pid || cpu_percent->n == 0) {
+		fprintf(out, "null\n");
+		return;
+	}
+	fprintf(out, "{\"pid\": %d, \"samples\": %" PRIu64 ", ",
+		pid, cpu_percent->n);
+	print_json_stat(out, "percent", cpu_percent);
+	fprintf(out, "}\n");
+}
+
+/* Copies the overruns the server counted to the streams it reported on. */
+static void match_server_streams(unsigned int num_streams)
+{
+	unsigned int i, j, num_server_streams;
+
+	if (!have_debug_info)
+		return;
+	num_server_streams = MIN(debug_info.num_streams, MAX_DEBUG_STREAMS);
+	for (i = 0; i < num_streams; i++) {
+		if (!streams[i].added)
+			continue;
+		for (j = 0; j < num_server_streams; j++) {
+			if (debug_info.streams[j].stream_id != streams[i].id)
+				continue;
+			streams[i].server_overruns =
+				debug_info.streams[j].num_overruns;
+			streams[i].have_server_info = true;
+			break;
+		}
+	}
+}
+
+static void print_usage(const char *command) {
+	fprintf(stderr,
+		"%s [options]\n"
+		"  Where [options] are:\n"
+		"    --playback <n>  - Playback streams to run (default 1).\n"
+		"    --capture <n>  - Capture streams to run (default 0).\n"
+		"    --clients <n>  - Clients to spread the streams over "
+			"(default 1).\n"
+		"    --duration_seconds <n>  - How long to run (default 10).\n"
+		"    --rates <list>  - Rates the streams take in turn, as "
+			"48000,44100 (default 48000).\n"
+		"    --block_sizes <list>  - Block sizes the streams take in "
+			"turn (default 480).\n"
+		"    --channels <list>  - Channel counts the streams take in "
+			"turn (default 2).\n"
+		"    --formats <list>  - Formats the streams take in turn, "
+			"s16 or s32 (default s16).\n"
+		"    --playback_device <n>  - Pin playback to device index n.\n"
+		"    --capture_device <n>  - Pin capture to device index n.\n"
+		"    --server_pid <pid>  - Pid of the server, found by name "
+			"if not given.\n"
+		"    --cpu_interval_ms <n>  - How often to sample the server "
+			"CPU use (default 1000).\n"
+		"    --output <file>  - Write the JSON results to file "
+			"instead of stdout.\n"
+		"    --log-level <n>  - Set the syslog level (7 == "
+			"LOG_DEBUG).\n"
+		"    --help  - Print this message.\n",
+		command);
+}
+
+/* Adds stream |idx| from |client|, the stream params cycle through the
+ * lists given, each on its own. */
+static int add_stream(struct cras_client *client, unsigned int idx,
+		      int pin_dev)
+{
+	struct load_stream *stream = &streams[idx];
+	struct cras_audio_format *aud_format;
+	struct cras_stream_params *params;
+	int rc;
+
+	aud_format = cras_audio_format_create(stream->format, stream->rate,
+					      stream->channels);
+	if (!aud_format)
+		return -ENOMEM;
+
+	params = cras_client_stream_params_create(
+			stream->direction, stream->block_size * 2,
+			stream->block_size, 0, CRAS_STREAM_TYPE_DEFAULT, 0,
+			stream, stream_cb, stream_error_cb, aud_format);
+	if (!params) {
+		cras_audio_format_destroy(aud_format);
+		return -ENOMEM;
+	}
+
+	if (pin_dev >= 0)
+		rc = cras_client_add_pinned_stream(client, pin_dev,
+						   &stream->id, params);
+	else
+		rc = cras_client_add_stream(client, &stream->id, params);
+	if (rc == 0)
+		stream->added = true;
+
+	cras_client_stream_params_destroy(params);
+	cras_audio_format_destroy(aud_format);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	struct cras_client *clients[MAX_CLIENTS] = { NULL };
+	struct value_list rates = { 1, { 48000 } };
+	struct value_list block_sizes = { 1, { 480 } };
+	struct value_list channels = { 1, { 2 } };
+	struct value_list formats = { 1, { SND_PCM_FORMAT_S16_LE } };
+	unsigned int num_playback = 1, num_capture = 0, num_clients = 1;
+	unsigned int duration_seconds = 10, cpu_interval_ms = 1000;
+	unsigned int i, num_streams;
+	int playback_dev = -1, capture_dev = -1;
+	pid_t server_pid = 0;
+	const char *output = NULL;
+	FILE *out = stdout;
+	struct stat_acc cpu_percent;
+	struct timespec start, now, diff, interval;
+	long long ticks, last_ticks;
+	double elapsed, last_elapsed;
+	long ticks_per_sec;
+	int log_level = LOG_WARNING;
+	int option_character;
+	int rc = 0;
+	static struct option long_options[] = {
+		{"playback", required_argument, NULL, 'p'},
+		{"capture", required_argument, NULL, 'c'},
+		{"clients", required_argument, NULL, 'n'},
+		{"duration_seconds", required_argument, NULL, 'd'},
+		{"rates", required_argument, NULL, 'r'},
+		{"block_sizes", required_argument, NULL, 'b'},
+		{"channels", required_argument, NULL, 'C'},
+		{"formats", required_argument, NULL, 'f'},
+		{"playback_device", required_argument, NULL, 'P'},
+		{"capture_device", required_argument, NULL, 'R'},
+		{"server_pid", required_argument, NULL, 's'},
+		{"cpu_interval_ms", required_argument, NULL, 'i'},
+		{"output", required_argument, NULL, 'o'},
+		{"log-level", required_argument, NULL, 'l'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0},
+	};
+
+	while(true) {
+		int option_index = 0;
+
+		option_character = getopt_long(argc, argv,
+					       "p:c:n:d:r:b:C:f:P:R:s:i:o:l:h",
+					       long_options, &option_index);
+		if (option_character == -1)
+			break;
+		switch (option_character) {
+		case 'p':
+			num_playback = atoi(optarg);
+			break;
+		case 'c':
+			num_capture = atoi(optarg);
+			break;
+		case 'n':
+			num_clients = atoi(optarg);
+			break;
+		case 'd':
+			duration_seconds = atoi(optarg);
+			break;
+		case 'r':
+			rc = parse_list(optarg, &rates);
+			break;
+		case 'b':
+			rc = parse_list(optarg, &block_sizes);
+			break;
+		case 'C':
+			rc = parse_list(optarg, &channels);
+			break;
+		case 'f':
+			rc = parse_formats(optarg, &formats);
+			break;
+		case 'P':
+			playback_dev = atoi(optarg);
+			break;
+		case 'R':
+			capture_dev = atoi(optarg);
+			break;
+		case 's':
+			server_pid = atoi(optarg);
+			break;
+		case 'i':
+			cpu_interval_ms = atoi(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'l':
+			log_level = atoi(optarg);
+			if (log_level < 0)
+				log_level = LOG_WARNING;
+			else if (log_level > LOG_DEBUG)
+				log_level = LOG_DEBUG;
+			break;
+		default:
+			print_usage(argv[0]);
+			return 1;
+		}
+		if (rc) {
+			fprintf(stderr, "%s: Invalid list '%s'.\n",
+				argv[0], optarg);
+			return 1;
+		}
+	}
+
+	if (optind < argc) {
+		fprintf(stderr, "%s: Extra arguments.\n", argv[0]);
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	num_streams = num_playback + num_capture;
+	if (num_streams == 0 || num_streams > MAX_STREAMS ||
+	    num_clients == 0 || num_clients > MAX_CLIENTS ||
+	    cpu_interval_ms == 0) {
+		fprintf(stderr, "%s: Need 1 to %d streams from 1 to %d "
+			"clients.\n", argv[0], MAX_STREAMS, MAX_CLIENTS);
+		return 1;
+	}
+	num_clients = MIN(num_clients, num_streams);
+
+	openlog("cras_load_gen", LOG_PERROR, LOG_USER);
+	setlogmask(LOG_UPTO(log_level));
+
+	if (output) {
+		out = fopen(output, "w");
+		if (!out) {
+			syslog(LOG_ERR, "Couldn't open %s.", output);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < num_clients; i++) {
+		rc = cras_client_create(&clients[i]);
+		if (rc < 0) {
+			syslog(LOG_ERR, "Couldn't create client.");
+			goto destroy_clients;
+		}
+		rc = cras_client_connect_timeout(clients[i], 1000);
+		if (rc) {
+			syslog(LOG_ERR, "Couldn't connect to server.");
+			goto destroy_clients;
+		}
+		rc = cras_client_run_thread(clients[i]);
+		if (rc) {
+			syslog(LOG_ERR, "Couldn't run client thread.");
+			goto destroy_clients;
+		}
+	}
+
+	if (!server_pid)
+		server_pid = find_server_pid();
+	if (!server_pid)
+		syslog(LOG_WARNING, "Server not found, no CPU use measured.");
+	ticks_per_sec = sysconf(_SC_CLK_TCK);
+
+	for (i = 0; i < num_streams; i++) {
+		struct load_stream *stream = &streams[i];
+
+		stream->direction = i < num_playback ? CRAS_STREAM_OUTPUT :
+						      CRAS_STREAM_INPUT;
+		stream->client = i % num_clients;
+		stream->rate = rates.values[i % rates.num];
+		stream->block_size = block_sizes.values[i % block_sizes.num];
+		stream->channels = channels.values[i % channels.num];
+		stream->format = formats.values[i % formats.num];
+		stream->noise = i + 1;
+
+		rc = add_stream(clients[stream->client], i,
+				stream->direction == CRAS_STREAM_OUTPUT ?
+					playback_dev : capture_dev);
+		if (rc)
+			syslog(LOG_ERR, "Couldn't add stream %u: %d", i, rc);
+	}
+
+	/* Sample the server CPU use until the time is up. */
+	memset(&cpu_percent, 0, sizeof(cpu_percent));
+	interval.tv_sec = cpu_interval_ms / 1000;
+	interval.tv_nsec = (cpu_interval_ms % 1000) * 1000000;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	last_ticks = server_pid ? read_cpu_ticks(server_pid) : -1;
+	last_elapsed = 0;
+	do {
+		nanosleep(&interval, NULL);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+		subtract_timespecs(&now, &start, &diff);
+		elapsed = diff.tv_sec + diff.tv_nsec / 1000000000.0;
+
+		ticks = server_pid ? read_cpu_ticks(server_pid) : -1;
+		if (ticks >= 0 && last_ticks >= 0 && elapsed > last_elapsed)
+			stat_add(&cpu_percent,
+				 100.0 * (ticks - last_ticks) / ticks_per_sec /
+				 (elapsed - last_elapsed));
+		last_ticks = ticks;
+		last_elapsed = elapsed;
+	} while (elapsed < duration_seconds);
+
+	/* Take the server counts while the streams are still attached. */
+	fetch_debug_info(clients[0]);
+
+	for (i = 0; i < num_streams; i++)
+		if (streams[i].added)
+			cras_client_rm_stream(clients[streams[i].client],
+					      streams[i].id);
+
+	match_server_streams(num_streams);
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"config\": {\"playback\": %u, \"capture\": %u, "
+		"\"clients\": %u, \"duration_seconds\": %u, ",
+		num_playback, num_capture, num_clients, duration_seconds);
+	print_json_list(out, "rates", &rates);
+	fprintf(out, ", ");
+	print_json_list(out, "block_sizes", &block_sizes);
+	fprintf(out, ", ");
+	print_json_list(out, "channels", &channels);
+	fprintf(out, ", ");
+	print_json_formats(out, &formats);
+	fprintf(out, ", \"playback_device\": %d, \"capture_device\": %d},\n",
+		playback_dev, capture_dev);
+	print_json_streams(out, num_streams);
+	print_json_devices(out);
+	print_json_cpu(out, server_pid, &cpu_percent);
+	fprintf(out, "}\n");
+	rc = 0;
+
+destroy_clients:
+	for (i = 0; i < num_clients; i++)
+		if (clients[i])
+			cras_client_destroy(clients[i]);
+	if (out != stdout)
+		fclose(out);
+	return rc ? 1 : 0;
+}
@@ -36,6 +36,7 @@ static const size_t MAX_ATTACHED_CLIENTS = 10; /* Max clients to print out. */
 
 static int pipefd[2];
 static struct timespec last_latency;
+static struct timespec last_latency_bound;
 static int show_latency;
 static float last_rms_sqr_sum;
 static int last_rms_size;
@@ -139,7 +140,8 @@ static int got_samples(struct cras_client *client,
 	while (pause_client)
 		usleep(10000);
 
-	cras_client_calc_capture_latency(captured_time, &last_latency);
+	cras_client_calc_latency_bound(client, stream_id, captured_time,
+				       &last_latency, &last_latency_bound);
 
 	frame_bytes = cras_client_format_bytes_per_frame(aud_format);
 	write_size = frames * frame_bytes;
@@ -183,7 +185,8 @@ static int put_samples(struct cras_client *client,
 
 	check_stream_terminate(frames);
 
-	cras_client_calc_playback_latency(playback_time, &last_latency);
+	cras_client_calc_latency_bound(client, stream_id, playback_time,
+				       &last_latency, &last_latency_bound);
 
 	if (play_short_sound) {
 		if (play_short_sound_periods_left)
@@ -243,12 +246,14 @@ static int stream_error(struct cras_client *client,
 static void print_last_latency()
 {
 	if (last_latency.tv_sec > 0 || last_latency.tv_nsec > 0)
-		printf("%u.%09u\n", (unsigned)last_latency.tv_sec,
+		printf("%u.%09u", (unsigned)last_latency.tv_sec,
 		       (unsigned)last_latency.tv_nsec);
 	else {
-		printf("-%lld.%09lld\n", (long long)-last_latency.tv_sec,
+		printf("-%lld.%09lld", (long long)-last_latency.tv_sec,
 		       (long long)-last_latency.tv_nsec);
 	}
+	printf(" +/- %u.%09u\n", (unsigned)last_latency_bound.tv_sec,
+	       (unsigned)last_latency_bound.tv_nsec);
 }
 
 static void print_last_rms()
@@ -545,6 +550,10 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 {
 	int i, j;
 	printf("Audio Debug Stats:\n");
+	printf("fmt_conv_pool hits: %u misses: %u\n",
+	       (unsigned int)info->fmt_conv_pool_hits,
+	       (unsigned int)info->fmt_conv_pool_misses);
+	printf("apm instances: %u\n", (unsigned int)info->num_apms);
 	printf("-------------devices------------\n");
 	if (info->num_devs > MAX_DEBUG_DEVS)
 		return;
@@ -574,6 +583,16 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 		       (unsigned int)info->devs[i].num_underruns,
 		       (unsigned int)info->devs[i].num_severe_underruns,
 		       (unsigned int)info->devs[i].highest_hw_level);
+		if (info->devs[i].num_wakes)
+			printf("hw_calls_per_wake: %.2f\n",
+			       (double)info->devs[i].num_hw_calls /
+					info->devs[i].num_wakes);
+		if (info->devs[i].adaptive_watermark)
+			printf("adaptive_watermark near_misses: %u\n",
+			       (unsigned int)info->devs[i].num_near_misses);
+		if (info->devs[i].num_overruns)
+			printf("num_overruns: %u\n",
+			       (unsigned int)info->devs[i].num_overruns);
 		printf("\n");
 	}
 
@@ -594,6 +613,7 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 		printf("buffer_frames: %u\n"
 		       "cb_threshold: %u\n"
 		       "effects: 0x%.4x\n"
+		       "apm_users: %u\n"
 		       "frame_rate: %u\n"
 		       "num_channels: %u\n"
 		       "longest_fetch_sec: %u.%09u\n"
@@ -601,6 +621,7 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 		       (unsigned int)info->streams[i].buffer_frames,
 		       (unsigned int)info->streams[i].cb_threshold,
 		       (unsigned int)info->streams[i].effects,
+		       (unsigned int)info->streams[i].apm_users,
 		       (unsigned int)info->streams[i].frame_rate,
 		       (unsigned int)info->streams[i].num_channels,
 		       (unsigned int)info->streams[i].longest_fetch_sec,
@@ -695,6 +716,52 @@ static void audio_thread_snapshots(struct cras_client *client)
 	pthread_mutex_unlock(&done_mutex);
 }
 
+static void print_dsp_profile_info(struct cras_client *client)
+{
+	const struct dsp_profile_info *info;
+	const struct dsp_pipeline_profile_info *p;
+	const struct dsp_module_profile_info *m;
+	unsigned int i, j, k;
+
+	info = cras_client_get_dsp_profile_info(client);
+	/* The server starts profiling on the first request. */
+	if (info->num_pipelines && info->pipelines[0].num_modules &&
+	    !info->pipelines[0].modules[0].runs)
+		printf("Profiling started, dump again for module times.\n");
+
+	for (i = 0; i < info->num_pipelines; i++) {
+		p = &info->pipelines[i];
+		printf("Pipeline %s: rate %u, fixed_point %u, "
+		       "%" PRIu64 " frames in %" PRIu64 "ns, max %" PRIu64
+		       "ns\n", p->purpose, p->sample_rate, p->fixed_point,
+		       p->total_samples, p->total_ns, p->max_ns);
+		for (j = 0; j < p->num_modules; j++) {
+			m = &p->modules[j];
+			printf("  %-20s runs %" PRIu64 " avg %" PRIu64
+			       "ns max %uns\n", m->name, m->runs,
+			       m->runs ? m->total_ns / m->runs : 0,
+			       m->max_ns);
+			printf("    histogram(us):");
+			for (k = 0; k < DSP_PROFILE_NUM_BUCKETS; k++) {
+				if (!m->histogram[k])
+					continue;
+				if (k == DSP_PROFILE_NUM_BUCKETS - 1)
+					printf(" >=%u:%u", 1u << (k - 1),
+					       m->histogram[k]);
+				else
+					printf(" <%u:%u", 1u << k,
+					       m->histogram[k]);
+			}
+			printf("\n");
+		}
+	}
+
+	/* Signal main thread we are done. */
+	pthread_mutex_lock(&done_mutex);
+	pthread_cond_signal(&done_cond);
+	pthread_mutex_unlock(&done_mutex);
+}
+
 static int start_stream(struct cras_client *client,
 			cras_stream_id_t *stream_id,
 			struct cras_stream_params *params,
@@ -1062,6 +1129,22 @@ static void show_audio_thread_snapshots(struct cras_client *client)
 	pthread_mutex_unlock(&done_mutex);
 }
 
+static void show_dsp_profile_info(struct cras_client *client)
+{
+	struct timespec wait_time;
+
+	cras_client_run_thread(client);
+	cras_client_connected_wait(client); /* To synchronize data. */
+	cras_client_update_dsp_profile_info(client, print_dsp_profile_info);
+
+	clock_gettime(CLOCK_REALTIME, &wait_time);
+	wait_time.tv_sec += 2;
+
+	pthread_mutex_lock(&done_mutex);
+	pthread_cond_timedwait(&done_cond, &done_mutex, &wait_time);
+	pthread_mutex_unlock(&done_mutex);
+}
+
 static void show_audio_debug_info(struct cras_client *client)
 {
 	struct timespec wait_time;
@@ -1179,6 +1262,8 @@ static struct option long_options[] = {
 	{"reload_aec_config",	no_argument,		0, 'D'},
 	{"effects",		required_argument,	0, 'E'},
 	{"get_aec_supported",	no_argument,		0, 'F'},
+	{"dump_dsp_profile",	no_argument,		0, 'G'},
+	{"sim_hw_config",	required_argument,	0, 'H'},
 	{"syslog_mask",		required_argument,	0, 'L'},
 	{"mute_loop_test",	required_argument,	0, 'M'},
 	{"stream_type",		required_argument,	0, 'T'},
@@ -1191,7 +1276,8 @@ static void show_usage()
 	       "to active input device list\n");
 	printf("--add_active_output <N>:<M> - Add the ionode with the given id"
 	       "to active output device list\n");
-	printf("--add_test_dev <type> - add a test iodev.\n");
+	printf("--add_test_dev <type> - add a test iodev. Types: 0 - hotword,\n"
+	       "                       1 - simulated playback, 2 - simulated capture.\n");
 	printf("--block_size <N> - The number for frames per callback(dictates latency).\n");
 	printf("--capture_file <name> - Name of file to record to.\n");
 	printf("--capture_gain <dB> - Set system caputre gain in dB*100 (100 = 1dB).\n");
@@ -1200,6 +1286,7 @@ static void show_usage()
 	printf("--check_output_plugged <output name> - Check if the output is plugged in\n");
 	printf("--dump_audio_thread - Dumps audio thread info.\n");
 	printf("--dump_dsp - Print status of dsp to syslog.\n");
+	printf("--dump_dsp_profile - Print CPU time of each dsp module since the first call.\n");
 	printf("--dump_server_info - Print status of the server.\n");
 	printf("--duration_seconds <N> - Seconds to record or playback.\n");
 	printf("--get_hotword_models <N>:<M> - Get the supported hotword models of node\n");
@@ -1232,6 +1319,10 @@ static void show_usage()
 	       "                             1 - Record from post-DSP loopback device.\n");
 	printf("--set_node_volume <N>:<M>:<0-100> - Set the volume of the ionode with the given id\n");
 	printf("--show_latency - Display latency while playing or recording.\n");
+	printf("--sim_hw_config <N>:<params> - Set the timing of simulated device N from\n"
+	       "                               drift_ppm, period, jitter_us, xrun_ms and seed,\n"
+	       "                               e.g. drift_ppm=100,period=256,jitter_us=500.\n"
+	       "                               Applies at the next open of the device.\n");
 	printf("--show_rms - Display RMS value of loopback stream.\n");
 	printf("--show_total_rms - Display total RMS value of loopback stream at the end.\n");
 	printf("--suspend <0|1> - Set audio suspend state.\n");
@@ -1603,6 +1694,33 @@ int main(int argc, char **argv)
 		case 'F':
 			printf("AEC supported %d\n",
 			       !!cras_client_get_aec_supported(client));
+			break;
+		case 'H': {
+			const char *s;
+			const char *params;
+			int dev_index;
+
+			s = strtok(optarg, ":");
+			if (!s) {
+				show_usage();
+				return -EINVAL;
+			}
+			dev_index = atoi(s);
+
+			params = strtok(NULL, ":");
+			if (!params) {
+				show_usage();
+				return -EINVAL;
+			}
+			cras_client_test_iodev_command(client, dev_index,
+					TEST_IODEV_CMD_SIM_CONFIG,
+					strlen(params),
+					(const uint8_t *)params);
+			break;
+		}
+		case 'G':
+			show_dsp_profile_info(client);
+			break;
 		default:
 			break;
 		}
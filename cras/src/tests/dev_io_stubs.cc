@@ -22,7 +22,8 @@ extern "C" {
 ShmPtr create_shm(size_t cb_threshold) {
   uint32_t frame_bytes = 4;
   uint32_t used_size = cb_threshold * 2 * frame_bytes;
-  uint32_t shm_size = sizeof(cras_audio_shm_area) + used_size * 2;
+  uint32_t shm_size = sizeof(cras_audio_shm_area) + used_size * 2 +
+                      sizeof(cras_audio_shm_trailer);
   ShmPtr shm(reinterpret_cast<cras_audio_shm_area*>(calloc(1, shm_size)),
               free);
   shm->config.used_size = used_size;
@@ -14,6 +14,7 @@ extern "C" {
 #include "dev_stream.h" // tested
 #include "cras_rstream.h" // stubbed
 #include "cras_iodev.h" // stubbed
+#include "cras_fmt_conv.h"
 #include "cras_shm.h"
 #include "cras_types.h"
 #include "utlist.h"
@@ -67,6 +68,61 @@ TEST_F(DevIoSuite, SendCapturedFails) {
   EXPECT_EQ(-3, dev_io_send_captured_samples(dev_list));
 }
 
+TEST_F(DevIoSuite, ClockSlaveLocksToStreamMaster) {
+  const size_t cb_threshold = 480;
+
+  cras_audio_format format;
+  fill_audio_format(&format, 48000);
+
+  struct open_dev* dev_list = NULL;
+  DevicePtr master = create_device(CRAS_STREAM_OUTPUT, cb_threshold,
+                                   &format, CRAS_NODE_TYPE_INTERNAL_SPEAKER);
+  DevicePtr slave = create_device(CRAS_STREAM_OUTPUT, cb_threshold,
+                                  &format, CRAS_NODE_TYPE_HEADPHONE);
+  master->dev->info.idx = 1;
+  master->dev->state = CRAS_IODEV_STATE_NORMAL_RUN;
+  master->dev->ext_format = &format;
+  slave->dev->info.idx = 2;
+  slave->dev->state = CRAS_IODEV_STATE_NORMAL_RUN;
+  slave->dev->ext_format = &format;
+  DL_APPEND(dev_list, master->odev.get());
+  DL_APPEND(dev_list, slave->odev.get());
+
+  // One stream played by both devices, the first one is its master.
+  StreamPtr stream =
+      create_stream(1, 1, CRAS_STREAM_OUTPUT, cb_threshold, &format);
+  stream->rstream->master_dev.dev_id = 1;
+  stream->rstream->master_dev.dev_ptr = master->dev.get();
+  add_stream_to_dev(master->dev, stream);
+  DevStreamPtr slave_stream = create_dev_stream(2, stream->rstream.get());
+  slave_stream->conv = cras_fmt_conv_create(&format, &format, cb_threshold,
+                                            0, CRAS_RESAMPLER_SPEEX);
+  DL_APPEND(slave->dev->streams, slave_stream.get());
+
+  // The slave plays 10 frames ahead of the master. It takes a measurement
+  // to pick the master and one more to start the phase lock.
+  for (unsigned int i = 0; i < 3; i++) {
+    struct timespec ts = { 1, i * 100000000L };
+    rstream_stub_dev_offset(stream->rstream.get(), 1, i * 4800);
+    rstream_stub_dev_offset(stream->rstream.get(), 2, i * 4800);
+    iodev_stub_frames_queued(master->dev.get(), 480, ts);
+    iodev_stub_frames_queued(slave->dev.get(), 470, ts);
+    write_output_samples(&dev_list, master->odev.get(), NULL);
+    write_output_samples(&dev_list, slave->odev.get(), NULL);
+    EXPECT_EQ(master->dev.get(), slave->odev->clock.master);
+    EXPECT_EQ(NULL, master->odev->clock.master);
+  }
+
+  // The slave is slowed down, the stream keeps its master device.
+  EXPECT_GT(slave->odev->clock.correction, 0);
+  EXPECT_EQ(slave->odev->clock.correction, slave->odev->clock.applied);
+  EXPECT_EQ(0, master->odev->clock.correction);
+  EXPECT_EQ(1, stream->rstream->master_dev.dev_id);
+  EXPECT_NE(48000, cras_fmt_conv_in_frames_to_out(slave_stream->conv, 48000));
+
+  cras_fmt_conv_destroy(&slave_stream->conv);
+}
+
 /* Stubs */
 extern "C" {
 
@@ -96,6 +152,12 @@ int input_data_get_for_stream(
   return 0;
 }
 
+unsigned int input_data_get_delay_frames(struct input_data *data,
+					 struct cras_rstream *stream)
+{
+  return 0;
+}
+
 int input_data_put_for_stream(struct input_data *data,
 			   struct cras_rstream *stream,
 			   struct buffer_share *offsets,
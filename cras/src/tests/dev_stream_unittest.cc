@@ -9,6 +9,8 @@ extern "C" {
 #include "audio_thread_log.h"
 #include "byte_buffer.h"
 #include "cras_audio_area.h"
+#include "cras_iodev.h"
+#include "cras_resampler.h"
 #include "cras_rstream.h"
 #include "cras_shm.h"
 #include "cras_types.h"
@@ -86,6 +88,10 @@ static int config_format_converter_called;
 static const struct cras_audio_format *config_format_converter_from_fmt;
 static int config_format_converter_frames;
 static struct cras_fmt_conv *config_format_converter_conv;
+static enum CRAS_RESAMPLER_TYPE config_format_converter_src_type;
+static struct cras_fmt_conv *cras_fmt_conv_pool_put_conv;
+static enum CRAS_STREAM_TYPE cras_resampler_type_for_stream_arg;
+static enum CRAS_RESAMPLER_TYPE cras_resampler_type_for_stream_ret;
 static struct cras_audio_format in_fmt;
 static struct cras_audio_format out_fmt;
 static struct cras_audio_area_copy_call copy_area_call;
@@ -107,6 +113,7 @@ static int cras_rstream_audio_ready_called;
 static int cras_rstream_audio_ready_count;
 static int cras_rstream_is_pending_reply_ret;
 static int cras_rstream_flush_old_audio_messages_called;
+static int cras_mix_buffer_is_zero_ret;
 
 class CreateSuite : public testing::Test{
   protected:
@@ -131,6 +138,9 @@ class CreateSuite : public testing::Test{
 
       config_format_converter_from_fmt = NULL;
       config_format_converter_called = 0;
+      config_format_converter_src_type = CRAS_RESAMPLER_NUM_TYPES;
+      cras_fmt_conv_pool_put_conv = NULL;
+      cras_resampler_type_for_stream_ret = CRAS_RESAMPLER_SPEEX;
       cras_fmt_conversion_needed_val = 0;
       cras_fmt_conv_set_linear_resample_rates_called = 0;
 
@@ -138,6 +148,7 @@ class CreateSuite : public testing::Test{
       cras_rstream_audio_ready_count = 0;
       cras_rstream_is_pending_reply_ret = 0;
       cras_rstream_flush_old_audio_messages_called = 0;
+      cras_mix_buffer_is_zero_ret = 0;
 
       memset(&copy_area_call, 0xff, sizeof(copy_area_call));
       memset(&conv_frames_call, 0xff, sizeof(conv_frames_call));
@@ -182,7 +193,9 @@ class CreateSuite : public testing::Test{
       int16_t *buf;
 
       shm->area = static_cast<struct cras_audio_shm_area *>(
-          calloc(1, kBufferFrames * 4 + sizeof(cras_audio_shm_area)));
+          calloc(1, kBufferFrames * 4 * CRAS_NUM_SHM_BUFFERS +
+                    sizeof(cras_audio_shm_area) +
+                    sizeof(cras_audio_shm_trailer)));
       cras_shm_set_frame_bytes(shm, 4);
       cras_shm_set_used_size(shm,
                              kBufferFrames * cras_shm_frame_bytes(shm));
@@ -327,6 +340,32 @@ TEST_F(CreateSuite, CreateSRC44to48) {
   dev_stream_destroy(dev_stream);
 }
 
+TEST_F(CreateSuite, CreateUsesResamplerForStreamType) {
+  struct dev_stream *dev_stream;
+
+  rstream_.stream_type = CRAS_STREAM_TYPE_VOICE_COMMUNICATION;
+  cras_resampler_type_for_stream_ret = CRAS_RESAMPLER_FAST;
+  config_format_converter_conv = reinterpret_cast<struct cras_fmt_conv*>(0x33);
+  dev_stream = dev_stream_create(&rstream_, 0, &fmt_s16le_48, (void *)0x55,
+                                 &cb_ts);
+  EXPECT_EQ(1, config_format_converter_called);
+  EXPECT_EQ(CRAS_STREAM_TYPE_VOICE_COMMUNICATION,
+            cras_resampler_type_for_stream_arg);
+  EXPECT_EQ(CRAS_RESAMPLER_FAST, config_format_converter_src_type);
+  dev_stream_destroy(dev_stream);
+}
+
+TEST_F(CreateSuite, DestroyReleasesConverterToPool) {
+  struct dev_stream *dev_stream;
+
+  config_format_converter_conv = reinterpret_cast<struct cras_fmt_conv*>(0x33);
+  dev_stream = dev_stream_create(&rstream_, 0, &fmt_s16le_48, (void *)0x55,
+                                 &cb_ts);
+  EXPECT_EQ(1, config_format_converter_called);
+  dev_stream_destroy(dev_stream);
+  EXPECT_EQ(config_format_converter_conv, cras_fmt_conv_pool_put_conv);
+}
+
 TEST_F(CreateSuite, CreateSRC44from48Input) {
   struct dev_stream *dev_stream;
   struct cras_audio_format processed_fmt = fmt_s16le_48;
@@ -589,7 +628,8 @@ TEST_F(CreateSuite, StreamMixNoFrames) {
   rstream_playable_frames_ret = 0;
   fmt.num_channels = 2;
   fmt.format = SND_PCM_FORMAT_S16_LE;
-  EXPECT_EQ(0, dev_stream_mix(&dev_stream, &fmt, 0, 3));
+  int silent = 1;
+  EXPECT_EQ(0, dev_stream_mix(&dev_stream, &fmt, 0, 3, &silent));
 }
 
 TEST_F(CreateSuite, StreamMixNoConv) {
@@ -605,7 +645,10 @@ TEST_F(CreateSuite, StreamMixNoConv) {
   rstream_get_readable_call.num_called = 0;
   fmt.num_channels = 2;
   fmt.format = SND_PCM_FORMAT_S16_LE;
-  EXPECT_EQ(nfr, dev_stream_mix(&dev_stream, &fmt, (uint8_t*)0x5000, nfr));
+  int silent = 1;
+  EXPECT_EQ(nfr, dev_stream_mix(&dev_stream, &fmt, (uint8_t*)0x5000, nfr,
+                                &silent));
+  EXPECT_EQ(0, silent);
   EXPECT_EQ((int16_t*)0x5000, mix_add_call.dst);
   EXPECT_EQ((int16_t*)0x4000, mix_add_call.src);
   EXPECT_EQ(200, mix_add_call.count);
@@ -631,7 +674,9 @@ TEST_F(CreateSuite, StreamMixNoConvTwoPass) {
   rstream_get_readable_call.num_called = 0;
   fmt.num_channels = 2;
   fmt.format = SND_PCM_FORMAT_S16_LE;
-  EXPECT_EQ(nfr, dev_stream_mix(&dev_stream, &fmt, (uint8_t*)0x5000, nfr));
+  int silent = 1;
+  EXPECT_EQ(nfr, dev_stream_mix(&dev_stream, &fmt, (uint8_t*)0x5000, nfr,
+                                &silent));
   const unsigned int half_offset = nfr / 2 * bytes_per_frame;
   EXPECT_EQ((int16_t*)(0x5000 + half_offset), mix_add_call.dst);
   EXPECT_EQ((int16_t*)0x4000, mix_add_call.src);
@@ -642,6 +687,76 @@ TEST_F(CreateSuite, StreamMixNoConvTwoPass) {
   EXPECT_EQ(2, rstream_get_readable_call.num_called);
 }
 
+TEST_F(CreateSuite, StreamMixSilentSkipsMix) {
+  struct dev_stream dev_stream;
+  const unsigned int nfr = 100;
+  struct cras_audio_format fmt;
+  int silent = 1;
+
+  dev_stream.conv = NULL;
+  dev_stream.stream = reinterpret_cast<cras_rstream*>(0x5446);
+  rstream_playable_frames_ret = nfr;
+  rstream_get_readable_num = nfr;
+  rstream_get_readable_ptr = reinterpret_cast<uint8_t*>(0x4000);
+  rstream_get_readable_call.num_called = 0;
+  fmt.num_channels = 2;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  mix_add_call.dst = NULL;
+  cras_mix_buffer_is_zero_ret = 1;
+
+  /* Frames are still consumed, nothing is mixed. */
+  EXPECT_EQ(nfr, dev_stream_mix(&dev_stream, &fmt, (uint8_t*)0x5000, nfr,
+                                &silent));
+  EXPECT_EQ(1, silent);
+  EXPECT_EQ(NULL, mix_add_call.dst);
+  EXPECT_EQ(1, rstream_get_readable_call.num_called);
+}
+
+TEST_F(CreateSuite, StreamMixSilentSkipsConvOnceDrained) {
+  const unsigned int nfr = 100;
+  struct cras_audio_format fmt;
+  int silent = 1;
+
+  in_fmt.frame_rate = 44100;
+  out_fmt.frame_rate = 44100;
+  devstr.conv = reinterpret_cast<cras_fmt_conv*>(0x33);
+  devstr.conv_buffer = byte_buffer_create(nfr * 4);
+  devstr.conv_silent = 0;
+  devstr.stream = reinterpret_cast<cras_rstream*>(0x5446);
+  cras_fmt_conversion_needed_val = 1;
+  rstream_playable_frames_ret = nfr;
+  rstream_get_readable_num = nfr;
+  rstream_get_readable_ptr = reinterpret_cast<uint8_t*>(0x4000);
+  fmt.num_channels = 2;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  cras_mix_buffer_is_zero_ret = 1;
+
+  /* The converter has to run once to drain any earlier tail. */
+  EXPECT_EQ(nfr, dev_stream_mix(&devstr, &fmt, (uint8_t*)0x5000, nfr,
+                                &silent));
+  EXPECT_EQ(reinterpret_cast<uint8_t*>(0x4000), conv_frames_call.in_buf);
+  EXPECT_EQ(1, devstr.conv_silent);
+  EXPECT_EQ(1, silent);
+
+  /* Then it is skipped. */
+  memset(&conv_frames_call, 0xff, sizeof(conv_frames_call));
+  EXPECT_EQ(nfr, dev_stream_mix(&devstr, &fmt, (uint8_t*)0x5000, nfr,
+                                &silent));
+  EXPECT_NE(reinterpret_cast<uint8_t*>(0x4000), conv_frames_call.in_buf);
+  EXPECT_EQ(1, silent);
+
+  /* Non-zero audio runs the converter again. */
+  cras_mix_buffer_is_zero_ret = 0;
+  EXPECT_EQ(nfr, dev_stream_mix(&devstr, &fmt, (uint8_t*)0x5000, nfr,
+                                &silent));
+  EXPECT_EQ(reinterpret_cast<uint8_t*>(0x4000), conv_frames_call.in_buf);
+  EXPECT_EQ(0, devstr.conv_silent);
+  EXPECT_EQ(0, silent);
+
+  byte_buffer_destroy(&devstr.conv_buffer);
+  devstr.conv = NULL;
+}
+
 TEST_F(CreateSuite, DevStreamFlushAudioMessages) {
   struct dev_stream *dev_stream;
   unsigned int dev_id = 9;
@@ -999,6 +1114,65 @@ TEST_F(CreateSuite, InputDevStreamWakeTimeByDevice) {
   dev_stream_destroy(dev_stream);
 }
 
+TEST_F(CreateSuite, SetDelayTstampPlayback) {
+  struct cras_iodev_delay delay;
+
+  rstream_.format.frame_rate = 48000;
+  in_fmt.frame_rate = 48000;
+  out_fmt.frame_rate = 48000;
+  rstream_.shm.area->write_offset[0] = 480 * 4;
+  rstream_.shm.area->read_offset[0] = 0;
+
+  // 100ms in the device plus 10ms in shm, projected from the hardware time
+  // stamp rather than from now.
+  delay.frames = 4800;
+  delay.tstamp.tv_sec = 1;
+  delay.tstamp.tv_nsec = 0;
+  delay.rate_ratio = 1.0;
+  delay.rate_err = 100e-6;
+  delay.frames_err = 1;
+  dev_stream_set_delay_tstamp(&devstr, &delay);
+  EXPECT_EQ(1, rstream_.shm.area->ts.tv_sec);
+  EXPECT_NEAR(110000000, rstream_.shm.area->ts.tv_nsec, 1000);
+  // One frame of pointer error, one of rate error and one of rounding.
+  EXPECT_EQ(0, cras_shm_get_trailer(&rstream_.shm)->ts_bound.tv_sec);
+  EXPECT_EQ(41666, cras_shm_get_trailer(&rstream_.shm)->ts_bound.tv_nsec);
+
+  // A device running fast plays the same frames sooner.
+  delay.rate_ratio = 1.001;
+  dev_stream_set_delay_tstamp(&devstr, &delay);
+  EXPECT_NEAR(109890110, rstream_.shm.area->ts.tv_nsec, 1000);
+}
+
+TEST_F(CreateSuite, SetDelayTstampCapture) {
+  struct cras_iodev_delay delay;
+
+  rstream_.direction = CRAS_STREAM_INPUT;
+  rstream_.format.frame_rate = 48000;
+  in_fmt.frame_rate = 48000;
+  out_fmt.frame_rate = 48000;
+  rstream_.shm.area->write_offset[0] = 0;
+
+  delay.frames = 960;
+  delay.tstamp.tv_sec = 2;
+  delay.tstamp.tv_nsec = 0;
+  delay.rate_ratio = 1.0;
+  delay.rate_err = 0;
+  delay.frames_err = 480;
+  dev_stream_set_delay_tstamp(&devstr, &delay);
+  EXPECT_EQ(1, rstream_.shm.area->ts.tv_sec);
+  EXPECT_NEAR(980000000, rstream_.shm.area->ts.tv_nsec, 1000);
+  EXPECT_EQ(10020833,
+            cras_shm_get_trailer(&rstream_.shm)->ts_bound.tv_nsec);
+
+  // The time stamp is of the first sample in the buffer, it doesn't move
+  // once the buffer has data.
+  rstream_.shm.area->write_offset[0] = 4;
+  delay.tstamp.tv_sec = 3;
+  dev_stream_set_delay_tstamp(&devstr, &delay);
+  EXPECT_EQ(1, rstream_.shm.area->ts.tv_sec);
+}
+
 //  Test set_playback_timestamp.
 TEST(DevStreamTimimg, SetPlaybackTimeStampSimple) {
   struct cras_timespec ts;
@@ -1154,19 +1328,29 @@ struct cras_audio_format *cras_rstream_post_processing_format(
   return cras_rstream_post_processing_format_val;
 }
 
+enum CRAS_RESAMPLER_TYPE cras_resampler_type_for_stream(
+    enum CRAS_STREAM_TYPE stream_type) {
+  cras_resampler_type_for_stream_arg = stream_type;
+  return cras_resampler_type_for_stream_ret;
+}
+
 int config_format_converter(struct cras_fmt_conv **conv,
 			    enum CRAS_STREAM_DIRECTION dir,
 			    const struct cras_audio_format *from,
 			    const struct cras_audio_format *to,
-			    unsigned int frames) {
+			    unsigned int frames,
+			    enum CRAS_RESAMPLER_TYPE src_type) {
   config_format_converter_called++;
+  config_format_converter_src_type = src_type;
   config_format_converter_from_fmt = from;
   config_format_converter_frames = frames;
   *conv = config_format_converter_conv;
   return 0;
 }
 
-void cras_fmt_conv_destroy(struct cras_fmt_conv *conv) {
+void cras_fmt_conv_pool_put(struct cras_fmt_conv **conv) {
+  cras_fmt_conv_pool_put_conv = *conv;
+  *conv = NULL;
 }
 
 size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
@@ -1204,6 +1388,10 @@ void cras_mix_add(snd_pcm_format_t fmt, uint8_t *dst, uint8_t *src,
   mix_add_call.mix_vol = mix_vol;
 }
 
+int cras_mix_buffer_is_zero(const uint8_t *buf, size_t bytes) {
+  return cras_mix_buffer_is_zero_ret;
+}
+
 struct cras_audio_area *cras_audio_area_create(int num_channels) {
   cras_audio_area_create_num_channels_val = num_channels;
   return NULL;
@@ -34,6 +34,28 @@ static float magnitude_at(float *data, size_t len, float f)
   return sqrt(re * re + im * im) * (2.0 / len);
 }
 
+/* Converts float samples in [-1.0, 1.0) to Q31. */
+static void to_q31(const float *in, int32_t *out, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    out[i] = lrint(in[i] * 2147483648.0);
+}
+
+/* Returns the signal to noise ratio in dB of Q31 samples compared to the
+ * float reference. */
+static double snr_q31(const float *ref, const int32_t *data, size_t len)
+{
+  double signal = 0, noise = 0;
+  for (size_t i = 0; i < len; i++) {
+    double d = data[i] / 2147483648.0 - ref[i];
+    signal += (double)ref[i] * ref[i];
+    noise += d * d;
+  }
+  if (noise == 0)
+    return INFINITY;
+  return 10 * log10(signal / noise);
+}
+
 TEST(InterleaveTest, All) {
   const int FRAMES = 12;
   const int SAMPLES = FRAMES * 2;
@@ -76,6 +98,65 @@ TEST(InterleaveTest, All) {
   }
 }
 
+TEST(InterleaveTest, Q31) {
+  const int FRAMES = 6;
+  const int SAMPLES = FRAMES * 2;
+  int16_t input16[SAMPLES] = {
+    -32768, -32767, -2, -1, 0, 1, 2, 3, 32765, 32766, 32767, 100
+  };
+  int32_t input32[SAMPLES] = {
+    INT32_MIN, INT32_MIN + 1, -2, -1, 0, 1, 2, 3, INT32_MAX - 2,
+    INT32_MAX - 1, INT32_MAX, 100
+  };
+  int32_t output[SAMPLES];
+  int32_t *out_ptr[] = {output, output + FRAMES};
+  int16_t output16[SAMPLES];
+  int32_t output32[SAMPLES];
+
+  dsp_util_deinterleave_q31((uint8_t *)input16, out_ptr, 2,
+                            SND_PCM_FORMAT_S16_LE, FRAMES);
+  for (int i = 0; i < FRAMES; i++) {
+    EXPECT_EQ(input16[i * 2] * 65536, output[i]);
+    EXPECT_EQ(input16[i * 2 + 1] * 65536, output[FRAMES + i]);
+  }
+
+  /* Round to nearest, and saturate instead of wrapping around. */
+  for (int i = 0; i < SAMPLES; i++)
+    output[i] += 32767;
+  dsp_util_interleave_q31(out_ptr, (uint8_t *)output16, 2,
+                          SND_PCM_FORMAT_S16_LE, FRAMES);
+  for (int i = 0; i < SAMPLES; i++)
+    EXPECT_EQ(input16[i], output16[i]);
+  output[FRAMES - 1] = INT32_MAX;
+  dsp_util_interleave_q31(out_ptr, (uint8_t *)output16, 2,
+                          SND_PCM_FORMAT_S16_LE, FRAMES);
+  EXPECT_EQ(32767, output16[SAMPLES - 2]);
+
+  /* S32_LE is passed through unchanged. */
+  dsp_util_deinterleave_q31((uint8_t *)input32, out_ptr, 2,
+                            SND_PCM_FORMAT_S32_LE, FRAMES);
+  dsp_util_interleave_q31(out_ptr, (uint8_t *)output32, 2,
+                          SND_PCM_FORMAT_S32_LE, FRAMES);
+  for (int i = 0; i < SAMPLES; i++)
+    EXPECT_EQ(input32[i], output32[i]);
+
+  /* S24_LE ignores the top byte of the container. */
+  int32_t input24[SAMPLES] = {
+    0x7fffff, 0x800000, (int32_t)0xff800000, (int32_t)0xffffffff, 1,
+    0x12345678, (int32_t)0xab800001, 0, -1, 0x400000, 0x7f000000, 2
+  };
+  int32_t expected[SAMPLES] = {
+    INT32_MAX - 255, INT32_MIN, INT32_MIN, -256, 256, 0x34567800,
+    INT32_MIN + 256, 0, -256, 0x40000000, 0, 512
+  };
+  dsp_util_deinterleave_q31((uint8_t *)input24, out_ptr, 2,
+                            SND_PCM_FORMAT_S24_LE, FRAMES);
+  for (int i = 0; i < FRAMES; i++) {
+    EXPECT_EQ(expected[i * 2], output[i]);
+    EXPECT_EQ(expected[i * 2 + 1], output[FRAMES + i]);
+  }
+}
+
 TEST(EqTest, All) {
   struct eq *eq;
   size_t len = 44100;
@@ -405,6 +486,221 @@ TEST(DrcTest, All) {
   free(data_right);
 }
 
+/* Runs a biquad in double precision, as the reference for the float and the
+ * fixed-point filters. */
+static void biquad_double(const struct biquad *bq, double *data, size_t len)
+{
+  double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+  for (size_t i = 0; i < len; i++) {
+    double x = data[i];
+    double y = bq->b0 * x + bq->b1 * x1 + bq->b2 * x2 - bq->a1 * y1 -
+               bq->a2 * y2;
+    x2 = x1;
+    x1 = x;
+    y2 = y1;
+    y1 = y;
+    data[i] = y;
+  }
+}
+
+/* Returns the signal to noise ratio in dB of data compared to ref. */
+template <typename T>
+static double snr(const double *ref, const T *data, size_t len, double scale)
+{
+  double signal = 0, noise = 0;
+  for (size_t i = 0; i < len; i++) {
+    double d = data[i] * scale - ref[i];
+    signal += ref[i] * ref[i];
+    noise += d * d;
+  }
+  return 10 * log10(signal / noise);
+}
+
+TEST(BiquadQ31Test, Headroom) {
+  size_t len = 4096;
+  double *ref = (double *)calloc(len, sizeof(double));
+  int32_t *data = (int32_t *)calloc(len, sizeof(int32_t));
+  struct biquad bq = {};
+  struct biquad_q31 q;
+
+  /* Every coefficient is below 2 but they add up to almost 8, so the
+   * headroom must come from the sum for a full scale square wave near
+   * Nyquist not to overflow the accumulator. */
+  bq.b0 = 1.9;
+  bq.b1 = -1.9;
+  bq.b2 = 1.9;
+  bq.a1 = 1.2;
+  bq.a2 = 0.9;
+  biquad_q31_init(&q, &bq);
+  EXPECT_FALSE(q.use_float);
+  EXPECT_EQ(28, q.frac_bits);
+
+  for (size_t i = 0; i < len; i++)
+    ref[i] = (i % 2) ? -0.05 : 0.05;
+  for (size_t i = 0; i < len; i++) {
+    data[i] = lrint(ref[i] * 2147483648.0);
+    data[i] = biquad_q31_step(&q, data[i]);
+  }
+  biquad_double(&bq, ref, len);
+  EXPECT_GT(snr(ref, data, len, 1 / 2147483648.0), 80);
+
+  /* Too much gain for fixed point, the float coefficients are used. */
+  bq.b0 = 300;
+  bq.b1 = 0;
+  bq.b2 = 0;
+  bq.a1 = 0;
+  bq.a2 = 0;
+  biquad_q31_init(&q, &bq);
+  EXPECT_TRUE(q.use_float);
+  EXPECT_EQ(314572800, biquad_q31_step(&q, 1 << 20));
+  EXPECT_EQ(INT32_MAX, biquad_q31_step(&q, 1 << 24));
+  EXPECT_EQ(INT32_MIN, biquad_q31_step(&q, -(1 << 24)));
+
+  free(ref);
+  free(data);
+}
+
+TEST(Eq2Test, Q31MatchesFloat) {
+  size_t len = 44100;
+  float NQ = len / 2;
+  struct biquad bq[3];
+  double *ref = (double *)calloc(len, sizeof(double));
+  float *data_float[2];
+  int32_t *data_q31[2];
+  struct eq2 *eq2_float = eq2_new();
+  struct eq2 *eq2_fixed = eq2_new();
+
+  for (int ch = 0; ch < 2; ch++) {
+    data_float[ch] = (float *)calloc(len, sizeof(float));
+    data_q31[ch] = (int32_t *)calloc(len, sizeof(int32_t));
+    add_sine(data_float[ch], len, 50 / NQ, 0, 0.2);
+    add_sine(data_float[ch], len, 1000 / NQ, 0, 0.2);
+    add_sine(data_float[ch], len, 12000 / NQ, 0, 0.2);
+    to_q31(data_float[ch], data_q31[ch], len);
+  }
+  for (size_t i = 0; i < len; i++)
+    ref[i] = data_float[0][i];
+
+  /* Low frequency filters are where the rounding noise of the float
+   * implementation is the worst. */
+  biquad_set(&bq[0], BQ_LOWSHELF, 100 / NQ, 0, -6);
+  biquad_set(&bq[1], BQ_PEAKING, 1000 / NQ, 2, 6);
+  biquad_set(&bq[2], BQ_HIGHPASS, 40 / NQ, 0.7, 0);
+  for (int i = 0; i < 3; i++) {
+    biquad_double(&bq[i], ref, len);
+    for (int ch = 0; ch < 2; ch++) {
+      eq2_append_biquad_direct(eq2_float, ch, &bq[i]);
+      eq2_append_biquad_direct(eq2_fixed, ch, &bq[i]);
+    }
+  }
+
+  for (size_t start = 0; start < len; start += 512) {
+    int chunk = std::min(len - start, (size_t)512);
+    eq2_process(eq2_float, data_float[0] + start, data_float[1] + start,
+                chunk);
+    eq2_process_q31(eq2_fixed, data_q31[0] + start, data_q31[1] + start,
+                    chunk);
+  }
+
+  /* The fixed-point filters should be at least as close to the double
+   * precision result as the float ones. */
+  double snr_float = snr(ref, data_float[1], len, 1);
+  double snr_fixed = snr(ref, data_q31[1], len, 1 / 2147483648.0);
+  EXPECT_GT(snr_fixed, 100);
+  EXPECT_GE(snr_fixed, snr_float);
+  EXPECT_EQ(0, memcmp(data_q31[0], data_q31[1], len * sizeof(int32_t)));
+
+  eq2_free(eq2_float);
+  eq2_free(eq2_fixed);
+  free(ref);
+  for (int ch = 0; ch < 2; ch++) {
+    free(data_float[ch]);
+    free(data_q31[ch]);
+  }
+}
+
+TEST(Crossover2Test, Q31MatchesFloat) {
+  size_t len = 44100;
+  float NQ = len / 2;
+  float *ref[6];
+  int32_t *data[6];
+  struct crossover2 xo2_float, xo2_fixed;
+
+  for (int i = 0; i < 6; i++) {
+    ref[i] = (float *)calloc(len, sizeof(float));
+    data[i] = (int32_t *)calloc(len, sizeof(int32_t));
+  }
+  for (int ch = 0; ch < 2; ch++) {
+    add_sine(ref[ch], len, 60 / NQ, 0, 0.3);
+    add_sine(ref[ch], len, 1000 / NQ, 0, 0.3);
+    add_sine(ref[ch], len, 10000 / NQ, 0, 0.3);
+    to_q31(ref[ch], data[ch], len);
+  }
+
+  crossover2_init(&xo2_float, 200 / NQ, 2000 / NQ);
+  crossover2_init(&xo2_fixed, 200 / NQ, 2000 / NQ);
+  crossover2_process(&xo2_float, len, ref[0], ref[1], ref[2], ref[3],
+                     ref[4], ref[5]);
+  crossover2_process_q31(&xo2_fixed, len, data[0], data[1], data[2],
+                         data[3], data[4], data[5]);
+
+  for (int i = 0; i < 6; i++) {
+    EXPECT_GT(snr_q31(ref[i], data[i], len), 90) << "band " << i / 2;
+    free(ref[i]);
+    free(data[i]);
+  }
+}
+
+TEST(DrcTest, Q31MatchesFloat) {
+  size_t len = 44100;
+  float NQ = len / 2;
+  float *ref[2];
+  int32_t *data[2];
+  struct drc *drc[2];
+
+  dsp_enable_flush_denormal_to_zero();
+  for (int i = 0; i < 2; i++) {
+    drc[i] = drc_new(44100);
+    drc_set_param(drc[i], 0, PARAM_CROSSOVER_LOWER_FREQ, 0);
+    drc_set_param(drc[i], 0, PARAM_ENABLED, 1);
+    drc_set_param(drc[i], 0, PARAM_THRESHOLD, -30);
+    drc_set_param(drc[i], 0, PARAM_RATIO, 3);
+    drc_set_param(drc[i], 1, PARAM_CROSSOVER_LOWER_FREQ, 250 / NQ);
+    drc_set_param(drc[i], 1, PARAM_ENABLED, 0);
+    drc_set_param(drc[i], 2, PARAM_CROSSOVER_LOWER_FREQ, 4000 / NQ);
+    drc_set_param(drc[i], 2, PARAM_ENABLED, 1);
+    drc_set_param(drc[i], 2, PARAM_THRESHOLD, -20);
+    drc_set_param(drc[i], 2, PARAM_RATIO, 2);
+    drc_init(drc[i]);
+  }
+
+  for (int ch = 0; ch < 2; ch++) {
+    ref[ch] = (float *)calloc(len, sizeof(float));
+    data[ch] = (int32_t *)calloc(len, sizeof(int32_t));
+    add_sine(ref[ch], len, 62.5 / NQ, 0, 0.2);
+    add_sine(ref[ch], len, 1000 / NQ, 0, 0.2);
+    add_sine(ref[ch], len, 16000 / NQ, 0, 0.2);
+    to_q31(ref[ch], data[ch], len);
+  }
+
+  for (size_t start = 0; start < len; start += DRC_PROCESS_MAX_FRAMES) {
+    int chunk = std::min(len - start, (size_t)DRC_PROCESS_MAX_FRAMES);
+    float *ref_chunk[] = {ref[0] + start, ref[1] + start};
+    int32_t *data_chunk[] = {data[0] + start, data[1] + start};
+    drc_process(drc[0], ref_chunk, chunk);
+    drc_process_q31(drc[1], data_chunk, chunk);
+  }
+
+  EXPECT_GT(snr_q31(ref[0], data[0], len), 80);
+  EXPECT_GT(snr_q31(ref[1], data[1], len), 80);
+
+  for (int i = 0; i < 2; i++) {
+    drc_free(drc[i]);
+    free(ref[i]);
+    free(data[i]);
+  }
+}
+
 }  //  namespace
 
 int main(int argc, char **argv) {
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <gtest/gtest.h>
+#include <pthread.h>
 
 #include "cras_dsp.h"
 #include "cras_dsp_module.h"
@@ -11,6 +12,11 @@
 
 namespace {
 
+static int live_modules;
+static struct cras_timer *reclaim_timer;
+static void (*reclaim_timer_cb)(struct cras_timer *t, void *data);
+static void *reclaim_timer_data;
+
 extern "C" {
 struct dsp_module *cras_dsp_module_load_ladspa(struct plugin *plugin)
 {
@@ -18,6 +24,15 @@ struct dsp_module *cras_dsp_module_load_ladspa(struct plugin *plugin)
 }
 }
 
+// Fires the timer armed to free the retired pipelines, if any.
+static void FireReclaimTimer() {
+  if (!reclaim_timer)
+    return;
+  reclaim_timer = NULL;
+  reclaim_timer_cb(reinterpret_cast<struct cras_timer *>(1),
+                   reclaim_timer_data);
+}
+
 class DspTestSuite : public testing::Test {
  protected:
   virtual void SetUp() {
@@ -97,6 +112,140 @@ TEST_F(DspTestSuite, Simple) {
   cras_dsp_stop();
 }
 
+struct RunnerArgs {
+  struct cras_dsp_context *ctx;
+  volatile int stop;
+  unsigned int runs;
+};
+
+static void *RunPipeline(void *arg) {
+  struct RunnerArgs *args = static_cast<struct RunnerArgs *>(arg);
+  int16_t buf[256 * 2] = {0};
+  struct pipeline *pipeline;
+
+  while (!args->stop) {
+    pipeline = cras_dsp_get_pipeline(args->ctx);
+    if (!pipeline)
+      break;
+    cras_dsp_pipeline_apply(pipeline, (uint8_t *)buf, SND_PCM_FORMAT_S16_LE,
+                            256);
+    cras_dsp_put_pipeline(args->ctx);
+    args->runs++;
+    // Sleep between runs as the audio thread does between wakes.
+    usleep(50);
+  }
+  return NULL;
+}
+
+TEST_F(DspTestSuite, LoadWhileRunning) {
+  const char *content =
+      "[M1]\n"
+      "library=builtin\n"
+      "label=source\n"
+      "purpose=playback\n"
+      "output_0={l}\n"
+      "output_1={r}\n"
+      "[M2]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=playback\n"
+      "input_0={l}\n"
+      "input_1={r}\n"
+      "\n";
+  struct RunnerArgs args;
+  pthread_t runner;
+  int i;
+
+  fprintf(fp, "%s", content);
+  CloseFile();
+
+  live_modules = 0;
+  reclaim_timer = NULL;
+  cras_dsp_init(filename);
+  args.ctx = cras_dsp_context_new(48000, "playback");
+  args.stop = 0;
+  args.runs = 0;
+  cras_dsp_load_pipeline(args.ctx);
+  EXPECT_EQ(2, live_modules);
+
+  // Reload while the pipeline runs, reclaiming as the timer fires.
+  pthread_create(&runner, NULL, RunPipeline, &args);
+  for (i = 0; i < 200; i++) {
+    cras_dsp_load_pipeline(args.ctx);
+    if (i % 4 == 0)
+      usleep(1000);
+    FireReclaimTimer();
+  }
+  args.stop = 1;
+  pthread_join(runner, NULL);
+  EXPECT_LT(0, args.runs);
+
+  // Finish the crossfade, everything but the current pipeline is freed.
+  args.stop = 0;
+  pthread_create(&runner, NULL, RunPipeline, &args);
+  usleep(10000);
+  args.stop = 1;
+  pthread_join(runner, NULL);
+  FireReclaimTimer();
+  EXPECT_EQ(NULL, reclaim_timer);
+  EXPECT_EQ(2, live_modules);
+
+  cras_dsp_context_free(args.ctx);
+  EXPECT_EQ(0, live_modules);
+  cras_dsp_stop();
+}
+
+TEST_F(DspTestSuite, LoadWithReader) {
+  const char *content =
+      "[M1]\n"
+      "library=builtin\n"
+      "label=source\n"
+      "purpose=playback\n"
+      "output_0={l}\n"
+      "[M2]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=playback\n"
+      "input_0={l}\n"
+      "\n";
+  struct cras_dsp_context *ctx;
+  struct pipeline *pipeline;
+  int16_t buf[1024] = {0};
+
+  fprintf(fp, "%s", content);
+  CloseFile();
+
+  live_modules = 0;
+  reclaim_timer = NULL;
+  cras_dsp_init(filename);
+  ctx = cras_dsp_context_new(48000, "playback");
+  cras_dsp_load_pipeline(ctx);
+
+  // Loading doesn't wait for the reader, the old pipeline is kept.
+  pipeline = cras_dsp_get_pipeline(ctx);
+  ASSERT_TRUE(pipeline);
+  cras_dsp_load_pipeline(ctx);
+  EXPECT_EQ(4, live_modules);
+  EXPECT_NE(pipeline, cras_dsp_get_pipeline(ctx));
+  cras_dsp_put_pipeline(ctx);
+  FireReclaimTimer();
+  EXPECT_EQ(4, live_modules);
+
+  // Freed by the timer once the reader and the crossfade are done.
+  cras_dsp_put_pipeline(ctx);
+  pipeline = cras_dsp_get_pipeline(ctx);
+  cras_dsp_pipeline_apply(pipeline, (uint8_t *)buf, SND_PCM_FORMAT_S16_LE,
+                          1024);
+  cras_dsp_put_pipeline(ctx);
+  FireReclaimTimer();
+  EXPECT_EQ(2, live_modules);
+  EXPECT_EQ(NULL, reclaim_timer);
+
+  cras_dsp_context_free(ctx);
+  EXPECT_EQ(0, live_modules);
+  cras_dsp_stop();
+}
+
 static int empty_instantiate(struct dsp_module *module,
                              unsigned long sample_rate)
 {
@@ -117,6 +266,7 @@ static void empty_deinstantiate(struct dsp_module *module) {}
 
 static void empty_free_module(struct dsp_module *module)
 {
+  live_modules--;
   free(module);
 }
 
@@ -148,12 +298,32 @@ struct dsp_module *cras_dsp_module_load_builtin(struct plugin *plugin)
   struct dsp_module *module;
   module = (struct dsp_module *)calloc(1, sizeof(struct dsp_module));
   empty_init_module(module);
+  live_modules++;
   return module;
 }
 void cras_dsp_module_set_sink_ext_module(struct dsp_module *module,
 					 struct ext_dsp_module *ext_module)
 {
 }
+struct cras_tm *cras_system_state_get_tm()
+{
+  return reinterpret_cast<struct cras_tm *>(1);
+}
+struct cras_timer *cras_tm_create_timer(
+    struct cras_tm *tm,
+    unsigned int ms,
+    void (*cb)(struct cras_timer *t, void *data),
+    void *cb_data)
+{
+  reclaim_timer = reinterpret_cast<struct cras_timer *>(1);
+  reclaim_timer_cb = cb;
+  reclaim_timer_data = cb_data;
+  return reclaim_timer;
+}
+void cras_tm_cancel_timer(struct cras_tm *tm, struct cras_timer *t)
+{
+  reclaim_timer = NULL;
+}
 } // extern "C"
 
 int main(int argc, char **argv) {
@@ -239,6 +239,98 @@ TEST(ExprTest, Builtin) {
   cras_expr_env_free(&env);
 }
 
+static int count_calls;
+
+static void function_count(cras_expr_value_array *operands,
+                           struct cras_expr_value *result)
+{
+  count_calls++;
+  cras_expr_value_free(result);
+  result->type = CRAS_EXPR_VALUE_TYPE_BOOLEAN;
+  result->u.boolean = 1;
+}
+
+TEST(ExprTest, CachedEvaluation) {
+  struct cras_expr_expression *expr;
+  struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+  char boolean = 0;
+  unsigned int num_keys;
+
+  count_calls = 0;
+  cras_expr_env_install_builtins(&env);
+  cras_expr_env_set_variable_function(&env, "count", &function_count);
+  cras_expr_env_set_variable_string(&env, "dsp_name", "foo");
+  cras_expr_env_set_variable_boolean(&env, "unrelated", 0);
+
+  expr = cras_expr_expression_parse("(and (count) (equal? dsp_name \"foo\"))");
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr, &env, &boolean));
+  EXPECT_EQ(1, boolean);
+  EXPECT_EQ(1, count_calls);
+
+  /* Nothing read by the expression changed, use the cached result. */
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr, &env, &boolean));
+  cras_expr_env_set_variable_boolean(&env, "unrelated", 1);
+  cras_expr_env_set_variable_string(&env, "dsp_name", "foo");
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr, &env, &boolean));
+  EXPECT_EQ(1, boolean);
+  EXPECT_EQ(1, count_calls);
+
+  /* A variable it depends on changed, evaluate again. */
+  cras_expr_env_set_variable_string(&env, "dsp_name", "bar");
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr, &env, &boolean));
+  EXPECT_EQ(0, boolean);
+  EXPECT_EQ(2, count_calls);
+
+  /* A variable defined after the first evaluation is also tracked, and
+   * reading it before doesn't define it. */
+  cras_expr_expression_free(expr);
+  expr = cras_expr_expression_parse("(and (count) later)");
+  num_keys = ARRAY_COUNT(&env.keys);
+  EXPECT_EQ(-1, cras_expr_expression_eval_boolean(expr, &env, &boolean));
+  EXPECT_EQ(3, count_calls);
+  EXPECT_EQ(num_keys, ARRAY_COUNT(&env.keys));
+  cras_expr_env_set_variable_boolean(&env, "later", 1);
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr, &env, &boolean));
+  EXPECT_EQ(1, boolean);
+  EXPECT_EQ(4, count_calls);
+
+  cras_expr_expression_free(expr);
+  cras_expr_env_free(&env);
+}
+
+TEST(ExprTest, CompiledFormFreedWithExpression) {
+  struct cras_expr_expression *expr1, *expr2;
+  struct cras_expr_env env1 = CRAS_EXPR_ENV_INIT;
+  struct cras_expr_env env2 = CRAS_EXPR_ENV_INIT;
+  char boolean = 0;
+
+  cras_expr_env_install_builtins(&env1);
+  cras_expr_env_install_builtins(&env2);
+  expr1 = cras_expr_expression_parse("(not #f)");
+  expr2 = cras_expr_expression_parse("(not #t)");
+
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr1, &env1, &boolean));
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr1, &env2, &boolean));
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr2, &env1, &boolean));
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr1, &env1, &boolean));
+  EXPECT_EQ(2, ARRAY_COUNT(&env1.programs));
+  EXPECT_EQ(1, ARRAY_COUNT(&env2.programs));
+
+  /* Freeing an expression drops what was compiled from it. */
+  cras_expr_expression_free(expr1);
+  EXPECT_EQ(1, ARRAY_COUNT(&env1.programs));
+  EXPECT_EQ(0, ARRAY_COUNT(&env2.programs));
+
+  /* Freeing the environment first works too. */
+  cras_expr_env_free(&env1);
+  EXPECT_EQ(0, ARRAY_COUNT(&expr2->programs));
+  EXPECT_EQ(0, cras_expr_expression_eval_boolean(expr2, &env2, &boolean));
+  EXPECT_EQ(0, boolean);
+
+  cras_expr_expression_free(expr2);
+  cras_expr_env_free(&env2);
+}
+
 }  //  namespace
 
 int main(int argc, char **argv) {
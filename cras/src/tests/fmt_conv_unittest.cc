@@ -22,10 +22,15 @@ static int linear_resampler_needed_val;
 static double linear_resampler_ratio = 1.0;
 static unsigned int linear_resampler_num_channels;
 static unsigned int linear_resampler_format_bytes;
+static snd_pcm_format_t linear_resampler_format;
+static int linear_resampler_set_rates_called;
+static float linear_resampler_set_rates_from;
+static float linear_resampler_set_rates_to;
 
 void ResetStub() {
   linear_resampler_needed_val = 0;
   linear_resampler_ratio = 1.0;
+  linear_resampler_set_rates_called = 0;
 }
 
 // Like malloc or calloc, but fill the memory with random bytes.
@@ -63,7 +68,8 @@ TEST(FormatConverterTest, SmallFramesSRCWithLinearResampler) {
   in_buf = (int16_t *)malloc(10 * 2 * 2);
   out_buf = (int16_t *)malloc(10 * 2 * 2);
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 10, 1);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 10, 1,
+                           CRAS_RESAMPLER_SPEEX);
   EXPECT_NE((void *)NULL, c);
 
   /* When process on small buffers doing SRC 16KHz -> 48KHz,
@@ -105,7 +111,8 @@ TEST(FormatConverterTest,  InvalidParamsOnlyLE) {
   ResetStub();
   in_fmt.format = out_fmt.format = SND_PCM_FORMAT_S32_BE;
   in_fmt.num_channels = out_fmt.num_channels = 2;
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 4096, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 4096, 0,
+                           CRAS_RESAMPLER_SPEEX);
   EXPECT_EQ(NULL, c);
 }
 
@@ -129,7 +136,8 @@ TEST(FormatConverterTest, MonoToStereo) {
   in_fmt.frame_rate = 48000;
   out_fmt.frame_rate = 48000;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_out_frames_to_in(c, buf_size);
@@ -180,7 +188,8 @@ TEST(FormatConverterTest, StereoToMono) {
   in_fmt.frame_rate = 48000;
   out_fmt.frame_rate = 48000;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_out_frames_to_in(c, buf_size);
@@ -238,7 +247,8 @@ TEST(FormatConverterTest, StereoToMono24bit) {
     in_fmt.frame_rate = 48000;
     out_fmt.frame_rate = 48000;
 
-    c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+    c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                             CRAS_RESAMPLER_SPEEX);
     ASSERT_NE(c, (void *)NULL);
 
     out_frames = cras_fmt_conv_out_frames_to_in(c, buf_size);
@@ -293,7 +303,8 @@ TEST(FormatConverterTest, SurroundToStereo) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     in_fmt.channel_layout[i] = surround_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_out_frames_to_in(c, buf_size);
@@ -331,7 +342,8 @@ TEST(FormatConverterTest, SurroundToStereo) {
    */
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_FL, CRAS_CH_FR);
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_RL, CRAS_CH_RR);
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   out_frames = cras_fmt_conv_convert_frames(c,
                                             (uint8_t *)in_buff,
                                             (uint8_t *)out_buff,
@@ -347,7 +359,8 @@ TEST(FormatConverterTest, SurroundToStereo) {
    */
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_FR, CRAS_CH_FC);
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_RR, CRAS_CH_LFE);
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   out_frames = cras_fmt_conv_convert_frames(c,
                                             (uint8_t *)in_buff,
                                             (uint8_t *)out_buff,
@@ -364,7 +377,8 @@ TEST(FormatConverterTest, SurroundToStereo) {
    * Assert output left is positive and right is negative. */
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_LFE, CRAS_CH_FR);
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_FC, CRAS_CH_FL);
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   out_frames = cras_fmt_conv_convert_frames(c,
                                             (uint8_t *)in_buff,
                                             (uint8_t *)out_buff,
@@ -404,7 +418,8 @@ TEST(FormatConverterTest, QuadToStereo) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     in_fmt.channel_layout[i] = quad_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_out_frames_to_in(c, buf_size);
@@ -444,7 +459,8 @@ TEST(FormatConverterTest, QuadToStereo) {
    */
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_FL, CRAS_CH_FR);
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_RL, CRAS_CH_RR);
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   out_frames = cras_fmt_conv_convert_frames(c,
                                             (uint8_t *)in_buff,
                                             (uint8_t *)out_buff,
@@ -462,7 +478,8 @@ TEST(FormatConverterTest, QuadToStereo) {
    */
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_FR, CRAS_CH_RR);
   swap_channel_layout(in_fmt.channel_layout, CRAS_CH_FL, CRAS_CH_RL);
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   out_frames = cras_fmt_conv_convert_frames(c,
                                             (uint8_t *)in_buff,
                                             (uint8_t *)out_buff,
@@ -480,7 +497,8 @@ TEST(FormatConverterTest, QuadToStereo) {
    */
   for (i = 0; i < CRAS_CH_MAX; i++)
     in_fmt.channel_layout[i] = -1;
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   out_frames = cras_fmt_conv_convert_frames(c,
                                             (uint8_t *)in_buff,
                                             (uint8_t *)out_buff,
@@ -515,7 +533,8 @@ TEST(FormatConverterTest,  Convert2To1) {
   in_fmt.frame_rate = 96000;
   out_fmt.frame_rate = 48000;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -550,7 +569,8 @@ TEST(FormatConverterTest,  Convert1To2) {
   in_fmt.frame_rate = 22050;
   out_fmt.frame_rate = 44100;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -586,7 +606,8 @@ TEST(FormatConverterTest,  Convert1To2MonoToStereo) {
   in_fmt.frame_rate = 22050;
   out_fmt.frame_rate = 44100;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_out_frames_to_in(c, buf_size);
@@ -626,7 +647,8 @@ TEST(FormatConverterTest, ConvertS32LEToS16LE) {
   in_fmt.frame_rate = 48000;
   out_fmt.frame_rate = 48000;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -667,7 +689,8 @@ TEST(FormatConverterTest, ConvertS24LEToS16LE) {
   in_fmt.frame_rate = 48000;
   out_fmt.frame_rate = 48000;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -709,7 +732,8 @@ TEST(FormatConverterTest, ConvertU8LEToS16LE) {
   in_fmt.frame_rate = 48000;
   out_fmt.frame_rate = 48000;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -751,7 +775,8 @@ TEST(FormatConverterTest, ConvertS16LEToS32LE) {
   in_fmt.frame_rate = 48000;
   out_fmt.frame_rate = 48000;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -792,7 +817,8 @@ TEST(FormatConverterTest, ConvertS16LEToS24LE) {
   in_fmt.frame_rate = 48000;
   out_fmt.frame_rate = 48000;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -834,7 +860,8 @@ TEST(FormatConverterTest, ConvertS16LEToU8) {
   in_fmt.frame_rate = 48000;
   out_fmt.frame_rate = 48000;
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -879,7 +906,8 @@ TEST(FormatConverterTest, ConvertS32LEToS16LEDownmix51ToStereo) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     in_fmt.channel_layout[i] = surround_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -922,7 +950,8 @@ TEST(FormatConverterTest, ConvertS16LEToS16LEStereoTo51) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     out_fmt.channel_layout[i] = surround_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -974,7 +1003,8 @@ TEST(FormatConverterTest, ConvertS16LEToS16LEMonoTo51) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     out_fmt.channel_layout[i] = surround_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -1026,7 +1056,8 @@ TEST(FormatConverterTest, ConvertS16LEToS16LEStereoToQuad) {
   for (unsigned int i = 0; i < CRAS_CH_MAX; i++)
     out_fmt.channel_layout[i] = quad_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -1056,7 +1087,8 @@ TEST(FormatConverterTest, ConvertS16LEToS16LEStereoToQuad) {
   // Swap channels and check channel layout is respected.
   swap_channel_layout(out_fmt.channel_layout, CRAS_CH_FL, CRAS_CH_RR);
   swap_channel_layout(out_fmt.channel_layout, CRAS_CH_RL, CRAS_CH_FR);
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   out_frames = cras_fmt_conv_convert_frames(c,
                                             (uint8_t *)in_buff,
                                             (uint8_t *)out_buff,
@@ -1098,7 +1130,8 @@ TEST(FormatConverterTest, ConvertS32LEToS16LEDownmix51ToStereo48To96) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     in_fmt.channel_layout[i] = surround_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -1141,7 +1174,8 @@ TEST(FormatConverterTest, ConvertS32LEToS16LEDownmix51ToStereo96To48) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     in_fmt.channel_layout[i] = surround_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -1185,7 +1219,8 @@ TEST(FormatConverterTest, ConvertS32LEToS16LEDownmix51ToStereo48To441) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     in_fmt.channel_layout[i] = surround_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -1229,7 +1264,8 @@ TEST(FormatConverterTest, ConvertS32LEToS16LEDownmix51ToStereo441To48) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     in_fmt.channel_layout[i] = surround_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -1274,7 +1310,8 @@ TEST(FormatConverterTest, ConvertS32LEToS16LEDownmix51ToStereo96To48Short) {
   for (i = 0; i < CRAS_CH_MAX; i++)
     in_fmt.channel_layout[i] = surround_channel_layout[i];
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   out_frames = cras_fmt_conv_in_frames_to_out(c, buf_size);
@@ -1321,7 +1358,8 @@ TEST(FormatConverterTest, Convert96to48PreLinearResample) {
     out_fmt.channel_layout[i] = surround_channel_layout[i];
   }
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size * 2, 1);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size * 2, 1,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   linear_resampler_needed_val = 1;
@@ -1370,7 +1408,8 @@ TEST(FormatConverterTest, Convert96to48PostLinearResample) {
     out_fmt.channel_layout[i] = surround_channel_layout[i];
   }
 
-  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size * 2, 0);
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size * 2, 0,
+                           CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   linear_resampler_needed_val = 1;
@@ -1412,7 +1451,8 @@ TEST(FormatConverterTest, ConfigConverter) {
     out_fmt.channel_layout[i] = stereo_channel_layout[i];
   }
 
-  config_format_converter(&c, CRAS_STREAM_OUTPUT, &in_fmt, &out_fmt, 4096);
+  config_format_converter(&c, CRAS_STREAM_OUTPUT, &in_fmt, &out_fmt, 4096,
+                          CRAS_RESAMPLER_SPEEX);
   ASSERT_NE(c, (void *)NULL);
 
   cras_fmt_conv_destroy(&c);
@@ -1438,7 +1478,8 @@ TEST(FormatConverterTest, ConfigConverterNoNeed) {
     out_fmt.channel_layout[i] = stereo_channel_layout[i];
   }
 
-  config_format_converter(&c, CRAS_STREAM_OUTPUT, &in_fmt, &out_fmt, 4096);
+  config_format_converter(&c, CRAS_STREAM_OUTPUT, &in_fmt, &out_fmt, 4096,
+                          CRAS_RESAMPLER_SPEEX);
   EXPECT_NE(c, (void *)NULL);
   EXPECT_EQ(0, cras_fmt_conversion_needed(c));
   cras_fmt_conv_destroy(&c);
@@ -1466,12 +1507,146 @@ TEST(FormatConverterTest, ConfigConverterNoNeedForInput) {
     out_fmt.channel_layout[i] = kmic_channel_layout[i];
   }
 
-  config_format_converter(&c, CRAS_STREAM_INPUT, &in_fmt, &out_fmt, 4096);
+  config_format_converter(&c, CRAS_STREAM_INPUT, &in_fmt, &out_fmt, 4096,
+                          CRAS_RESAMPLER_SPEEX);
   EXPECT_NE(c, (void *)NULL);
   EXPECT_EQ(0, cras_fmt_conversion_needed(c));
   cras_fmt_conv_destroy(&c);
 }
 
+TEST(FormatConverterTest, ConvertWithEachResampler) {
+  struct cras_fmt_conv *c;
+  struct cras_audio_format in_fmt;
+  struct cras_audio_format out_fmt;
+  size_t out_frames;
+  int16_t *in_buff;
+  int16_t *out_buff;
+  unsigned int in_frames;
+  unsigned int i, t;
+  const size_t buf_size = 4096;
+
+  ResetStub();
+  in_fmt.format = out_fmt.format = SND_PCM_FORMAT_S16_LE;
+  in_fmt.num_channels = out_fmt.num_channels = 2;
+  in_fmt.frame_rate = 44100;
+  out_fmt.frame_rate = 48000;
+
+  in_buff = (int16_t *)ralloc(buf_size * cras_get_format_bytes(&in_fmt));
+  out_buff = (int16_t *)malloc(2 * buf_size * cras_get_format_bytes(&out_fmt));
+
+  for (t = 0; t < CRAS_RESAMPLER_NUM_TYPES; t++) {
+    c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size * 2, 0,
+                             (enum CRAS_RESAMPLER_TYPE)t);
+    ASSERT_NE(c, (void *)NULL);
+    EXPECT_EQ(1, cras_fmt_conversion_needed(c));
+
+    in_frames = buf_size;
+    out_frames = cras_fmt_conv_convert_frames(c,
+                                              (uint8_t *)in_buff,
+                                              (uint8_t *)out_buff,
+                                              &in_frames,
+                                              buf_size * 2);
+    /* Filter delay may hold back a few frames, never more. */
+    EXPECT_GE(buf_size, in_frames);
+    EXPECT_LE(buf_size - 128, in_frames);
+    i = (size_t)in_frames * 48000 / 44100;
+    EXPECT_GE(i + 1, out_frames);
+    EXPECT_LE(i - 128, out_frames);
+    cras_fmt_conv_destroy(&c);
+  }
+
+  free(in_buff);
+  free(out_buff);
+}
+
+TEST(FormatConverterTest, LinearResamplerFormat) {
+  struct cras_fmt_conv *c;
+  struct cras_audio_format in_fmt;
+  struct cras_audio_format out_fmt;
+
+  ResetStub();
+  in_fmt.format = SND_PCM_FORMAT_S32_LE;
+  out_fmt.format = SND_PCM_FORMAT_S24_LE;
+  in_fmt.num_channels = out_fmt.num_channels = 2;
+  in_fmt.frame_rate = 48000;
+  out_fmt.frame_rate = 44100;
+
+  /* Before the format conversion it sees the input frames. */
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 4096, 1,
+                           CRAS_RESAMPLER_SPEEX);
+  ASSERT_NE(c, (void *)NULL);
+  EXPECT_EQ(SND_PCM_FORMAT_S32_LE, linear_resampler_format);
+  EXPECT_EQ(2, linear_resampler_num_channels);
+  cras_fmt_conv_destroy(&c);
+
+  /* After SRC and channel conversion frames are always S16_LE. */
+  out_fmt.num_channels = 6;
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 4096, 0,
+                           CRAS_RESAMPLER_SPEEX);
+  ASSERT_NE(c, (void *)NULL);
+  EXPECT_EQ(SND_PCM_FORMAT_S16_LE, linear_resampler_format);
+  EXPECT_EQ(6, linear_resampler_num_channels);
+  cras_fmt_conv_destroy(&c);
+}
+
+TEST(FormatConverterTest, PoolReuse) {
+  struct cras_fmt_conv *c, *c2, *c3;
+  struct cras_audio_format in_fmt;
+  struct cras_audio_format out_fmt;
+  unsigned int hits, misses, hits0, misses0;
+  int i;
+
+  ResetStub();
+  in_fmt.format = out_fmt.format = SND_PCM_FORMAT_S16_LE;
+  in_fmt.num_channels = out_fmt.num_channels = 2;
+  in_fmt.frame_rate = 44100;
+  out_fmt.frame_rate = 48000;
+  for (i = 0; i < CRAS_CH_MAX; i++)
+    in_fmt.channel_layout[i] = out_fmt.channel_layout[i] =
+        stereo_channel_layout[i];
+  cras_fmt_conv_pool_get_stats(&hits0, &misses0);
+
+  c = cras_fmt_conv_pool_get(&in_fmt, &out_fmt, 4096, 0,
+                             CRAS_RESAMPLER_FAST);
+  ASSERT_NE(c, (void *)NULL);
+  cras_fmt_conv_pool_get_stats(&hits, &misses);
+  EXPECT_EQ(hits0, hits);
+  EXPECT_EQ(misses0 + 1, misses);
+
+  c2 = c;
+  cras_fmt_conv_pool_put(&c);
+  EXPECT_EQ(NULL, c);
+
+  // A different conversion doesn't match the idle converter.
+  c3 = cras_fmt_conv_pool_get(&in_fmt, &out_fmt, 4096, 0,
+                              CRAS_RESAMPLER_HQ);
+  ASSERT_NE(c3, (void *)NULL);
+  EXPECT_NE(c2, c3);
+  cras_fmt_conv_destroy(&c3);
+
+  // The same one gets the idle converter back, with the linear resampler
+  // reset to the rates it was created with.
+  linear_resampler_set_rates_called = 0;
+  c = cras_fmt_conv_pool_get(&in_fmt, &out_fmt, 4096, 0,
+                             CRAS_RESAMPLER_FAST);
+  EXPECT_EQ(c2, c);
+  EXPECT_EQ(1, linear_resampler_set_rates_called);
+  EXPECT_EQ(48000, linear_resampler_set_rates_from);
+  EXPECT_EQ(48000, linear_resampler_set_rates_to);
+  cras_fmt_conv_pool_get_stats(&hits, &misses);
+  EXPECT_EQ(hits0 + 1, hits);
+  EXPECT_EQ(misses0 + 2, misses);
+
+  cras_fmt_conv_pool_put(&c);
+  cras_fmt_conv_pool_flush();
+  c = cras_fmt_conv_pool_get(&in_fmt, &out_fmt, 4096, 0,
+                             CRAS_RESAMPLER_FAST);
+  cras_fmt_conv_pool_get_stats(&hits, &misses);
+  EXPECT_EQ(hits0 + 1, hits);
+  EXPECT_EQ(misses0 + 3, misses);
+  cras_fmt_conv_destroy(&c);
+}
+
 TEST(ChannelRemixTest, ChannelRemixAppliedOrNot) {
   float coeff[4] = {0.5, 0.5, 0.26, 0.73};
   struct cras_fmt_conv *conv;
@@ -1536,11 +1711,12 @@ float **cras_channel_conv_matrix_create(const struct cras_audio_format *in,
 					out->num_channels);
 }
 struct linear_resampler *linear_resampler_create(unsigned int num_channels,
-             unsigned int format_bytes,
+             snd_pcm_format_t format,
              float src_rate,
              float dst_rate)
 {
-  linear_resampler_format_bytes = format_bytes;
+  linear_resampler_format = format;
+  linear_resampler_format_bytes = PCM_FORMAT_WIDTH(format) / 8;
   linear_resampler_num_channels = num_channels;
   return reinterpret_cast<struct linear_resampler*>(0x33);;
 }
@@ -1551,9 +1727,12 @@ int linear_resampler_needed(struct linear_resampler *lr)
 }
 
 void linear_resampler_set_rates(struct linear_resampler *lr,
-                                unsigned int from,
-                                unsigned int to)
+                                float from,
+                                float to)
 {
+  linear_resampler_set_rates_called++;
+  linear_resampler_set_rates_from = from;
+  linear_resampler_set_rates_to = to;
 }
 
 unsigned int linear_resampler_out_frames_to_in(struct linear_resampler *lr,
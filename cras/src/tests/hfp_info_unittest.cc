@@ -8,6 +8,7 @@
 #include <time.h>
 
 extern "C" {
+  #include "cras_audio_codec.h"
   #include "cras_hfp_info.c"
 }
 
@@ -69,7 +70,7 @@ TEST(HfpInfo, AcquirePlaybackBuffer) {
   info = hfp_info_create();
   ASSERT_NE(info, (void *)NULL);
 
-  hfp_info_start(1, 48, info);
+  hfp_info_start(1, 48, HFP_CODEC_ID_CVSD, info);
   dev.direction = CRAS_STREAM_OUTPUT;
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
@@ -117,7 +118,7 @@ TEST(HfpInfo, AcquireCaptureBuffer) {
   info = hfp_info_create();
   ASSERT_NE(info, (void *)NULL);
 
-  hfp_info_start(1, 48, info);
+  hfp_info_start(1, 48, HFP_CODEC_ID_CVSD, info);
   dev.direction = CRAS_STREAM_INPUT;
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
@@ -164,7 +165,7 @@ TEST(HfpInfo, HfpReadWriteFD) {
   ASSERT_NE(info, (void *)NULL);
 
   dev.direction = CRAS_STREAM_INPUT;
-  hfp_info_start(sock[1], 48, info);
+  hfp_info_start(sock[1], 48, HFP_CODEC_ID_CVSD, info);
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
   /* Mock the sco fd and send some fake data */
@@ -190,19 +191,26 @@ TEST(HfpInfo, HfpReadWriteFD) {
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
   /* Initial buffer is empty */
-  rc = hfp_write(info);
+  rc = hfp_write(info, 1);
   ASSERT_EQ(0, rc);
 
   buffer_count = 1024;
   buf = buf_write_pointer_size(info->playback_buf, &buffer_count);
   buf_increment_write(info->playback_buf, buffer_count);
 
-  rc = hfp_write(info);
+  rc = hfp_write(info, 1);
   ASSERT_EQ(48, rc);
 
   rc = recv(sock[0], sample, 48, 0);
   ASSERT_EQ(48, rc);
 
+  /* Several packets go in one call. */
+  rc = hfp_write(info, 4);
+  ASSERT_EQ(4 * 48, rc);
+
+  rc = recv(sock[0], sample, 4 * 48, 0);
+  ASSERT_EQ(4 * 48, rc);
+
   hfp_info_destroy(info);
 }
 
@@ -214,7 +222,7 @@ TEST(HfpInfo, StartHfpInfo) {
   info = hfp_info_create();
   ASSERT_NE(info, (void *)NULL);
 
-  hfp_info_start(sock[0], 48, info);
+  hfp_info_start(sock[0], 48, HFP_CODEC_ID_CVSD, info);
   ASSERT_EQ(1, hfp_info_running(info));
   ASSERT_EQ(cb_data, (void *)info);
 
@@ -238,7 +246,7 @@ TEST(HfpInfo, StartHfpInfoAndRead) {
   ASSERT_NE(info, (void *)NULL);
 
   /* Start and send two chunk of fake data */
-  hfp_info_start(sock[1], 48, info);
+  hfp_info_start(sock[1], 48, HFP_CODEC_ID_CVSD, info);
   send(sock[0], sample ,48, 0);
   send(sock[0], sample ,48, 0);
 
@@ -280,7 +288,7 @@ TEST(HfpInfo, StartHfpInfoAndWrite) {
   info = hfp_info_create();
   ASSERT_NE(info, (void *)NULL);
 
-  hfp_info_start(sock[1], 48, info);
+  hfp_info_start(sock[1], 48, HFP_CODEC_ID_CVSD, info);
   send(sock[0], sample ,48, 0);
   send(sock[0], sample ,48, 0);
 
@@ -306,6 +314,117 @@ TEST(HfpInfo, StartHfpInfoAndWrite) {
   hfp_info_destroy(info);
 }
 
+TEST(HfpInfo, BatchedReadWriteSeqpacket) {
+  struct hfp_info_stats stats;
+  int rc, i;
+  int sock[2];
+  uint8_t sample[480];
+
+  ResetStubData();
+
+  /* SOCK_SEQPACKET keeps the packet boundaries like a SCO socket. */
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+
+  /* The adapter uses 60 byte packets on a 64 byte MTU. */
+  hfp_info_start(sock[1], 64, HFP_CODEC_ID_CVSD, info);
+  dev.direction = CRAS_STREAM_OUTPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+  buf_increment_write(info->playback_buf, 60 * 10);
+
+  for (i = 0; i < 5; i++)
+    send(sock[0], sample, 60, 0);
+
+  /* The first packet is read alone to learn the packet size. */
+  thread_cb((struct hfp_info *)cb_data);
+  ASSERT_EQ(60, info->packet_size);
+  ASSERT_EQ(60, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+
+  /* The rest is drained in one call, and as many packets written. */
+  thread_cb((struct hfp_info *)cb_data);
+  for (i = 0; i < 4; i++) {
+    rc = recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT);
+    ASSERT_EQ(60, rc);
+  }
+  ASSERT_GT(0, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+
+  /* Nothing to read still writes one packet. */
+  thread_cb((struct hfp_info *)cb_data);
+  ASSERT_EQ(60, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+
+  hfp_info_get_stats(info, &stats);
+  EXPECT_EQ(3, stats.callbacks);
+  EXPECT_EQ(5, stats.packets_read);
+  EXPECT_EQ(6, stats.packets_written);
+  EXPECT_EQ(4, stats.max_read_batch);
+  EXPECT_EQ(60 * 4, stats.playback_depth_min);
+  EXPECT_EQ(60 * 9, stats.playback_depth_max);
+  EXPECT_EQ(3, stats.playback_depth_samples);
+  EXPECT_EQ(60 * (9 + 5 + 4), stats.playback_depth_sum);
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+}
+
+TEST(HfpInfo, MsbcLoopback) {
+  struct cras_iodev idev;
+  int sock[2];
+  unsigned int i;
+  uint8_t pkt[64];
+  int16_t *pcm;
+
+  ResetStubData();
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 64, HFP_CODEC_ID_MSBC, info));
+  ASSERT_NE((void *)NULL, info->msbc);
+
+  dev.direction = CRAS_STREAM_OUTPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+  idev.direction = CRAS_STREAM_INPUT;
+  idev.format = &format;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &idev));
+
+  /* Two frames of 16kHz audio to send. */
+  pcm = (int16_t *)buf_write_pointer(info->playback_buf);
+  for (i = 0; i < 240; i++)
+    pcm[i] = i * 100;
+  buf_increment_write(info->playback_buf, 480);
+
+  /* A packet of noise received is skipped, and concealed to keep time.
+   * One frame is coded and sent in return. */
+  memset(pkt, 0, sizeof(pkt));
+  send(sock[0], pkt, 60, 0);
+  thread_cb((struct hfp_info *)cb_data);
+  ASSERT_EQ(240, buf_queued(info->playback_buf));
+  ASSERT_EQ(240, buf_queued(info->capture_buf));
+  buf_increment_read(info->capture_buf, 240);
+
+  ASSERT_EQ(60, recv(sock[0], pkt, sizeof(pkt), MSG_DONTWAIT));
+  EXPECT_EQ(0x01, pkt[0]);
+  EXPECT_EQ(0x08, pkt[1]);
+  EXPECT_EQ(0xad, pkt[2]);
+
+  /* Looped back, it decodes to the first frame, past the crossfade from
+   * the concealed one. */
+  send(sock[0], pkt, 60, 0);
+  thread_cb((struct hfp_info *)cb_data);
+  ASSERT_EQ(240, buf_queued(info->capture_buf));
+  EXPECT_EQ(0, memcmp(info->playback_buf->bytes + 32,
+                      buf_read_pointer(info->capture_buf) + 32, 208));
+
+  ASSERT_EQ(60, recv(sock[0], pkt, sizeof(pkt), MSG_DONTWAIT));
+  EXPECT_EQ(0x38, pkt[1]);
+
+  hfp_info_stop(info);
+  ASSERT_EQ((void *)NULL, info->msbc);
+  hfp_info_destroy(info);
+}
+
 } // namespace
 
 extern "C" {
@@ -329,6 +448,51 @@ int audio_thread_rm_callback_sync(struct audio_thread *thread, int fd)
   cb_data = NULL;
   return 0;
 }
+
+/* Fake mSBC codec. The PCM of each frame is kept aside and the frame holds
+ * its index, so decoding gives back exactly what was encoded. */
+static uint8_t coded_frames[16][240];
+static unsigned int num_coded_frames;
+
+static int fake_msbc_encode(struct cras_audio_codec *codec, const void *input,
+                            size_t input_len, void *output,
+                            size_t output_len, size_t *count)
+{
+  uint8_t *frame = (uint8_t *)output;
+
+  memcpy(coded_frames[num_coded_frames % 16], input, 240);
+  memset(frame, 0, 57);
+  frame[0] = 0xad;
+  frame[1] = num_coded_frames++ % 16;
+  *count = 57;
+  return 240;
+}
+
+static int fake_msbc_decode(struct cras_audio_codec *codec, const void *input,
+                            size_t input_len, void *output,
+                            size_t output_len, size_t *count)
+{
+  const uint8_t *frame = (const uint8_t *)input;
+
+  memcpy(output, coded_frames[frame[1] % 16], 240);
+  *count = 240;
+  return 57;
+}
+
+struct cras_audio_codec *cras_msbc_codec_create()
+{
+  struct cras_audio_codec *codec =
+      (struct cras_audio_codec *)calloc(1, sizeof(*codec));
+
+  codec->encode = fake_msbc_encode;
+  codec->decode = fake_msbc_decode;
+  return codec;
+}
+
+void cras_sbc_codec_destroy(struct cras_audio_codec *codec)
+{
+  free(codec);
+}
 }
 
 int main(int argc, char **argv) {
@@ -0,0 +1,269 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <vector>
+
+extern "C" {
+#include "byte_buffer.h"
+#include "cras_audio_codec.h"
+#include "hfp_msbc.h"
+}
+
+namespace {
+
+static const unsigned int kSamples = MSBC_CODE_SIZE / 2;
+
+// The fake codec keeps the PCM of each frame aside and puts only the sync
+// word and an id in the frame, so decoding gives back exactly the input.
+static std::map<uint32_t, std::vector<int16_t> > coded_frames;
+static uint32_t next_frame_id;
+static unsigned int codec_create_called;
+static unsigned int codec_destroy_called;
+
+void ResetStubData() {
+  coded_frames.clear();
+  next_frame_id = 0;
+  codec_create_called = 0;
+  codec_destroy_called = 0;
+}
+
+class HfpMsbcTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      ResetStubData();
+      msbc_ = hfp_msbc_create();
+      ASSERT_NE((void *)NULL, msbc_);
+      pcm_in_ = byte_buffer_create(MSBC_CODE_SIZE * 64);
+      pcm_out_ = byte_buffer_create(MSBC_CODE_SIZE * 64);
+      sco_ = byte_buffer_create(MSBC_PKT_SIZE * 64);
+    }
+
+    virtual void TearDown() {
+      hfp_msbc_destroy(msbc_);
+      byte_buffer_destroy(&pcm_in_);
+      byte_buffer_destroy(&pcm_out_);
+      byte_buffer_destroy(&sco_);
+      EXPECT_EQ(2, codec_create_called);
+      EXPECT_EQ(2, codec_destroy_called);
+    }
+
+    // Queues |frames| frames of a 500Hz sine, continuing from |phase|.
+    void QueueSine(unsigned int frames, unsigned int *phase) {
+      int16_t *pcm = (int16_t *)buf_write_pointer(pcm_in_);
+      unsigned int i;
+
+      for (i = 0; i < frames * kSamples; i++, (*phase)++)
+        pcm[i] = 8000 * sin(2 * M_PI * 500 * *phase / 16000);
+      buf_increment_write(pcm_in_, frames * MSBC_CODE_SIZE);
+    }
+
+    struct hfp_msbc *msbc_;
+    struct byte_buffer *pcm_in_;
+    struct byte_buffer *pcm_out_;
+    struct byte_buffer *sco_;
+};
+
+TEST_F(HfpMsbcTestSuite, EncodeDecodeRoundTrip) {
+  static const uint8_t h2_header_1[] = { 0x08, 0x38, 0xc8, 0xf8 };
+  struct hfp_msbc_stats stats;
+  unsigned int phase = 0, i;
+  uint8_t *pkt;
+
+  QueueSine(10, &phase);
+
+  // Encoding stops once the target is reached.
+  EXPECT_EQ(4, hfp_msbc_encode(msbc_, pcm_in_, sco_, 4 * MSBC_PKT_SIZE));
+  EXPECT_EQ(4 * MSBC_PKT_SIZE, buf_queued(sco_));
+  EXPECT_EQ(6, hfp_msbc_encode(msbc_, pcm_in_, sco_, 1000));
+  EXPECT_EQ(0, buf_queued(pcm_in_));
+
+  pkt = buf_read_pointer(sco_);
+  for (i = 0; i < 10; i++, pkt += MSBC_PKT_SIZE) {
+    EXPECT_EQ(0x01, pkt[0]);
+    EXPECT_EQ(h2_header_1[i % 4], pkt[1]);
+    EXPECT_EQ(0xad, pkt[2]);
+  }
+
+  // Feed it back as a USB adapter would, in 24 byte packets.
+  for (i = 0; i < 10 * MSBC_PKT_SIZE; i += 24)
+    hfp_msbc_decode(msbc_, buf_read_pointer(sco_) + i, 24, pcm_out_);
+
+  ASSERT_EQ(10 * MSBC_CODE_SIZE, buf_queued(pcm_out_));
+  EXPECT_EQ(0, memcmp(pcm_in_->bytes, buf_read_pointer(pcm_out_),
+                      10 * MSBC_CODE_SIZE));
+
+  hfp_msbc_get_stats(msbc_, &stats);
+  EXPECT_EQ(10, stats.frames_encoded);
+  EXPECT_EQ(10, stats.frames_decoded);
+  EXPECT_EQ(0, stats.frames_concealed);
+  EXPECT_EQ(0, stats.bytes_skipped);
+}
+
+TEST_F(HfpMsbcTestSuite, ConcealLostPacket) {
+  struct hfp_msbc_stats stats;
+  unsigned int phase = 0, i;
+  const int16_t *in, *out;
+  double signal = 0, noise = 0;
+  uint8_t *pkt;
+
+  QueueSine(20, &phase);
+  EXPECT_EQ(20, hfp_msbc_encode(msbc_, pcm_in_, sco_, 20 * MSBC_PKT_SIZE));
+
+  // Packet 10 never arrives, the gap in sequence numbers tells.
+  pkt = buf_read_pointer(sco_);
+  EXPECT_EQ(10, hfp_msbc_decode(msbc_, pkt, 10 * MSBC_PKT_SIZE, pcm_out_));
+  EXPECT_EQ(10, hfp_msbc_decode(msbc_, pkt + 11 * MSBC_PKT_SIZE,
+                                9 * MSBC_PKT_SIZE, pcm_out_));
+  ASSERT_EQ(20 * MSBC_CODE_SIZE, buf_queued(pcm_out_));
+
+  hfp_msbc_get_stats(msbc_, &stats);
+  EXPECT_EQ(19, stats.frames_decoded);
+  EXPECT_EQ(1, stats.frames_concealed);
+
+  // The substitute continues the periodic signal closely.
+  in = (const int16_t *)pcm_in_->bytes + 10 * kSamples;
+  out = (const int16_t *)buf_read_pointer(pcm_out_) + 10 * kSamples;
+  for (i = 0; i < kSamples; i++) {
+    signal += (double)in[i] * in[i];
+    noise += (double)(in[i] - out[i]) * (in[i] - out[i]);
+  }
+  EXPECT_GT(10 * log10(signal / noise), 20);
+
+  // The good frame after the loss comes through untouched.
+  EXPECT_EQ(0, memcmp(in + kSamples + 16, out + kSamples + 16,
+                      MSBC_CODE_SIZE - 32));
+}
+
+TEST_F(HfpMsbcTestSuite, ResyncAfterGarbage) {
+  struct hfp_msbc_stats stats;
+  unsigned int phase = 0;
+  uint8_t garbage[130];
+  uint8_t *pkt;
+
+  memset(garbage, 0, sizeof(garbage));
+  QueueSine(12, &phase);
+  EXPECT_EQ(12, hfp_msbc_encode(msbc_, pcm_in_, sco_, 12 * MSBC_PKT_SIZE));
+  pkt = buf_read_pointer(sco_);
+
+  // A few stray bytes are skipped without losing a frame.
+  hfp_msbc_decode(msbc_, pkt, 4 * MSBC_PKT_SIZE, pcm_out_);
+  hfp_msbc_decode(msbc_, garbage, 7, pcm_out_);
+  hfp_msbc_decode(msbc_, pkt + 4 * MSBC_PKT_SIZE, 4 * MSBC_PKT_SIZE,
+                  pcm_out_);
+  hfp_msbc_get_stats(msbc_, &stats);
+  EXPECT_EQ(8, stats.frames_decoded);
+  EXPECT_EQ(0, stats.frames_concealed);
+  EXPECT_EQ(7, stats.bytes_skipped);
+  EXPECT_EQ(8 * MSBC_CODE_SIZE, buf_queued(pcm_out_));
+
+  // A long run of garbage keeps the audio going, a frame per packet time.
+  hfp_msbc_decode(msbc_, garbage, sizeof(garbage), pcm_out_);
+  hfp_msbc_decode(msbc_, pkt + 8 * MSBC_PKT_SIZE, 4 * MSBC_PKT_SIZE,
+                  pcm_out_);
+  hfp_msbc_get_stats(msbc_, &stats);
+  EXPECT_EQ(12, stats.frames_decoded);
+  EXPECT_EQ(2, stats.frames_concealed);
+  EXPECT_EQ(137, stats.bytes_skipped);
+  EXPECT_EQ(14 * MSBC_CODE_SIZE, buf_queued(pcm_out_));
+}
+
+TEST_F(HfpMsbcTestSuite, CorruptFrameConcealed) {
+  struct hfp_msbc_stats stats;
+  unsigned int phase = 0;
+  uint8_t *pkt;
+
+  QueueSine(4, &phase);
+  EXPECT_EQ(4, hfp_msbc_encode(msbc_, pcm_in_, sco_, 4 * MSBC_PKT_SIZE));
+  pkt = buf_read_pointer(sco_);
+
+  // The header is intact but the frame doesn't decode.
+  pkt[2 * MSBC_PKT_SIZE + 3] ^= 0xff;
+  EXPECT_EQ(4, hfp_msbc_decode(msbc_, pkt, 4 * MSBC_PKT_SIZE, pcm_out_));
+
+  hfp_msbc_get_stats(msbc_, &stats);
+  EXPECT_EQ(3, stats.frames_decoded);
+  EXPECT_EQ(1, stats.frames_concealed);
+}
+
+TEST_F(HfpMsbcTestSuite, DropWhenOutputFull) {
+  struct hfp_msbc_stats stats;
+  unsigned int phase = 0;
+
+  QueueSine(4, &phase);
+  EXPECT_EQ(4, hfp_msbc_encode(msbc_, pcm_in_, sco_, 4 * MSBC_PKT_SIZE));
+
+  byte_buffer_set_used_size(pcm_out_, 2 * MSBC_CODE_SIZE);
+  EXPECT_EQ(2, hfp_msbc_decode(msbc_, buf_read_pointer(sco_),
+                               4 * MSBC_PKT_SIZE, pcm_out_));
+
+  hfp_msbc_get_stats(msbc_, &stats);
+  EXPECT_EQ(4, stats.frames_decoded);
+  EXPECT_EQ(2, stats.frames_dropped);
+}
+
+} // namespace
+
+extern "C" {
+
+static int fake_encode(struct cras_audio_codec *codec, const void *input,
+                       size_t input_len, void *output, size_t output_len,
+                       size_t *count) {
+  const int16_t *pcm = (const int16_t *)input;
+  uint8_t *frame = (uint8_t *)output;
+
+  if (input_len < MSBC_CODE_SIZE || output_len < MSBC_FRAME_SIZE)
+    return -1;
+  memset(frame, 0, MSBC_FRAME_SIZE);
+  frame[0] = 0xad;
+  memcpy(frame + 1, &next_frame_id, sizeof(next_frame_id));
+  coded_frames[next_frame_id++].assign(pcm, pcm + kSamples);
+  *count = MSBC_FRAME_SIZE;
+  return MSBC_CODE_SIZE;
+}
+
+static int fake_decode(struct cras_audio_codec *codec, const void *input,
+                       size_t input_len, void *output, size_t output_len,
+                       size_t *count) {
+  const uint8_t *frame = (const uint8_t *)input;
+  std::map<uint32_t, std::vector<int16_t> >::iterator it;
+  uint32_t id;
+
+  if (input_len < MSBC_FRAME_SIZE || output_len < MSBC_CODE_SIZE ||
+      frame[0] != 0xad)
+    return -1;
+  memcpy(&id, frame + 1, sizeof(id));
+  it = coded_frames.find(id);
+  if (it == coded_frames.end())
+    return -1;
+  memcpy(output, &it->second[0], MSBC_CODE_SIZE);
+  *count = MSBC_CODE_SIZE;
+  return MSBC_FRAME_SIZE;
+}
+
+struct cras_audio_codec *cras_msbc_codec_create() {
+  struct cras_audio_codec *codec =
+      (struct cras_audio_codec *)calloc(1, sizeof(*codec));
+
+  codec->encode = fake_encode;
+  codec->decode = fake_decode;
+  codec_create_called++;
+  return codec;
+}
+
+void cras_sbc_codec_destroy(struct cras_audio_codec *codec) {
+  codec_destroy_called++;
+  free(codec);
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,67 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "hw_ptr_model.h"
+}
+
+namespace {
+
+static const double kRate = 48000;
+
+static struct timespec Ts(time_t sec, long msec) {
+  struct timespec ts = { sec, msec * 1000000 };
+  return ts;
+}
+
+TEST(HwPtrModel, Predict) {
+  struct hw_ptr_model model;
+  struct timespec ts;
+  unsigned int level;
+
+  hw_ptr_model_invalidate(&model);
+  ts = Ts(1, 10);
+  EXPECT_EQ(-EAGAIN, hw_ptr_model_predict(&model, kRate, &ts, 96, &level));
+
+  ts = Ts(1, 0);
+  hw_ptr_model_update(&model, 960, &ts);
+  ts = Ts(1, 10);
+  ASSERT_EQ(0, hw_ptr_model_predict(&model, kRate, &ts, 96, &level));
+  EXPECT_EQ(480, level);
+
+  hw_ptr_model_add_frames(&model, 100);
+  ASSERT_EQ(0, hw_ptr_model_predict(&model, kRate, &ts, 96, &level));
+  EXPECT_EQ(580, level);
+
+  // Too old.
+  ts = Ts(1, 60);
+  EXPECT_EQ(-EAGAIN, hw_ptr_model_predict(&model, kRate, &ts, 96, &level));
+
+  hw_ptr_model_invalidate(&model);
+  ts = Ts(1, 10);
+  EXPECT_EQ(-EAGAIN, hw_ptr_model_predict(&model, kRate, &ts, 96, &level));
+}
+
+TEST(HwPtrModel, NoPredictionBelowMargin) {
+  struct hw_ptr_model model;
+  struct timespec ts = Ts(1, 0);
+  unsigned int level;
+
+  hw_ptr_model_update(&model, 192, &ts);
+  ts = Ts(1, 1);
+  EXPECT_EQ(0, hw_ptr_model_predict(&model, kRate, &ts, 96, &level));
+  EXPECT_EQ(144, level);
+  ts = Ts(1, 3);
+  EXPECT_EQ(-EAGAIN, hw_ptr_model_predict(&model, kRate, &ts, 96, &level));
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
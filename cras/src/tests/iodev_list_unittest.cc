@@ -1732,6 +1732,17 @@ void test_iodev_command(struct cras_iodev *iodev,
                         const uint8_t *data) {
 }
 
+struct cras_iodev *sim_iodev_create(enum CRAS_STREAM_DIRECTION direction) {
+  return NULL;
+}
+
+int sim_iodev_command(struct cras_iodev *iodev,
+                      enum CRAS_TEST_IODEV_CMD command,
+                      unsigned int data_len,
+                      const uint8_t *data) {
+  return 0;
+}
+
 struct cras_iodev *loopback_iodev_create(enum CRAS_LOOPBACK_TYPE type) {
   return &loopback_input;
 }
@@ -24,7 +24,7 @@ void iodev_stub_reset() {
 
 void iodev_stub_frames_queued(cras_iodev* iodev, int ret, timespec ts) {
   cb_data data = { ret, ts };
-  data_map.insert({iodev, data});
+  data_map[iodev] = data;
 }
 
 extern "C" {
@@ -37,6 +37,19 @@ int cras_iodev_get_dsp_delay(const struct cras_iodev *iodev) {
   return 0;
 }
 
+int cras_iodev_get_delay(const struct cras_iodev *iodev,
+                         struct cras_iodev_delay *delay) {
+  int rc = iodev->delay_frames(iodev);
+  if (rc < 0)
+    return rc;
+  delay->frames = rc;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &delay->tstamp);
+  delay->rate_ratio = 1.0;
+  delay->rate_err = 0;
+  delay->frames_err = 0;
+  return 0;
+}
+
 int cras_iodev_frames_queued(struct cras_iodev *iodev,
                              struct timespec *tstamp) {
   auto elem = data_map.find(iodev);
@@ -59,7 +72,7 @@ int cras_iodev_update_rate(struct cras_iodev *iodev, unsigned int level,
 }
 
 enum CRAS_IODEV_STATE cras_iodev_state(const struct cras_iodev *iodev) {
-  return CRAS_IODEV_STATE_OPEN;
+  return iodev->state;
 }
 
 unsigned int cras_iodev_all_streams_written(struct cras_iodev *iodev) {
@@ -71,11 +84,16 @@ int cras_iodev_put_input_buffer(struct cras_iodev *iodev) {
 }
 
 int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
-                                 unsigned int nframes, int* non_empty,
+                                 unsigned int nframes, int is_silent,
+                                 int* non_empty,
                                  struct cras_fmt_conv *output_converter) {
   return 0;
 }
 
+int cras_iodev_commit_output_buffer(struct cras_iodev *odev) {
+  return 0;
+}
+
 int cras_iodev_get_input_buffer(struct cras_iodev *iodev,
                                 unsigned *frames) {
   return 0;
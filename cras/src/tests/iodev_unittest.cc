@@ -54,12 +54,17 @@ static float cras_dsp_pipeline_sink_buffer[2][DSP_BUFFER_SIZE];
 static int cras_dsp_pipeline_get_delay_called;
 static int cras_dsp_pipeline_apply_called;
 static int cras_dsp_pipeline_set_sink_ext_module_called;
+static struct ext_dsp_module *cras_dsp_pipeline_set_sink_ext_module_val;
+static struct ext_dsp_module *ext_mod_configure_connected_val;
+static int audio_thread_dev_set_ext_dsp_module_called;
 static int cras_dsp_pipeline_apply_sample_count;
 static unsigned int cras_mix_mute_count;
+static int cras_mix_buffer_is_zero_ret;
 static unsigned int cras_dsp_num_input_channels_return;
 static unsigned int cras_dsp_num_output_channels_return;
 struct cras_dsp_context *cras_dsp_context_new_return;
 static unsigned int cras_dsp_load_dummy_pipeline_called;
+static unsigned int cras_dsp_disable_fixed_point_called;
 static unsigned int rate_estimator_add_frames_num_frames;
 static unsigned int rate_estimator_add_frames_called;
 static int cras_system_get_mute_return;
@@ -111,6 +116,8 @@ static int buffer_share_add_id_called;
 static int buffer_share_get_new_write_point_ret;
 static int ext_mod_configure_called;
 static struct input_data *input_data_create_ret;
+static int input_data_add_stream_called;
+static int input_data_rm_stream_called;
 
 // Iodev callback
 int update_channel_layout(struct cras_iodev *iodev) {
@@ -128,6 +135,8 @@ int set_swap_mode_for_node(struct cras_iodev *iodev, struct cras_ionode *node,
 }
 
 void ResetStubData() {
+  input_data_add_stream_called = 0;
+  input_data_rm_stream_called = 0;
   cras_iodev_list_disable_dev_called = 0;
   select_node_called = 0;
   notify_nodes_changed_called = 0;
@@ -152,12 +161,17 @@ void ResetStubData() {
          sizeof(cras_dsp_pipeline_sink_buffer));
   cras_dsp_pipeline_get_delay_called = 0;
   cras_dsp_pipeline_apply_called = 0;
+  cras_mix_buffer_is_zero_ret = 0;
   cras_dsp_pipeline_set_sink_ext_module_called = 0;
+  cras_dsp_pipeline_set_sink_ext_module_val = NULL;
+  ext_mod_configure_connected_val = NULL;
+  audio_thread_dev_set_ext_dsp_module_called = 0;
   cras_dsp_pipeline_apply_sample_count = 0;
   cras_dsp_num_input_channels_return = 2;
   cras_dsp_num_output_channels_return = 2;
   cras_dsp_context_new_return = NULL;
   cras_dsp_load_dummy_pipeline_called = 0;
+  cras_dsp_disable_fixed_point_called = 0;
   rate_estimator_add_frames_num_frames = 0;
   rate_estimator_add_frames_called = 0;
   cras_system_get_mute_return = 0;
@@ -453,6 +467,8 @@ TEST_F(IoDevSetFormatTestSuite, InputDSPChannleReduction) {
   EXPECT_EQ(SND_PCM_FORMAT_S16_LE, iodev_.ext_format->format);
   EXPECT_EQ(48000, iodev_.ext_format->frame_rate);
   EXPECT_EQ(2, iodev_.ext_format->num_channels);
+  // The input data module connects to the sink, so no fixed point.
+  EXPECT_EQ(1, cras_dsp_disable_fixed_point_called);
 }
 
 TEST_F(IoDevSetFormatTestSuite, UpdateChannelLayoutSuccess) {
@@ -606,7 +622,8 @@ TEST(IoDevPutOutputBuffer, SystemMuted) {
   iodev.format = &fmt;
   iodev.put_buffer = put_buffer;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(20, cras_mix_mute_count);
   EXPECT_EQ(20, put_buffer_nframes);
@@ -668,7 +685,8 @@ TEST(IoDevPutOutputBuffer, NodeVolumeZeroShouldMute) {
   iodev.format = &fmt;
   iodev.put_buffer = put_buffer;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(20, cras_mix_mute_count);
   EXPECT_EQ(20, put_buffer_nframes);
@@ -697,7 +715,8 @@ TEST(IoDevPutOutputBuffer, SystemMutedWithRamp) {
   // Assume ramping is done.
   cras_ramp_get_current_action_ret.type = CRAS_RAMP_ACTION_NONE;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, 0, NULL,
+                                    nullptr);
   // Output should be muted.
   EXPECT_EQ(0, rc);
   EXPECT_EQ(20, cras_mix_mute_count);
@@ -707,7 +726,8 @@ TEST(IoDevPutOutputBuffer, SystemMutedWithRamp) {
   // Test for the case where ramping is not done yet.
   ResetStubData();
   cras_ramp_get_current_action_ret.type = CRAS_RAMP_ACTION_PARTIAL;
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, 0, NULL,
+                                    nullptr);
 
   // Output should not be muted.
   EXPECT_EQ(0, rc);
@@ -746,7 +766,8 @@ TEST(IoDevPutOutputBuffer, NodeVolumeZeroShouldMuteWithRamp) {
   // Assume ramping is done.
   cras_ramp_get_current_action_ret.type = CRAS_RAMP_ACTION_NONE;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(20, cras_mix_mute_count);
   EXPECT_EQ(20, put_buffer_nframes);
@@ -755,7 +776,8 @@ TEST(IoDevPutOutputBuffer, NodeVolumeZeroShouldMuteWithRamp) {
   // Test for the case where ramping is not done yet.
   ResetStubData();
   cras_ramp_get_current_action_ret.type = CRAS_RAMP_ACTION_PARTIAL;
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, 0, NULL,
+                                    nullptr);
 
   // Output should not be muted.
   EXPECT_EQ(0, rc);
@@ -787,7 +809,8 @@ TEST(IoDevPutOutputBuffer, NoDSP) {
   iodev.format = &fmt;
   iodev.put_buffer = put_buffer;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 22, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 22, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(0, cras_mix_mute_count);
   EXPECT_EQ(22, put_buffer_nframes);
@@ -813,7 +836,8 @@ TEST(IoDevPutOutputBuffer, DSP) {
   cras_iodev_register_pre_dsp_hook(&iodev, pre_dsp_hook, (void *)0x1234);
   cras_iodev_register_post_dsp_hook(&iodev, post_dsp_hook, (void *)0x5678);
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 32, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 32, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(0, cras_mix_mute_count);
   EXPECT_EQ(1, pre_dsp_hook_called);
@@ -827,6 +851,64 @@ TEST(IoDevPutOutputBuffer, DSP) {
   EXPECT_EQ(cras_dsp_get_pipeline_called, cras_dsp_put_pipeline_called);
 }
 
+TEST(IoDevPutOutputBuffer, SilentSkipsDspAfterTail) {
+  struct cras_audio_format fmt;
+  struct cras_iodev iodev;
+  /* 100ms at 48kHz is the tail with a zero delay pipeline. */
+  const unsigned int tail_frames = 4800;
+  uint8_t *frames = (uint8_t *)calloc(tail_frames, 4);
+  int rc;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.dsp_context = reinterpret_cast<cras_dsp_context*>(0x15);
+  cras_dsp_get_pipeline_ret = 0x25;
+
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  fmt.frame_rate = 48000;
+  fmt.num_channels = 2;
+  iodev.format = &fmt;
+  iodev.put_buffer = put_buffer;
+  iodev.software_volume_needed = 1;
+  cras_iodev_register_post_dsp_hook(&iodev, post_dsp_hook, (void *)0x5678);
+
+  /* Silence in, silence out, the DSP still runs until the tail drained. */
+  cras_mix_buffer_is_zero_ret = 1;
+  rc = cras_iodev_put_output_buffer(&iodev, frames, tail_frames, 1, NULL,
+                                    nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1, cras_dsp_pipeline_apply_called);
+  EXPECT_EQ(tail_frames, iodev.dsp_silent_frames);
+
+  /* Now skipped, as are the volume scaling and the non-empty check. */
+  int non_empty = 0;
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 100, 1, &non_empty,
+                                    nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1, cras_dsp_pipeline_apply_called);
+  EXPECT_EQ(0, cras_scale_buffer_called);
+  EXPECT_EQ(0, non_empty);
+  EXPECT_EQ(2, post_dsp_hook_called);
+  EXPECT_EQ(100, put_buffer_nframes);
+  EXPECT_EQ(cras_dsp_get_pipeline_called, cras_dsp_put_pipeline_called);
+
+  /* Audio resets the tail. */
+  cras_mix_buffer_is_zero_ret = 0;
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 100, 0, NULL, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(2, cras_dsp_pipeline_apply_called);
+  EXPECT_EQ(0, iodev.dsp_silent_frames);
+
+  /* A non-zero tail from the DSP clears the silent flag. */
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 100, 1, &non_empty,
+                                    nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(3, cras_dsp_pipeline_apply_called);
+  EXPECT_EQ(0, iodev.dsp_silent_frames);
+  EXPECT_EQ(1, non_empty);
+  free(frames);
+}
+
 TEST(IoDevPutOutputBuffer, SoftVol) {
   struct cras_audio_format fmt;
   struct cras_iodev iodev;
@@ -846,7 +928,8 @@ TEST(IoDevPutOutputBuffer, SoftVol) {
   cras_system_get_volume_return = 13;
   softvol_scalers[13] = 0.435;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 53, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 53, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(0, cras_mix_mute_count);
   EXPECT_EQ(53, put_buffer_nframes);
@@ -884,7 +967,8 @@ TEST(IoDevPutOutputBuffer, SoftVolWithRamp) {
   cras_system_get_volume_return = volume;
   softvol_scalers[volume] = volume_scaler;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, n_frames, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, n_frames, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(0, cras_mix_mute_count);
   EXPECT_EQ(n_frames, put_buffer_nframes);
@@ -901,7 +985,8 @@ TEST(IoDevPutOutputBuffer, SoftVolWithRamp) {
   cras_system_get_volume_return = volume;
   softvol_scalers[volume] = volume_scaler;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, n_frames, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, n_frames, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(0, cras_mix_mute_count);
   // cras_scale_buffer is not called.
@@ -949,7 +1034,8 @@ TEST(IoDevPutOutputBuffer, NoSoftVolWithRamp) {
   // Assume ramping is done.
   cras_ramp_get_current_action_ret.type = CRAS_RAMP_ACTION_NONE;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, n_frames, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, n_frames, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(0, cras_mix_mute_count);
   // cras_scale_buffer is not called.
@@ -963,7 +1049,8 @@ TEST(IoDevPutOutputBuffer, NoSoftVolWithRamp) {
   cras_ramp_get_current_action_ret.scaler = ramp_scaler;
   cras_ramp_get_current_action_ret.increment = increment;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, n_frames, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, n_frames, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(0, cras_mix_mute_count);
   // cras_scale_buffer is not called.
@@ -1000,7 +1087,8 @@ TEST(IoDevPutOutputBuffer, Scale32Bit) {
   iodev.format = &fmt;
   iodev.put_buffer = put_buffer;
 
-  rc = cras_iodev_put_output_buffer(&iodev, frames, 53, NULL, nullptr);
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 53, 0, NULL,
+                                    nullptr);
   EXPECT_EQ(0, rc);
   EXPECT_EQ(0, cras_mix_mute_count);
   EXPECT_EQ(53, put_buffer_nframes);
@@ -1529,6 +1617,33 @@ TEST(IoDev, FillZeros) {
   EXPECT_EQ(0, rc);
 }
 
+static int commit_buffer_called;
+static int commit_buffer(struct cras_iodev *iodev) {
+  commit_buffer_called++;
+  return 0;
+}
+
+TEST(IoDev, FillZerosCommitsBatch) {
+  struct cras_iodev iodev;
+  struct cras_audio_format fmt;
+
+  ResetStubData();
+
+  memset(&iodev, 0, sizeof(iodev));
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  fmt.frame_rate = 48000;
+  fmt.num_channels = 2;
+  iodev.ext_format = &fmt;
+  iodev.get_buffer = get_buffer;
+  iodev.put_buffer = put_buffer;
+  iodev.commit_buffer = commit_buffer;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  commit_buffer_called = 0;
+
+  EXPECT_EQ(0, cras_iodev_fill_odev_zeros(&iodev, 50));
+  EXPECT_EQ(1, commit_buffer_called);
+}
+
 TEST(IoDev, DefaultNoStreamPlaybackRunning) {
   struct cras_iodev iodev;
   struct cras_audio_format fmt;
@@ -2072,6 +2187,100 @@ TEST(IoDev, HandleOutputUnderrun) {
   EXPECT_EQ(1, output_underrun_called);
 }
 
+static int close_dev(struct cras_iodev *iodev) {
+  return 0;
+}
+
+TEST(IoDev, AdaptiveWatermark) {
+  struct cras_iodev iodev;
+  struct timespec tstamp;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.configure_dev = configure_dev;
+  iodev.close_dev = close_dev;
+  iodev.frames_queued = frames_queued;
+  iodev.output_underrun = output_underrun;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.ext_format = &audio_fmt;
+  iodev.min_buffer_level = 96;
+  iodev.adaptive_watermark = 1;
+  iodev_buffer_size = 1024;
+  cras_iodev_open(&iodev, 240, &audio_fmt);
+  EXPECT_EQ(96, iodev.watermark.level);
+
+  // An underrun doubles the margin before the device refills.
+  EXPECT_EQ(0, cras_iodev_output_underrun(&iodev));
+  EXPECT_EQ(1, output_underrun_called);
+  EXPECT_EQ(192, iodev.min_buffer_level);
+
+  // Levels close to empty count as near misses, but only in normal run.
+  fr_queued = 10;
+  cras_iodev_frames_queued(&iodev, &tstamp);
+  EXPECT_EQ(192, iodev.min_buffer_level);
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  EXPECT_EQ(0, cras_iodev_frames_queued(&iodev, &tstamp));
+  EXPECT_EQ(240, iodev.min_buffer_level);
+
+  // The configured level is restored on close.
+  cras_iodev_close(&iodev);
+  EXPECT_EQ(96, iodev.min_buffer_level);
+}
+
+TEST(IoDev, DeepBufferOnlyForMediaStreams) {
+  struct cras_iodev iodev;
+  struct cras_rstream media1, media2, voice;
+  struct dev_stream stream1, stream2, stream3;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  memset(&media1, 0, sizeof(media1));
+  memset(&media2, 0, sizeof(media2));
+  memset(&voice, 0, sizeof(voice));
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.allow_deep_buffer = 1;
+  media1.stream_type = CRAS_STREAM_TYPE_MULTIMEDIA;
+  media1.num_attached_devs = 1;
+  media2.stream_type = CRAS_STREAM_TYPE_DEFAULT;
+  media2.num_attached_devs = 1;
+  voice.stream_type = CRAS_STREAM_TYPE_VOICE_COMMUNICATION;
+  voice.num_attached_devs = 1;
+  stream1.stream = &media1;
+  stream2.stream = &media2;
+  stream3.stream = &voice;
+
+  cras_iodev_add_stream(&iodev, &stream1);
+  cras_iodev_add_stream(&iodev, &stream2);
+  EXPECT_EQ(1, iodev.deep_buffer);
+  EXPECT_EQ(1, media1.deep_buffer_frames);
+  EXPECT_EQ(1, media2.deep_buffer_frames);
+
+  // A voice stream takes the media streams back to low latency.
+  cras_iodev_add_stream(&iodev, &stream3);
+  EXPECT_EQ(0, iodev.deep_buffer);
+  EXPECT_EQ(0, media1.deep_buffer_frames);
+  EXPECT_EQ(0, media2.deep_buffer_frames);
+
+  cras_iodev_rm_stream(&iodev, &voice);
+  EXPECT_EQ(1, iodev.deep_buffer);
+  EXPECT_EQ(1, media1.deep_buffer_frames);
+
+  // A removed stream leaves deep buffer mode, it may move to another device.
+  cras_iodev_rm_stream(&iodev, &media1);
+  EXPECT_EQ(0, media1.deep_buffer_frames);
+  EXPECT_EQ(1, media2.deep_buffer_frames);
+
+  // Streams shared with another device aren't rescheduled.
+  media1.num_attached_devs = 2;
+  cras_iodev_add_stream(&iodev, &stream1);
+  EXPECT_EQ(0, iodev.deep_buffer);
+  EXPECT_EQ(0, media2.deep_buffer_frames);
+
+  cras_iodev_rm_stream(&iodev, &media1);
+  cras_iodev_rm_stream(&iodev, &media2);
+  EXPECT_EQ(0, iodev.deep_buffer);
+}
+
 static void ext_mod_configure(
     struct ext_dsp_module *ext,
     unsigned int buffer_size,
@@ -2079,6 +2288,7 @@ static void ext_mod_configure(
     unsigned int rate)
 {
   ext_mod_configure_called++;
+  ext_mod_configure_connected_val = cras_dsp_pipeline_set_sink_ext_module_val;
 }
 
 TEST(IoDev, SetExtDspMod) {
@@ -2106,24 +2316,33 @@ TEST(IoDev, SetExtDspMod) {
 
   cras_iodev_open(&iodev, 240, &fmt);
   EXPECT_EQ(1, ext_mod_configure_called);
-  EXPECT_EQ(1, cras_dsp_get_pipeline_called);
+  EXPECT_EQ(2, cras_dsp_get_pipeline_called);
   EXPECT_EQ(1, cras_dsp_pipeline_set_sink_ext_module_called);
+  EXPECT_EQ(0, audio_thread_dev_set_ext_dsp_module_called);
 
+  /* Once open the audio thread disconnects the sink. */
   cras_iodev_set_ext_dsp_module(&iodev, NULL);
   EXPECT_EQ(1, ext_mod_configure_called);
+  EXPECT_EQ(1, audio_thread_dev_set_ext_dsp_module_called);
+  EXPECT_EQ(2, cras_dsp_pipeline_set_sink_ext_module_called);
+  EXPECT_EQ(NULL, cras_dsp_pipeline_set_sink_ext_module_val);
+  EXPECT_EQ(cras_dsp_get_pipeline_called, cras_dsp_put_pipeline_called);
 
+  /* The module is configured between disconnecting and connecting. */
   cras_iodev_set_ext_dsp_module(&iodev, &ext);
   EXPECT_EQ(2, ext_mod_configure_called);
-  EXPECT_EQ(2, cras_dsp_get_pipeline_called);
-  EXPECT_EQ(2, cras_dsp_pipeline_set_sink_ext_module_called);
+  EXPECT_EQ(3, audio_thread_dev_set_ext_dsp_module_called);
+  EXPECT_EQ(4, cras_dsp_pipeline_set_sink_ext_module_called);
+  EXPECT_EQ(&ext, cras_dsp_pipeline_set_sink_ext_module_val);
+  EXPECT_EQ(NULL, ext_mod_configure_connected_val);
+  EXPECT_EQ(cras_dsp_get_pipeline_called, cras_dsp_put_pipeline_called);
 
   /* If pipeline doesn't exist, dummy pipeline should be loaded. */
   cras_dsp_get_pipeline_ret = 0x0;
   cras_iodev_set_ext_dsp_module(&iodev, &ext);
   EXPECT_EQ(3, ext_mod_configure_called);
-  EXPECT_EQ(4, cras_dsp_get_pipeline_called);
   EXPECT_EQ(1, cras_dsp_load_dummy_pipeline_called);
-  EXPECT_EQ(3, cras_dsp_pipeline_set_sink_ext_module_called);
+  EXPECT_EQ(4, cras_dsp_pipeline_set_sink_ext_module_called);
 }
 
 TEST(IoDev, InputDspOffset) {
@@ -2160,6 +2379,7 @@ TEST(IoDev, InputDspOffset) {
   cras_iodev_open(&iodev, 240, &fmt);
 
   cras_iodev_add_stream(&iodev, &stream1);
+  EXPECT_EQ(1, input_data_add_stream_called);
   cras_iodev_get_input_buffer(&iodev, &frames);
 
   buffer_share_get_new_write_point_ret = 100;
@@ -2173,6 +2393,10 @@ TEST(IoDev, InputDspOffset) {
   buffer_share_get_new_write_point_ret = 80;
   cras_iodev_put_input_buffer(&iodev);
   EXPECT_EQ(60, iodev.input_dsp_offset);
+
+  /* Removing the stream detaches it from its APM on this device. */
+  cras_iodev_rm_stream(&iodev, &rstream1);
+  EXPECT_EQ(1, input_data_rm_stream_called);
 }
 
 extern "C" {
@@ -2249,6 +2473,11 @@ struct cras_dsp_context *cras_dsp_context_new(int sample_rate,
   return cras_dsp_context_new_return;
 }
 
+void cras_dsp_disable_fixed_point(struct cras_dsp_context *ctx)
+{
+  cras_dsp_disable_fixed_point_called++;
+}
+
 void cras_dsp_context_free(struct cras_dsp_context *ctx)
 {
   dsp_context_free_called++;
@@ -2304,6 +2533,17 @@ int cras_dsp_pipeline_get_delay(struct pipeline *pipeline)
   return 0;
 }
 
+int cras_dsp_pipeline_get_sample_rate(struct pipeline *pipeline)
+{
+  return 48000;
+}
+
+struct pipeline *cras_dsp_pipeline_get_crossfade_source(
+    struct pipeline *pipeline)
+{
+  return NULL;
+}
+
 int cras_dsp_pipeline_apply(struct pipeline *pipeline,
 			    uint8_t *buf, snd_pcm_format_t format,
 			    unsigned int frames)
@@ -2318,10 +2558,12 @@ void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
                                      int samples)
 {
 }
-void cras_dsp_pipeline_set_sink_ext_module(struct pipeline *pipeline,
-					   struct ext_dsp_module *ext_module)
+int cras_dsp_pipeline_set_sink_ext_module(struct pipeline *pipeline,
+                                          struct ext_dsp_module *ext_module)
 {
   cras_dsp_pipeline_set_sink_ext_module_called++;
+  cras_dsp_pipeline_set_sink_ext_module_val = ext_module;
+  return 0;
 }
 
 unsigned int cras_dsp_num_output_channels(const struct cras_dsp_context *ctx)
@@ -2340,6 +2582,20 @@ int audio_thread_post_message(struct audio_thread *thread,
   return 0;
 }
 
+int audio_thread_dev_set_ext_dsp_module(struct audio_thread *thread,
+                                        struct cras_iodev *dev,
+                                        struct ext_dsp_module *ext)
+{
+  audio_thread_dev_set_ext_dsp_module_called++;
+  // Run it as the audio thread would.
+  return cras_iodev_connect_ext_dsp_module(dev, ext);
+}
+
+struct audio_thread *cras_iodev_list_get_audio_thread()
+{
+  return NULL;
+}
+
 void cras_iodev_list_select_node(enum CRAS_STREAM_DIRECTION direction,
                                  cras_node_id_t node_id)
 {
@@ -2452,9 +2708,14 @@ size_t cras_mix_mute_buffer(uint8_t *dst,
   return count;
 }
 
+int cras_mix_buffer_is_zero(const uint8_t *buf, size_t bytes) {
+  return cras_mix_buffer_is_zero_ret;
+}
+
 struct rate_estimator *rate_estimator_create(unsigned int rate,
                                              const struct timespec *window_size,
-                                             double smooth_factor) {
+                                             double smooth_factor,
+                                             enum RATE_ESTIMATOR_TYPE type) {
   return NULL;
 }
 
@@ -2478,12 +2739,21 @@ double rate_estimator_get_rate(struct rate_estimator *re) {
   return 0.0;
 }
 
+double rate_estimator_get_rate_error(struct rate_estimator *re) {
+  return 0.0;
+}
+
 unsigned int dev_stream_cb_threshold(const struct dev_stream *dev_stream) {
   if (dev_stream->stream)
     return dev_stream->stream->cb_threshold;
   return 0;
 }
 
+void cras_rstream_set_deep_buffer(struct cras_rstream *stream, int enable,
+                                  const struct timespec *now) {
+  stream->deep_buffer_frames = enable;
+}
+
 int dev_stream_attached_devs(const struct dev_stream *dev_stream) {
   return 1;
 }
@@ -2567,6 +2837,18 @@ void input_data_set_all_streams_read(struct input_data *data,
 {
 }
 
+void input_data_add_stream(struct input_data *data,
+			   const struct cras_rstream *stream)
+{
+  input_data_add_stream_called++;
+}
+
+void input_data_rm_stream(struct input_data *data,
+			  const struct cras_rstream *stream)
+{
+  input_data_rm_stream_called++;
+}
+
 int cras_audio_thread_severe_underrun()
 {
   return 0;
@@ -3,9 +3,12 @@
 // found in the LICENSE file.
 
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <gtest/gtest.h>
+#include <vector>
 
 extern "C" {
 #include "linear_resampler.h"
@@ -31,7 +34,7 @@ TEST(LinearResampler, ReampleToSlightlyLargerRate) {
 		*((int16_t *)(in_buf + i * 4 + 2)) = i * 20;
 	}
 
-	lr = linear_resampler_create(2, 4, 48000, 48001);
+	lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 48000, 48001);
 
 	count = 20;
 	rc = linear_resampler_resample(lr, in_buf + 4 * in_offset, &count,
@@ -72,7 +75,7 @@ TEST(LinearResampler, ResampleIntegerFractionToLarger) {
 	}
 
 	/* Rate 10 -> 11 */
-	lr = linear_resampler_create(2, 4, 10, 11);
+	lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 10, 11);
 
 	count = 5;
 	rc = linear_resampler_resample(lr, in_buf + 4 * in_offset, &count,
@@ -123,7 +126,7 @@ TEST(LinearResampler, ResampleIntegerFractionToLess) {
 	}
 
 	/* Rate 10 -> 9 */
-	lr = linear_resampler_create(2, 4, 10, 9);
+	lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 10, 9);
 
 	count = 6;
 	rc = linear_resampler_resample(lr, in_buf + 4 * in_offset, &count,
@@ -166,7 +169,7 @@ TEST(LinearResampler, ResampleIntegerNoSrcBuffer) {
 	memset(out_buf, 0, BUF_SIZE);
 
 	/* Rate 10 -> 9 */
-	lr = linear_resampler_create(2, 4, 10, 9);
+	lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 10, 9);
 
 	count = 0;
 	rc = linear_resampler_resample(lr, in_buf, &count,
@@ -185,7 +188,7 @@ TEST(LinearResampler, ResampleIntegerNoDstBuffer) {
 	memset(out_buf, 0, BUF_SIZE);
 
 	/* Rate 10 -> 9 */
-	lr = linear_resampler_create(2, 4, 10, 9);
+	lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 10, 9);
 
 	count = BUF_SIZE;
 	rc = linear_resampler_resample(lr, in_buf, &count,
@@ -195,6 +198,190 @@ TEST(LinearResampler, ResampleIntegerNoDstBuffer) {
 	linear_resampler_destroy(lr);
 }
 
+/* The float implementation linear_resampler_resample() used before moving
+ * to a fixed point source position, for S16_LE. */
+struct ref_resampler {
+	unsigned int num_channels;
+	unsigned int src_offset;
+	unsigned int dst_offset;
+	unsigned int to_times_100;
+	unsigned int from_times_100;
+	float f;
+};
+
+static void ref_init(struct ref_resampler *lr, unsigned int num_channels,
+		     float from, float to)
+{
+	lr->num_channels = num_channels;
+	lr->f = (float)to / from;
+	lr->to_times_100 = to * 100;
+	lr->from_times_100 = from * 100;
+	lr->src_offset = 0;
+	lr->dst_offset = 0;
+}
+
+static unsigned int ref_resample(struct ref_resampler *lr, int16_t *src,
+				 unsigned int *src_frames, int16_t *dst,
+				 unsigned int dst_frames)
+{
+	unsigned int ch, src_idx = 0, dst_idx;
+	unsigned int nch = lr->num_channels;
+	float src_pos;
+
+	for (dst_idx = 0; dst_idx <= dst_frames; dst_idx++) {
+		src_pos = (float)(lr->dst_offset + dst_idx) / lr->f;
+		if (src_pos > lr->src_offset)
+			src_pos -= lr->src_offset;
+		else
+			src_pos = 0;
+		src_idx = (unsigned int)src_pos;
+
+		if (src_pos > *src_frames - 1 || dst_idx >= dst_frames) {
+			if (src_pos > *src_frames - 1)
+				src_idx = *src_frames - 1;
+			break;
+		}
+		for (ch = 0; ch < nch; ch++) {
+			int16_t *in = src + src_idx * nch;
+
+			if (src_idx == *src_frames - 1)
+				dst[dst_idx * nch + ch] = in[ch];
+			else
+				dst[dst_idx * nch + ch] = in[ch] +
+					(src_pos - src_idx) *
+					(in[nch + ch] - in[ch]);
+		}
+	}
+	*src_frames = src_idx + 1;
+	lr->src_offset += *src_frames;
+	lr->dst_offset += dst_idx;
+	while ((lr->src_offset > lr->from_times_100) &&
+	       (lr->dst_offset > lr->to_times_100)) {
+		lr->src_offset -= lr->from_times_100;
+		lr->dst_offset -= lr->to_times_100;
+	}
+	return dst_idx;
+}
+
+TEST(LinearResampler, MatchesFloatImplementation) {
+	static const unsigned int channels[] = { 1, 2, 3, 6, 8 };
+	static const float rates[][2] = {
+		{ 48000, 48001 }, { 48000, 47990 }, { 44100, 44110.5 },
+		{ 16000, 16002 },
+	};
+	const unsigned int frames = 256;
+
+	for (auto nch : channels) {
+		for (auto &rate : rates) {
+			std::vector<int16_t> in(frames * nch);
+			std::vector<int16_t> out(2 * frames * nch);
+			std::vector<int16_t> ref(2 * frames * nch);
+			struct ref_resampler rr;
+			struct linear_resampler *lr;
+			unsigned int i, count, ref_count, rc, ref_rc;
+
+			lr = linear_resampler_create(nch, SND_PCM_FORMAT_S16_LE,
+						     rate[0], rate[1]);
+			ref_init(&rr, nch, rate[0], rate[1]);
+			for (unsigned int pass = 0; pass < 20; pass++) {
+				/* The float positions drift by up to 1e-3
+				 * frames, use audio that moves slowly enough
+				 * for that to stay below 1 LSB. */
+				for (i = 0; i < in.size(); i++)
+					in[i] = 30000 * sin((pass * frames +
+							     i / nch) * 0.01 +
+							    i % nch);
+				count = ref_count = frames - pass;
+				rc = linear_resampler_resample(
+					lr, (uint8_t *)in.data(), &count,
+					(uint8_t *)out.data(), frames + pass);
+				ref_rc = ref_resample(&rr, in.data(),
+						      &ref_count, ref.data(),
+						      frames + pass);
+				ASSERT_EQ(ref_rc, rc) << nch << " " << rate[1];
+				ASSERT_EQ(ref_count, count);
+				for (i = 0; i < rc * nch; i++)
+					ASSERT_NEAR(ref[i], out[i], 1)
+						<< nch << " " << rate[1]
+						<< " " << i;
+			}
+			linear_resampler_destroy(lr);
+		}
+	}
+}
+
+TEST(LinearResampler, WideFormats) {
+	static const snd_pcm_format_t formats[] = {
+		SND_PCM_FORMAT_S24_LE,
+		SND_PCM_FORMAT_S24_3LE,
+		SND_PCM_FORMAT_S32_LE,
+	};
+	const unsigned int nch = 2, frames = 100;
+
+	for (auto fmt : formats) {
+		unsigned int width = PCM_FORMAT_WIDTH(fmt) / 8;
+		unsigned int shift = fmt == SND_PCM_FORMAT_S32_LE ? 0 : 8;
+		std::vector<uint8_t> in(frames * nch * width);
+		std::vector<uint8_t> out(2 * frames * nch * width);
+		struct linear_resampler *lr;
+		unsigned int i, ch, count = frames, rc;
+
+		/* Full scale ramps, the 24 bit container gets a junk top
+		 * byte that must be ignored. */
+		for (i = 0; i < frames; i++) {
+			for (ch = 0; ch < nch; ch++) {
+				int32_t v = (int32_t)(i * 20000000 *
+						      (ch ? -1 : 1)) >> shift;
+				uint8_t *p = in.data() +
+					     (i * nch + ch) * width;
+
+				if (fmt == SND_PCM_FORMAT_S24_LE)
+					v = (v & 0xffffff) | 0x5a000000;
+				memcpy(p, &v, width);
+			}
+		}
+
+		lr = linear_resampler_create(nch, fmt, 10, 11);
+		ASSERT_NE((void *)NULL, lr);
+		rc = linear_resampler_resample(lr, in.data(), &count,
+					       out.data(), 2 * frames);
+		EXPECT_EQ(frames, count);
+		EXPECT_LE(frames, rc);
+
+		for (i = 0; i < rc; i++) {
+			double pos = i / (double)(11.0f / 10);
+			unsigned int idx = pos;
+
+			for (ch = 0; ch < nch; ch++) {
+				int32_t a = 0, b = 0, v = 0;
+				uint8_t *pa = in.data() +
+					      (idx * nch + ch) * width;
+
+				memcpy(&a, pa, width);
+				memcpy(&v, out.data() + (i * nch + ch) * width,
+				       width);
+				if (idx + 1 < frames)
+					memcpy(&b, pa + nch * width, width);
+				else
+					b = a;
+				if (shift) {
+					a = (int32_t)((uint32_t)a << 8) >> 8;
+					b = (int32_t)((uint32_t)b << 8) >> 8;
+					v = (int32_t)((uint32_t)v << 8) >> 8;
+				}
+				ASSERT_NEAR(a + (pos - idx) * ((double)b - a),
+					    v, 1) << fmt << " " << i;
+			}
+		}
+		linear_resampler_destroy(lr);
+	}
+}
+
+TEST(LinearResampler, UnsupportedFormat) {
+	EXPECT_EQ(NULL, linear_resampler_create(2, SND_PCM_FORMAT_FLOAT_LE,
+						44100, 48000));
+}
+
 extern "C" {
 
 void cras_mix_add_scale_stride(int fmt, uint8_t *dst, uint8_t *src,
@@ -0,0 +1,274 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "cras_iodev.h"
+#include "dev_stream.h"
+#include "loopback_tap.h"
+}
+
+namespace {
+
+static const unsigned int kFrameBytes = 4;
+static const unsigned int kRingFrames = 16384;
+
+static struct timespec time_now;
+static loopback_hook_t pre_dsp_hook[2];
+static void *pre_dsp_hook_cb_data[2];
+static loopback_hook_t post_dsp_hook;
+static unsigned int register_pre_dsp_hook_called;
+static struct cras_iodev *second_dev;
+
+class LoopbackTapTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      memset(&odev_, 0, sizeof(odev_));
+      memset(&odev2_, 0, sizeof(odev2_));
+      odev_.streams = &stream_;
+      odev2_.streams = &stream_;
+      fmt_.frame_rate = 48000;
+      fmt_.num_channels = 2;
+      fmt_.format = SND_PCM_FORMAT_S16_LE;
+      for (unsigned int i = 0; i < sizeof(buf_) / sizeof(buf_[0]); i++)
+        buf_[i] = i;
+      memset(pre_dsp_hook, 0, sizeof(pre_dsp_hook));
+      memset(pre_dsp_hook_cb_data, 0, sizeof(pre_dsp_hook_cb_data));
+      post_dsp_hook = NULL;
+      register_pre_dsp_hook_called = 0;
+      second_dev = &odev2_;
+      time_now.tv_sec = 100;
+      time_now.tv_nsec = 0;
+    }
+
+    void Play(int idx, unsigned int nframes) {
+      ASSERT_NE(reinterpret_cast<loopback_hook_t>(NULL), pre_dsp_hook[idx]);
+      pre_dsp_hook[idx](reinterpret_cast<uint8_t *>(buf_), nframes, &fmt_,
+                        pre_dsp_hook_cb_data[idx]);
+    }
+
+    struct cras_iodev odev_, odev2_;
+    struct dev_stream stream_;
+    struct cras_audio_format fmt_;
+    int16_t buf_[8192];
+};
+
+TEST_F(LoopbackTapTestSuite, ReadersShareTap) {
+  struct loopback_tap_reader *r1, *r2;
+  struct timespec tstamp;
+  unsigned int readable;
+  uint8_t *p1, *p2;
+
+  r1 = loopback_tap_reader_create(LOOPBACK_POST_MIX_PRE_DSP);
+  r2 = loopback_tap_reader_create(LOOPBACK_POST_MIX_PRE_DSP);
+  EXPECT_EQ(0, loopback_tap_reader_attach(r1, &odev_));
+  EXPECT_EQ(0, loopback_tap_reader_attach(r2, &odev_));
+  EXPECT_EQ(1, register_pre_dsp_hook_called);
+  EXPECT_EQ(1, loopback_tap_get_num_taps());
+  EXPECT_EQ(&odev_, loopback_tap_reader_get_dev(r2));
+
+  Play(0, 1024);
+  EXPECT_EQ(1024 * kFrameBytes,
+            loopback_tap_reader_queued(r1, kFrameBytes, 48000, &tstamp));
+  EXPECT_EQ(1024 * kFrameBytes,
+            loopback_tap_reader_queued(r2, kFrameBytes, 48000, &tstamp));
+
+  // Both readers read the same samples in place.
+  p1 = loopback_tap_reader_read_pointer(r1, &readable);
+  EXPECT_EQ(1024 * kFrameBytes, readable);
+  p2 = loopback_tap_reader_read_pointer(r2, &readable);
+  EXPECT_EQ(p1, p2);
+  EXPECT_EQ(0, memcmp(p1, buf_, readable));
+
+  // Cursors move independently.
+  loopback_tap_reader_read(r1, 1000 * kFrameBytes);
+  EXPECT_EQ(24 * kFrameBytes,
+            loopback_tap_reader_queued(r1, kFrameBytes, 48000, &tstamp));
+  EXPECT_EQ(1024 * kFrameBytes,
+            loopback_tap_reader_queued(r2, kFrameBytes, 48000, &tstamp));
+  p1 = loopback_tap_reader_read_pointer(r1, &readable);
+  EXPECT_EQ(p2 + 1000 * kFrameBytes, p1);
+
+  // The tap is released with its last reader.
+  loopback_tap_reader_detach(r1);
+  EXPECT_NE(reinterpret_cast<loopback_hook_t>(NULL), pre_dsp_hook[0]);
+  loopback_tap_reader_detach(r2);
+  EXPECT_EQ(reinterpret_cast<loopback_hook_t>(NULL), pre_dsp_hook[0]);
+  EXPECT_EQ(0, loopback_tap_get_num_taps());
+
+  loopback_tap_reader_destroy(r1);
+  loopback_tap_reader_destroy(r2);
+}
+
+TEST_F(LoopbackTapTestSuite, OverrunAndWrap) {
+  struct loopback_tap_reader *fast, *slow;
+  struct timespec tstamp;
+  unsigned int readable, i;
+  uint8_t *p;
+
+  fast = loopback_tap_reader_create(LOOPBACK_POST_MIX_PRE_DSP);
+  slow = loopback_tap_reader_create(LOOPBACK_POST_MIX_PRE_DSP);
+  loopback_tap_reader_attach(fast, &odev_);
+  loopback_tap_reader_attach(slow, &odev_);
+
+  // Write more than a ring, the fast reader keeps up.
+  for (i = 0; i < kRingFrames / 4096 + 1; i++) {
+    Play(0, 4096);
+    p = loopback_tap_reader_read_pointer(fast, &readable);
+    EXPECT_EQ(4096 * kFrameBytes, readable);
+    EXPECT_EQ(0, memcmp(p, buf_, readable));
+    loopback_tap_reader_read(fast, readable);
+  }
+  EXPECT_EQ(0, loopback_tap_reader_get_overruns(fast));
+
+  // The slow one lost its samples.
+  EXPECT_EQ(0, loopback_tap_reader_queued(slow, kFrameBytes, 48000, &tstamp));
+  EXPECT_EQ(1, loopback_tap_reader_get_overruns(slow));
+
+  // A read across the end of the ring is split. The slow reader is at
+  // 4096 frames into the ring now.
+  for (i = 0; i < 4; i++)
+    Play(0, 3000);
+  loopback_tap_reader_read(slow, 9000 * kFrameBytes);
+  Play(0, 3000);
+  p = loopback_tap_reader_read_pointer(slow, &readable);
+  EXPECT_EQ((kRingFrames - 13096) * kFrameBytes, readable);
+  EXPECT_EQ(0, memcmp(p, buf_, 3000 * kFrameBytes));
+  loopback_tap_reader_read(slow, readable);
+  p = loopback_tap_reader_read_pointer(slow, &readable);
+  EXPECT_EQ((6000 - (kRingFrames - 13096)) * kFrameBytes, readable);
+  EXPECT_EQ(0, memcmp(p, buf_ + 288 * 2, readable));
+  EXPECT_EQ(1, loopback_tap_reader_get_overruns(slow));
+
+  loopback_tap_reader_destroy(fast);
+  loopback_tap_reader_destroy(slow);
+}
+
+TEST_F(LoopbackTapTestSuite, RingInWholeFrames) {
+  struct loopback_tap_reader *r;
+  struct timespec tstamp;
+  unsigned int readable, i;
+  const unsigned int frame_bytes = 12;
+  const unsigned int ring_frames = 65536 / frame_bytes;
+
+  r = loopback_tap_reader_create(LOOPBACK_POST_MIX_PRE_DSP);
+  loopback_tap_reader_attach(r, &odev_);
+
+  // Samples in another frame size are dropped, but not as an overrun.
+  Play(0, 480);
+  fmt_.num_channels = 6;
+  Play(0, 1000);
+  EXPECT_EQ(1000 * frame_bytes,
+            loopback_tap_reader_queued(r, frame_bytes, 48000, &tstamp));
+  EXPECT_EQ(0, loopback_tap_reader_get_overruns(r));
+
+  for (i = 0; i < 4; i++)
+    Play(0, 1000);
+  loopback_tap_reader_read(r, 5000 * frame_bytes);
+
+  // The ring ends on a frame boundary, so no frame is split across it.
+  Play(0, 1000);
+  loopback_tap_reader_read_pointer(r, &readable);
+  EXPECT_EQ((ring_frames - 5000) * frame_bytes, readable);
+  loopback_tap_reader_read(r, readable);
+  loopback_tap_reader_read_pointer(r, &readable);
+  EXPECT_EQ((1000 - (ring_frames - 5000)) * frame_bytes, readable);
+
+  loopback_tap_reader_destroy(r);
+}
+
+TEST_F(LoopbackTapTestSuite, TapPerDevice) {
+  struct loopback_tap_reader *r1, *r2, *r3;
+  struct timespec tstamp;
+
+  r1 = loopback_tap_reader_create(LOOPBACK_POST_MIX_PRE_DSP);
+  r2 = loopback_tap_reader_create(LOOPBACK_POST_MIX_PRE_DSP);
+  r3 = loopback_tap_reader_create(LOOPBACK_POST_DSP);
+  loopback_tap_reader_attach(r1, &odev_);
+  loopback_tap_reader_attach(r2, &odev2_);
+  loopback_tap_reader_attach(r3, &odev_);
+  EXPECT_EQ(3, loopback_tap_get_num_taps());
+  EXPECT_NE(reinterpret_cast<loopback_hook_t>(NULL), post_dsp_hook);
+
+  Play(1, 480);
+  EXPECT_EQ(0, loopback_tap_reader_queued(r1, kFrameBytes, 48000, &tstamp));
+  EXPECT_EQ(480 * kFrameBytes,
+            loopback_tap_reader_queued(r2, kFrameBytes, 48000, &tstamp));
+
+  // Moving a reader to another device starts at the newest samples there.
+  loopback_tap_reader_attach(r1, &odev2_);
+  EXPECT_EQ(2, loopback_tap_get_num_taps());
+  EXPECT_EQ(reinterpret_cast<loopback_hook_t>(NULL), pre_dsp_hook[0]);
+  EXPECT_EQ(0, loopback_tap_reader_queued(r1, kFrameBytes, 48000, &tstamp));
+
+  loopback_tap_reader_destroy(r1);
+  loopback_tap_reader_destroy(r2);
+  loopback_tap_reader_destroy(r3);
+  EXPECT_EQ(0, loopback_tap_get_num_taps());
+}
+
+TEST_F(LoopbackTapTestSuite, SilenceWithoutStreams) {
+  struct loopback_tap_reader *r;
+  struct timespec tstamp;
+  unsigned int readable;
+  uint8_t *p;
+
+  r = loopback_tap_reader_create(LOOPBACK_POST_MIX_PRE_DSP);
+  loopback_tap_reader_attach(r, NULL);
+  EXPECT_EQ(0, register_pre_dsp_hook_called);
+
+  time_now.tv_nsec += 480 * 1e9 / 48000;
+  EXPECT_EQ(480 * kFrameBytes,
+            loopback_tap_reader_queued(r, kFrameBytes, 48000, &tstamp));
+  EXPECT_EQ(time_now.tv_nsec, tstamp.tv_nsec);
+  p = loopback_tap_reader_read_pointer(r, &readable);
+  EXPECT_EQ(480 * kFrameBytes, readable);
+  for (unsigned int i = 0; i < readable; i++)
+    EXPECT_EQ(0, p[i]);
+
+  // A draining device doesn't feed the tap.
+  odev_.streams = NULL;
+  loopback_tap_reader_attach(r, &odev_);
+  Play(0, 480);
+  EXPECT_EQ(0, loopback_tap_reader_queued(r, kFrameBytes, 48000, &tstamp));
+
+  loopback_tap_reader_destroy(r);
+}
+
+/* Stubs */
+extern "C" {
+
+void cras_iodev_register_pre_dsp_hook(struct cras_iodev *iodev,
+                                      loopback_hook_t loop_cb,
+                                      void *cb_data)
+{
+  int idx = (iodev == second_dev) ? 1 : 0;
+
+  if (loop_cb)
+    register_pre_dsp_hook_called++;
+  pre_dsp_hook[idx] = loop_cb;
+  pre_dsp_hook_cb_data[idx] = cb_data;
+}
+
+void cras_iodev_register_post_dsp_hook(struct cras_iodev *iodev,
+                                       loopback_hook_t loop_cb,
+                                       void *cb_data)
+{
+  post_dsp_hook = loop_cb;
+}
+
+int clock_gettime(clockid_t clk_id, struct timespec *tp) {
+  *tp = time_now;
+  return 0;
+}
+
+}  // extern "C"
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
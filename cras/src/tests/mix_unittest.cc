@@ -1091,6 +1091,27 @@ TEST_F(MixTestSuiteS24_3LE, StrideCopy) {
   TestScaleStride(0.1);
 }
 
+TEST(MixBufferIsZero, UnalignedAndTail) {
+  uint8_t buf[1024 + 16] = {};
+
+  /* Every length and alignment, zero and with one byte set anywhere. */
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t len = 0; len < 300; len += 7) {
+      EXPECT_EQ(1, cras_mix_buffer_is_zero(buf + offset, len));
+      for (size_t i = 0; i < len; i++) {
+        buf[offset + i] = 0x80;
+        EXPECT_EQ(0, cras_mix_buffer_is_zero(buf + offset, len));
+        buf[offset + i] = 0;
+      }
+    }
+  }
+
+  /* Bytes just outside the range are not looked at. */
+  buf[3] = 1;
+  buf[4 + 1000] = 1;
+  EXPECT_EQ(1, cras_mix_buffer_is_zero(buf + 4, 1000));
+}
+
 /* Stubs */
 extern "C" {
 
@@ -0,0 +1,170 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Feeds a simulated output device with clock drift, timestamp jitter, an
+ * underrun and a suspend into each rate estimator, and reports how quickly
+ * and how closely it tracks the true rate.
+ *
+ * Usage: rate_estimator_sim [seed]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rate_estimator.h"
+
+#define RATE 48000
+/* Audio thread wake interval and the scheduling jitter on top of it. */
+#define WAKE_SEC 0.010
+#define WAKE_JITTER_SEC 0.001
+#define TARGET_LEVEL 960
+#define SIM_SEC 100.0
+/* The device underruns at UNDERRUN_SEC and doesn't run for SUSPEND_LEN_SEC
+ * from SUSPEND_SEC. */
+#define UNDERRUN_SEC 40.0
+#define SUSPEND_SEC 70.0
+#define SUSPEND_LEN_SEC 3.0
+/* Error bound for the convergence time, in ppm. */
+#define CONVERGED_PPM 5.0
+
+struct scenario {
+	const char *name;
+	double ppm;
+	/* Drift of the device clock in ppm per minute. */
+	double ppm_per_min;
+	/* Standard deviation of the timestamp noise. */
+	double ts_jitter_sec;
+	/* The buffer level is only reported in multiples of this. */
+	unsigned int granularity;
+};
+
+static const struct scenario scenarios[] = {
+	{ "+50ppm", 50, 0, 0.00005, 1 },
+	{ "-120ppm", -120, 0, 0.00005, 1 },
+	{ "+30ppm usb", 30, 0, 0.0002, 48 },
+	{ "drift 6ppm/min", 0, 6, 0.00005, 1 },
+};
+
+static const struct timespec window = { 5, 0 };
+
+struct result {
+	double converge_sec;
+	double rms_ppm;
+	double max_underrun_ppm;
+	double max_suspend_ppm;
+};
+
+static double gaussian()
+{
+	double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static void sec_to_timespec(double sec, struct timespec *ts)
+{
+	ts->tv_sec = (time_t)sec;
+	ts->tv_nsec = (long)((sec - ts->tv_sec) * 1e9);
+}
+
+static double true_ppm(const struct scenario *sc, double t)
+{
+	return sc->ppm + sc->ppm_per_min * t / 60;
+}
+
+static void run(const struct scenario *sc, enum RATE_ESTIMATOR_TYPE type,
+		struct result *res)
+{
+	struct rate_estimator *re;
+	struct timespec ts;
+	double t = 1.0, played = 0, written = TARGET_LEVEL;
+	double sum_sq = 0, err;
+	unsigned int n = 0;
+	int suspended = 0;
+
+	re = rate_estimator_create(RATE, &window, 0.3, type);
+	res->converge_sec = t;
+	res->max_underrun_ppm = 0;
+	res->max_suspend_ppm = 0;
+
+	while (t < SIM_SEC) {
+		double dt = WAKE_SEC + WAKE_JITTER_SEC * rand() / RAND_MAX;
+		int level, w;
+
+		if (!suspended && t >= SUSPEND_SEC &&
+		    t < SUSPEND_SEC + SUSPEND_LEN_SEC) {
+			dt = SUSPEND_LEN_SEC;
+			suspended = 1;
+		} else {
+			played += RATE * (1 + true_ppm(sc, t) * 1e-6) * dt;
+		}
+		t += dt;
+
+		/* Starve the device for a while to make it underrun. */
+		if (t >= UNDERRUN_SEC && t < UNDERRUN_SEC + 0.05)
+			continue;
+
+		if (played > written)
+			played = written;
+		level = written - played;
+		level -= level % sc->granularity;
+		sec_to_timespec(t + sc->ts_jitter_sec * gaussian(), &ts);
+		/* Like cras_iodev_update_rate(). */
+		if (!level)
+			rate_estimator_reset_rate(re, RATE);
+		rate_estimator_check(re, level, &ts);
+
+		w = TARGET_LEVEL - level;
+		if (w > 0) {
+			rate_estimator_add_frames(re, w);
+			written += w;
+		}
+
+		err = (rate_estimator_get_rate(re) / RATE - 1) * 1e6 -
+		      true_ppm(sc, t);
+		if (t < UNDERRUN_SEC) {
+			if (fabs(err) > CONVERGED_PPM)
+				res->converge_sec = t;
+			if (t > UNDERRUN_SEC / 2) {
+				sum_sq += err * err;
+				n++;
+			}
+		} else if (t < UNDERRUN_SEC + 10) {
+			res->max_underrun_ppm = fmax(res->max_underrun_ppm,
+						     fabs(err));
+		} else if (t >= SUSPEND_SEC && t < SUSPEND_SEC + 10) {
+			res->max_suspend_ppm = fmax(res->max_suspend_ppm,
+						    fabs(err));
+		}
+	}
+	res->rms_ppm = sqrt(sum_sq / n);
+	rate_estimator_destroy(re);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *type_names[] = { "lsq", "kalman" };
+	unsigned int i, type;
+
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+
+	printf("%-16s %-7s %10s %8s %14s %14s\n", "scenario", "type",
+	       "converge s", "rms ppm", "underrun max", "suspend max");
+	for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		for (type = RATE_ESTIMATOR_LSQ; type <= RATE_ESTIMATOR_KALMAN;
+		     type++) {
+			struct result res;
+
+			run(&scenarios[i], type, &res);
+			printf("%-16s %-7s %10.2f %8.2f %14.2f %14.2f\n",
+			       scenarios[i].name, type_names[type],
+			       res.converge_sec - 1.0, res.rms_ppm,
+			       res.max_underrun_ppm, res.max_suspend_ppm);
+		}
+	}
+	return 0;
+}
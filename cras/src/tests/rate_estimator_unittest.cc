@@ -21,7 +21,8 @@ TEST(RateEstimatorTest, EstimateOutputLinear) {
   };
   int i, rc, level, tmp;
 
-  re = rate_estimator_create(10000, &window, 0.0f);
+  re = rate_estimator_create(10000, &window, 0.0f,
+                             RATE_ESTIMATOR_LSQ);
   level = 240;
   for (i = 0; i < 20; i++) {
     rc = rate_estimator_check(re, level, &t);
@@ -54,7 +55,8 @@ TEST(RateEstimatorTest, EstimateOutputLinear2) {
   int interval_nsec[5] = {1000000, 1500000, 2000000, 2500000, 3000000};
   int frames_written[5] = {30, 25, 20, 15, 10};
 
-  re = rate_estimator_create(7470, &window, 0.0f);
+  re = rate_estimator_create(7470, &window, 0.0f,
+                             RATE_ESTIMATOR_LSQ);
   for (i = 0; i < 5; i++) {
     rc = rate_estimator_check(re, level, &t);
     EXPECT_EQ(0, rc);
@@ -86,7 +88,8 @@ TEST(RateEstimatorTest, EstimateRateSkewTooLarge) {
   int interval_nsec[5] = {1000000, 1500000, 2000000, 2500000, 3000000};
   int frames_written[5] = {30, 25, 20, 15, 10};
 
-  re = rate_estimator_create(10000, &window, 0.0f);
+  re = rate_estimator_create(10000, &window, 0.0f,
+                             RATE_ESTIMATOR_LSQ);
   for (i = 0; i < 5; i++) {
     rc = rate_estimator_check(re, level, &t);
     EXPECT_EQ(0, rc);
@@ -110,7 +113,8 @@ TEST(RateEstimatorTest, EstimateOutputSmooth) {
   struct timespec t;
   int rc;
 
-  re = rate_estimator_create(10010, &window, 0.9f);
+  re = rate_estimator_create(10010, &window, 0.9f,
+                             RATE_ESTIMATOR_LSQ);
   t.tv_sec = 1;
   rc = rate_estimator_check(re, 240, &t);
   EXPECT_EQ(0, rc);
@@ -139,7 +143,8 @@ TEST(RateEstimatorTest, EstimateInputLinear) {
   struct timespec t;
   int i, rc, level, tmp;
 
-  re = rate_estimator_create(10000, &window, 0.0f);
+  re = rate_estimator_create(10000, &window, 0.0f,
+                             RATE_ESTIMATOR_LSQ);
   t.tv_sec = 1;
   level = 1200;
   for (i = 0; i < 20; i++) {
@@ -170,7 +175,8 @@ TEST(RateEstimatorTest, EstimateInputLinear2) {
     .tv_nsec = 100000000
   };
 
-  re = rate_estimator_create(10000, &this_window, 0.0f);
+  re = rate_estimator_create(10000, &this_window, 0.0f,
+                             RATE_ESTIMATOR_LSQ);
   t.tv_sec = 1;
   t.tv_nsec = 0;
   rc = rate_estimator_check(re, 200, &t);
@@ -193,6 +199,117 @@ TEST(RateEstimatorTest, EstimateInputLinear2) {
   rate_estimator_destroy(re);
 }
 
+// Plays |seconds| of audio at |rate| frames per second on a device that is
+// topped up to 960 frames every 10ms, with up to |jitter_ns| of noise on
+// the timestamps.
+static void RunKalman(struct rate_estimator *re, struct timespec *t,
+                      double *played, double rate, int seconds,
+                      int jitter_ns) {
+  double written = *played + 960;
+  struct timespec ts;
+  int i, level;
+
+  for (i = 0; i < seconds * 100; i++) {
+    *played += rate / 100;
+    level = (int)(written - *played);
+    t->tv_nsec += 10000000;
+    if (t->tv_nsec >= 1000000000) {
+      t->tv_nsec -= 1000000000;
+      t->tv_sec++;
+    }
+    ts = *t;
+    ts.tv_nsec += rand() % (2 * jitter_ns + 1) - jitter_ns;
+    rate_estimator_check(re, level, &ts);
+    rate_estimator_add_frames(re, 960 - level);
+    written += 960 - level;
+  }
+}
+
+TEST(RateEstimatorTest, KalmanConverges) {
+  static struct timespec kalman_window = { 5, 0 };
+  struct rate_estimator *re;
+  struct timespec t = { 1, 0 };
+  double played = 0;
+
+  re = rate_estimator_create(48000, &kalman_window, 0.3f,
+                             RATE_ESTIMATOR_KALMAN);
+  rate_estimator_check(re, 960, &t);
+
+  // 50 ppm fast, within 1 ppm after 5 seconds.
+  RunKalman(re, &t, &played, 48002.4, 5, 50000);
+  EXPECT_NEAR(48002.4, rate_estimator_get_rate(re), 0.048);
+
+  rate_estimator_destroy(re);
+}
+
+TEST(RateEstimatorTest, KalmanSlewBounded) {
+  static struct timespec kalman_window = { 5, 0 };
+  struct rate_estimator *re;
+  struct timespec t = { 1, 0 };
+  double played = 0;
+
+  re = rate_estimator_create(48000, &kalman_window, 0.3f,
+                             RATE_ESTIMATOR_KALMAN);
+  rate_estimator_check(re, 960, &t);
+
+  // The rate can't move more than 200 ppm per second.
+  RunKalman(re, &t, &played, 48080, 1, 0);
+  EXPECT_GE(48000 + 48000 * 200e-6, rate_estimator_get_rate(re));
+  EXPECT_LT(48000, rate_estimator_get_rate(re));
+
+  rate_estimator_destroy(re);
+}
+
+TEST(RateEstimatorTest, KalmanKeepsRateAcrossReset) {
+  static struct timespec kalman_window = { 5, 0 };
+  struct rate_estimator *re;
+  struct timespec t = { 1, 0 };
+  double played = 0;
+
+  re = rate_estimator_create(48000, &kalman_window, 0.3f,
+                             RATE_ESTIMATOR_KALMAN);
+  rate_estimator_check(re, 960, &t);
+  RunKalman(re, &t, &played, 47997.6, 5, 0);
+  EXPECT_NEAR(47997.6, rate_estimator_get_rate(re), 0.048);
+
+  // An underrun loses track of the phase but not of the rate.
+  rate_estimator_reset_rate(re, 48000);
+  EXPECT_NEAR(47997.6, rate_estimator_get_rate(re), 0.048);
+  played += 1000;
+  RunKalman(re, &t, &played, 47997.6, 1, 0);
+  EXPECT_NEAR(47997.6, rate_estimator_get_rate(re), 0.048);
+
+  // A device that stopped for a while looks like a phase jump too.
+  t.tv_sec += 2;
+  RunKalman(re, &t, &played, 47997.6, 1, 0);
+  EXPECT_NEAR(47997.6, rate_estimator_get_rate(re), 0.048);
+
+  // A new rate starts over.
+  rate_estimator_reset_rate(re, 44100);
+  EXPECT_EQ(44100, rate_estimator_get_rate(re));
+
+  rate_estimator_destroy(re);
+}
+
+TEST(RateEstimatorTest, KalmanRateErrorShrinks) {
+  static struct timespec kalman_window = { 5, 0 };
+  struct rate_estimator *re;
+  struct timespec t = { 1, 0 };
+  double played = 0;
+
+  re = rate_estimator_create(48000, &kalman_window, 0.3f,
+                             RATE_ESTIMATOR_KALMAN);
+  EXPECT_EQ(100, rate_estimator_get_rate_error(re));
+  rate_estimator_check(re, 960, &t);
+
+  RunKalman(re, &t, &played, 48002.4, 5, 50000);
+  EXPECT_GT(2, rate_estimator_get_rate_error(re));
+  EXPECT_NEAR(48002.4, rate_estimator_get_rate(re),
+              rate_estimator_get_rate_error(re));
+
+  rate_estimator_destroy(re);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -36,6 +36,8 @@ static int cras_system_set_capture_mute_called;
 static size_t cras_system_set_capture_mute_locked_value;
 static int cras_system_set_capture_mute_locked_called;
 static int cras_system_state_dump_snapshots_called;
+static struct cras_server_state server_state;
+static struct dsp_profile_info *cras_dsp_get_profile_info_value;
 static size_t cras_make_fd_nonblocking_called;
 static audio_thread* iodev_get_thread_return;
 static int stream_list_add_stream_return;
@@ -77,6 +79,7 @@ void ResetStubData() {
   cras_system_set_capture_mute_locked_value = 0;
   cras_system_set_capture_mute_locked_called = 0;
   cras_system_state_dump_snapshots_called = 0;
+  cras_dsp_get_profile_info_value = NULL;
   cras_make_fd_nonblocking_called = 0;
   iodev_get_thread_return = reinterpret_cast<audio_thread*>(0xad);
   stream_list_add_stream_return = 0;
@@ -365,6 +368,23 @@ TEST_F(RClientMessagesSuite, DumpSnapshots) {
   EXPECT_EQ(1, cras_system_state_dump_snapshots_called);
 }
 
+TEST_F(RClientMessagesSuite, DumpDspProfile) {
+  struct cras_dump_dsp_profile msg;
+  struct cras_client_message *reply;
+  uint8_t buf[1024];
+  int rc;
+
+  cras_fill_dump_dsp_profile(&msg);
+  rc = cras_rclient_message_from_client(rclient_, &msg.header, -1);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(&server_state.dsp_profile_info, cras_dsp_get_profile_info_value);
+
+  rc = read(pipe_fds_[0], buf, sizeof(buf));
+  ASSERT_EQ(sizeof(struct cras_client_audio_debug_info_ready), (size_t)rc);
+  reply = reinterpret_cast<struct cras_client_message *>(buf);
+  EXPECT_EQ(CRAS_CLIENT_AUDIO_DEBUG_INFO_READY, reply->id);
+}
+
 void RClientMessagesSuite::RegisterNotification(
     enum CRAS_CLIENT_MESSAGE_ID msg_id,
     void *callback, void **ops_address) {
@@ -828,7 +848,7 @@ void cras_system_set_suspended(int suspended) {
 
 struct cras_server_state *cras_system_state_get_no_lock()
 {
-  return NULL;
+  return &server_state;
 }
 
 key_t cras_sys_state_shm_fd()
@@ -844,6 +864,11 @@ void cras_dsp_dump_info()
 {
 }
 
+void cras_dsp_get_profile_info(struct dsp_profile_info *info)
+{
+  cras_dsp_get_profile_info_value = info;
+}
+
 int cras_iodev_list_set_node_attr(cras_node_id_t id,
 				  enum ionode_attr attr, int value)
 {
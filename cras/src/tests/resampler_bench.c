@@ -0,0 +1,178 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Measures CPU cost and THD+N of each cras_resampler backend.
+ *
+ * Usage: resampler_bench [seconds]
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cras_resampler.h"
+
+/* Constant for converting time to nanoseconds. */
+#define BILLION 1000000000LL
+/* Frames handed to the resampler per call, like one audio thread wake. */
+#define BLOCK_FRAMES 480
+#define NUM_CHANNELS 2
+/* Test tone, 1kHz at -3dBFS. */
+#define TONE_HZ 1000.0
+#define TONE_AMP (32767.0 * 0.7071)
+
+struct rate_pair {
+	unsigned int in_rate;
+	unsigned int out_rate;
+};
+
+static const struct rate_pair rate_pairs[] = {
+	{ 44100, 48000 },
+	{ 16000, 48000 },
+};
+
+static int64_t ts_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * BILLION + (b->tv_nsec - a->tv_nsec);
+}
+
+/* Fits a*sin + b*cos + c at the tone frequency to the first channel of
+ * |buf| and returns the residual to signal power ratio in dB. Frames in
+ * the first 20ms are skipped to let the filters settle. */
+static double thd_n_db(const int16_t *buf, unsigned int frames,
+		       unsigned int rate)
+{
+	double ss = 0, cc = 0, sc = 0, s1 = 0, c1 = 0, n = 0;
+	double ys = 0, yc = 0, y1 = 0;
+	double a, b, c, det, sig = 0, res = 0;
+	unsigned int i, start = rate / 50;
+
+	for (i = start; i < frames; i++) {
+		double w = 2 * M_PI * TONE_HZ * i / rate;
+		double s = sin(w), co = cos(w), y = buf[i * NUM_CHANNELS];
+
+		ss += s * s;
+		cc += co * co;
+		sc += s * co;
+		s1 += s;
+		c1 += co;
+		n += 1;
+		ys += y * s;
+		yc += y * co;
+		y1 += y;
+	}
+
+	/* Solve the 3x3 normal equations by Cramer's rule. */
+	det = ss * (cc * n - c1 * c1) - sc * (sc * n - c1 * s1) +
+	      s1 * (sc * c1 - cc * s1);
+	a = (ys * (cc * n - c1 * c1) - sc * (yc * n - c1 * y1) +
+	     s1 * (yc * c1 - cc * y1)) / det;
+	b = (ss * (yc * n - c1 * y1) - ys * (sc * n - c1 * s1) +
+	     s1 * (sc * y1 - yc * s1)) / det;
+	c = (ss * (cc * y1 - yc * c1) - sc * (sc * y1 - yc * s1) +
+	     ys * (sc * c1 - cc * s1)) / det;
+
+	for (i = start; i < frames; i++) {
+		double w = 2 * M_PI * TONE_HZ * i / rate;
+		double fit = a * sin(w) + b * cos(w);
+		double e = buf[i * NUM_CHANNELS] - fit - c;
+
+		sig += fit * fit;
+		res += e * e;
+	}
+	return 10 * log10(res / sig);
+}
+
+/* Resamples |in| block by block and returns the number of output frames. */
+static unsigned int run(struct cras_resampler *r, const int16_t *in,
+			unsigned int in_frames, int16_t *out,
+			unsigned int out_size)
+{
+	unsigned int in_off = 0, out_off = 0;
+
+	while (in_off < in_frames && out_off < out_size) {
+		unsigned int fr_in = in_frames - in_off;
+		unsigned int fr_out = out_size - out_off;
+
+		if (fr_in > BLOCK_FRAMES)
+			fr_in = BLOCK_FRAMES;
+		cras_resampler_process(r, in + in_off * NUM_CHANNELS, &fr_in,
+				       out + out_off * NUM_CHANNELS, &fr_out);
+		if (fr_in == 0 && fr_out == 0)
+			break;
+		in_off += fr_in;
+		out_off += fr_out;
+	}
+	return out_off;
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 10;
+	unsigned int p, t, i;
+
+	if (seconds <= 0) {
+		fprintf(stderr, "usage: %s [seconds]\n", argv[0]);
+		return 1;
+	}
+
+	printf("%-22s %14s %12s %10s %10s\n", "backend", "rates",
+	       "ns/out frame", "x realtime", "THD+N dB");
+
+	for (p = 0; p < sizeof(rate_pairs) / sizeof(rate_pairs[0]); p++) {
+		unsigned int in_rate = rate_pairs[p].in_rate;
+		unsigned int out_rate = rate_pairs[p].out_rate;
+		unsigned int in_frames = in_rate * seconds;
+		unsigned int out_size = out_rate * seconds + BLOCK_FRAMES;
+		int16_t *in, *out;
+
+		in = malloc(in_frames * NUM_CHANNELS * sizeof(*in));
+		out = malloc(out_size * NUM_CHANNELS * sizeof(*out));
+		if (!in || !out) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		for (i = 0; i < in_frames; i++) {
+			double w = 2 * M_PI * TONE_HZ * i / in_rate;
+			int16_t v = lrint(TONE_AMP * sin(w));
+
+			in[i * NUM_CHANNELS] = v;
+			in[i * NUM_CHANNELS + 1] = v;
+		}
+
+		for (t = 0; t < CRAS_RESAMPLER_NUM_TYPES; t++) {
+			struct cras_resampler *r;
+			struct timespec start, end;
+			unsigned int out_frames;
+			int64_t ns;
+			char rates[32];
+
+			r = cras_resampler_create(t, NUM_CHANNELS, in_rate,
+						  out_rate);
+			if (!r) {
+				fprintf(stderr, "failed to create %s\n",
+					cras_resampler_type_str(t));
+				return 1;
+			}
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+			out_frames = run(r, in, in_frames, out, out_size);
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+			cras_resampler_destroy(r);
+
+			ns = ts_diff_ns(&start, &end);
+			snprintf(rates, sizeof(rates), "%u->%u",
+				 in_rate, out_rate);
+			printf("%-22s %14s %12.1f %10.0f %10.1f\n",
+			       cras_resampler_type_str(t), rates,
+			       (double)ns / out_frames,
+			       seconds * BILLION / (ns ? ns : 1),
+			       thd_n_db(out, out_frames, out_rate));
+		}
+		free(in);
+		free(out);
+	}
+	return 0;
+}
@@ -0,0 +1,186 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <sys/param.h>
+#include <vector>
+
+extern "C" {
+#include "cras_resampler.h"
+}
+
+namespace {
+
+static const enum CRAS_RESAMPLER_TYPE kSincTypes[] = {
+  CRAS_RESAMPLER_FAST,
+  CRAS_RESAMPLER_HQ,
+};
+
+static void FillSine(std::vector<int16_t> *buf, unsigned int channels,
+                     double freq, unsigned int rate, double amp) {
+  for (size_t i = 0; i < buf->size() / channels; i++)
+    for (unsigned int ch = 0; ch < channels; ch++)
+      (*buf)[i * channels + ch] = lrint(amp * sin(2 * M_PI * freq * i / rate));
+}
+
+TEST(ResamplerTest, TypeForStream) {
+  EXPECT_EQ(CRAS_RESAMPLER_FAST, cras_resampler_type_for_stream(
+      CRAS_STREAM_TYPE_VOICE_COMMUNICATION));
+  EXPECT_EQ(CRAS_RESAMPLER_FAST, cras_resampler_type_for_stream(
+      CRAS_STREAM_TYPE_SPEECH_RECOGNITION));
+  EXPECT_EQ(CRAS_RESAMPLER_SPEEX, cras_resampler_type_for_stream(
+      CRAS_STREAM_TYPE_MULTIMEDIA));
+  EXPECT_EQ(CRAS_RESAMPLER_HQ, cras_resampler_type_for_stream(
+      CRAS_STREAM_TYPE_PRO_AUDIO));
+  EXPECT_EQ(CRAS_RESAMPLER_SPEEX, cras_resampler_type_for_stream(
+      CRAS_STREAM_TYPE_DEFAULT));
+  EXPECT_EQ(CRAS_RESAMPLER_SPEEX, cras_resampler_type_for_stream(
+      CRAS_STREAM_TYPE_ACCESSIBILITY));
+}
+
+TEST(ResamplerTest, CreateInvalid) {
+  EXPECT_EQ(NULL, cras_resampler_create(CRAS_RESAMPLER_NUM_TYPES,
+                                        2, 44100, 48000));
+  EXPECT_EQ(NULL, cras_resampler_create(CRAS_RESAMPLER_FAST, 0,
+                                        44100, 48000));
+  EXPECT_EQ(NULL, cras_resampler_create(CRAS_RESAMPLER_HQ, 2, 0, 48000));
+}
+
+TEST(ResamplerTest, CreateEachType) {
+  struct cras_resampler *r;
+  unsigned int t;
+
+  for (t = 0; t < CRAS_RESAMPLER_NUM_TYPES; t++) {
+    r = cras_resampler_create((enum CRAS_RESAMPLER_TYPE)t, 2, 16000, 48000);
+    ASSERT_NE((void *)NULL, r);
+    EXPECT_EQ(t, cras_resampler_get_type(r));
+    cras_resampler_destroy(r);
+  }
+}
+
+TEST(ResamplerTest, SincFrameCounts) {
+  std::vector<int16_t> in(2 * 441);
+  std::vector<int16_t> out(2 * 1000);
+  unsigned int in_frames, out_frames;
+
+  for (auto type : kSincTypes) {
+    struct cras_resampler *r = cras_resampler_create(type, 2, 44100, 48000);
+    ASSERT_NE((void *)NULL, r);
+
+    // Plenty of room for output, all the input is consumed.
+    in_frames = 441;
+    out_frames = 1000;
+    EXPECT_EQ(0, cras_resampler_process(r, in.data(), &in_frames,
+                                        out.data(), &out_frames));
+    EXPECT_EQ(441, in_frames);
+    EXPECT_GE(480, out_frames);
+    EXPECT_LE(480 - cras_resampler_latency(r) * 2, out_frames);
+
+    // Limited output, input is left with the caller.
+    in_frames = 441;
+    out_frames = 100;
+    EXPECT_EQ(0, cras_resampler_process(r, in.data(), &in_frames,
+                                        out.data(), &out_frames));
+    EXPECT_EQ(100, out_frames);
+    EXPECT_GT(200, in_frames);
+    cras_resampler_destroy(r);
+  }
+}
+
+TEST(ResamplerTest, SincDcGain) {
+  static const unsigned int in_rates[] = { 16000, 44100, 96000 };
+  std::vector<int16_t> in(1024, 10000);
+  std::vector<int16_t> out(4096);
+  unsigned int in_frames, out_frames, i;
+
+  for (auto type : kSincTypes) {
+    for (auto rate : in_rates) {
+      struct cras_resampler *r = cras_resampler_create(type, 1, rate, 48000);
+      ASSERT_NE((void *)NULL, r);
+      in_frames = in.size();
+      out_frames = out.size();
+      cras_resampler_process(r, in.data(), &in_frames,
+                             out.data(), &out_frames);
+      // Skip the ramp up through the filter.
+      for (i = 2 * 48000 * cras_resampler_latency(r) / rate;
+           i < out_frames; i++)
+        ASSERT_NEAR(10000, out[i], 2) << type << " " << rate << " " << i;
+      cras_resampler_destroy(r);
+    }
+  }
+}
+
+TEST(ResamplerTest, SincChunkedMatchesOneShot) {
+  std::vector<int16_t> in(2 * 2000);
+  std::vector<int16_t> ref(2 * 3000);
+  std::vector<int16_t> out(2 * 3000);
+  unsigned int in_frames, out_frames, ref_frames;
+  unsigned int in_off = 0, out_off = 0;
+
+  for (size_t i = 0; i < in.size(); i++)
+    in[i] = rand() % 20000 - 10000;
+
+  for (auto type : kSincTypes) {
+    struct cras_resampler *r = cras_resampler_create(type, 2, 32000, 44100);
+
+    in_frames = 2000;
+    ref_frames = 3000;
+    cras_resampler_process(r, in.data(), &in_frames, ref.data(), &ref_frames);
+    EXPECT_EQ(2000, in_frames);
+
+    cras_resampler_reset(r);
+    in_off = 0;
+    out_off = 0;
+    do {
+      in_frames = MIN(7, 2000 - in_off);
+      out_frames = 5;
+      cras_resampler_process(r, in.data() + 2 * in_off, &in_frames,
+                             out.data() + 2 * out_off, &out_frames);
+      in_off += in_frames;
+      out_off += out_frames;
+    } while (in_off < 2000 || out_frames);
+    ASSERT_EQ(ref_frames, out_off);
+    for (unsigned int i = 0; i < 2 * ref_frames; i++)
+      ASSERT_EQ(ref[i], out[i]) << type << " " << i;
+    cras_resampler_destroy(r);
+  }
+}
+
+// Compares a resampled sine with the ideal one. The sinc backends put output
+// frame k at input time k * in_rate / out_rate, so no alignment is needed.
+static double SineErrorDb(enum CRAS_RESAMPLER_TYPE type,
+                          unsigned int in_rate, unsigned int out_rate) {
+  std::vector<int16_t> in(in_rate / 4);
+  std::vector<int16_t> out(out_rate / 4);
+  unsigned int in_frames = in.size(), out_frames = out.size();
+  struct cras_resampler *r;
+  double sig = 0, err = 0;
+
+  FillSine(&in, 1, 1000, in_rate, 16000);
+  r = cras_resampler_create(type, 1, in_rate, out_rate);
+  cras_resampler_process(r, in.data(), &in_frames, out.data(), &out_frames);
+  cras_resampler_destroy(r);
+
+  for (unsigned int i = out_rate / 100; i < out_frames; i++) {
+    double ideal = 16000 * sin(2 * M_PI * 1000 * i / out_rate);
+    sig += ideal * ideal;
+    err += (out[i] - ideal) * (out[i] - ideal);
+  }
+  return 10 * log10(err / sig);
+}
+
+TEST(ResamplerTest, SincSineError) {
+  EXPECT_GT(-40, SineErrorDb(CRAS_RESAMPLER_FAST, 16000, 48000));
+  EXPECT_GT(-40, SineErrorDb(CRAS_RESAMPLER_FAST, 44100, 48000));
+  EXPECT_GT(-80, SineErrorDb(CRAS_RESAMPLER_HQ, 16000, 48000));
+  EXPECT_GT(-80, SineErrorDb(CRAS_RESAMPLER_HQ, 44100, 48000));
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
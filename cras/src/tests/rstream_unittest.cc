@@ -14,6 +14,7 @@ extern "C" {
 #include "cras_messages.h"
 #include "cras_rstream.h"
 #include "cras_shm.h"
+#include "cras_util.h"
 }
 
 namespace {
@@ -279,6 +280,88 @@ TEST_F(RstreamTestSuite, OutputStreamFlushMessages) {
   cras_rstream_destroy(s);
 }
 
+TEST_F(RstreamTestSuite, OutputStreamDeepBuffer) {
+  struct cras_rstream *s;
+  struct audio_message msg;
+  struct timespec now = {10, 0};
+  int rc;
+
+  config_.buffer_frames = 24000;
+  config_.cb_threshold = 480;
+  rc = cras_rstream_create(&config_, &s);
+  EXPECT_EQ(0, rc);
+
+  // 250ms of audio per callback, capped by the shm size.
+  cras_rstream_set_deep_buffer(s, 1, &now);
+  EXPECT_EQ(12000, cras_rstream_get_cb_frames(s));
+  EXPECT_EQ(0, s->sleep_interval_ts.tv_sec);
+  EXPECT_EQ(250000000, s->sleep_interval_ts.tv_nsec);
+
+  rc = cras_rstream_request_audio(s, &now);
+  EXPECT_GT(rc, 0);
+  rc = read(client_fd_, &msg, sizeof(msg));
+  EXPECT_EQ(sizeof(msg), rc);
+  EXPECT_EQ(12000, msg.frames);
+  s->next_cb_ts = now;
+  add_timespecs(&s->next_cb_ts, &s->sleep_interval_ts);
+
+  // A client that writes less is called back once that has played.
+  stub_client_reply(AUDIO_MESSAGE_DATA_READY, 960, 0);
+  cras_rstream_flush_old_audio_messages(s);
+  EXPECT_EQ(10, s->next_cb_ts.tv_sec);
+  EXPECT_EQ(20000000, s->next_cb_ts.tv_nsec);
+
+  // Leaving deep buffer mode doesn't wait for the long interval.
+  s->next_cb_ts.tv_nsec = 250000000;
+  cras_rstream_set_deep_buffer(s, 0, &now);
+  EXPECT_EQ(480, cras_rstream_get_cb_frames(s));
+  EXPECT_EQ(10000000, s->sleep_interval_ts.tv_nsec);
+  EXPECT_EQ(10, s->next_cb_ts.tv_sec);
+  EXPECT_EQ(10000000, s->next_cb_ts.tv_nsec);
+
+  cras_rstream_destroy(s);
+}
+
+TEST_F(RstreamTestSuite, OutputStreamDeepBufferKeepsRate) {
+  struct cras_rstream *s;
+  struct timespec now = {10, 0};
+  int rc;
+
+  config_.buffer_frames = 24000;
+  config_.cb_threshold = 480;
+  rc = cras_rstream_create(&config_, &s);
+  EXPECT_EQ(0, rc);
+
+  // The master device runs at 48048Hz.
+  cras_frames_to_time_precise(480, 48048, &s->sleep_interval_ts);
+
+  cras_rstream_set_deep_buffer(s, 1, &now);
+  EXPECT_EQ(0, s->sleep_interval_ts.tv_sec);
+  EXPECT_NEAR(249750250, s->sleep_interval_ts.tv_nsec, 100);
+
+  cras_rstream_set_deep_buffer(s, 0, &now);
+  EXPECT_NEAR(9990010, s->sleep_interval_ts.tv_nsec, 100);
+
+  cras_rstream_destroy(s);
+}
+
+TEST_F(RstreamTestSuite, OutputStreamNoDeepBufferInSmallShm) {
+  struct cras_rstream *s;
+  struct timespec now = {10, 0};
+  int rc;
+
+  // One callback threshold per shm buffer leaves no room to go deeper.
+  config_.buffer_frames = 2048;
+  config_.cb_threshold = 2048;
+  rc = cras_rstream_create(&config_, &s);
+  EXPECT_EQ(0, rc);
+
+  cras_rstream_set_deep_buffer(s, 1, &now);
+  EXPECT_EQ(2048, cras_rstream_get_cb_frames(s));
+
+  cras_rstream_destroy(s);
+}
+
 TEST_F(RstreamTestSuite, InputStreamIsPendingReply) {
   struct cras_rstream *s;
   int rc;
@@ -0,0 +1,124 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Measures the CPU cost of SBC encoding for A2DP, one frame per encode call
+ * and in batches of a full RTP packet per call.
+ *
+ * Usage: sbc_encode_bench [seconds]
+ */
+
+#include <math.h>
+#include <sbc/sbc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cras_audio_codec.h"
+#include "cras_sbc_codec.h"
+
+/* Constant for converting time to nanoseconds. */
+#define BILLION 1000000000LL
+#define RATE 44100
+#define NUM_CHANNELS 2
+/* A common L2CAP MTU for A2DP, less the RTP header and payload byte. */
+#define PACKET_BYTES (895 - 13)
+/* Test tone, 1kHz at -3dBFS. */
+#define TONE_HZ 1000.0
+#define TONE_AMP (32767.0 * 0.7071)
+
+/* Middle and high quality bitpools recommended by the A2DP spec. */
+static const uint8_t bitpools[] = { 35, 53 };
+
+static int64_t ts_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * BILLION + (b->tv_nsec - a->tv_nsec);
+}
+
+/* Encodes |in_bytes| of |in| handing |out_bytes| of output space to each
+ * encode call. Returns the number of SBC frames encoded. */
+static unsigned int run(struct cras_audio_codec *codec, const uint8_t *in,
+			size_t in_bytes, size_t out_bytes)
+{
+	static uint8_t out[PACKET_BYTES];
+	size_t offset = 0, encoded;
+	unsigned int frames = 0;
+	int processed;
+
+	while (offset < in_bytes) {
+		processed = codec->encode(codec, in + offset, in_bytes - offset,
+					  out, out_bytes, &encoded);
+		if (processed <= 0)
+			break;
+		offset += processed;
+		frames += processed / cras_sbc_get_codesize(codec);
+	}
+	return frames;
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 10;
+	unsigned int in_frames, b, batched, i;
+	int16_t *in;
+
+	if (seconds <= 0) {
+		fprintf(stderr, "usage: %s [seconds]\n", argv[0]);
+		return 1;
+	}
+
+	in_frames = RATE * seconds;
+	in = malloc(in_frames * NUM_CHANNELS * sizeof(*in));
+	if (!in) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < in_frames; i++) {
+		double w = 2 * M_PI * TONE_HZ * i / RATE;
+		int16_t v = lrint(TONE_AMP * sin(w));
+
+		in[i * NUM_CHANNELS] = v;
+		in[i * NUM_CHANNELS + 1] = v;
+	}
+
+	printf("%-8s %8s %10s %12s %8s\n", "mode", "bitpool", "frame len",
+	       "frames/s", "CPU %");
+
+	for (b = 0; b < sizeof(bitpools) / sizeof(bitpools[0]); b++) {
+		for (batched = 0; batched < 2; batched++) {
+			struct cras_audio_codec *codec;
+			struct timespec start, end;
+			unsigned int frames, frame_length;
+			int64_t ns;
+
+			codec = cras_sbc_codec_create(SBC_FREQ_44100,
+						      SBC_MODE_JOINT_STEREO,
+						      SBC_SB_8,
+						      SBC_AM_LOUDNESS,
+						      SBC_BLK_16,
+						      bitpools[b]);
+			if (!codec) {
+				fprintf(stderr, "failed to create codec\n");
+				return 1;
+			}
+			frame_length = cras_sbc_get_frame_length(codec);
+
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+			frames = run(codec, (const uint8_t *)in,
+				     in_frames * NUM_CHANNELS * sizeof(*in),
+				     batched ? PACKET_BYTES : frame_length);
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+			cras_sbc_codec_destroy(codec);
+
+			ns = ts_diff_ns(&start, &end);
+			printf("%-8s %8u %10u %12.0f %8.2f\n",
+			       batched ? "batch" : "frame", bitpools[b],
+			       frame_length,
+			       (double)frames * BILLION / (ns ? ns : 1),
+			       100.0 * ns / (seconds * BILLION));
+		}
+	}
+	free(in);
+	return 0;
+}
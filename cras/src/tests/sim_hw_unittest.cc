@@ -0,0 +1,203 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "sim_hw.h"
+}
+
+namespace {
+
+static void SetUs(struct timespec *ts, uint64_t us) {
+  ts->tv_sec = 100 + us / 1000000;
+  ts->tv_nsec = (us % 1000000) * 1000;
+}
+
+class SimHwTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      sim_hw_default_params(&params_);
+      SetUs(&start_, 0);
+    }
+
+    // Level of |hw| |us| microseconds after start.
+    int LevelAt(struct sim_hw *hw, uint64_t us) {
+      struct timespec now;
+
+      SetUs(&now, us);
+      return sim_hw_update(hw, &now);
+    }
+
+    struct sim_hw_params params_;
+    struct timespec start_;
+};
+
+TEST_F(SimHwTestSuite, ParseParams) {
+  params_.seed = 3;
+  EXPECT_EQ(0, sim_hw_parse_params(
+      "drift_ppm=-150,period=256,jitter_us=800,xrun_ms=5000", &params_));
+  EXPECT_EQ(-150, params_.drift_ppm);
+  EXPECT_EQ(256, params_.period_frames);
+  EXPECT_EQ(800, params_.jitter_us);
+  EXPECT_EQ(5000, params_.xrun_interval_ms);
+  EXPECT_EQ(3, params_.seed);
+
+  // A seed takes the full 32 bit range.
+  EXPECT_EQ(0, sim_hw_parse_params("seed=4294967295", &params_));
+  EXPECT_EQ(4294967295u, params_.seed);
+  EXPECT_EQ(-EINVAL, sim_hw_parse_params("seed=-1", &params_));
+  EXPECT_EQ(-EINVAL, sim_hw_parse_params("seed=4294967296", &params_));
+  EXPECT_EQ(4294967295u, params_.seed);
+
+  // Nothing changes on error.
+  EXPECT_EQ(-EINVAL, sim_hw_parse_params("period=128,bogus=1", &params_));
+  EXPECT_EQ(-EINVAL, sim_hw_parse_params("period=12a", &params_));
+  EXPECT_EQ(-EINVAL, sim_hw_parse_params("period", &params_));
+  EXPECT_EQ(-EINVAL, sim_hw_parse_params("drift_ppm=2000000", &params_));
+  EXPECT_EQ(256, params_.period_frames);
+  EXPECT_EQ(-150, params_.drift_ppm);
+}
+
+TEST_F(SimHwTestSuite, DriftingClock) {
+  struct sim_hw hw;
+
+  params_.drift_ppm = 100;
+  sim_hw_start(&hw, &params_, CRAS_STREAM_OUTPUT, 48000, 1 << 20, &start_);
+  sim_hw_commit(&hw, 1 << 20);
+
+  // 100ppm fast plays 4.8 frames a second more than nominal.
+  EXPECT_EQ((1 << 20) - 480048, LevelAt(&hw, 10000000));
+  EXPECT_EQ(0, hw.num_underruns);
+
+  params_.drift_ppm = -100;
+  sim_hw_start(&hw, &params_, CRAS_STREAM_INPUT, 48000, 1 << 20, &start_);
+  EXPECT_EQ(479952, LevelAt(&hw, 10000000));
+}
+
+TEST_F(SimHwTestSuite, PeriodGranularity) {
+  struct sim_hw hw;
+
+  params_.period_frames = 480;
+  sim_hw_start(&hw, &params_, CRAS_STREAM_INPUT, 48000, 4800, &start_);
+
+  // The pointer holds between period boundaries, every 10ms.
+  EXPECT_EQ(0, LevelAt(&hw, 9999));
+  EXPECT_EQ(480, LevelAt(&hw, 10000));
+  EXPECT_EQ(480, LevelAt(&hw, 19000));
+  EXPECT_EQ(960, LevelAt(&hw, 20500));
+
+  // Reads past what was captured are cut short.
+  sim_hw_commit(&hw, 1000);
+  EXPECT_EQ(0, sim_hw_avail(&hw));
+  EXPECT_EQ(960, hw.appl_ptr);
+}
+
+TEST_F(SimHwTestSuite, JitterIsBoundedAndReproducible) {
+  struct sim_hw hw, again;
+  unsigned int period, late, max_late = 0, num_late = 0;
+  uint64_t us;
+  int level;
+
+  params_.period_frames = 480;
+  params_.jitter_us = 2000;
+  params_.seed = 42;
+  sim_hw_start(&hw, &params_, CRAS_STREAM_INPUT, 48000, 1 << 20, &start_);
+  sim_hw_start(&again, &params_, CRAS_STREAM_INPUT, 48000, 1 << 20,
+               &start_);
+
+  // Find when each boundary shows up, at 100us resolution.
+  for (period = 1, us = 0; period <= 200; us += 100) {
+    level = LevelAt(&hw, us);
+    ASSERT_EQ(level, LevelAt(&again, us));
+    ASSERT_LE(level, (int)period * 480);
+    if (level == (int)period * 480) {
+      late = us - period * 10000;
+      max_late = std::max(max_late, late);
+      num_late += late > 0;
+      period++;
+    }
+  }
+  EXPECT_LE(max_late, 2000);
+  EXPECT_GT(max_late, 1000);
+  EXPECT_GT(num_late, 150);
+
+  // Another seed gives another sequence.
+  params_.seed = 43;
+  sim_hw_start(&again, &params_, CRAS_STREAM_INPUT, 48000, 1 << 20,
+               &start_);
+  for (period = 1; period <= 200; period++)
+    if (LevelAt(&again, period * 10000 + 1000) !=
+        LevelAt(&hw, period * 10000 + 1000))
+      break;
+  EXPECT_GT(200, period);
+
+  // Jitter beyond a period is clamped.
+  params_.jitter_us = 50000;
+  sim_hw_start(&hw, &params_, CRAS_STREAM_INPUT, 48000, 1 << 20, &start_);
+  EXPECT_EQ(10000, hw.params.jitter_us);
+}
+
+TEST_F(SimHwTestSuite, PlaybackUnderrun) {
+  struct sim_hw hw;
+
+  sim_hw_start(&hw, &params_, CRAS_STREAM_OUTPUT, 48000, 4800, &start_);
+  EXPECT_EQ(4800, sim_hw_avail(&hw));
+  sim_hw_commit(&hw, 960);
+  EXPECT_EQ(480, LevelAt(&hw, 10000));
+  EXPECT_EQ(4320, sim_hw_avail(&hw));
+
+  // The audio ran out at 20ms, silence played since.
+  EXPECT_EQ(0, LevelAt(&hw, 30000));
+  EXPECT_EQ(1, hw.num_underruns);
+  sim_hw_commit(&hw, 480);
+  EXPECT_EQ(240, LevelAt(&hw, 35000));
+  EXPECT_EQ(1, hw.num_underruns);
+}
+
+TEST_F(SimHwTestSuite, CaptureOverrun) {
+  struct sim_hw hw;
+
+  sim_hw_start(&hw, &params_, CRAS_STREAM_INPUT, 48000, 4800, &start_);
+  EXPECT_EQ(4800, LevelAt(&hw, 100000));
+  EXPECT_EQ(0, hw.num_underruns);
+
+  // The oldest audio is overwritten.
+  EXPECT_EQ(4800, LevelAt(&hw, 150000));
+  EXPECT_EQ(1, hw.num_underruns);
+  EXPECT_EQ(7200 - 4800, hw.appl_ptr);
+}
+
+TEST_F(SimHwTestSuite, InjectedXrun) {
+  struct sim_hw hw;
+
+  params_.xrun_interval_ms = 1000;
+  sim_hw_start(&hw, &params_, CRAS_STREAM_OUTPUT, 48000, 1 << 20, &start_);
+  sim_hw_commit(&hw, 96000);
+
+  EXPECT_EQ(96000 - 47952, LevelAt(&hw, 999000));
+  EXPECT_EQ(-EPIPE, LevelAt(&hw, 1000000));
+  EXPECT_EQ(1, hw.num_injected);
+  EXPECT_EQ(0, sim_hw_level(&hw));
+
+  // Reported once, the device goes on.
+  EXPECT_EQ(0, LevelAt(&hw, 1001000));
+  sim_hw_commit(&hw, 4800);
+  EXPECT_EQ(4800 - 480, LevelAt(&hw, 1011000));
+
+  // Missed intervals are skipped, one xrun at a time.
+  EXPECT_EQ(-EPIPE, LevelAt(&hw, 3500000));
+  EXPECT_EQ(2, hw.num_injected);
+  EXPECT_EQ(0, LevelAt(&hw, 3900000));
+  EXPECT_EQ(-EPIPE, LevelAt(&hw, 4000000));
+  EXPECT_EQ(3, hw.num_injected);
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
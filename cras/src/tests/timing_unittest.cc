@@ -437,6 +437,12 @@ int input_data_get_for_stream(
   return 0;
 }
 
+unsigned int input_data_get_delay_frames(struct input_data *data,
+					 struct cras_rstream *stream)
+{
+  return 0;
+}
+
 int input_data_put_for_stream(struct input_data *data,
 			   struct cras_rstream *stream,
 			   struct buffer_share *offsets,